@@ -2,6 +2,8 @@
 // X the executable for this program should be named 'mygrep'
 // X not allowed to use the functions: fgets(), gets(), scanf(), or fscanf()
 // X all terminal output to be done with printf() or fprintf()
+//    - selected lines have since moved to a buffered writer using write(),
+//       see out_write(), all messages still use fprintf()
 // X all error messages should go to stderr, not stdout
 // X must error check the original call and all library calls
 // X in the event of a error with a library call, print the standard system
@@ -19,16 +21,95 @@
 //    X the return code 2 occurs in grep regardless of match or no match if
 //       an error occurs - this program behaves the same
 
+// _GNU_SOURCE is defined for the memmem() and memrchr() functions, which are
+//  GNU extensions to string.h - memmem() is only used as the search on
+//  processors without SIMD search functions
+#define _GNU_SOURCE
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
-// unistd.h is included for the access() function and associated constants
-//  the access() function tests for file existence and permissions
+// unistd.h is included for read(), used to read streams in large blocks, and
+//  pread(), used to check the start of a file for binary data
 #include<unistd.h>
 // errno.h is included for the errno variable that is set by system calls and
 //  library functions when an error occurs - for use with perror() and
 //  strerror()
 #include <errno.h>
+// sys/stat.h is included for the fstat() function, used to find regular files
+//  and their sizes
+#include<sys/stat.h>
+// sys/mman.h is included for the mmap(), madvise() and munmap() functions,
+//  used to search regular files without copying them into a buffer
+#include<sys/mman.h>
+// signal.h and setjmp.h are included to catch the SIGBUS signal that is
+//  raised if a mapped file is truncated while it is being searched
+#include<signal.h>
+#include<setjmp.h>
+// pthread.h is included for the worker threads used by the -j option to
+//  search several files at once
+#include<pthread.h>
+// fcntl.h and dirent.h are included for openat() style directory access and
+//  the getdents64() function, used by the -r option to read directories in
+//  large batches of entries
+#include<fcntl.h>
+#include<dirent.h>
+// locale.h, langinfo.h, wchar.h and wctype.h are included for the -i option,
+//  which folds the case of letters outside ASCII with towupper() and towlower()
+//  when the locale uses UTF-8
+#include<locale.h>
+#include<langinfo.h>
+#include<wchar.h>
+#include<wctype.h>
+// ctype.h is included for isalpha() and the other functions used to fill in
+//  the character classes, such as [:alpha:], of a regular expression
+#include<ctype.h>
+// stdint.h is included for the fixed size numbers of the index file written by
+//  the index subcommand, which is mapped and read in place
+#include<stdint.h>
+// sys/inotify.h and poll.h are included for the --follow option, which waits
+//  for lines to be written to the files it follows
+#include<sys/inotify.h>
+#include<poll.h>
+// sys/uio.h is included for writev(), which writes the output buffer and a
+//  long run of selected lines straight from the input in one call
+#include<sys/uio.h>
+// linux/io_uring.h and sys/syscall.h are included for the io_uring system
+//  calls, which the read-ahead pipeline uses to open and read several of the
+//  files given in args at once - there is no wrapper for them in the C
+//  library, and without the header, or when the program is built with
+//  -DMG_NO_URING, the pipeline uses a read-ahead thread instead
+#if defined(__linux__) && defined(__has_include) && ! defined(MG_NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include<linux/io_uring.h>
+#include<sys/syscall.h>
+#define MG_URING 1
+#endif
+#endif
+// zlib.h and zstd.h are included to decompress gzip and zstd files while they
+//  are searched - each is only used when the program is built with -DMG_ZLIB
+//  or -DMG_ZSTD and linked with -lz or -lzstd, otherwise compressed files are
+//  searched as they are
+#ifdef MG_ZLIB
+#include<zlib.h>
+#endif
+#ifdef MG_ZSTD
+#include<zstd.h>
+#endif
+// time.h is included for clock_gettime(), used to time each stage of the
+//  search for the --stats option when the program is built with -DMG_STATS
+#ifdef MG_STATS
+#include<time.h>
+#endif
+// immintrin.h is included for the SSE2 and AVX2 intrinsics used by the
+//  substring search on x86 processors
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define MG_X86 1
+#endif
+// mygrep.h is included for the library interface, which searches buffers and
+//  streams given by another program with the same searchers as the program -
+//  built on its own with -DMG_LIBRARY, which leaves out main()
+#include "mygrep.h"
 
 // PREPROCESSOR DIRECTIVES
 // preprocessor directives for exit codes
@@ -37,28 +118,1519 @@
 #define R_ERROR 2
 // preprocessor directive for program name
 #define PROG_NAME "mygrep"
-// preprocessor directive of initial buffer size
-#define BUFF_SIZE 1024
+// preprocessor directive of initial block buffer size used when reading
+//  streams - lines longer than this cause the buffer to be doubled
+#define BUFF_SIZE (256*1024)
+// preprocessor directive of smallest regular file that is memory mapped -
+//  smaller files fit in a single block read and are streamed instead
+#define MMAP_MIN_SIZE BUFF_SIZE
+// preprocessor directive of window size used when searching a mapped file for
+//  the end of a line, so that a file without any '\n' is not searched to the
+//  end for every line
+#define EOL_WINDOW 4096
+// preprocessor directive of longest search string handled by the SIMD first
+//  and last byte filter - longer search strings use Boyer-Moore-Horspool,
+//  whose skips grow with the search string length
+#define SIMD_MAX_NEEDLE 32
+// preprocessor directive of most worker threads allowed by the -j option
+#define MAX_JOBS 256
+// preprocessor directive of largest limit allowed by the --max-line-length
+//  option, far more than can be allocated, so the limit plus a block never
+//  overflows a size_t
+#define MAX_LINE_LIMIT (1ULL << 40)
+// preprocessor directive of size of each chunk when a single large mapped file
+//  is searched by several worker threads - chunks are moved forward to the
+//  next line start, so no line is split between two chunks
+#define CHUNK_SIZE (16*1024*1024)
+// preprocessor directive of output buffer size - selected lines are copied
+//  into the buffer and written out with write() when it is full
+#define OUT_BUFF_SIZE (256*1024)
+// preprocessor directive of shortest run of selected lines written straight
+//  from the input with writev(), instead of being copied into the output
+//  buffer - a shorter run is cheaper to copy than to add to the list of runs
+#define OUT_SPAN_MIN 1024
+// preprocessor directive of shortest run of selected lines spliced from a
+//  mapped file into a pipe - a shorter run is cheaper to add to the list of
+//  runs than to splice with a system call of its own
+#define OUT_SPLICE_MIN (64*1024)
+// preprocessor directive of most runs, of the input and of the output buffer,
+//  listed to be written by one writev() call
+#define OUT_IOV 128
+// preprocessor directive of how many jobs per worker thread may be searched
+//  ahead of the file being printed - this bounds the memory used to hold the
+//  output of files that are finished but cannot be printed yet
+#define JOB_WINDOW 4
+// preprocessor directive of number of threads walking the directory trees
+//  given to the -r option
+#define WALK_THREADS 4
+// preprocessor directive of most files found by the -r option that may wait
+//  to be searched - the walking threads block once this many are waiting
+#define WALK_QUEUE 1024
+// preprocessor directive of most files a walking thread collects before adding
+//  them to the files waiting, so the searching threads are woken once per
+//  batch instead of once per file
+#define WALK_BATCH 64
+// preprocessor directive of size of the buffer directory entries are read
+//  into by getdents64()
+#define WALK_BUFF_SIZE (64*1024)
+// preprocessor directive of how much of the start of a file or stream is
+//  checked for a null byte to decide that it is binary - the first block of a
+//  stream, so a file is decided the same way however it is read, and whether
+//  the -r option skips it
+#define BINARY_BLOCK BUFF_SIZE
+// preprocessor directive of size of each piece is_binary() reads the first
+//  block through
+#define BINARY_PIECE (64*1024)
+// preprocessor directive of size of each block of decompressed data handed
+//  from the decompression thread to the thread searching a compressed file
+#define DECOMP_BLOCK (256*1024)
+// preprocessor directive of most decompressed blocks that may wait to be
+//  searched - the decompression thread blocks once this many are waiting
+#define DECOMP_QUEUE 8
+// preprocessor directives for the compression formats found by the magic bytes
+//  at the start of a file - only formats the program was built with are found
+#define COMP_NONE 0
+#define COMP_GZIP 1
+#define COMP_ZSTD 2
+// preprocessor directives for output modes - print selected lines, print a
+//  count of selected lines per file (-c), print the names of files with
+//  selected lines (-l), or print nothing (-q)
+#define MODE_PRINT 0
+#define MODE_COUNT 1
+#define MODE_LIST 2
+#define MODE_QUIET 3
+// preprocessor directive for name printed for stdin by the -c and -l options
+#define STDIN_NAME "(standard input)"
+// preprocessor directive of the index file written by the index subcommand
+//  when no -o option is given
+#define INDEX_NAME "mygrep.idx"
+// preprocessor directive of the first bytes of an index file, changed whenever
+//  its layout changes
+#define INDEX_MAGIC "MGIDX02\n"
+// preprocessor directive of a number stored in every index file, which reads
+//  back differently on a machine with the other byte order
+#define INDEX_ENDIAN 0x01020304
+// preprocessor directive of the size a block of an indexed file grows to
+//  before the next block starts - every block is a run of whole lines, so a
+//  match never spans two blocks, and smaller blocks narrow a search further
+//  but make the index bigger
+#define INDEX_BLOCK (64*1024)
+// preprocessor directive of the number of different trigrams, three bytes each
+#define INDEX_TRIGRAMS (1 << 24)
+// preprocessor directive of the starting number of slots in the hash table of
+//  trigrams while an index is built, a power of 2
+#define INDEX_HASH_MIN 65536
+// preprocessor directive hashing a trigram to a slot of that table, taking
+//  the high bits of a Fibonacci product so nearby trigrams spread apart
+#define INDEX_HASH(t) \
+	((size_t) (((uint64_t) (t) * 0x9E3779B97F4A7C15ULL) >> 32))
+// preprocessor directive of the number of sums index_sum keeps, each taking
+//  every fourth word of 8 bytes, so their multiplies run side by side
+#define INDEX_SUM_LANES 4
+// preprocessor directives of the flags of an indexed file - a binary file has
+//  no blocks and is always searched in full, since its bytes would fill the
+//  index with trigrams no search string has, and a compressed file is indexed
+//  as a single block, since a block inside it cannot be reached without
+//  decompressing everything before it
+#define INDEX_F_BINARY 1
+#define INDEX_F_WHOLE 2
+// preprocessor directive of the milliseconds the --follow option waits for an
+//  inotify event before checking the files anyway, which catches changes
+//  inotify does not report, such as writes over NFS
+#define FOLLOW_POLL_MS 1000
+// preprocessor directive of the size of the buffer inotify events are drained
+//  into by the --follow option
+#define FOLLOW_EVENTS 4096
+// preprocessor directive of how many files ahead of the one being searched
+//  the read-ahead pipeline opens and reads, which is also the number of
+//  buffers it reuses
+#define PREFETCH_DEPTH 32
+// preprocessor directive of size of each buffer of the read-ahead pipeline - a
+//  regular file no bigger than this is read whole ahead of its search, a
+//  bigger one is only handed to the kernel to read ahead with posix_fadvise()
+#define PREFETCH_BUFF (128*1024)
+// preprocessor directives for the states of a file in the read-ahead pipeline
+//  - its buffer is free, it is being opened, its start is being read into the
+//  buffer, or it is ready to be searched
+#define PREFETCH_FREE 0
+#define PREFETCH_OPEN 1
+#define PREFETCH_READ 2
+#define PREFETCH_READY 3
+// preprocessor directive folding an ASCII upper case letter to lower case,
+//  leaving every other byte as it is
+#define FOLD_ASCII(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c))
+// preprocessor directive folding a wide char for the -i option - going through
+//  upper case first makes letters with more than one lower case form, such as
+//  final sigma, fold to the same char
+#define FOLD_WIDE(c) (towlower(towupper(c)))
+// preprocessor directives for how search strings are compared with the text -
+//  exactly, with ASCII letters folded for the -i option, or with every letter
+//  folded by FOLD_WIDE for the -i option in a UTF-8 locale
+#define CASE_EXACT 0
+#define CASE_ASCII 1
+#define CASE_WIDE 2
+// preprocessor directive of the last char looked at for the chars that fold
+//  the same as a char of a regular expression, past every letter with a case
+#define FOLD_WIDE_LAST 0x1FFFF
+// preprocessor directive of most chars folding the same that one char of a
+//  regular expression matches
+#define FOLD_MAX_VARIANTS 8
+// preprocessor directive of largest count allowed in a {m,n} interval of a
+//  regular expression, as in POSIX
+#define RE_MAX_REPEAT 255
+// preprocessor directive of most NFA states a regular expression may compile
+//  into - an interval copies its subexpression, so even a short expression
+//  can be too big
+#define RE_MAX_STATES 100000
+// preprocessor directive of most NFA states search strings that are not
+//  regular expressions may compile into, see re_parse_strings - nothing is
+//  copied, so their NFA only grows with the length of the search strings
+#define RE_MAX_FIXED_STATES 2000000
+// preprocessor directive of deepest nesting of parentheses allowed in a
+//  regular expression, which bounds the recursion of the parser
+#define RE_MAX_DEPTH 256
+// preprocessor directive of longest literal string kept while working out the
+//  strings every match of a regular expression must contain
+#define RE_MUST_MAX 256
+// preprocessor directives for the kinds of node in a parsed regular expression
+//  and the kinds of NFA state it compiles into - a set of bytes, the start or
+//  end of a line, the empty string, a concatenation, an alternation and a
+//  repeat only appear in the parsed expression, a split and the final match
+//  only in the NFA
+#define RE_SET 0
+#define RE_BOL 1
+#define RE_EOL 2
+#define RE_EMPTY 3
+#define RE_CAT 4
+#define RE_ALT 5
+#define RE_REPEAT 6
+#define RE_SPLIT 7
+#define RE_MATCH 8
+// preprocessor directive of memory each thread may use for the states of its
+//  lazily built DFA - once it is full the states are thrown away and built
+//  again as they are needed, so a pattern whose DFA would be huge still runs
+//  in bounded memory and linear time
+#define DFA_CACHE_SIZE (8*1024*1024)
+// preprocessor directive of fewest DFA states kept before the cache is thrown
+//  away, however many byte classes there are
+#define DFA_MIN_STATES 64
+// preprocessor directives for entries of the DFA transition table that are
+//  not a state - a transition not built yet, a transition that completes a
+//  match, and a transition after which the rest of the line cannot match
+#define DFA_UNKNOWN (-1)
+#define DFA_ACCEPT (-2)
+#define DFA_DEAD (-3)
+// preprocessor directives for flags of a DFA state - a match has been found,
+//  a match is found if the line ends here, and the rest of the line cannot
+//  match
+#define DFA_F_ACCEPT 1
+#define DFA_F_EOLACCEPT 2
+#define DFA_F_DEAD 4
+// preprocessor directive added to the start of line flag of a DFA state whose
+//  matches all start at one byte - the start of the expression is not added
+//  again at each byte, so the state tells where the matches from that byte end
+#define DFA_ANCHORED 2
+// preprocessor directives for the stages of the search timed by the --stats
+//  option - reading input, finding the line endings that split it into runs of
+//  whole lines, matching, writing output, decompressing, and counting the
+//  lines searched, a pass the search itself does not need
+#define STAGE_NONE 0
+#define STAGE_READ 1
+#define STAGE_SPLIT 2
+#define STAGE_MATCH 3
+#define STAGE_WRITE 4
+#define STAGE_DECOMP 5
+#define STAGE_COUNT 6
+#define NUM_STAGES 7
+// preprocessor directives for the report of the --stats option
+#define STATS_OFF 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+// preprocessor directives that count and time the search for the --stats
+//  option - without -DMG_STATS they are empty, so their arguments are never
+//  evaluated and the search costs exactly what it did without them
+#ifdef MG_STATS
+#define STATS_ADD(field,n) \
+	do { if (mg_statson) { mg_stats.field += (n); } } while (0)
+#define STATS_BEGIN(stage) \
+	do { if (mg_statson) { stats_begin(stage); } } while (0)
+#define STATS_END(stage) do { if (mg_statson) { stats_end(stage); } } while (0)
+#define STATS_FILE_BEGIN() \
+	do { if (mg_statson) { stats_file_begin(); } } while (0)
+#define STATS_FILE_END(name,count) \
+	do { if (mg_statson) { stats_file_end(name,count); } } while (0)
+#define STATS_MERGE() do { if (mg_statson) { stats_merge(); } } while (0)
+#define STATS_LINES(data,len) \
+	do { if (mg_statson) { stats_lines(data,len); } } while (0)
+#else
+#define STATS_ADD(field,n)
+#define STATS_BEGIN(stage)
+#define STATS_END(stage)
+#define STATS_FILE_BEGIN()
+#define STATS_FILE_END(name,count)
+#define STATS_MERGE()
+#define STATS_LINES(data,len)
+#endif
+// preprocessor directive marking the functions of the library interface in
+//  mygrep.h - built with -fvisibility=hidden, they are the only functions the
+//  library leaves visible to the program linking it
+#define MG_API __attribute__((visibility("default")))
 // preprocessor directives for true/false
 #define TRUE 1
 #define FALSE 0
 
+// STRUCTURES
+// block-buffered line reader - reads large blocks from a file descriptor and
+//  hands out runs of whole lines as views into the block instead of copies
+struct line_reader {
+	// file descriptor being read
+	int fd;
+	// block buffer
+	char *buff;
+	// usable size of the block buffer
+	size_t buffsize;
+	// position of the first unconsumed byte in the buffer
+	size_t start;
+	// position one past the last valid byte in the buffer
+	size_t end;
+	// position from which the buffer still has to be searched for a line
+	//  ending, so a long line spanning several blocks is not rescanned
+	//  every time the buffer is filled
+	size_t scanned;
+	// number of bytes before start that are kept when the buffer is
+	//  refilled, so lines already searched can still be printed as context
+	size_t keep;
+	// boolean flag set once read() reports the end of the file
+	int eof;
+	// boolean flag set if read() reported the end of the file after the
+	//  first block was read, which the next fill reports as the end without
+	//  reading again - the end is only ever reported by a fill that read
+	//  nothing
+	int ended;
+	// decompression thread the data is taken from instead of the file
+	//  descriptor, NULL for a file that is not compressed
+	struct decomp_pipe *pipe;
+	// boolean flag set once the first block read has been checked for a
+	//  null byte, and boolean flag set if it had one
+	int checked;
+	int binary;
+	// boolean flag for a file followed by the --follow option - at the end
+	//  of the file an unfinished last line is kept for the next write to
+	//  finish, instead of being handed out as the last run
+	int follow;
+	// boolean flag set by grep_stream when selected lines are never
+	//  printed - a line too long for the buffer is then handed out a part
+	//  at a time instead of growing the buffer to hold all of it
+	int partial;
+	// bytes at the end of each part of a line handed out again at the
+	//  start of the next part, so a match spanning the two is still found
+	size_t overlap;
+	// boolean flag set while the rest of a line is skipped - a line cut by
+	//  the --max-line-length option, or a line already selected by a part
+	int skipping;
+	// number of bytes skipped since the last run was searched, added to
+	//  the byte offset by grep_stream so the offsets after them are right
+	unsigned long long skipped;
+	// number of lines cut by the --max-line-length option
+	unsigned long cutlines;
+};
+
+// state of the -A, -B and -C options for the file being searched by a thread -
+//  no line is copied, context lines are found again in the data when needed
+struct context {
+	// earliest byte before the data being searched that is still available,
+	//  lines from here on can be printed as context before a selected line
+	char *floor;
+	// end of the last line printed, just past its line ending, or null if
+	//  no line of the file has been printed or it is no longer available
+	char *printed;
+	// distance back from the end of the last run of a stream to the end of
+	//  the last line printed, -1 if there is none, kept while the reader's
+	//  buffer is refilled
+	long back;
+	// number of lines the reader keeps in front of the next run, counted so
+	//  they need not be walked over again
+	long kept;
+	// number of lines after the last selected line still to be printed
+	long pending;
+	// boolean flag set once any line has been printed to the thread's
+	//  output, so that groups of lines after it are separated by "--"
+	int any;
+};
+
+// line number and byte offset of a position in the file being searched by a
+//  thread, for the -n and -b options - moved on to each line printed, or back
+//  to a context line, by counting only the lines in between, so the lines that
+//  are not printed are counted with memchr and never split
+struct line_count {
+	// position in the data being searched, always the start of a line
+	char *at;
+	// number of the line starting at at, from 1
+	unsigned long long lineno;
+	// byte offset of at in the file
+	unsigned long long offset;
+};
+
+#ifdef MG_STATS
+// counters and stage times of the --stats option, kept by each thread and added
+//  to the totals when the thread is done
+struct stats {
+	// bytes searched, after any decompression
+	unsigned long long bytes;
+	// bytes of compressed files read
+	unsigned long long compressed;
+	// lines searched
+	unsigned long long lines;
+	// lines selected
+	unsigned long long matches;
+	// files searched, including stdin
+	unsigned long long files;
+	// calls to read() and write()
+	unsigned long long reads;
+	unsigned long long writes;
+	// times a line reader or output buffer was grown
+	unsigned long long grows;
+	// times the DFA cache filled up and was flushed
+	unsigned long long flushes;
+	// nanoseconds spent in each stage, not counting the stages nested in it
+	unsigned long long ns[NUM_STAGES];
+	// when each stage being timed started, and the stage it is nested in
+	unsigned long long start[NUM_STAGES];
+	int outer[NUM_STAGES];
+	// stage being timed right now, STAGE_NONE if none
+	int current;
+	// when the file being searched was opened, and the bytes searched
+	//  before it
+	unsigned long long filestart;
+	unsigned long long filebytes;
+};
+
+// one file searched, for the per file throughput of the --stats option
+struct stats_file {
+	// path of the file, or null for stdin
+	char *name;
+	// bytes searched
+	unsigned long long bytes;
+	// nanoseconds from opening the file to closing it
+	unsigned long long ns;
+	// lines selected
+	long matches;
+};
+#endif
+
+// search strings given with the -e and -f options, in the order given
+struct pattern_list {
+	// the search strings, which are not null-terminated
+	char **pats;
+	// length of each search string
+	size_t *lens;
+	// number of search strings
+	int num;
+	// number of search strings there is room for
+	int size;
+	// contents of each pattern file read, which the search strings from
+	//  that file point into
+	char **buffs;
+	// number of pattern files read
+	int numbuffs;
+};
+
+// node of a parsed regular expression - the children of a concatenation or
+//  alternation are linked through next and prev, so that none of the passes
+//  over a long expression recurse once per char
+struct re_node {
+	// kind of node, one of the RE_ directives
+	int type;
+	// first and last child of RE_CAT and RE_ALT, the repeated node of
+	//  RE_REPEAT (in child), or -1
+	int child;
+	int last;
+	// next and previous child of the same parent, or -1
+	int next;
+	int prev;
+	// fewest and most repeats of RE_REPEAT, most is -1 for no limit
+	int min;
+	int max;
+	// index of the set of bytes matched by RE_SET
+	int set;
+};
+
+// state of the NFA a regular expression is compiled into
+struct re_state {
+	// kind of state, one of the RE_ directives
+	int type;
+	// state that follows, or the first choice of RE_SPLIT
+	int out;
+	// second choice of RE_SPLIT
+	int out1;
+	// index of the set of bytes matched by RE_SET
+	int set;
+};
+
+// node of the trie the search strings are gathered into when several that
+//  are not regular expressions are compiled into one, see re_parse_strings
+struct re_trie {
+	// the char leading to the node, as it is compared
+	wint_t key;
+	// the char in the first search string holding it, and the bytes left
+	//  in that search string from the char
+	unsigned char *chr;
+	size_t left;
+	// boolean flag for a search string folded by FOLD_WIDE, see foldall
+	int foldall;
+	// first child and next sibling, -1 if there is none
+	int child;
+	int next;
+	// boolean flag for a search string ending at the node
+	int end;
+};
+
+// a char that FOLD_WIDE changes, and the char it folds to
+struct wide_fold {
+	wint_t chr;
+	wint_t folded;
+};
+
+// regular expression for the -E option, parsed into a tree of nodes and
+//  compiled into an NFA by search_compile, from which each scanner builds its
+//  own DFA while searching
+// note: the expression is matched byte by byte, as grep does in the C locale,
+//        except that with the -i option in a UTF-8 locale a char outside
+//        ASCII matches the bytes of every char that folds the same
+struct regex {
+	// pattern being parsed, which does not need to be null-terminated, its
+	//  length, the parser's position in it and how deep in parentheses the
+	//  parser is
+	unsigned char *pat;
+	size_t len;
+	size_t pos;
+	int depth;
+	// message for an invalid or too big expression, null if only memory
+	//  ran out
+	char *err;
+	// parsed nodes, only kept until the NFA is built
+	struct re_node *nodes;
+	int numnodes;
+	int nodesize;
+	// sets of bytes matched by RE_SET, 256 bits each
+	unsigned char (*sets)[32];
+	int numsets;
+	int setsize;
+	// NFA states and the state every match starts from
+	struct re_state *states;
+	int numstates;
+	int statesize;
+	int start;
+	// DFA byte classes - bytes that every set either holds or leaves out
+	//  together share a class, which keeps the rows of the DFA short
+	unsigned char classes[256];
+	// number of byte classes, the length of each row of the DFA
+	int nclasses;
+	// the string every match contains, searched for by the prefilter, or
+	//  the whole expression if it only matches one string
+	char *literal;
+	// the only bytes that can start a match, when there are at most three
+	//  and the expression has no '^' - the search skips straight to the
+	//  next of them from the start state, see re_first
+	unsigned char first[3];
+	// number of bytes in first, 0 if the search cannot skip
+	int numfirst;
+	// boolean flag set if the NFA has a '^' anchor
+	int bol;
+	// how the expression is compared with the text, from the CASE_
+	//  directives - with the -i option both cases of an ASCII letter match
+	int fold;
+	// with the -i option in a UTF-8 locale, the chars FOLD_WIDE changes,
+	//  sorted by the char each folds to, only kept while parsing - a char
+	//  outside ASCII then matches every char that folds the same
+	struct wide_fold *wide;
+	int numwide;
+	// boolean flag for search strings parsed as plain strings, without -E
+	int fixed;
+	// boolean flag for a pattern with chars outside ASCII, with the -i
+	//  option in a UTF-8 locale, all of whose chars are folded by
+	//  FOLD_WIDE, as search_init_icase folds a single search string
+	int foldall;
+};
+
+// strings every match of part of a regular expression starts with, ends with
+//  and contains, used to find a literal string to search for before running
+//  the DFA
+struct re_must {
+	// the only string the part matches, if exactlen is not -1
+	char exact[RE_MUST_MAX];
+	int exactlen;
+	// string every match starts with
+	char left[RE_MUST_MAX];
+	int leftlen;
+	// string every match ends with
+	char right[RE_MUST_MAX];
+	int rightlen;
+	// longest string known to be in every match
+	char in[RE_MUST_MAX];
+	int inlen;
+};
+
+// DFA built lazily from the NFA of a regular expression - each DFA state is a
+//  set of NFA states, and a transition is only worked out the first time the
+//  search takes it, so only the states the text actually reaches are built
+// each thread keeps its own, so no lock is taken while searching
+struct dfa_cache {
+	// regular expression the states were built from, null before the first
+	//  search
+	struct regex *re;
+	// transition table, one row of nclasses entries per state, holding the
+	//  offset of the row of the next state or one of the DFA_ directives
+	int *trans;
+	// flags of each state, from the DFA_F_ directives
+	unsigned char *flags;
+	// boolean flag of each state for the state at the start of a line, with
+	//  DFA_ANCHORED added for the states of a match from one byte
+	unsigned char *bols;
+	// position and length of each state's set of NFA states in sets
+	int *setstart;
+	int *setlen;
+	// sorted sets of NFA states of every state, one after the other
+	int *sets;
+	// number of ints used in sets, and how many it can hold
+	int setsused;
+	int setscap;
+	// number of states built, and how many the cache can hold
+	int numstates;
+	int maxstates;
+	// hash table of the states by their set of NFA states - buckets hold
+	//  the first state of each chain, chain the next state, -1 ends both
+	int *buckets;
+	int *chain;
+	int numbuckets;
+	// offset of the row of the state at the start of a line, -1 until it
+	//  is built
+	int startstate;
+	// offsets of the rows of the anchored states away from and at the start
+	//  of a line, -1 until they are built
+	int anchored[2];
+	// number of times the cache has been thrown away
+	unsigned long flushes;
+	// stack of NFA states to visit, marks of states already visited in
+	//  the current pass and the number of that pass, and two sets of NFA
+	//  states being built
+	int *stack;
+	unsigned int *mark;
+	unsigned int gen;
+	int *work;
+	int *work2;
+};
+
+// compiled search string - the search string is preprocessed once in main()
+//  and the search function best suited to its length and the processor is
+//  picked, so every search after that only scans the text
+// with more than one search string (-e or -f) they are all compiled into one
+//  Aho-Corasick automaton instead, so each byte of the text is looked at once
+//  no matter how many search strings there are
+// with the -E option the search strings are regular expressions, compiled
+//  into an NFA that each thread turns into a DFA as it searches
+struct searcher {
+	// the search string
+	char *needle;
+	// length of the search string
+	size_t len;
+	// boolean flag set when no line can ever match - the search string
+	//  contains a line ending, or every search string does
+	int nevermatch;
+	// Aho-Corasick transition table, one row of nclasses entries per
+	//  state, flattened into a single array so that each step is one
+	//  indexed load
+	int *trans;
+	// Aho-Corasick byte classes - every byte that appears in no search
+	//  string shares class 0, which keeps the rows of the table short
+	unsigned char classes[256];
+	// number of byte classes, the length of each row of the table
+	int nclasses;
+	// for each Aho-Corasick state, the length of the longest search string
+	//  that ends there, or 0 if none does
+	int *outlen;
+	// length of the longest search string in the automaton
+	int maxlen;
+	// Boyer-Moore-Horspool skip table, indexed by byte value, only filled
+	//  in for search strings longer than SIMD_MAX_NEEDLE (and for any
+	//  search string with the -i option on processors without SIMD)
+	size_t skip[256];
+	// search string with ASCII letters folded to lower case, for the -i
+	//  option
+	char *folded;
+	// search string decoded from UTF-8 with each char folded by FOLD_WIDE,
+	//  for the -i option with a search string outside ASCII
+	wint_t *wneedle;
+	// number of chars in wneedle
+	size_t wlen;
+	// searcher for the longest run of ASCII chars in wneedle, which finds
+	//  candidates for the UTF-8 search much faster than decoding every
+	//  char, or null if the search string has no such run
+	struct searcher *prefilter;
+	// the run of ASCII chars searched by prefilter
+	char *run;
+	// index in wneedle of the first char of the run
+	size_t runidx;
+	// regular expression for the -E option, or null
+	struct regex *re;
+	// how the search strings are compared with the text, from the CASE_
+	//  directives
+	int fold;
+	// search function picked by search_init, or null for a regular
+	//  expression, which is searched with a scanner's DFA - see
+	//  scanner_find
+	char *(*find)(struct searcher *srch, char *hay, size_t haylen);
+};
+
+// output buffer for selected lines - lines and their filename prefixes are
+//  copied in with memcpy and the buffer is written to the file descriptor
+//  with write() when it is full, instead of going through printf for each
+//  line
+// a buffer without a file descriptor grows instead, holding all the output of
+//  a worker thread's job until it can be printed in order
+struct out_buf {
+	// file descriptor written to, or -1 for a buffer that grows
+	int fd;
+	// the buffer
+	char *buff;
+	// number of bytes in the buffer
+	size_t len;
+	// size of the buffer
+	size_t size;
+	// errno of the first failed write or allocation, 0 if none failed -
+	//  once set, all further output is dropped
+	int err;
+	// runs of the input, and of the buffer between them, waiting to be
+	//  written in order by writev(), and the number of them - the input
+	//  runs must be written before the input is changed
+	struct iovec iov[OUT_IOV];
+	int iovcnt;
+	// number of bytes at the start of the buffer already in the list
+	size_t mark;
+	// boolean flag set if the file descriptor is a pipe, which runs of a
+	//  mapped file can be spliced into without copying them
+	int pipe;
+	// start and file descriptor of the mapped file being searched, whose
+	//  runs are spliced, null and -1 if none
+	char *mapbase;
+	int mapfd;
+};
+
+// result of searching one file, or one chunk of a file, with the -j option -
+//  the output is held in memory until every job before it has been printed
+struct pool_job {
+	// output of the search, taken from the worker's growing output buffer
+	char *out;
+	// length of the output
+	size_t outlen;
+	// 1 if any lines in the file or chunk were selected
+	int foundmatch;
+	// number of lines selected in the chunk
+	long matchcount;
+	// number of errors for the file or chunk
+	int founderror;
+	// boolean flag set once the file or chunk has been searched
+	int done;
+	// boolean flag set if lines were printed with context, in groups that
+	//  are separated from the groups of the jobs before - a "Binary file X
+	//  matches" line is not a group
+	int groups;
+	// number of lines in the chunk, and the number of its first line once
+	//  every chunk before it has been counted, 0 until then - only for the
+	//  -n option
+	unsigned long long lines;
+	unsigned long long firstline;
+};
+
+// worker pool for the -j option - the workers take jobs in order and the main
+//  thread prints each job's output in the same order
+// a job is either one file from the args, or one chunk of a single large
+//  mapped file when data is set
+struct work_pool {
+	// file paths from args, or null when searching chunks
+	char **filenames;
+	// start of the mapped file when searching chunks, otherwise null
+	char *data;
+	// size of the mapped file
+	size_t size;
+	// file path of the mapped file
+	char *file_pathname;
+	// number of jobs, one per file or chunk
+	int numjobs;
+	// total number of lines selected in all the chunks
+	long matchcount;
+	// compiled search strings shared by every worker, each of which
+	//  searches with a scanner of its own
+	struct mygrep_pattern *pat;
+	// one result per job
+	struct pool_job *jobs;
+	// index of the next job to hand out to a worker
+	int next;
+	// number of jobs already printed by the main thread
+	int printed;
+	// how far past the printed jobs the workers may run ahead
+	int window;
+	// lock protecting next, printed and the done flags
+	pthread_mutex_t lock;
+	// signalled when a job is finished or printed
+	pthread_cond_t cond;
+};
+
+// directory or path given on the command line waiting to be walked by the -r
+//  option
+struct walk_entry {
+	// path of the directory, or an empty string for the current directory
+	//  when no path was given
+	char *path;
+	// boolean flag for a path given on the command line, which may also be
+	//  a file and is followed if it is a symbolic link
+	int isroot;
+};
+
+// state shared by the threads walking directories for the -r option and the
+//  threads searching the files they find
+struct walk_pool {
+	// directories waiting to be read, used as a stack
+	struct walk_entry *dirs;
+	// number of directories waiting
+	int numdirs;
+	// number of directories there is room for
+	int dirsize;
+	// ring of paths of files waiting to be searched
+	char *files[WALK_QUEUE];
+	// position of the oldest file waiting
+	int head;
+	// number of files waiting
+	int numfiles;
+	// number of walking threads reading a directory right now - a walking
+	//  thread with nothing to do only exits once this is 0, since a busy
+	//  one may still find more directories
+	int busy;
+	// number of walking threads still running
+	int walkers;
+	// boolean flag set when the search should stop early, after a write
+	//  error or once the -q option has found a selected line
+	int quit;
+	// compiled search strings shared by every searching thread, each of
+	//  which searches with a scanner of its own
+	struct mygrep_pattern *pat;
+	// output buffer of the main thread, which the searching threads append
+	//  each finished file to
+	struct out_buf *out;
+	// number of files with selected lines and number of errors, from all
+	//  the threads
+	int foundmatch;
+	int founderror;
+	// lock protecting everything above
+	pthread_mutex_t lock;
+	// signalled when a directory is added, or the walk is finished
+	pthread_cond_t dircond;
+	// signalled when a file is added, or the last walking thread exits
+	pthread_cond_t filecond;
+	// signalled when the files waiting drop to half of WALK_QUEUE
+	pthread_cond_t spacecond;
+	// lock held while a searching thread appends to the output buffer
+	pthread_mutex_t outlock;
+	// boolean flag set once any file's lines have been appended to the
+	//  output buffer, so that with the -A, -B and -C options the next
+	//  file's lines are separated from them by "--"
+	int anyout;
+};
+
+// compressed file being decompressed by its own thread, which hands blocks of
+//  decompressed data to the thread searching it through a bounded ring, so
+//  decompressing and searching overlap
+struct decomp_pipe {
+	// file descriptor of the compressed file
+	int fd;
+	// compression format, COMP_GZIP or COMP_ZSTD
+	int type;
+	// path of the file, for error messages
+	char *file_pathname;
+	// buffer the compressed data is read into
+	unsigned char *inbuff;
+	// ring of decompressed blocks, and the length of the data in each
+	char *blocks[DECOMP_QUEUE];
+	size_t lens[DECOMP_QUEUE];
+	// position of the oldest block waiting
+	int head;
+	// number of blocks waiting
+	int count;
+	// position in the oldest block of the first byte not yet taken, only
+	//  used by the searching thread
+	size_t pos;
+	// boolean flag set by the decompression thread once it has handed out
+	//  its last block
+	int done;
+	// errno value of an error that ended the decompression, 0 if none
+	int err;
+	// boolean flag set by the searching thread to stop the decompression
+	//  thread early, once the file needs no more searching
+	int quit;
+	// boolean flag set while a compressed stream is only partly read, so
+	//  a file cut short is reported
+	int instream;
+#ifdef MG_ZLIB
+	// gzip decompression state
+	z_stream zs;
+#endif
+#ifdef MG_ZSTD
+	// zstd decompression state, and the compressed data not yet used
+	ZSTD_DStream *zds;
+	ZSTD_inBuffer zin;
+#endif
+	// lock protecting head, count, done, err and quit
+	pthread_mutex_t lock;
+	// signalled when a block is added, or the decompression is done
+	pthread_cond_t fullcond;
+	// signalled when a block is taken, or the search stops
+	pthread_cond_t spacecond;
+	// the decompression thread
+	pthread_t thread;
+};
+
+// header at the start of an index file written by the index subcommand - the
+//  file is mapped and read in place, so every section starts on a multiple of
+//  8 bytes and numbers are stored in the byte order of the machine
+// the sections follow the header in this order: the files, the start of every
+//  block, the trigrams, the paths the index was built from, the posting lists
+//  and the strings holding the paths
+struct index_header {
+	// INDEX_MAGIC and INDEX_ENDIAN
+	char magic[8];
+	uint32_t endian;
+	// INDEX_BLOCK of the program that built the index
+	uint32_t blocksize;
+	// number of files, blocks, trigrams and paths the index was built from
+	uint64_t numfiles;
+	uint64_t numblocks;
+	uint64_t numtrigrams;
+	uint64_t numroots;
+	// offset of each section from the start of the index, and the length of
+	//  the sections of bytes
+	uint64_t filesoff;
+	uint64_t blocksoff;
+	uint64_t trigramsoff;
+	uint64_t rootsoff;
+	uint64_t postingsoff;
+	uint64_t postingslen;
+	uint64_t stringsoff;
+	uint64_t stringslen;
+	// length of the whole index, and its checksum by index_checksum - an
+	//  index that no longer has both was damaged after it was written
+	uint64_t length;
+	uint64_t checksum;
+};
+
+// file in an index, in order of path so it can be found by binary search
+struct index_file {
+	// offset of the null-terminated path in the strings section
+	uint64_t path;
+	// size and modification time of the file when it was indexed - a file
+	//  that no longer has both is searched in full
+	uint64_t size;
+	int64_t mtime;
+	int64_t mtimens;
+	// number of the first block of the file and how many blocks it has -
+	//  blocks are numbered in the order the files were read, so a file's
+	//  blocks are numbered one after the other
+	uint32_t firstblock;
+	uint32_t numblocks;
+	// INDEX_F_ flags
+	uint32_t flags;
+	uint32_t pad;
+};
+
+// trigram in an index, in order of trigram so it can be found by binary search
+// note: letters are folded to lower case by FOLD_ASCII before they are
+//        indexed, so one index serves searches with and without the -i option
+struct index_trigram {
+	// the three bytes, the first one in the highest bits
+	uint32_t trigram;
+	// number of blocks holding the trigram
+	uint32_t count;
+	// offset of its posting list in the postings section - the numbers of
+	//  the blocks holding it in order, each stored as the difference from
+	//  the one before in groups of 7 bits, lowest group first, with the top
+	//  bit set on every group but the last
+	uint64_t off;
+};
+
+// posting list of one trigram while an index is built
+struct index_list {
+	// the trigram plus one, 0 for an empty slot of the hash table
+	uint32_t key;
+	// number of the last block added plus one, so that a trigram found
+	//  again in the same block is only added once
+	uint32_t last;
+	// number of blocks in the list
+	uint32_t count;
+	// the list, encoded as in the postings section, its length and its size
+	unsigned char *data;
+	size_t len;
+	size_t size;
+};
+
+// file read by the index subcommand
+struct index_entry {
+	// path of the file as the walk found it
+	char *path;
+	// the file as it is written to the index, path is filled in then
+	struct index_file file;
+};
+
+// state of the index subcommand while it reads the files
+struct index_builder {
+	// hash table of the posting lists, its number of slots, a power of 2,
+	//  and the number of lists in it
+	struct index_list *lists;
+	size_t listsize;
+	size_t numlists;
+	// one bit per trigram, set once it is added to the current block, and
+	//  the trigrams set, so only their bits are cleared for the next block
+	unsigned char *seen;
+	uint32_t *touched;
+	size_t numtouched;
+	size_t touchedsize;
+	// files read so far, the number of them and the number there is room
+	//  for
+	struct index_entry *files;
+	size_t numfiles;
+	size_t filesize;
+	// start of every block in its file, the number of blocks and the number
+	//  there is room for
+	uint64_t *blocks;
+	size_t numblocks;
+	size_t blocksize;
+	// number of blocks of the file being read, and bytes added to its last
+	//  block so far
+	uint32_t fileblocks;
+	size_t blockfill;
+	// device and inode of the index being written and of the index it
+	//  replaces, neither of which is indexed
+	dev_t dev[2];
+	ino_t ino[2];
+};
+
+// index file mapped by the --index option, and the blocks a search has to look
+//  at
+struct trigram_index {
+	// the mapping and its size, null if no index is used
+	char *map;
+	size_t size;
+	// the sections of the index, see index_header
+	struct index_header *hdr;
+	struct index_file *files;
+	uint64_t *blocks;
+	struct index_trigram *trigrams;
+	uint64_t *roots;
+	unsigned char *postings;
+	char *strings;
+	// boolean flag set when the search cannot be narrowed by the index, so
+	//  every file is searched in full
+	int all;
+	// numbers of the blocks that may hold a match, in order, and how many
+	//  there are
+	uint32_t *cand;
+	size_t numcand;
+};
+
+// blocks of the file being searched that may hold a match, found by
+//  index_file_hits for grep_file
+struct index_hits {
+	// boolean flag set when only these blocks of the file are searched
+	int on;
+	// number of the first block of the file, the start of each of its
+	//  blocks, how many there are and the size of the file
+	uint32_t first;
+	uint64_t *blocks;
+	uint32_t numblocks;
+	uint64_t size;
+	// numbers of the blocks that may hold a match, in order, and how many
+	//  there are
+	uint32_t *cand;
+	size_t numcand;
+};
+
+// file followed by the --follow option
+struct follow_file {
+	// path of the file from args
+	char *path;
+	// file descriptor of the file open under the path, -1 if there is none
+	int fd;
+	// device and inode of the open file, to find a new file under the path
+	dev_t dev;
+	ino_t ino;
+	// inotify watch descriptors of the file and of its directory, -1 if
+	//  there are none
+	int wd;
+	int dirwd;
+	// reader holding the unfinished last line and the lines kept for the
+	//  -B option between writes
+	struct line_reader rdr;
+	// context state of the file between writes
+	struct context ctx;
+	// line number and byte offset of the file between writes
+	struct line_count lines;
+	// boolean flag set once opening the file failed, so that a missing
+	//  file is only reported once while it is waited for
+	int missing;
+	// boolean flag set once any line of the file was selected
+	int matched;
+	// boolean flag set once the file is no longer followed
+	int done;
+};
+
+// file given in args that the read-ahead pipeline opens, and reads the start
+//  of, before it is searched
+struct prefetch_slot {
+	// one of PREFETCH_FREE, PREFETCH_OPEN, PREFETCH_READ or PREFETCH_READY
+	int state;
+	// file descriptor of the file, -1 if it failed to open
+	int fd;
+	// errno value of the failed open, 0 if none
+	int err;
+	// size of the file when it was opened, -1 if it is not a regular file
+	off_t size;
+	// buffer the start of the file is read into, kept for later files
+	char *buff;
+	// number of bytes read into the buffer, -1 if nothing was read
+	ssize_t len;
+};
+
+// read-ahead pipeline keeping the files after the one being searched open and
+//  being read, so reading them from disk overlaps with the search - on an
+//  io_uring instance when there is one, otherwise on a read-ahead thread
+struct prefetch {
+	// the file paths from args, and the number of them
+	char **filenames;
+	int numfiles;
+	// the files ahead, each in the slot of its index modulo PREFETCH_DEPTH
+	struct prefetch_slot slots[PREFETCH_DEPTH];
+	// index of the next file handed to the search
+	int next;
+	// index of the next file to open
+	int opened;
+	// index of the next file to read, only used by the read-ahead thread
+	int filled;
+	// boolean flag set to stop reading ahead
+	int quit;
+	// io_uring instance the opens and reads are queued on, -1 if the
+	//  read-ahead thread is used instead
+	int ringfd;
+#ifdef MG_URING
+	// the mapped submission ring, completion ring and submission entries,
+	//  and their sizes - the two rings may share one mapping
+	void *sqmap;
+	size_t sqmaplen;
+	void *cqmap;
+	size_t cqmaplen;
+	struct io_uring_sqe *sqes;
+	size_t sqeslen;
+	// fields of the rings shared with the kernel
+	unsigned *sqhead;
+	unsigned *sqtail;
+	unsigned *sqmask;
+	unsigned *sqarray;
+	unsigned *cqhead;
+	unsigned *cqtail;
+	unsigned *cqmask;
+	struct io_uring_cqe *cqes;
+	// entries queued but not yet handed to the kernel
+	unsigned tosubmit;
+	// operations handed to the kernel and not yet completed
+	int inflight;
+	// boolean flag set once io_uring_enter failed - nothing more is queued,
+	//  and the files not yet ready are searched by grep_path
+	int broken;
+#endif
+	// lock protecting the slot states, next, opened, filled and quit when
+	//  the read-ahead thread is used
+	pthread_mutex_t lock;
+	// signalled when a file is ready to be searched
+	pthread_cond_t readycond;
+	// signalled when a slot is freed, or reading ahead should stop
+	pthread_cond_t freecond;
+	// the read-ahead thread
+	pthread_t thread;
+};
+
+// compiled search strings, by main() for the program and by mygrep_compile
+//  for the library interface - shared read only by every scanner using them
+struct mygrep_pattern {
+	// the compiled search strings
+	struct searcher srch;
+	// copy of the search strings, which the searcher points into, or null
+	//  if the caller keeps them
+	char *text;
+	// the -i, -E and -v options, from the MYGREP_ directives
+	int flags;
+};
+
+// state of one search through a pattern - everything the search changes is
+//  kept here and passed down to the functions that search, so the program
+//  keeps one scanner per thread, the library one per stream, and the pattern
+//  is never written to
+struct mygrep_scanner {
+	// the pattern searched for
+	struct mygrep_pattern *pat;
+	// DFA states built for the pattern's regular expression
+	struct dfa_cache dfa;
+	// errno of a DFA that could not be set up, 0 if none - the search of
+	//  the run stops
+	int err;
+	// boolean flag set once the search of the run should stop, because the
+	//  library's callback or the program's -l or -q option has what it
+	//  needs, or the output cannot be written
+	int stopped;
+	// line number and byte offset of the library's stream
+	struct line_count lines;
+	// unfinished last line kept between calls to mygrep_scan, its length,
+	//  and the size of its buffer
+	char *tail;
+	size_t taillen;
+	size_t tailsize;
+	// reader used by mygrep_scan_fd, its buffer is kept for the next stream
+	struct line_reader rdr;
+	// callback of the library call being run, and its argument
+	mygrep_callback cb;
+	void *cbarg;
+};
+
 // GLOBAL VARIABLES
-// boolean flag for -v or --invert-match option
-static int mg_invert = 0;
 // boolean flag for if there is more than one filename specified in cli options
 //  and the filename should be prepened to the matched output
 static int mg_printfname = 0;
+// buffer that selected lines are printed to - written to stdout for the main
+//  thread, grown in memory for each job searched by a worker thread
+static __thread struct out_buf mg_out;
+// block-buffered line reader shared by every stream in a thread - its buffer
+//  is allocated for the first stream and reused, along with any growth, for
+//  every stream after it, so no memory is allocated per line or per file
+static __thread struct line_reader mg_reader;
+// jump buffer used to return from the SIGBUS handler to grep_file if a mapped
+//  file is truncated while it is being searched
+static __thread sigjmp_buf mg_sigbus_jmp;
+// output mode from the -c, -l and -q options, MODE_PRINT if none is given
+static int mg_mode = MODE_PRINT;
+// boolean flag set when the current file needs no more searching, because the
+//  -l or -q option only needs to know that one line was selected
+static __thread int mg_stop = 0;
+// boolean flag set when the current file could not be searched to its end and
+//  the reason was already printed to stderr - the lines selected before it
+//  are still counted, and the file counts as an error
+static __thread int mg_failed = 0;
+// number of worker threads used to search a single large mapped file in
+//  chunks, 1 searches it in one piece
+static int mg_chunkjobs = 1;
+// boolean flag set while grep_file is searching a mapping, so the SIGBUS
+//  handler knows the jump buffer is valid
+static __thread volatile sig_atomic_t mg_in_mapping = 0;
+// boolean flag for the -r option, files found to be binary are skipped
+static int mg_skipbinary = 0;
+// boolean flag for -a or --text option, binary files are searched as text
+static int mg_text = 0;
+// longest line searched in a stream, from the --max-line-length option, 0 for
+//  no limit - the rest of a longer line is skipped, so the reader's buffer
+//  never grows much past this
+static size_t mg_maxline = 0;
+// boolean flag set when the first block of the file being searched holds a
+//  null byte - its lines are not printed, a single "Binary file X matches"
+//  line is printed instead if any line is selected
+static __thread int mg_binary = FALSE;
+// number of lines of context printed after and before each selected line by
+//  the -A, -B and -C options
+static long mg_after = 0;
+static long mg_before = 0;
+// boolean flag set when any of the -A, -B or -C options is given, even with 0
+//  lines, so that groups of lines that are not next to each other are
+//  separated by "--" as in grep
+static int mg_context = 0;
+// context state for the file being searched in this thread
+static __thread struct context mg_ctx;
+// boolean flags for the -n or --line-number, -b or --byte-offset and -o or
+//  --only-matching options
+static int mg_lineno = 0;
+static int mg_byteoff = 0;
+static int mg_only = 0;
+// line number and byte offset in the file being searched in this thread
+static __thread struct line_count mg_lines;
+// index mapped by the --index option, shared read only by every thread
+static struct trigram_index mg_index;
+// blocks of the file being searched in this thread that may hold a match,
+//  with the --index option
+static __thread struct index_hits mg_hits;
+#ifdef MG_STATS
+// report asked for by the --stats option, STATS_OFF if none
+static int mg_statson = STATS_OFF;
+// counters of this thread for the --stats option, and the totals of every
+//  thread that is done, protected by the lock
+static __thread struct stats mg_stats;
+static struct stats mg_totals;
+// files searched so far, the number of them and the number there is room for,
+//  protected by the lock
+static struct stats_file *mg_statfiles = NULL;
+static size_t mg_numstatfiles = 0;
+static size_t mg_statfilessize = 0;
+static pthread_mutex_t mg_statslock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 // FUNCTION PROTOTYPES
-int grep_stream(FILE *fpntr, char *string, char *file_pathname);
-char *get_next_line(FILE *fpntr);
+long grep_stream(FILE *fpntr, struct mygrep_scanner *sc, char *file_pathname);
+long grep_file(FILE *fpntr, struct mygrep_scanner *sc, char *file_pathname);
+long grep_compressed(FILE *fpntr, struct mygrep_scanner *sc,
+	char *file_pathname, int type);
+int grep_follow(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror);
+int follow_watch_dir(int notifyfd, char *path);
+int follow_open(struct follow_file *ff, int notifyfd);
+void follow_check(struct follow_file *ff, struct mygrep_scanner *sc,
+	int notifyfd, int *foundmatch, int *founderror);
+void follow_scan(struct follow_file *ff, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror);
+int compress_type(int fd);
+void grep_path(char *file_pathname, struct mygrep_scanner *sc, int *foundmatch,
+	int *founderror);
+void grep_handle(FILE *fileh, char *file_pathname, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror);
+void print_open_error(char *file_pathname);
+long grep_memory(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname);
+int grep_prefetch(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror);
+void grep_prefetched(struct prefetch_slot *slot, char *file_pathname,
+	struct mygrep_scanner *sc, int *foundmatch, int *founderror);
+int prefetch_start(struct prefetch *pf, char **filenames, int numfiles);
+struct prefetch_slot *prefetch_next(struct prefetch *pf);
+void prefetch_done(struct prefetch *pf);
+void prefetch_stop(struct prefetch *pf);
+int prefetch_opened(struct prefetch_slot *slot);
+void *prefetch_thread(void *arg);
+#ifdef MG_URING
+int prefetch_ring_init(struct prefetch *pf);
+void prefetch_ring_free(struct prefetch *pf);
+int prefetch_ring_queue(struct prefetch *pf, int fidx);
+int prefetch_ring_enter(struct prefetch *pf, int wait);
+void prefetch_ring_reap(struct prefetch *pf);
+void prefetch_ring_abandon(struct prefetch *pf);
+#endif
+int grep_parallel(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int numjobs, int *foundmatch, int *founderror);
+long grep_chunked(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname, int numjobs);
+int pool_run(struct work_pool *pool, int numjobs, int *foundmatch,
+	int *founderror);
+void *grep_worker(void *arg);
+int grep_recursive(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int numjobs, int *foundmatch, int *founderror);
+int walk_start(struct walk_pool *pool, char **filenames, int numfiles,
+	pthread_t *walkers);
+void walk_end(struct walk_pool *pool, pthread_t *walkers, int numwalkers);
+void *walk_worker(void *arg);
+void walk_dir(struct walk_pool *pool, struct walk_entry *ent, char *buff);
+int walk_push_dir(struct walk_pool *pool, char *path, int isroot);
+int walk_push_files(struct walk_pool *pool, char **paths, int count);
+char *walk_next_file(struct walk_pool *pool);
+void *walk_searcher(void *arg);
+void walk_stop(struct walk_pool *pool);
+int is_binary(int fd);
+int data_binary(char *data, size_t size);
+size_t chunk_start(char *data, size_t size, int chunk);
+void chunk_lines(struct work_pool *pool, int jidx, size_t from, size_t to);
+size_t line_start(char *data, size_t size, size_t pos);
+long grep_region(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname);
+long region_select(struct mygrep_scanner *sc, char *from, char *to,
+	void *arg);
+int search_compile(struct searcher *srch, struct pattern_list *plist,
+	int flags, char **errmsg);
+int search_init(struct searcher *srch, char *needle, size_t len, int fold);
+int search_init_icase(struct searcher *srch);
+int pattern_wide(char *str, size_t len);
+int search_init_multi(struct searcher *srch, struct pattern_list *plist,
+	int fold);
+char *search_aho(struct searcher *srch, char *hay, size_t haylen);
+char *search_all(struct searcher *srch, char *hay, size_t haylen);
+int add_pattern(struct pattern_list *plist, char *pat, size_t len);
+int read_patterns(struct pattern_list *plist, char *pathname);
+char *search_memchr(struct searcher *srch, char *hay, size_t haylen);
+char *search_memmem(struct searcher *srch, char *hay, size_t haylen);
+char *search_horspool(struct searcher *srch, char *hay, size_t haylen);
+char *search_horspool_icase(struct searcher *srch, char *hay, size_t haylen);
+char *search_utf8_icase(struct searcher *srch, char *hay, size_t haylen);
+size_t utf8_match(struct searcher *srch, char *text, size_t len);
+int utf8_prefilter(struct searcher *srch);
+void search_free(struct searcher *srch);
+int search_init_regex(struct searcher *srch, struct pattern_list *plist,
+	int fold, int fixed, char **errmsg);
+char *search_regex(struct searcher *srch, struct dfa_cache *dfa, char *hay,
+	size_t haylen);
+char *regex_scan(struct dfa_cache *dfa, char *hay, size_t haylen);
+long regex_longest(struct dfa_cache *dfa, char *linestart, char *eol,
+	char *from);
+long regex_longest_nfa(struct dfa_cache *dfa, char *linestart, char *eol,
+	char *from);
+int re_parse_alt(struct regex *re);
+int re_parse_branch(struct regex *re);
+int re_parse_atom(struct regex *re);
+int re_parse_bracket(struct regex *re);
+int re_parse_interval(struct regex *re, int *min, int *max);
+int re_parse_strings(struct regex *re, struct pattern_list *plist);
+int re_trie_node(struct regex *re, struct re_trie *trie, int idx, int depth);
+int re_parse_char(struct regex *re, int node, int set);
+int fold_table(struct regex *re);
+int fold_cmp(const void *a, const void *b);
+int fold_variants(struct regex *re, wint_t chr, wint_t *variants);
+int re_new_node(struct regex *re, int type);
+void re_add_child(struct regex *re, int parent, int child);
+int re_new_set(struct regex *re);
+void re_set_add(struct regex *re, int set, int byte);
+int re_set_char(struct regex *re, int set);
+void re_must(struct regex *re, int node, struct re_must *must);
+void must_exact(struct re_must *must, char *str, int len);
+void must_cat(struct re_must *acc, struct re_must *part);
+void must_alt(struct re_must *acc, struct re_must *part);
+void must_longest(struct re_must *must, char *str, int len);
+int re_compile(struct regex *re, int node, int next);
+int re_new_state(struct regex *re, int type, int out, int out1, int set);
+void re_classes(struct regex *re);
+void re_first(struct regex *re, struct dfa_cache *dfa);
+char *regex_skip(struct regex *re, char *hay, size_t haylen);
+void regex_free(struct regex *re);
+int dfa_init(struct dfa_cache *dfa, struct regex *re);
+void dfa_flush(struct dfa_cache *dfa);
+int dfa_start(struct dfa_cache *dfa);
+int dfa_anchored(struct dfa_cache *dfa, int bol);
+void dfa_new_pass(struct dfa_cache *dfa);
+int dfa_step(struct dfa_cache *dfa, int state, unsigned char byte);
+int dfa_add(struct dfa_cache *dfa, int *set, int len, int bol);
+int dfa_closure(struct dfa_cache *dfa, int depth, int bol, int eol, int *set);
+int dfa_cmp_state(const void *a, const void *b);
+void dfa_free(struct dfa_cache *dfa);
+int casecmp_ascii(char *text, char *folded, size_t len);
+size_t utf8_decode(unsigned char *str, size_t len, wint_t *chr);
+size_t utf8_encode(wint_t chr, unsigned char *str);
+#ifdef MG_X86
+char *search_sse2(struct searcher *srch, char *hay, size_t haylen);
+char *search_avx2(struct searcher *srch, char *hay, size_t haylen);
+char *search_sse2_icase(struct searcher *srch, char *hay, size_t haylen);
+char *search_avx2_icase(struct searcher *srch, char *hay, size_t haylen);
+#endif
+long print_lines(char *data, size_t size, char *file_pathname);
+void print_result(char *file_pathname, long matchcount);
+char *find_eol(char *data, size_t size);
+char *find_eol_back(char *data, size_t size);
+void print_line(char *line, size_t linelen, char *file_pathname, char sep);
+void print_part(char *linestart, char *part, size_t partlen,
+	char *file_pathname, char sep);
+void print_matches(struct mygrep_scanner *sc, char *linestart, char *eol,
+	char *file_pathname);
+char *match_span(struct mygrep_scanner *sc, char *linestart, char *eol,
+	char *from, char **start);
+void lines_reset(char *data);
+void lines_seek(char *to);
+unsigned long long count_lines(char *data, size_t size);
+size_t format_number(char *buff, unsigned long long num);
+long grep_context(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname);
+long context_select(struct mygrep_scanner *sc, char *from, char *to,
+	void *arg);
+long context_print(char *from, char *to, struct mygrep_scanner *sc,
+	char *file_pathname);
+long context_lines(char *from, char *to, long max, char sep,
+	struct mygrep_scanner *sc, char *file_pathname);
+char *line_back(char *lower, char *linestart);
+char *line_end(char *linestart, char *next);
+void context_keep(struct line_reader *rdr, char *block);
+void context_restore(struct line_reader *rdr, char *block);
+void sigbus_handler(int signum);
+int out_init(struct out_buf *out, int fd);
+int out_flush(struct out_buf *out);
+void out_write(struct out_buf *out, char *data, size_t len);
+void out_span(struct out_buf *out, char *data, size_t len);
+long print_span(char *data, size_t size);
+int writev_all(int fd, struct iovec *iov, int iovcnt);
+int write_all(int fd, char *data, size_t len);
+int get_next_block(struct line_reader *rdr, char **block, size_t *blocklen);
+int reader_init(struct line_reader *rdr, int fd);
+int reader_fill(struct line_reader *rdr);
+int reader_skip(struct line_reader *rdr);
+char *reader_limit(struct line_reader *rdr, char *from, char *to);
+void reader_report_cut(struct line_reader *rdr, char *file_pathname);
+void reader_free(struct line_reader *rdr);
+int decomp_open(struct decomp_pipe *dp, int fd, int type,
+	char *file_pathname);
+void decomp_close(struct decomp_pipe *dp);
+void decomp_free(struct decomp_pipe *dp);
+ssize_t decomp_read(struct decomp_pipe *dp, char *buff, size_t len);
+void *decomp_worker(void *arg);
+int decomp_fill(struct decomp_pipe *dp, char *block, size_t *blocklen);
+int index_main(int argc, char *argv[]);
+int index_build(char *indexpath, char **paths, int numpaths);
+int index_add_file(struct index_builder *bld, char *path);
+int index_add_run(struct index_builder *bld, char *run, size_t len,
+	uint64_t offset, int whole);
+int index_add_bytes(struct index_builder *bld, char *data, size_t len);
+int index_add_trigram(struct index_builder *bld, uint32_t trigram);
+int index_grow(struct index_builder *bld);
+int index_write(struct index_builder *bld, int fd, char **roots,
+	int numroots);
+int index_cmp_entry(const void *a, const void *b);
+int index_cmp_list(const void *a, const void *b);
+void index_free_builder(struct index_builder *bld);
+int index_open(struct trigram_index *idx, char *indexpath);
+int index_check(struct trigram_index *idx);
+int index_query(struct trigram_index *idx, struct mygrep_pattern *pat,
+	char *searchstr, struct pattern_list *plist);
+int index_pattern(struct trigram_index *idx, char *pat, size_t len, int fold,
+	uint32_t **cand, size_t *numcand, size_t *candsize);
+uint32_t *index_postings(struct trigram_index *idx,
+	struct index_trigram *tri);
+struct index_trigram *index_find_trigram(struct trigram_index *idx,
+	uint32_t trigram);
+struct index_file *index_find_file(struct trigram_index *idx, char *path);
+int index_file_hits(struct trigram_index *idx, char *path, int fd);
+uint64_t index_checksum(char *map, size_t size);
+uint64_t index_sum(uint64_t sum, unsigned char *data, size_t len);
+uint64_t index_mix(uint64_t sum, uint64_t word);
+int index_fits(uint64_t off, uint64_t count, uint64_t itemsize,
+	uint64_t size);
+size_t index_lower(uint32_t *cand, size_t num, uint64_t block);
+void index_close(struct trigram_index *idx);
+long grep_hits(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname);
+int index_cmp_trigram(const void *a, const void *b);
+int index_cmp_count(const void *a, const void *b);
+int index_cmp_block(const void *a, const void *b);
+void scanner_init(struct mygrep_scanner *sc, struct mygrep_pattern *pat);
+void scanner_clear(struct mygrep_scanner *sc);
+char *scanner_find(struct mygrep_scanner *sc, char *hay, size_t haylen);
+long scan_region(struct mygrep_scanner *sc, char *data, size_t size,
+	int linestarts, long (*handler)(struct mygrep_scanner *sc, char *from,
+	char *to, void *arg), void *arg);
+long scanner_search(struct mygrep_scanner *sc, char *data, size_t size);
+long scan_lines(struct mygrep_scanner *sc, char *from, char *to, void *arg);
+void scan_line(struct mygrep_scanner *sc, char *linestart, char *eol);
+int scanner_keep(struct mygrep_scanner *sc, char *data, size_t len);
+void scanner_reset(struct mygrep_scanner *sc);
 void free_str_arr(int size, char **arr);
 void print_usage(char *progname);
 void remove_str(char **arr, int index, int len);
 void print_str_arr(char **arr, int len);
 void print_buffer(char *buff, int len);
+#ifdef MG_STATS
+unsigned long long stats_now(void);
+void stats_begin(int stage);
+void stats_end(int stage);
+void stats_file_begin(void);
+void stats_file_end(char *file_pathname, long matchcount);
+void stats_merge(void);
+void stats_lines(char *data, size_t size);
+void stats_report(unsigned long long wallns);
+void stats_json_str(char *str);
+#endif
 
+#ifndef MG_LIBRARY
 // main function
 int main(int argc, char *argv[]) {
 	////////////////////////////////////////////////////////////////////////
@@ -68,10 +1640,22 @@ int main(int argc, char *argv[]) {
 	////////////////////////////////////////////////////////////////////////
 	// boolean for reading stdin instead of file
 	int readstdin = 0;
-	// file handle for open file
-	FILE *fileh = NULL;
+	// boolean for the -r option, directories are searched recursively
+	int recursive = 0;
+	// status of the only path given to the -r option
+	struct stat st;
 	// search string from args
 	char *searchstr = NULL;
+	// search strings from the -e and -f options
+	struct pattern_list plist = { NULL, NULL, 0, 0, NULL, 0 };
+	// search strings compiled for fast searching, the same way as by the
+	//  library interface, and the main thread's scanner searching for them
+	struct mygrep_pattern pattern;
+	struct mygrep_scanner scanner;
+	// the -v, -i and -E options, from the MYGREP_ directives
+	int flags = 0;
+	// message for an invalid regular expression
+	char *errmsg;
 	// file paths from args
 	char **filenames = NULL;
 	// index of current position in argv - start from index 1 because index
@@ -87,9 +1671,39 @@ int main(int argc, char *argv[]) {
 	int foundmatch = 0;
 	// keep track of number of errors overall
 	int founderror = 0;
-	// temporary storage for number of times grep_stream returned true,
-	//  meaning there was a match
-	int grepreturn;
+	// temporary storage for number of lines grep_stream selected, or -1
+	//  on error
+	long grepreturn;
+	// number of worker threads from the -j option, 1 searches the files in
+	//  the main thread
+	int numjobs = 1;
+	// end of the number given to the -j option, used to check it
+	char *endptr;
+	// number of lines of context from the -A, -B and -C options, -1 if the
+	//  option was not given, and the option itself
+	long after = -1, before = -1, context = -1, numlines;
+	char ctxopt;
+	// number given to a context option
+	char *numstr;
+	// number given to the --max-line-length option, and the shift of its
+	//  K, M or G suffix
+	unsigned long long maxline;
+	int shift;
+#ifdef MG_STATS
+	// when the search started, for the --stats option
+	unsigned long long wallstart = 0;
+#endif
+	// SIGBUS handler installed for the whole run
+	struct sigaction sa;
+	// path of the index from the --index option, or null
+	char *indexpath = NULL;
+	// return value of index_open
+	int indexret;
+	// boolean for the --follow option, files are searched again as lines
+	//  are written to them
+	int follow = 0;
+	// index of the path the index was built from
+	uint64_t ridx;
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
 	// END VARIABLE DECLARATIONS
@@ -110,20 +1724,282 @@ int main(int argc, char *argv[]) {
 		print_usage(PROG_NAME);
 		return(R_ERROR);
 	}
-	// if the first argument is invert option, set invert boolean and
-	//  increment arg index to next position
-	// note: if invert option is specified, it must be the first argument
-	if ( strcmp(argv[argidx],"-v") == 0 ||
-		 strcmp(argv[argidx],"--invert-match") == 0 ) {
-		mg_invert = 1;
+	// the index subcommand builds an index for the --index option instead
+	//  of searching
+	if (strcmp(argv[1],"index") == 0) { return(index_main(argc-1,argv+1)); }
+	// loop through the options before the search string, stopping at the
+	//  first argument that is not an option or at '--'
+	// note: options must come before the search string
+	for (; argidx < argc && argv[argidx][0] == '-' &&
+		argv[argidx][1] != '\0'; argidx++)
+	{
+		// if the argument is invert option, set invert flag
+		if ( strcmp(argv[argidx],"-v") == 0 ||
+			 strcmp(argv[argidx],"--invert-match") == 0 ) {
+			flags |= MYGREP_INVERT;
+		}
+		// if the argument is the jobs option, read the number of
+		//  worker threads from the rest of the argument ("-j4") or from
+		//  the next argument ("-j 4")
+		else if (strncmp(argv[argidx],"-j",2) == 0) {
+			if (argv[argidx][2] == '\0') {
+				if (argidx+1 >= argc) {
+					print_usage(PROG_NAME);
+					return(R_ERROR);
+				}
+				argidx++;
+				errno = 0;
+				numjobs = strtol(argv[argidx],&endptr,10);
+			}
+			else {
+				errno = 0;
+				numjobs = strtol(argv[argidx]+2,&endptr,10);
+			}
+			if (errno != 0 || *endptr != '\0' || numjobs < 1 ||
+				numjobs > MAX_JOBS)
+			{
+				fprintf(stderr,"%s: invalid number of jobs: "
+					"must be from 1 to %d\n",PROG_NAME,
+					MAX_JOBS);
+				return(R_ERROR);
+			}
+		}
+		// if the argument is a context option, read the number of
+		//  lines the same way as for the -j option
+		else if (strncmp(argv[argidx],"-A",2) == 0 ||
+			strncmp(argv[argidx],"-B",2) == 0 ||
+			strncmp(argv[argidx],"-C",2) == 0)
+		{
+			ctxopt = argv[argidx][1];
+			if (argv[argidx][2] == '\0') {
+				if (argidx+1 >= argc) {
+					print_usage(PROG_NAME);
+					return(R_ERROR);
+				}
+				argidx++;
+				numstr = argv[argidx];
+			}
+			else { numstr = argv[argidx]+2; }
+			errno = 0;
+			numlines = strtol(numstr,&endptr,10);
+			if (errno != 0 || *endptr != '\0' || endptr == numstr ||
+				numlines < 0)
+			{
+				fprintf(stderr,"%s: %s: invalid context length "
+					"argument\n",PROG_NAME,numstr);
+				return(R_ERROR);
+			}
+			if (ctxopt == 'A') { after = numlines; }
+			else if (ctxopt == 'B') { before = numlines; }
+			else { context = numlines; }
+		}
+		// if the argument is the stats option, counters and the time
+		//  spent in each stage are reported on stderr at the end, as
+		//  text or as JSON
+		else if (strcmp(argv[argidx],"--stats") == 0 ||
+			strcmp(argv[argidx],"--stats=json") == 0) {
+#ifdef MG_STATS
+			mg_statson = (argv[argidx][7] == '=') ? STATS_JSON :
+				STATS_TEXT;
+#else
+			fprintf(stderr,"%s: --stats needs a build with "
+				"-DMG_STATS\n",PROG_NAME);
+			return(R_ERROR);
+#endif
+		}
+		// if the argument is the follow option, set follow boolean
+		else if (strcmp(argv[argidx],"--follow") == 0) {
+			follow = 1;
+		}
+		// if the argument is the index option, files are searched
+		//  through the index written by the index subcommand, read
+		//  from the next argument ("--index FILE") or the rest of the
+		//  argument ("--index=FILE")
+		else if (strcmp(argv[argidx],"--index") == 0) {
+			if (argidx+1 >= argc) {
+				print_usage(PROG_NAME);
+				return(R_ERROR);
+			}
+			argidx++;
+			indexpath = argv[argidx];
+		}
+		else if (strncmp(argv[argidx],"--index=",8) == 0) {
+			indexpath = argv[argidx]+8;
+		}
+		// if the argument is the max line length option, read the
+		//  number of bytes the same way, with a K, M or G suffix for
+		//  the binary multiples
+		else if (strcmp(argv[argidx],"--max-line-length") == 0 ||
+			strncmp(argv[argidx],"--max-line-length=",18) == 0)
+		{
+			if (argv[argidx][17] == '=') {
+				numstr = argv[argidx] + 18;
+			}
+			else if (argidx+1 >= argc) {
+				print_usage(PROG_NAME);
+				return(R_ERROR);
+			}
+			else { numstr = argv[++argidx]; }
+			errno = 0;
+			maxline = strtoull(numstr,&endptr,10);
+			shift = 0;
+			if (*endptr == 'K') { shift = 10; }
+			else if (*endptr == 'M') { shift = 20; }
+			else if (*endptr == 'G') { shift = 30; }
+			if (shift > 0) { endptr++; }
+			if (errno != 0 || *endptr != '\0' ||
+				! isdigit((unsigned char) *numstr) ||
+				maxline < 1 ||
+				maxline > (MAX_LINE_LIMIT >> shift))
+			{
+				fprintf(stderr,"%s: %s: invalid line length "
+					"argument\n",PROG_NAME,numstr);
+				return(R_ERROR);
+			}
+			mg_maxline = maxline << shift;
+		}
+		// if the argument is the ignore case option, set ignore case
+		//  flag
+		else if (strcmp(argv[argidx],"-i") == 0 ||
+			strcmp(argv[argidx],"--ignore-case") == 0) {
+			flags |= MYGREP_ICASE;
+		}
+		// if the argument is the extended regular expression option,
+		//  set extended flag
+		else if (strcmp(argv[argidx],"-E") == 0 ||
+			strcmp(argv[argidx],"--extended-regexp") == 0) {
+			flags |= MYGREP_EXTENDED;
+		}
+		// if the argument is the text option, set text boolean
+		else if (strcmp(argv[argidx],"-a") == 0 ||
+			strcmp(argv[argidx],"--text") == 0) {
+			mg_text = 1;
+		}
+		// if the argument is the recursive option, set recursive
+		//  boolean - binary files found are skipped
+		else if (strcmp(argv[argidx],"-r") == 0 ||
+			strcmp(argv[argidx],"--recursive") == 0) {
+			recursive = 1;
+			mg_skipbinary = 1;
+		}
+		// output mode options, if more than one is given the one
+		//  printing the least wins
+		else if (strcmp(argv[argidx],"-c") == 0 ||
+			strcmp(argv[argidx],"--count") == 0) {
+			if (mg_mode < MODE_COUNT) { mg_mode = MODE_COUNT; }
+		}
+		else if (strcmp(argv[argidx],"-l") == 0 ||
+			strcmp(argv[argidx],"--files-with-matches") == 0) {
+			if (mg_mode < MODE_LIST) { mg_mode = MODE_LIST; }
+		}
+		else if (strcmp(argv[argidx],"-q") == 0 ||
+			strcmp(argv[argidx],"--quiet") == 0 ||
+			strcmp(argv[argidx],"--silent") == 0) {
+			mg_mode = MODE_QUIET;
+		}
+		// the line number and byte offset of each line printed, and the
+		//  option printing only the matches in each selected line
+		else if (strcmp(argv[argidx],"-n") == 0 ||
+			strcmp(argv[argidx],"--line-number") == 0) {
+			mg_lineno = 1;
+		}
+		else if (strcmp(argv[argidx],"-b") == 0 ||
+			strcmp(argv[argidx],"--byte-offset") == 0) {
+			mg_byteoff = 1;
+		}
+		else if (strcmp(argv[argidx],"-o") == 0 ||
+			strcmp(argv[argidx],"--only-matching") == 0) {
+			mg_only = 1;
+		}
+		// search string option, may be given more than once
+		else if (strcmp(argv[argidx],"-e") == 0) {
+			if (argidx+1 >= argc) {
+				print_usage(PROG_NAME);
+				return(R_ERROR);
+			}
+			argidx++;
+			if (add_pattern(&plist,argv[argidx],
+				strlen(argv[argidx])) != 0)
+			{
+				fprintf(stderr,"%s: error allocating memory: "
+					"%s\n",PROG_NAME,strerror(errno));
+				return(R_ERROR);
+			}
+		}
+		// pattern file option, one search string per line, may be
+		//  given more than once
+		else if (strcmp(argv[argidx],"-f") == 0) {
+			if (argidx+1 >= argc) {
+				print_usage(PROG_NAME);
+				return(R_ERROR);
+			}
+			argidx++;
+			if (read_patterns(&plist,argv[argidx]) != 0) {
+				fprintf(stderr,"%s: pattern file '%s' could "
+					"not be read: %s\n",PROG_NAME,
+					argv[argidx],strerror(errno));
+				return(R_ERROR);
+			}
+		}
+		// '--' ends the options, the next argument is the search
+		//  string even if it starts with '-'
+		else if (strcmp(argv[argidx],"--") == 0) {
+			argidx++;
+			break;
+		}
+		// any other option is unknown
+		else {
+			fprintf(stderr,"%s: unknown option '%s'\n",PROG_NAME,
+				argv[argidx]);
+			print_usage(PROG_NAME);
+			return(R_ERROR);
+		}
+	}
+	// the search string is the next arg, unless the -e or -f options gave
+	//  the search strings, in which case every remaining arg is a file
+	if (plist.num == 0 && plist.numbuffs == 0) {
+		// if the options used up every argument, there is no search
+		//  string
+		if (argidx >= argc) {
+			print_usage(PROG_NAME);
+			return(R_ERROR);
+		}
+		// get the search string from arg
+		searchstr = argv[argidx];
+		// go to the next argument - start of the file paths
 		argidx++;
 	}
-	// get the search string from arg
-	searchstr = argv[argidx];
-	// go to the next argument - start of the file paths
-	argidx++;
 	// calculate how many filenames there are
 	numfiles = argc - argidx;
+	// the index is mapped for the whole run - a damaged one narrows
+	//  nothing, and if it cannot be read at all the files named are
+	//  searched without it
+	indexret = (indexpath != NULL) ? index_open(&mg_index,indexpath) : 0;
+	if (indexret == 1 ||
+		(indexret == -1 && errno == EBADMSG && numfiles > 0))
+	{
+		fprintf(stderr,"%s: index '%s' is damaged, searching every "
+			"file in full - rebuild it\n",PROG_NAME,indexpath);
+		if (indexret == -1) { indexpath = NULL; }
+	}
+	else if (indexret == -1 && errno == EBADMSG) {
+		fprintf(stderr,"%s: index '%s' is damaged and does not give "
+			"the paths to search - rebuild it\n",PROG_NAME,
+			indexpath);
+		return(R_ERROR);
+	}
+	else if (indexret == -1) {
+		fprintf(stderr,"%s: index '%s' could not be read: %s\n",
+			PROG_NAME,indexpath,strerror(errno));
+		return(R_ERROR);
+	}
+	// with no files given the index searches the paths it was built from,
+	//  the way the index subcommand walked them, so the paths found are
+	//  the ones in the index
+	if (indexpath != NULL && numfiles == 0) {
+		recursive = 1;
+		mg_skipbinary = 1;
+	}
 	// if there are filename args given, read them in
 	if (numfiles > 0) {
 		// allocate memory in filename array for each file arg
@@ -156,8 +2032,31 @@ int main(int argc, char *argv[]) {
 			fidx++;
 		}
 	}
-	// if there are no filename args, assume stdin (set flag)
-	else { readstdin = 1; }
+	// the paths the index was built from are searched in place of files,
+	//  unless it was built from the current directory
+	else if (indexpath != NULL && (mg_index.hdr->numroots > 1 ||
+		mg_index.strings[mg_index.roots[0]] != '\0'))
+	{
+		filenames = malloc(mg_index.hdr->numroots * sizeof(char *));
+		if (filenames == NULL) {
+			fprintf(stderr,"%s: error allocating memory: %s\n",
+				PROG_NAME,strerror(errno));
+			return(R_ERROR);
+		}
+		for (ridx=0; ridx<mg_index.hdr->numroots; ridx++) {
+			filenames[numfiles] = strdup(mg_index.strings +
+				mg_index.roots[ridx]);
+			if (filenames[numfiles] == NULL) {
+				fprintf(stderr,"%s: error allocating memory: "
+					"%s\n",PROG_NAME,strerror(errno));
+				return(R_ERROR);
+			}
+			numfiles++;
+		}
+	}
+	// if there are no filename args, assume stdin (set flag) - unless the
+	//  -r option was given, which searches the current directory
+	else if (! recursive) { readstdin = 1; }
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
 	// END ARGUMENT PARSING
@@ -171,75 +2070,91 @@ int main(int argc, char *argv[]) {
 	//  usage message or useful error message if it is a non-fatal error
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
-	// check if search string was given in args
-	if (searchstr == NULL || searchstr[0] == '\0') {
+	// check if search string was given in args, or with the -e or -f
+	//  options (an empty pattern file gives no search strings, which
+	//  matches nothing)
+	if ((searchstr == NULL || searchstr[0] == '\0') && plist.numbuffs == 0 &&
+		plist.num == 0)
+	{
 		// if no search string given, print usage and exit
 		print_usage(PROG_NAME);
 		// increment the error counter
 		founderror++;
 		return(R_ERROR);
 	}
-	// check each filename given in args for existence and readability
-	if (numfiles > 0) {
-		for (fidx=0; fidx<numfiles; fidx++) {
-			// check if file exists
-			if (access(filenames[fidx],F_OK) == 0) {
-				// if file is not readable, print error and
-				//  remove filename from array
-				if (access(filenames[fidx],R_OK) != 0) {
-					fprintf(stderr,"%s: file '%s' is not "
-						"readable: %s\n",PROG_NAME,
-						filenames[fidx],
-						strerror(errno));
-					// remove unreadable file from array
-					remove_str(filenames,fidx,numfiles);
-					// decrement number of files
-					numfiles--;
-					// check for no valid files
-					if (numfiles<1) {
-						// print usage message
-						print_usage(PROG_NAME);
-						// increment error counter
-						founderror++;
-						// return with error code
-						return(R_ERROR);
-					}
-					// move array index back by one since
-					//  the current element was removed
-					fidx--;
-					// increment the error counter
-					founderror++;
-				}
-			}
-			// if file doesn't exist, print error and remove
-			//  filename from array
-			else {
-				fprintf(stderr,"%s: file '%s' does not exist: "
-					"%s\n",PROG_NAME,filenames[fidx],
-					strerror(errno));
-				// remove nonexistent file from array
-				remove_str(filenames,fidx,numfiles);
-				// decrement number of files
-				numfiles--;
-				// check for no valid files
-				if (numfiles<1) {
-					// print usage message
-					print_usage(PROG_NAME);
-					// increment error counter
-					founderror++;
-					// return with error code
-					return(R_ERROR);
-				}
-				// move the array index back by one since the
-				//  current element was removed
-				fidx--;
-				// increment the error counter
-				founderror++;
-			}
+	// the --follow option only follows files named in args, and never
+	//  finishes a count
+	if (follow && (recursive || numfiles == 0 || mg_mode == MODE_COUNT)) {
+		fprintf(stderr,"%s: --follow needs FILE arguments and cannot "
+			"be used with -r or -c\n",PROG_NAME);
+		return(R_ERROR);
+	}
+	// with the -a option binary files are searched like any other, even by
+	//  the -r option
+	if (mg_text) { mg_skipbinary = 0; }
+	// -A and -B take precedence over -C whichever order they are given in,
+	//  and only lines that are printed have context
+	if (mg_mode == MODE_PRINT && (after >= 0 || before >= 0 ||
+		context >= 0))
+	{
+		mg_context = 1;
+		if (context < 0) { context = 0; }
+		mg_after = (after >= 0) ? after : context;
+		mg_before = (before >= 0) ? before : context;
+	}
+	// the -i option folds letters outside ASCII only if the locale uses
+	//  UTF-8, as in grep
+	if (flags & MYGREP_ICASE) { setlocale(LC_CTYPE,""); }
+	// the search string from args is the only one in the list, and the
+	//  list is compiled once for every stream, the same way as by the
+	//  library interface
+	if (searchstr != NULL &&
+		add_pattern(&plist,searchstr,strlen(searchstr)) != 0)
+	{
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		return(R_ERROR);
+	}
+	pattern.text = NULL;
+	pattern.flags = flags;
+	if (search_compile(&pattern.srch,&plist,flags,&errmsg) != 0) {
+		if (errmsg != NULL) {
+			fprintf(stderr,"%s: %s\n",PROG_NAME,errmsg);
+		}
+		else {
+			fprintf(stderr,"%s: error allocating memory: %s\n",
+				PROG_NAME,strerror(errno));
 		}
-		// if more than one valid file is given in args, set flag to
-		//  print filename before matched lines
-		if (numfiles > 1) { mg_printfname = 1; }
+		founderror++;
+		return(R_ERROR);
+	}
+	// the DFA of the main thread's scanner is set up now, so running out of
+	//  memory is reported before the search starts
+	scanner_init(&scanner,&pattern);
+	if (pattern.srch.find == NULL && ! pattern.srch.nevermatch &&
+		dfa_init(&scanner.dfa,pattern.srch.re) != 0)
+	{
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		return(R_ERROR);
+	}
+	// if more than one filename is given in args, or the -r option may find
+	//  more than one file, set flag to print filename before matched lines
+	// note: each file is only checked when it is opened, so a file that
+	//        does not exist or is not readable is reported then
+	if (numfiles > 1 || (recursive && (numfiles == 0 ||
+		(stat(filenames[0],&st) == 0 && S_ISDIR(st.st_mode)))))
+	{
+		mg_printfname = 1;
+	}
+	// the index finds the blocks that may hold a match once, for every
+	//  file searched
+	if (mg_index.map != NULL && index_query(&mg_index,&pattern,
+		(flags & MYGREP_EXTENDED) ? NULL : searchstr,&plist) != 0)
+	{
+		fprintf(stderr,"%s: index '%s' could not be read: %s\n",
+			PROG_NAME,indexpath,strerror(errno));
+		return(R_ERROR);
 	}
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
@@ -256,59 +2171,121 @@ int main(int argc, char *argv[]) {
 	// when function returns, close stream if it was a file
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
+#ifdef MG_STATS
+	if (mg_statson) { wallstart = stats_now(); }
+#endif
+	// selected lines from the main thread are buffered and written to
+	//  stdout
+	if (out_init(&mg_out,STDOUT_FILENO) != 0) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		founderror++;
+		return(R_ERROR);
+	}
+	// a reader closing the pipe on stdout makes write() fail with EPIPE,
+	//  which is handled, instead of killing the process with SIGPIPE
+	signal(SIGPIPE,SIG_IGN);
+	// catch SIGBUS for the whole run, it is raised if a mapped file is
+	//  truncated while it is being searched
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = sigbus_handler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGBUS,&sa,NULL) != 0) {
+		fprintf(stderr,"%s: error setting signal handler: %s\n",
+			PROG_NAME,strerror(errno));
+		founderror++;
+		return(R_ERROR);
+	}
 	// if no files were given, read from stdin
 	if (readstdin) {
 		// look for string match in stdin
-		grepreturn = grep_stream(stdin,searchstr,NULL);
-		// if error in grep, print error and exit
-		if (grepreturn == -1) {
+		STATS_FILE_BEGIN();
+		mg_failed = FALSE;
+		grepreturn = grep_stream(stdin,&scanner,NULL);
+		STATS_FILE_END(NULL,grepreturn);
+		// an error that stopped the search was printed where it
+		//  happened
+		if (mg_failed) { founderror++; }
+		// if error in grep, print error
+		else if (grepreturn == -1) {
 			fprintf(stderr,"%s: problem finding match: %s\n",
 				PROG_NAME,strerror(errno));
 			// increment the error counter
 			founderror++;
-			return(R_ERROR);
 		}
-		// if no error, add to match counter
-		else { foundmatch += grepreturn; }
+		// print the count or name if asked for and add to match
+		//  counter, for the lines selected before any error too
+		if (grepreturn != -1) {
+			print_result(NULL,grepreturn);
+			if (grepreturn > 0) { foundmatch++; }
+		}
+	}
+	// follow the files, searching the lines written to them until killed
+	else if (follow) {
+		if (grep_follow(filenames,numfiles,&scanner,&foundmatch,
+			&founderror) != 0)
+		{
+			founderror++;
+		}
+	}
+	// walk the directories given to the -r option, searching the files as
+	//  they are found
+	else if (recursive) {
+		if (grep_recursive(filenames,numfiles,&scanner,numjobs,
+			&foundmatch,&founderror) != 0)
+		{
+			founderror++;
+		}
+	}
+	// if more than one job was asked for, search the files in a pool of
+	//  worker threads, printing their output in argument order
+	else if (numjobs > 1 && numfiles > 1) {
+		if (grep_parallel(filenames,numfiles,&scanner,numjobs,
+			&foundmatch,&founderror) != 0)
+		{
+			founderror++;
+		}
 	}
 	else {
-		// loop through each file given in args
-		for(fidx=0; fidx<numfiles; fidx++) {
-			// open the file for reading only
-			fileh = fopen(filenames[fidx],"r");
-			// if there is a problem opening, skip to next iteration
-			//  of loop
-			if ( fileh == NULL) {
-				fprintf(stderr,"%s: file '%s' failed to open: "
-					"%s\n",PROG_NAME,filenames[fidx],
-					strerror(errno));
-				// increment error counter
-				founderror++;
-				continue;
-			}
-			// look for string match in file
-			grepreturn = grep_stream(fileh,searchstr,
-				filenames[fidx]);
-			// if error in grep, print error
-			if (grepreturn == -1) {
-				fprintf(stderr,"%s: problem finding match in "
-					"file '%s': %s\n",PROG_NAME,
-					filenames[fidx],strerror(errno));
-				// increment error counter
-				founderror++;
-			}
-			// if no error in grep, add to match counter
-			else { foundmatch += grepreturn; }
-			// close the file, printing error if unsuccessful
-			if (fclose(fileh) != 0) {
-				fprintf(stderr,"%s: file '%s' failed to close: "
-					"%s\n",PROG_NAME,filenames[fidx],
-					strerror(errno));
-				// increment error counter
-				founderror++;
+		// a single large file can still be searched by several worker
+		//  threads, in chunks - unless the -l or -q option only needs
+		//  the first selected line, or context is printed, which needs
+		//  the lines before and after each chunk
+		if (mg_mode < MODE_LIST && ! mg_context) {
+			mg_chunkjobs = numjobs;
+		}
+		// several files are opened and read ahead of the one being
+		//  searched - except with the --index option, which only reads
+		//  the blocks of a file that may hold a match - and if that
+		//  cannot be started, they are opened one at a time
+		if (numfiles < 2 || mg_index.map != NULL ||
+			grep_prefetch(filenames,numfiles,&scanner,&foundmatch,
+			&founderror) != 0)
+		{
+			// loop through each file given in args, searching each
+			//  one and adding to the match and error counters
+			// stop early once stdout can no longer be written to,
+			//  or with the -q option once any line is selected
+			for(fidx=0; fidx<numfiles && mg_out.err == 0 &&
+				! (mg_mode == MODE_QUIET && foundmatch > 0);
+				fidx++)
+			{
+				grep_path(filenames[fidx],&scanner,&foundmatch,
+					&founderror);
 			}
 		}
 	}
+	// write out whatever is left in the output buffer
+	out_flush(&mg_out);
+	// if writing to stdout failed, print error - unless the reader just
+	//  closed the pipe early, which is not worth a message
+	if (mg_out.err != 0) {
+		if (mg_out.err != EPIPE) {
+			fprintf(stderr,"%s: error writing output: %s\n",
+				PROG_NAME,strerror(mg_out.err));
+		}
+		founderror++;
+	}
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
 	// END STREAM PROCESSING
@@ -321,14 +2298,35 @@ int main(int argc, char *argv[]) {
 	// free any allocated memory and exit with appropriate exit status
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
+#ifdef MG_STATS
+	// report the counters of every thread, the main thread's are added last
+	if (mg_statson) {
+		stats_merge();
+		stats_report(stats_now() - wallstart);
+	}
+#endif
 	// if not reading from stdin, assume that memory was allocated for array
 	//  of filenames, so free the memory
 	if (! readstdin) { free_str_arr(numfiles,filenames); }
+	// release the block buffer shared by all streams in the main thread,
+	//  the output buffer and the DFA
+	reader_free(&mg_reader);
+	free(mg_out.buff);
+	scanner_clear(&scanner);
+	// free the search strings from the options and their automaton
+	free_str_arr(plist.numbuffs,plist.buffs);
+	free(plist.pats);
+	free(plist.lens);
+	search_free(&pattern.srch);
+	index_close(&mg_index);
 	// return appropriate code based on if match was found or any errors
 	//  occurred
+	// with the -q option any selected line means success, even if there
+	//  were errors, because the search stopped as soon as it was found
+	if (mg_mode == MODE_QUIET && foundmatch>0) { return(R_MATCH); }
 	// if there are any errors, regardless of if there are any matches,
 	//  return with the error code
-	if (founderror>0) { return(R_ERROR); }
+	else if (founderror>0) { return(R_ERROR); }
 	// if there were no errors and some lines were matched, return with the
 	//  match code. this also includes any lines not matching when the '-v'
 	//  or '--invert-match' option is specified
@@ -344,6 +2342,7 @@ int main(int argc, char *argv[]) {
 	////////////////////////////////////////////////////////////////////////
 	////////////////////////////////////////////////////////////////////////
 }
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -351,185 +2350,9905 @@ int main(int argc, char *argv[]) {
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 // fpntr is an open file stream
-// string is the search string
+// sc is this thread's scanner, with the compiled search strings
 // file_pathname is the file path that was open, null if stdin
-// reads line-by-line through the file, matches lines based on the search
-//  string, prints them to stdout, returns true if any lines matched, false
-//  otherwise
+// reads through the file a block of whole lines at a time, matches lines based
+//  on the search string, prints them to stdout, returns the number of lines
+//  selected, or -1 on error
+// note: the stream is read through its underlying file descriptor in large
+//        blocks, so no stdio read functions may be used on it before or
+//        after this function is called
 // note: this function should always return, never calling exit()
-int grep_stream(FILE *fpntr, char *string, char *file_pathname) {
+long grep_stream(FILE *fpntr, struct mygrep_scanner *sc, char *file_pathname) {
 	// initialize match count to zero
 	// increments by 1 if line is matched
-	int matchcount = 0;
-	// string to store each line
-	char *line;
-	// char to peek ahead
-	char peek;
-	
-	// iteratively call function to get next line from the stream until the
-	//  end of the file is reached
-	while (feof(fpntr) == 0) {
-		// peek ahead one character
-		peek = fgetc(fpntr);
-		// if peeking didn't cause EOF, put character back
-		if (feof(fpntr) == 0) { ungetc(peek,fpntr); }
-		// if it did cause EOF, break out of loop, we are done
-		// this turns out to be necessary when inverse match option is
-		//  specified, otherwise last line of output will be blank line
-		//  because get_next_line function will try to read last char of
-		//  file, find it is a newline so it will not be added to the
-		//  buffer, but the null char will, making an empty string that
-		//  will be printed because it doesn't match the search string
-		else { break; }
-		// get next line from stream
-		// note: be aware that this function returns a pointer to a
-		//        buffer (char array) that may be larger than the
-		//        line. the buffer should contain the line as a null-
-		//        terminated string, so string operations should be
-		//        safe - however, be aware that there is likely other
-		//        data in the buffer beyond the end of the string, so
-		//        caution with non-string operations is indicated
-		line = get_next_line(fpntr);
-		// if there was a problem getting next line, print error and
-		//  return with negative error code to indicate problem to
-		//  calling function
-		if (line == NULL) {
-			fprintf(stderr,"%s: error reading line from file '%s': "
-				"%s\n",PROG_NAME,file_pathname,strerror(errno));
-			return(-1);
-		}
-		// for each returned line, check if it contains the search
-		//  string
-		if (strstr(line,string) != NULL) {
-			// if the line should be as normal match, print to
-			//  stdout
-			if (mg_invert != 1) {
-				// increment match count
+	long matchcount = 0;
+	// pointer to each run of whole lines inside the reader's block buffer
+	char *block;
+	// length of each run of lines, including the last line ending
+	size_t blocklen;
+	// return value of get_next_block
+	int status = 0;
+	// block-buffered reader for the stream
+	struct line_reader *rdr = &mg_reader;
+	// length of the longest search string
+	size_t overlap;
+	// the compiled search strings
+	struct searcher *srch = &sc->pat->srch;
+
+	// set up the reader on the file descriptor behind the stream
+	if (reader_init(rdr,fileno(fpntr)) != 0) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		mg_failed = TRUE;
+		return(-1);
+	}
+	// a line too long for the buffer is searched a part at a time when
+	//  nothing but the count of selected lines is needed, and the search
+	//  finds a string inside any part holding it - the parts overlap by
+	//  one byte less than the longest search string, so a match across
+	//  two parts is still found whole in one
+	rdr->partial = (mg_mode != MODE_PRINT &&
+		! (sc->pat->flags & MYGREP_INVERT) && ! srch->nevermatch &&
+		srch->find != NULL && srch->find != search_utf8_icase &&
+		mg_maxline == 0);
+	overlap = (srch->trans != NULL) ? (size_t) srch->maxlen : srch->len;
+	rdr->overlap = (overlap > 0) ? overlap - 1 : 0;
+	// iteratively call function to get next run of lines from the stream
+	//  until the end of the file is reached, and search the whole run at
+	//  once the same way as a mapped file
+	// note: be aware that the returned run is a view into the reader's
+	//        block buffer, not a copy - it is not null-terminated and is
+	//        only valid until the next call to get_next_block
+	// stop early if the output can no longer be written, or the -l or -q
+	//  option has found a selected line
+	mg_stop = FALSE;
+	mg_binary = FALSE;
+	mg_ctx.back = -1;
+	mg_ctx.pending = 0;
+	lines_reset(NULL);
+	while (mg_out.err == 0 && ! mg_stop) {
+		STATS_BEGIN(STAGE_SPLIT);
+		status = get_next_block(rdr,&block,&blocklen);
+		STATS_END(STAGE_SPLIT);
+		// a part of a long line only has to be found to hold a match,
+		//  the rest of the line is then skipped
+		if (status == 2) {
+			mg_binary = rdr->binary;
+			STATS_BEGIN(STAGE_MATCH);
+			if (scanner_find(sc,block,blocklen) != NULL) {
+				rdr->skipping = TRUE;
 				matchcount++;
-				// if more than one file specified, print
-				//  filename before matched line
-				if (mg_printfname) { printf("%s:%s\n",
-					file_pathname,line); }
-				// otherwise, just print matched line
-				else { printf("%s\n",line); }
+				if (mg_mode >= MODE_LIST) { mg_stop = TRUE; }
 			}
+			STATS_END(STAGE_MATCH);
+			continue;
 		}
-		// if line doesn't contain search string
-		else {
-			// print lines that do not match if the invert option
-			//  specified
-			if (mg_invert == 1) {
-				// increment match count
-				matchcount++;
-				// if more than one file specified, print
-				//  filename before non-matching line
-				if (mg_printfname) { printf("%s:%s\n",
-					file_pathname,line); }
-				// otherwise, just print non-matching line
-				else { printf("%s\n",line); }
-			}
+		if (status != 1) { break; }
+		// known once the first block is read
+		mg_binary = rdr->binary;
+		STATS_LINES(block,blocklen);
+		// with the -A, -B and -C options the lines before the run are
+		//  kept in the buffer to be printed as context
+		if (mg_context) { context_restore(rdr,block); }
+		// the line number and byte offset were counted up to the end
+		//  of the last run, where this one starts, after any bytes of
+		//  a cut line skipped since
+		mg_lines.offset += rdr->skipped;
+		rdr->skipped = 0;
+		mg_lines.at = block;
+		STATS_BEGIN(STAGE_MATCH);
+		matchcount += grep_region(block,blocklen,sc,file_pathname);
+		STATS_END(STAGE_MATCH);
+		if (mg_context) { context_keep(rdr,block); }
+		if (mg_lineno || mg_byteoff) { lines_seek(block+blocklen); }
+	}
+	// if there was a problem getting next block, print error once and
+	//  stop, keeping the lines selected before it - a decompression error
+	//  was already printed by the decompression thread
+	if (status == -1) {
+		if (rdr->pipe == NULL) {
+			fprintf(stderr,"%s: error reading line from file '%s': "
+				"%s\n",PROG_NAME,(file_pathname != NULL) ?
+				file_pathname : STDIN_NAME,strerror(errno));
 		}
-		// free allocated memory for this line
-		free(line);
+		mg_failed = TRUE;
 	}
-	// return true if any number of lines matched, false otherwise
-	if (matchcount > 0) { return(TRUE); }
-	else { return(FALSE); }
+	reader_report_cut(rdr,file_pathname);
+	return(matchcount);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-// get_next_line function
+// grep_file function
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 // fpntr is an open file stream
-// read the next line from a stream and return it as a string, returns NULL if
-//  an I/O error occurs or the end of the file is reached
-// note: the newline character is not considered part of the line and is
-//        therefore not returned by this function
-// note: this function should not print any error messages or other output and
-//        it must always return
-char *get_next_line(FILE *fpntr) {
-	// current size of the buffer
-	int buffsize = BUFF_SIZE;
-	// char array to store line to return initialized with current buffer
-	//  size
-	char *line = malloc((buffsize+1) * sizeof(char));
-	// return null from the function if malloc fails
-	if (line == NULL) { return(NULL); }
-	// int to store each char returned from stream
-	int currchar;
-	// counter for place in buffer
-	int count = 0;
-
-	// iteratively call fgetc() to obtain the next character from
-	//  stream until the end of the current line is detected, the end of the
-	//  file is reached, or error occurs when reading
-	// note that fgetc() has an int return type due to the possibility
-	//  of errors or EOF (normally -1) - the difference can be
-	//  distinguished using ferror() or feof() or even errno
-	// this function can handle three types of line ending: "\n", "\r", or
-	//  "\r\n"
-	while ((currchar = fgetc(fpntr)) != (int) '\n' &&
-		currchar != (int) '\r' && feof(fpntr) == 0 &&
-		ferror(fpntr) == 0)
-	{
-		// if the buffer size has been reached, increase the size of the
-		//  buffer and then add the char
-		if ((count+1) == buffsize) {
-			// double the buffer size
-			buffsize *= 2;
-			// reallocate memory up to the new buffer size
-			char *temp = realloc(line, (buffsize+1));
-			// return null from the function if realloc fails
-			if (temp == NULL) { return(NULL); }
-			// otherwise, set the buffer pointer to the newly
-			//  allocated space
-			else { line = temp; }
-			// put the returned char (after typecasting) at the next
-			//  position in the buffer
-			line[count] = (char) currchar;
-		}
-		// otherwise, just add the char to the buffer
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path that was open
+// memory maps the file and searches the mapping with grep_region if it is a
+//  regular file of at least MMAP_MIN_SIZE bytes, otherwise (pipes, special
+//  files, small files, or if mapping fails) falls back to grep_stream
+// a gzip or zstd file is decompressed while it is searched instead, see
+//  grep_compressed
+// returns the number of lines selected, or -1 on error
+// note: the mapping covers the size of the file when it was opened - data
+//        appended while it is searched is ignored, and if the file is
+//        truncated the SIGBUS signal is caught and an error is returned
+// note: this function should always return, never calling exit()
+long grep_file(FILE *fpntr, struct mygrep_scanner *sc, char *file_pathname) {
+	// file descriptor behind the stream
+	int fd = fileno(fpntr);
+	// file status from fstat()
+	struct stat st;
+	// start of the mapped file
+	char *data;
+	// size of the mapped file
+	size_t size;
+	// number of lines selected in the mapping, or -1 on error
+	long grepreturn;
+	// compression format found at the start of the file
+	int type;
+
+	mg_binary = FALSE;
+	// a compressed file is found by its first bytes, before it is mapped
+	type = compress_type(fd);
+	if (type != COMP_NONE) {
+		return(grep_compressed(fpntr,sc,file_pathname,type));
+	}
+	// only regular files can be mapped safely
+	if (fstat(fd,&st) != 0 || ! S_ISREG(st.st_mode) ||
+		st.st_size < MMAP_MIN_SIZE)
+	{
+		return(grep_stream(fpntr,sc,file_pathname));
+	}
+	size = st.st_size;
+	// the blocks found by the index lie inside the file as it was indexed
+	if (mg_hits.on && size != mg_hits.size) { mg_hits.on = FALSE; }
+	// map the whole file read only, falling back to streaming on failure
+	STATS_BEGIN(STAGE_READ);
+	data = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+	STATS_END(STAGE_READ);
+	if (data == MAP_FAILED) {
+		return(grep_stream(fpntr,sc,file_pathname));
+	}
+	// the mapping is read from front to back, so ask the kernel to read
+	//  ahead aggressively - this is only a hint, so failure is ignored
+	//  (with the index only a few blocks are read, and read ahead would
+	//  read the rest too)
+	if (! mg_hits.on) {
+		STATS_ADD(bytes,size);
+		madvise(data,size,MADV_SEQUENTIAL);
+	}
+	// the first block decides whether the file is binary, the same as for
+	//  a stream
+	if (! mg_text) {
+		mg_binary = data_binary(data,size);
+	}
+	// SIGBUS is raised on access to pages past the end of a file that was
+	//  truncated after it was mapped, the handler installed by main()
+	//  jumps back here while the flag is set
+	if (sigsetjmp(mg_sigbus_jmp,1) == 0) {
+		mg_in_mapping = 1;
+		// with the --index option only the blocks that may hold a
+		//  match are searched
+		if (mg_hits.on) {
+			grepreturn = grep_hits(data,size,sc,file_pathname);
+		}
+		// a file of more than one chunk is searched by the worker
+		//  threads if the -j option was given for a single file -
+		//  unless it is binary, which only needs one selected line
+		else if (mg_chunkjobs > 1 && size > CHUNK_SIZE && ! mg_binary) {
+			mg_in_mapping = 0;
+			grepreturn = grep_chunked(data,size,sc,file_pathname,
+				mg_chunkjobs);
+		}
 		else {
-			// put the returned char (after typecasting) at the next
-			//  position in the buffer
-			line[count] = (char) currchar;
+			// runs of selected lines may be spliced from the file
+			mg_out.mapbase = data;
+			mg_out.mapfd = fd;
+			grepreturn = grep_memory(data,size,sc,file_pathname);
 		}
-		// increment the buffer position counter
-		count++;
 	}
-	// if there was an error, return null from function
-	if (ferror(fpntr) != 0 ) { return(NULL); }
-	// deal with windows line ending, carriage return and line feed (\r\n)
-	//  by getting next char but not adding  it to the buffer if it is a
-	//  '\n' - if it is not '\n', put it back
-	if (currchar == '\r' && (currchar = fgetc(fpntr)) != (int) '\n') {
-		ungetc(currchar,fpntr);
+	// the handler jumped back here, the file shrank while being read
+	else {
+		STATS_END(STAGE_MATCH);
+		fprintf(stderr,"%s: file '%s' was truncated while being read"
+			"\n",PROG_NAME,file_pathname);
+		mg_failed = TRUE;
+		grepreturn = -1;
+	}
+	mg_in_mapping = 0;
+	// runs of the mapping may still be listed to be written
+	if (mg_out.iovcnt > 0) { out_flush(&mg_out); }
+	mg_out.mapbase = NULL;
+	mg_out.mapfd = -1;
+	// release the mapping
+	if (munmap(data,size) != 0) {
+		fprintf(stderr,"%s: file '%s' failed to unmap: %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+		mg_failed = TRUE;
+		return(-1);
 	}
-	// stringify the buffer by adding null char at the end of the chars
-	line[count] = '\0';
-	// return next line in the stream as a string
-	return(line);
+	return(grepreturn);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-// free_str_arr function
+// grep_compressed function
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-// size is number of elements in string array
-// arr is the string array
-// frees allocated memory for a string array
-void free_str_arr(int size, char **arr) {
-	int idx;
-	for (idx=0; idx < size; idx++) {
-		free(arr[idx]);
+// fpntr is an open file stream
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path that was open
+// type is the compression format of the file from compress_type
+// starts a thread decompressing the file and searches the decompressed data as
+//  it arrives with grep_stream, returns the number of lines selected, or -1 on
+//  error
+// note: the decompression thread is stopped as soon as the search is, so the
+//        -l and -q options do not decompress the rest of the file
+// note: this function should always return, never calling exit()
+long grep_compressed(FILE *fpntr, struct mygrep_scanner *sc,
+	char *file_pathname, int type)
+{
+	// the decompression thread and its blocks
+	struct decomp_pipe dp;
+	// number of lines selected, or -1 on error
+	long grepreturn;
+	// errno from the search, kept while the thread is stopped
+	int saved;
+
+	if (decomp_open(&dp,fileno(fpntr),type,file_pathname) != 0) {
+		fprintf(stderr,"%s: file '%s' could not be decompressed: %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+		mg_failed = TRUE;
+		return(-1);
 	}
-	free(arr);
+	// the reader takes its data from the thread until the file is done
+	mg_reader.pipe = &dp;
+	grepreturn = grep_stream(fpntr,sc,file_pathname);
+	mg_reader.pipe = NULL;
+	saved = errno;
+	decomp_close(&dp);
+	errno = saved;
+	return(grepreturn);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_hits function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of the mapped file
+// size is the size of the mapping
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path that was open
+// searches only the blocks of the file in mg_hits, the ones the index found
+//  may hold a match, with grep_region - blocks next to each other are
+//  searched as one run - returns the number of lines selected
+// note: every block is a run of whole lines, so the lines selected are the
+//        same as if the whole file were searched
+long grep_hits(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname)
+{
+	// number of lines selected
+	long matchcount = 0;
+	// index of the first and last candidate of each run
+	size_t first, last;
+	// block number in the file of the last candidate of the run
+	uint32_t block;
+	// offsets of the start and end of the run
+	uint64_t start, end;
+
+	mg_stop = FALSE;
+	mg_ctx.floor = data;
+	mg_ctx.printed = NULL;
+	mg_ctx.pending = 0;
+	lines_reset(data);
+	for (first=0; first<mg_hits.numcand && mg_out.err == 0 && ! mg_stop;
+		first=last+1)
+	{
+		last = first;
+		while (last+1 < mg_hits.numcand &&
+			mg_hits.cand[last+1] == mg_hits.cand[last] + 1)
+		{
+			last++;
+		}
+		start = mg_hits.blocks[mg_hits.cand[first] - mg_hits.first];
+		block = mg_hits.cand[last] - mg_hits.first;
+		end = (block+1 < mg_hits.numblocks) ? mg_hits.blocks[block+1] :
+			size;
+		STATS_ADD(bytes,end - start);
+		STATS_BEGIN(STAGE_MATCH);
+		matchcount += grep_region(data + start,end - start,sc,
+			file_pathname);
+		STATS_END(STAGE_MATCH);
+		STATS_LINES(data + start,end - start);
+	}
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_follow function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// filenames is the array of file paths from args
+// numfiles is the number of file paths
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented for each file with selected lines
+// founderror is incremented for each error
+// searches what the files already hold, then waits with inotify for more to be
+//  written to them and searches only the new lines, for the --follow option -
+//  runs until it is killed, the output can no longer be written, the -q option
+//  selects a line, or the -l option has listed every file
+// returns 0, or -1 if the files could not be set up to be followed
+// note: a file that is replaced, as when logs are rotated, is followed under
+//        its path - the rest of the old file is searched first - and a file
+//        that shrinks is searched again from the start, as when a log is
+//        truncated in place
+// note: the files are also checked every FOLLOW_POLL_MS milliseconds, so
+//        they are still followed where inotify is not available
+int grep_follow(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror)
+{
+	// the files followed
+	struct follow_file *files;
+	// inotify instance woken by writes to the files, or -1 if there is none
+	int notifyfd;
+	// events read from the inotify instance, which are not looked at -
+	//  every file is checked after any event
+	char events[FOLLOW_EVENTS]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	// inotify instance waited on
+	struct pollfd pfd;
+	// index of the file
+	int fidx;
+	// number of files still followed
+	int active;
+
+	files = calloc(numfiles,sizeof(struct follow_file));
+	if (files == NULL) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		return(-1);
+	}
+	notifyfd = inotify_init1(IN_CLOEXEC|IN_NONBLOCK);
+	if (notifyfd == -1) {
+		fprintf(stderr,"%s: inotify is not available, checking files "
+			"every %d ms: %s\n",PROG_NAME,FOLLOW_POLL_MS,
+			strerror(errno));
+	}
+	for (fidx=0; fidx<numfiles; fidx++) {
+		files[fidx].path = filenames[fidx];
+		files[fidx].fd = -1;
+		files[fidx].wd = -1;
+		files[fidx].dirwd = (notifyfd == -1) ? -1 :
+			follow_watch_dir(notifyfd,filenames[fidx]);
+		if (follow_open(&files[fidx],notifyfd) != 0) {
+			(*founderror)++;
+		}
+	}
+	// the first check searches everything the files already hold
+	do {
+		active = 0;
+		for (fidx=0; fidx<numfiles && mg_out.err == 0 &&
+			! (mg_mode == MODE_QUIET && *foundmatch > 0); fidx++)
+		{
+			if (files[fidx].done) { continue; }
+			follow_check(&files[fidx],sc,notifyfd,foundmatch,
+				founderror);
+			if (! files[fidx].done) { active++; }
+		}
+		// selected lines are written out as soon as they are found
+		out_flush(&mg_out);
+		if (active == 0 || mg_out.err != 0 ||
+			(mg_mode == MODE_QUIET && *foundmatch > 0))
+		{
+			break;
+		}
+		// wait for a write to any file, or for the next check, then
+		//  drain the events
+		pfd.fd = notifyfd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd,(notifyfd != -1) ? 1 : 0,FOLLOW_POLL_MS) > 0 &&
+			(pfd.revents & POLLIN))
+		{
+			while (read(notifyfd,events,sizeof(events)) > 0) { }
+		}
+	} while (TRUE);
+	for (fidx=0; fidx<numfiles; fidx++) {
+		if (files[fidx].fd != -1) { close(files[fidx].fd); }
+		reader_free(&files[fidx].rdr);
+	}
+	if (notifyfd != -1) { close(notifyfd); }
+	free(files);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// follow_watch_dir function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// notifyfd is the inotify instance
+// path is the path of a file followed
+// watches the directory holding the file for files created or moved into it,
+//  so a file that is replaced is found at once, returns the watch descriptor,
+//  or -1 if the directory could not be watched
+int follow_watch_dir(int notifyfd, char *path) {
+	// copy of the path, cut at its last '/'
+	char *dir;
+	// last '/' of the path
+	char *slash = strrchr(path,'/');
+	// watch descriptor
+	int wd;
+
+	if (slash == NULL) {
+		return(inotify_add_watch(notifyfd,".",IN_CREATE|IN_MOVED_TO));
+	}
+	dir = strdup(path);
+	if (dir == NULL) { return(-1); }
+	// a file in the root directory keeps its '/'
+	dir[(slash == path) ? 1 : slash - path] = '\0';
+	wd = inotify_add_watch(notifyfd,dir,IN_CREATE|IN_MOVED_TO);
+	free(dir);
+	return(wd);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// follow_open function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// ff is a file followed that is not open
+// notifyfd is the inotify instance, or -1 if there is none
+// opens the file under its path, sets up its reader to be searched from the
+//  start, and watches it for writes, returns 0 on success or -1 if the file
+//  could not be opened, which is printed to stderr the first time it happens
+int follow_open(struct follow_file *ff, int notifyfd) {
+	// file status from fstat()
+	struct stat st;
+	// errno from fstat(), kept while the file is closed
+	int saved;
+
+	ff->fd = open(ff->path,O_RDONLY|O_CLOEXEC);
+	if (ff->fd != -1 && fstat(ff->fd,&st) != 0) {
+		saved = errno;
+		close(ff->fd);
+		ff->fd = -1;
+		errno = saved;
+	}
+	if (ff->fd == -1) {
+		// a missing file is waited for, so it is only reported once
+		if (! ff->missing) {
+			if (errno == ENOENT) {
+				fprintf(stderr,"%s: file '%s' does not exist: "
+					"%s\n",PROG_NAME,ff->path,
+					strerror(errno));
+			}
+			else if (errno == EACCES) {
+				fprintf(stderr,"%s: file '%s' is not readable: "
+					"%s\n",PROG_NAME,ff->path,
+					strerror(errno));
+			}
+			else {
+				fprintf(stderr,"%s: file '%s' failed to open: "
+					"%s\n",PROG_NAME,ff->path,
+					strerror(errno));
+			}
+		}
+		ff->missing = TRUE;
+		return(-1);
+	}
+	ff->missing = FALSE;
+	ff->dev = st.st_dev;
+	ff->ino = st.st_ino;
+	if (reader_init(&ff->rdr,ff->fd) != 0) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		close(ff->fd);
+		ff->fd = -1;
+		ff->done = TRUE;
+		return(-1);
+	}
+	ff->rdr.follow = TRUE;
+	ff->ctx.back = -1;
+	ff->ctx.pending = 0;
+	ff->lines.lineno = 1;
+	ff->lines.offset = 0;
+	if (notifyfd != -1) {
+		ff->wd = inotify_add_watch(notifyfd,ff->path,IN_MODIFY|
+			IN_ATTRIB|IN_MOVE_SELF|IN_DELETE_SELF);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// follow_check function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// ff is a file followed
+// sc is this thread's scanner, with the compiled search strings
+// notifyfd is the inotify instance, or -1 if there is none
+// foundmatch is incremented if the file has its first selected lines
+// founderror is incremented for each error
+// searches the lines written to the file since it was last checked, starting
+//  again from the start if the file shrank, then opens the file now under its
+//  path if it was replaced or did not exist, and searches that
+void follow_check(struct follow_file *ff, struct mygrep_scanner *sc,
+	int notifyfd, int *foundmatch, int *founderror)
+{
+	// file status from fstat() and stat()
+	struct stat st;
+	// offset the file has been read up to
+	off_t pos;
+
+	if (ff->fd != -1) {
+		pos = lseek(ff->fd,0,SEEK_CUR);
+		if (pos != -1 && fstat(ff->fd,&st) == 0 && st.st_size < pos &&
+			S_ISREG(st.st_mode))
+		{
+			fprintf(stderr,"%s: file '%s' was truncated, searching "
+				"it from the start\n",PROG_NAME,ff->path);
+			if (lseek(ff->fd,0,SEEK_SET) == 0) {
+				reader_init(&ff->rdr,ff->fd);
+				ff->ctx.back = -1;
+				ff->ctx.pending = 0;
+				ff->lines.lineno = 1;
+				ff->lines.offset = 0;
+			}
+		}
+		follow_scan(ff,sc,foundmatch,founderror);
+	}
+	if (ff->done || stat(ff->path,&st) != 0 || (ff->fd != -1 &&
+		st.st_dev == ff->dev && st.st_ino == ff->ino))
+	{
+		return;
+	}
+	// the file under the path is a new one, the old one was searched to
+	//  its end above
+	if (ff->fd != -1) {
+		fprintf(stderr,"%s: file '%s' was replaced, following the new "
+			"file\n",PROG_NAME,ff->path);
+		close(ff->fd);
+		ff->fd = -1;
+		if (ff->wd != -1) { inotify_rm_watch(notifyfd,ff->wd); }
+		ff->wd = -1;
+	}
+	if (follow_open(ff,notifyfd) == 0) {
+		follow_scan(ff,sc,foundmatch,founderror);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// follow_scan function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// ff is a file followed that is open
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented if the file has its first selected lines
+// founderror is incremented for each error
+// searches the whole lines read from the file up to its end with grep_region,
+//  the same way as grep_stream, keeping an unfinished last line, and the lines
+//  kept for the -B option, in the reader for the next time
+// note: the file stops being followed once the -l option has listed it, it is
+//        reported as a binary file that matches, or a read fails
+void follow_scan(struct follow_file *ff, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror)
+{
+	// number of lines selected
+	long matchcount = 0;
+	// pointer to each run of whole lines inside the reader's block buffer
+	char *block;
+	// length of each run of lines, including the last line ending
+	size_t blocklen;
+	// return value of get_next_block
+	int status = 0;
+	// the thread's flag for lines printed to its output, kept while the
+	//  file's own context state is used
+	int any = mg_ctx.any;
+
+	mg_ctx = ff->ctx;
+	mg_ctx.any = any;
+	mg_lines = ff->lines;
+	// the end of the file was reached last time, more may be there now
+	ff->rdr.eof = FALSE;
+	mg_stop = FALSE;
+	mg_binary = FALSE;
+	while (mg_out.err == 0 && ! mg_stop) {
+		STATS_BEGIN(STAGE_SPLIT);
+		status = get_next_block(&ff->rdr,&block,&blocklen);
+		STATS_END(STAGE_SPLIT);
+		if (status != 1) { break; }
+		mg_binary = ff->rdr.binary;
+		STATS_LINES(block,blocklen);
+		if (mg_context) { context_restore(&ff->rdr,block); }
+		mg_lines.offset += ff->rdr.skipped;
+		ff->rdr.skipped = 0;
+		mg_lines.at = block;
+		STATS_BEGIN(STAGE_MATCH);
+		matchcount += grep_region(block,blocklen,sc,ff->path);
+		STATS_END(STAGE_MATCH);
+		if (mg_context) { context_keep(&ff->rdr,block); }
+		if (mg_lineno || mg_byteoff) { lines_seek(block+blocklen); }
+	}
+	ff->ctx = mg_ctx;
+	ff->lines = mg_lines;
+	reader_report_cut(&ff->rdr,ff->path);
+	if (status == -1) {
+		fprintf(stderr,"%s: error reading line from file '%s': %s\n",
+			PROG_NAME,ff->path,strerror(errno));
+		(*founderror)++;
+		ff->done = TRUE;
+		return;
+	}
+	if (matchcount > 0 && ! ff->matched) {
+		ff->matched = TRUE;
+		(*foundmatch)++;
+	}
+	// the -l option lists the file once, and so does a binary file, the
+	//  -q option needs nothing more
+	if ((mg_mode == MODE_LIST || (mg_binary && mg_mode == MODE_PRINT)) &&
+		matchcount > 0)
+	{
+		print_result(ff->path,matchcount);
+		ff->done = TRUE;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// compress_type function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fd is the file descriptor of an open file
+// checks the magic bytes at the start of the file without moving the file
+//  position, returns COMP_GZIP or COMP_ZSTD for a compressed file whose format
+//  the program was built with, or COMP_NONE otherwise
+// note: a stream that cannot be read with pread(), such as a pipe, is never
+//        found to be compressed
+int compress_type(int fd) {
+	// first bytes of the file
+	unsigned char magic[4];
+	// number of bytes read
+	ssize_t nread;
+
+	nread = pread(fd,magic,sizeof(magic),0);
+	if (nread < 2) { return(COMP_NONE); }
+#ifdef MG_ZLIB
+	if (magic[0] == 0x1f && magic[1] == 0x8b) {
+		return(COMP_GZIP);
+	}
+#endif
+#ifdef MG_ZSTD
+	if (nread == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+		magic[2] == 0x2f && magic[3] == 0xfd)
+	{
+		return(COMP_ZSTD);
+	}
+#endif
+	return(COMP_NONE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_path function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// file_pathname is the path of the file to search
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented if any lines in the file matched
+// founderror is incremented for each error with the file
+// opens the file, searches it with grep_file and closes it again, printing any
+//  errors to stderr, and the count or name of the file if the -c or -l
+//  option asked for it
+// with the -r option, a binary file is skipped
+// note: this function should always return, never calling exit()
+void grep_path(char *file_pathname, struct mygrep_scanner *sc, int *foundmatch,
+	int *founderror)
+{
+	// file handle for open file
+	FILE *fileh;
+
+	// open the file for reading only
+	fileh = fopen(file_pathname,"r");
+	// if there is a problem opening, skip the file - the reason is taken
+	//  from errno, so the file is not checked with access() beforehand
+	if ( fileh == NULL) {
+		print_open_error(file_pathname);
+		// increment error counter
+		(*founderror)++;
+		return;
+	}
+	grep_handle(fileh,file_pathname,sc,foundmatch,founderror);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_handle function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fileh is the file opened from the path
+// file_pathname is the path of the file to search
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented if any lines in the file matched
+// founderror is incremented for each error with the file
+// searches the open file with grep_file and closes it, the rest of grep_path
+// note: this function should always return, never calling exit()
+void grep_handle(FILE *fileh, char *file_pathname, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror)
+{
+	// return value of grep_file
+	long grepreturn;
+
+	// with the --index option only the blocks of an unchanged file that
+	//  may hold a match are searched
+	mg_hits.on = (mg_index.map != NULL && ! mg_index.all &&
+		index_file_hits(&mg_index,file_pathname,fileno(fileh)) == 0);
+	// with the -r option binary files are skipped without a message - a
+	//  file found in the index was not binary when it was indexed
+	if (mg_skipbinary && ! mg_hits.on && is_binary(fileno(fileh))) {
+		mg_hits.on = FALSE;
+		fclose(fileh);
+		return;
+	}
+	// look for string match in file, memory mapping it if it is a large
+	//  regular file - a file with no blocks that may hold a match is not
+	//  read at all
+	STATS_FILE_BEGIN();
+	mg_failed = FALSE;
+	if (mg_hits.on && mg_hits.numcand == 0) { grepreturn = 0; }
+	else { grepreturn = grep_file(fileh,sc,file_pathname); }
+	mg_hits.on = FALSE;
+	// an error that stopped the search was printed where it happened
+	if (mg_failed) { (*founderror)++; }
+	// if error in grep, print error
+	else if (grepreturn == -1) {
+		fprintf(stderr,"%s: problem finding match in file '%s': %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+		// increment error counter
+		(*founderror)++;
+	}
+	// print the count or name if asked for and add to match counter,
+	//  for the lines selected before any error too
+	if (grepreturn != -1) {
+		print_result(file_pathname,grepreturn);
+		if (grepreturn > 0) { (*foundmatch)++; }
+	}
+	// close the file, printing error if unsuccessful
+	if (fclose(fileh) != 0) {
+		fprintf(stderr,"%s: file '%s' failed to close: %s\n",PROG_NAME,
+			file_pathname,strerror(errno));
+		// increment error counter
+		(*founderror)++;
+	}
+	STATS_FILE_END(file_pathname,grepreturn);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_open_error function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// file_pathname is the path of a file that failed to open
+// prints why the file could not be opened to stderr, taking the reason from
+//  errno
+void print_open_error(char *file_pathname) {
+	if (errno == ENOENT) {
+		fprintf(stderr,"%s: file '%s' does not exist: %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+	}
+	else if (errno == EACCES) {
+		fprintf(stderr,"%s: file '%s' is not readable: %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+	}
+	else {
+		fprintf(stderr,"%s: file '%s' failed to open: %s\n",
+			PROG_NAME,file_pathname,strerror(errno));
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_memory function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a whole file in memory, mapped or read
+// size is the size of the file
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path, printed before each selected line when
+//  several files are searched, and in the "Binary file X matches" line
+// searches every line of the file with grep_region, all of them available as
+//  context, returns the number of lines selected
+// note: mg_binary must already be set for the file
+long grep_memory(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname)
+{
+	// number of lines selected
+	long grepreturn;
+
+	mg_stop = FALSE;
+	// every line of the file is available as context
+	mg_ctx.floor = data;
+	mg_ctx.printed = NULL;
+	mg_ctx.pending = 0;
+	lines_reset(data);
+	STATS_BEGIN(STAGE_MATCH);
+	grepreturn = grep_region(data,size,sc,file_pathname);
+	STATS_END(STAGE_MATCH);
+	// counted after the search, which pages the file in
+	STATS_LINES(data,size);
+	return(grepreturn);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_prefetch function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// filenames is the array of file paths from args
+// numfiles is the number of file paths
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented for each file where any lines matched
+// founderror is incremented for each error with a file
+// searches the files in order, one at a time, while the read-ahead pipeline
+//  opens the next PREFETCH_DEPTH files and reads them into its buffers, so
+//  the disk is kept busy with several files while each one is searched,
+//  returns 0, or -1 if the pipeline could not be started
+// note: the output, and the errors, come out exactly as from grep_path
+int grep_prefetch(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int *foundmatch, int *founderror)
+{
+	// the read-ahead pipeline
+	struct prefetch pf;
+	// the file to search next
+	struct prefetch_slot *slot;
+	// index of the file
+	int fidx;
+
+	if (prefetch_start(&pf,filenames,numfiles) != 0) { return(-1); }
+	// stop early the same way as the loop over grep_path in main()
+	for (fidx=0; fidx<numfiles && mg_out.err == 0 &&
+		! (mg_mode == MODE_QUIET && *foundmatch > 0); fidx++)
+	{
+		STATS_BEGIN(STAGE_READ);
+		slot = prefetch_next(&pf);
+		STATS_END(STAGE_READ);
+		// a file the pipeline can no longer open is opened here
+		if (slot == NULL) {
+			grep_path(filenames[fidx],sc,foundmatch,founderror);
+		}
+		else {
+			grep_prefetched(slot,filenames[fidx],sc,foundmatch,
+				founderror);
+		}
+		prefetch_done(&pf);
+	}
+	prefetch_stop(&pf);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_prefetched function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// slot is a file of the read-ahead pipeline that is ready to be searched
+// file_pathname is the path of the file
+// sc is this thread's scanner, with the compiled search strings
+// foundmatch is incremented if any lines in the file matched
+// founderror is incremented for each error with the file
+// searches a file read whole into the slot's buffer in place, or else hands
+//  the open file to grep_handle, which searches it as grep_path does, and
+//  closes it
+// note: this function should always return, never calling exit()
+void grep_prefetched(struct prefetch_slot *slot, char *file_pathname,
+	struct mygrep_scanner *sc, int *foundmatch, int *founderror)
+{
+	// file handle for a file that was not read whole
+	FILE *fileh;
+	// number of lines selected
+	long grepreturn;
+
+	if (slot->fd == -1) {
+		errno = slot->err;
+		print_open_error(file_pathname);
+		(*founderror)++;
+		return;
+	}
+	// a file that is large, empty or not a regular file, that changed size
+	//  while it was read, or that failed to read is searched from the
+	//  start, as is a compressed file, which needs decompressing
+	if (slot->len == -1 || slot->len != slot->size ||
+		compress_type(slot->fd) != COMP_NONE)
+	{
+		fileh = fdopen(slot->fd,"r");
+		if (fileh == NULL) {
+			fprintf(stderr,"%s: file '%s' failed to open: %s\n",
+				PROG_NAME,file_pathname,strerror(errno));
+			close(slot->fd);
+			slot->fd = -1;
+			(*founderror)++;
+			return;
+		}
+		slot->fd = -1;
+		grep_handle(fileh,file_pathname,sc,foundmatch,founderror);
+		return;
+	}
+	STATS_FILE_BEGIN();
+	STATS_ADD(reads,1);
+	STATS_ADD(bytes,slot->len);
+	// the whole file is smaller than the first block of a stream, which
+	//  decides whether it is binary
+	mg_binary = (! mg_text && data_binary(slot->buff,slot->len));
+	grepreturn = grep_memory(slot->buff,slot->len,sc,file_pathname);
+	print_result(file_pathname,grepreturn);
+	if (grepreturn > 0) { (*foundmatch)++; }
+	if (close(slot->fd) != 0) {
+		fprintf(stderr,"%s: file '%s' failed to close: %s\n",PROG_NAME,
+			file_pathname,strerror(errno));
+		(*founderror)++;
+	}
+	slot->fd = -1;
+	STATS_FILE_END(file_pathname,grepreturn);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_start function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is the read-ahead pipeline to start
+// filenames is the array of file paths to read ahead
+// numfiles is the number of file paths
+// sets up an io_uring instance for the pipeline, or if there is none, starts
+//  the read-ahead thread, returns 0 on success or -1 on failure
+int prefetch_start(struct prefetch *pf, char **filenames, int numfiles) {
+	// index of the slot
+	int sidx;
+	// return value of pthread_create
+	int ret;
+
+	memset(pf,0,sizeof(struct prefetch));
+	pf->filenames = filenames;
+	pf->numfiles = numfiles;
+	pf->ringfd = -1;
+	for (sidx=0; sidx<PREFETCH_DEPTH; sidx++) {
+		pf->slots[sidx].fd = -1;
+	}
+#ifdef MG_URING
+	// the kernel may be too old for io_uring, or it may be turned off
+	if (prefetch_ring_init(pf) == 0) { return(0); }
+#endif
+	pthread_mutex_init(&pf->lock,NULL);
+	pthread_cond_init(&pf->readycond,NULL);
+	pthread_cond_init(&pf->freecond,NULL);
+	ret = pthread_create(&pf->thread,NULL,prefetch_thread,pf);
+	if (ret != 0) {
+		fprintf(stderr,"%s: error starting thread: %s\n",PROG_NAME,
+			strerror(ret));
+		pthread_cond_destroy(&pf->freecond);
+		pthread_cond_destroy(&pf->readycond);
+		pthread_mutex_destroy(&pf->lock);
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_next function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a started read-ahead pipeline
+// waits for the next file to be opened, and read if it is small, and returns
+//  its slot, after queuing the opens of the files up to PREFETCH_DEPTH ahead,
+//  or returns null if the io_uring instance failed before the file was opened,
+//  for the caller to open it itself
+// note: the slot is the caller's until prefetch_done is called, and the caller
+//        takes over its file descriptor
+struct prefetch_slot *prefetch_next(struct prefetch *pf) {
+	// the slot of the next file
+	struct prefetch_slot *slot = &pf->slots[pf->next % PREFETCH_DEPTH];
+#ifdef MG_URING
+	// boolean flag set to wait for a completion
+	int wait;
+
+	if (pf->ringfd != -1) {
+		while (! pf->broken && pf->opened < pf->numfiles &&
+			pf->opened < pf->next + PREFETCH_DEPTH &&
+			prefetch_ring_queue(pf,pf->opened) == 0)
+		{
+			pf->opened++;
+		}
+		// hand the queued operations to the kernel, waiting for
+		//  completions until the next file is ready
+		while (! pf->broken) {
+			wait = (slot->state != PREFETCH_READY);
+			if (prefetch_ring_enter(pf,wait) != 0) {
+				fprintf(stderr,"%s: io_uring failed, opening "
+					"the rest of the files one at a time: "
+					"%s\n",PROG_NAME,strerror(errno));
+				prefetch_ring_abandon(pf);
+				break;
+			}
+			prefetch_ring_reap(pf);
+			if (slot->state == PREFETCH_READY) { break; }
+		}
+		return((slot->state == PREFETCH_READY) ? slot : NULL);
+	}
+#endif
+	pthread_mutex_lock(&pf->lock);
+	while (slot->state != PREFETCH_READY) {
+		pthread_cond_wait(&pf->readycond,&pf->lock);
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return(slot);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_done function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a started read-ahead pipeline
+// frees the slot of the file returned by prefetch_next for a later file
+void prefetch_done(struct prefetch *pf) {
+	// the slot of the file searched
+	struct prefetch_slot *slot = &pf->slots[pf->next % PREFETCH_DEPTH];
+
+	if (pf->ringfd != -1) {
+		slot->state = PREFETCH_FREE;
+		pf->next++;
+		return;
+	}
+	pthread_mutex_lock(&pf->lock);
+	slot->state = PREFETCH_FREE;
+	pf->next++;
+	pthread_cond_signal(&pf->freecond);
+	pthread_mutex_unlock(&pf->lock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_stop function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a started read-ahead pipeline
+// stops reading ahead, waiting for the reads still going on, and closes the
+//  files opened ahead that were not searched
+void prefetch_stop(struct prefetch *pf) {
+	// index of the slot
+	int sidx;
+
+	if (pf->ringfd != -1) {
+#ifdef MG_URING
+		// the kernel may still be writing into the buffers
+		pf->quit = TRUE;
+		while (! pf->broken && pf->inflight > 0) {
+			if (prefetch_ring_enter(pf,TRUE) != 0) {
+				prefetch_ring_abandon(pf);
+				break;
+			}
+			prefetch_ring_reap(pf);
+		}
+		prefetch_ring_free(pf);
+#endif
+	}
+	else {
+		pthread_mutex_lock(&pf->lock);
+		pf->quit = TRUE;
+		pthread_cond_signal(&pf->freecond);
+		pthread_mutex_unlock(&pf->lock);
+		pthread_join(pf->thread,NULL);
+		pthread_cond_destroy(&pf->freecond);
+		pthread_cond_destroy(&pf->readycond);
+		pthread_mutex_destroy(&pf->lock);
+	}
+	for (sidx=0; sidx<PREFETCH_DEPTH; sidx++) {
+		if (pf->slots[sidx].fd != -1) { close(pf->slots[sidx].fd); }
+		free(pf->slots[sidx].buff);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_opened function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// slot is a file of the read-ahead pipeline that was just opened
+// finds the size of the file, returns TRUE if it is a regular file small
+//  enough to be read whole into the slot's buffer, otherwise FALSE, after
+//  asking the kernel to read a larger file ahead
+// note: nothing is read from a file that is not regular, such as a pipe,
+//        since it cannot be read again from the start
+int prefetch_opened(struct prefetch_slot *slot) {
+	// file status from fstat()
+	struct stat st;
+
+	slot->len = -1;
+	slot->size = -1;
+	if (fstat(slot->fd,&st) != 0 || ! S_ISREG(st.st_mode)) {
+		return(FALSE);
+	}
+	slot->size = st.st_size;
+	// a file of size 0 may still have data, as in /proc
+	if (st.st_size == 0) { return(FALSE); }
+	if (st.st_size > PREFETCH_BUFF) {
+		// this is only a hint, so failure is ignored
+		posix_fadvise(slot->fd,0,0,POSIX_FADV_WILLNEED);
+		return(FALSE);
+	}
+	if (slot->buff == NULL) {
+		slot->buff = malloc(PREFETCH_BUFF);
+		if (slot->buff == NULL) { return(FALSE); }
+	}
+	return(TRUE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_thread function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// arg is the read-ahead pipeline, used when there is no io_uring instance
+// opens the files up to PREFETCH_DEPTH ahead of the one being searched, asking
+//  the kernel to read each one ahead with posix_fadvise() as it is opened, so
+//  several are read from disk at once, and reads the small ones into their
+//  slots' buffers in order, until every file is done or it is told to stop
+// returns NULL
+void *prefetch_thread(void *arg) {
+	// the read-ahead pipeline
+	struct prefetch *pf = arg;
+	// the slot of the file opened or read
+	struct prefetch_slot *slot;
+	// index of the file
+	int fidx;
+	// boolean flag set if the file opened is to be read into its buffer
+	int readit;
+
+	pthread_mutex_lock(&pf->lock);
+	while (! pf->quit) {
+		// the opens come first, so that the kernel reads ahead every
+		//  file there is a slot for
+		if (pf->opened < pf->numfiles &&
+			pf->opened < pf->next + PREFETCH_DEPTH)
+		{
+			fidx = pf->opened;
+			slot = &pf->slots[fidx % PREFETCH_DEPTH];
+			pthread_mutex_unlock(&pf->lock);
+			slot->fd = open(pf->filenames[fidx],O_RDONLY|O_CLOEXEC);
+			slot->err = (slot->fd == -1) ? errno : 0;
+			readit = FALSE;
+			if (slot->fd != -1) {
+				readit = prefetch_opened(slot);
+				if (readit) {
+					posix_fadvise(slot->fd,0,0,
+						POSIX_FADV_WILLNEED);
+				}
+			}
+			pthread_mutex_lock(&pf->lock);
+			slot->state = readit ? PREFETCH_READ : PREFETCH_READY;
+			pf->opened++;
+			if (! readit) { pthread_cond_signal(&pf->readycond); }
+		}
+		else if (pf->filled < pf->opened) {
+			fidx = pf->filled++;
+			slot = &pf->slots[fidx % PREFETCH_DEPTH];
+			if (slot->state != PREFETCH_READ) { continue; }
+			pthread_mutex_unlock(&pf->lock);
+			slot->len = pread(slot->fd,slot->buff,PREFETCH_BUFF,0);
+			pthread_mutex_lock(&pf->lock);
+			slot->state = PREFETCH_READY;
+			pthread_cond_signal(&pf->readycond);
+		}
+		else if (pf->opened == pf->numfiles) { break; }
+		else { pthread_cond_wait(&pf->freecond,&pf->lock); }
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return(NULL);
+}
+
+
+#ifdef MG_URING
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is the read-ahead pipeline being started
+// sets up an io_uring instance with a submission entry for every slot and
+//  maps its rings, returns 0 on success, or -1 if io_uring is not available
+// note: the kernel must have the IORING_FEAT_FAST_POLL feature of Linux 5.7,
+//        which is later than the IORING_OP_OPENAT and IORING_OP_READ
+//        operations the pipeline uses
+int prefetch_ring_init(struct prefetch *pf) {
+	// parameters of the instance, filled in by the kernel
+	struct io_uring_params params;
+
+	memset(&params,0,sizeof(params));
+	pf->ringfd = syscall(SYS_io_uring_setup,PREFETCH_DEPTH,&params);
+	if (pf->ringfd == -1) { return(-1); }
+	if (! (params.features & IORING_FEAT_FAST_POLL)) {
+		close(pf->ringfd);
+		pf->ringfd = -1;
+		return(-1);
+	}
+	pf->sqmaplen = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned);
+	pf->cqmaplen = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	// the two rings may be in one mapping, as big as the bigger ring
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (pf->cqmaplen > pf->sqmaplen) {
+			pf->sqmaplen = pf->cqmaplen;
+		}
+		pf->cqmaplen = pf->sqmaplen;
+	}
+	pf->sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+	pf->sqmap = mmap(NULL,pf->sqmaplen,PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE,pf->ringfd,IORING_OFF_SQ_RING);
+	pf->cqmap = MAP_FAILED;
+	pf->sqes = MAP_FAILED;
+	if (pf->sqmap != MAP_FAILED) {
+		pf->cqmap = (params.features & IORING_FEAT_SINGLE_MMAP) ?
+			pf->sqmap : mmap(NULL,pf->cqmaplen,
+			PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,
+			pf->ringfd,IORING_OFF_CQ_RING);
+		pf->sqes = mmap(NULL,pf->sqeslen,PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE,pf->ringfd,IORING_OFF_SQES);
+	}
+	if (pf->sqmap == MAP_FAILED || pf->cqmap == MAP_FAILED ||
+		pf->sqes == MAP_FAILED)
+	{
+		prefetch_ring_free(pf);
+		return(-1);
+	}
+	pf->sqhead = (unsigned *) ((char *) pf->sqmap + params.sq_off.head);
+	pf->sqtail = (unsigned *) ((char *) pf->sqmap + params.sq_off.tail);
+	pf->sqmask = (unsigned *) ((char *) pf->sqmap +
+		params.sq_off.ring_mask);
+	pf->sqarray = (unsigned *) ((char *) pf->sqmap + params.sq_off.array);
+	pf->cqhead = (unsigned *) ((char *) pf->cqmap + params.cq_off.head);
+	pf->cqtail = (unsigned *) ((char *) pf->cqmap + params.cq_off.tail);
+	pf->cqmask = (unsigned *) ((char *) pf->cqmap +
+		params.cq_off.ring_mask);
+	pf->cqes = (struct io_uring_cqe *) ((char *) pf->cqmap +
+		params.cq_off.cqes);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a read-ahead pipeline with an io_uring instance
+// unmaps the rings and closes the instance
+// note: nothing may be in flight, or the kernel may still write into the
+//        buffers after they are freed
+void prefetch_ring_free(struct prefetch *pf) {
+	if (pf->sqes != MAP_FAILED) { munmap(pf->sqes,pf->sqeslen); }
+	if (pf->cqmap != MAP_FAILED && pf->cqmap != pf->sqmap) {
+		munmap(pf->cqmap,pf->cqmaplen);
+	}
+	if (pf->sqmap != MAP_FAILED) { munmap(pf->sqmap,pf->sqmaplen); }
+	close(pf->ringfd);
+	pf->ringfd = -1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_queue function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a read-ahead pipeline with an io_uring instance
+// fidx is the index of a file whose slot is free, or has just been opened
+// queues the open of the file, or the read of its start into its slot's
+//  buffer if it is open, on the submission ring, returns 0 on success or -1 if
+//  the ring is full
+// note: the entry is only handed to the kernel by prefetch_ring_enter
+int prefetch_ring_queue(struct prefetch *pf, int fidx) {
+	// the slot of the file
+	struct prefetch_slot *slot = &pf->slots[fidx % PREFETCH_DEPTH];
+	// the end of the submission ring, only moved here
+	unsigned tail = *pf->sqtail;
+	// position of the entry in the ring
+	unsigned pos;
+	// the submission entry
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(pf->sqhead,__ATOMIC_ACQUIRE) >
+		*pf->sqmask)
+	{
+		return(-1);
+	}
+	pos = tail & *pf->sqmask;
+	sqe = &pf->sqes[pos];
+	memset(sqe,0,sizeof(struct io_uring_sqe));
+	if (slot->state == PREFETCH_FREE) {
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t) pf->filenames[fidx];
+		sqe->open_flags = O_RDONLY|O_CLOEXEC;
+		slot->state = PREFETCH_OPEN;
+	}
+	else {
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = slot->fd;
+		sqe->addr = (uintptr_t) slot->buff;
+		sqe->len = PREFETCH_BUFF;
+		sqe->off = 0;
+		slot->state = PREFETCH_READ;
+	}
+	sqe->user_data = fidx;
+	pf->sqarray[pos] = pos;
+	// the entry is written before the kernel can see the new tail
+	__atomic_store_n(pf->sqtail,tail + 1,__ATOMIC_RELEASE);
+	pf->tosubmit++;
+	pf->inflight++;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_enter function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a read-ahead pipeline with an io_uring instance
+// wait is TRUE to wait for at least one completion
+// hands the entries queued to the kernel, returns 0 on success or -1 on error,
+//  with errno set
+int prefetch_ring_enter(struct prefetch *pf, int wait) {
+	// return value of io_uring_enter
+	int ret;
+
+	if (pf->tosubmit == 0 && ! wait) { return(0); }
+	do {
+		ret = syscall(SYS_io_uring_enter,pf->ringfd,pf->tosubmit,
+			wait ? 1 : 0,wait ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+	} while (ret == -1 && errno == EINTR);
+	if (ret == -1) {
+		// with the completion ring full, the completions are taken
+		//  and the entries handed over again next time
+		if (errno == EBUSY || errno == EAGAIN) { return(0); }
+		return(-1);
+	}
+	pf->tosubmit -= ret;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_reap function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a read-ahead pipeline with an io_uring instance
+// takes every completion off the completion ring - an open that completed
+//  queues the read of the file's start if it is small, a read that completed
+//  makes the file ready to be searched
+// note: once reading ahead is stopped, an opened file is only kept to be
+//        closed
+void prefetch_ring_reap(struct prefetch *pf) {
+	// the start of the completion ring, only moved here
+	unsigned head = *pf->cqhead;
+	// the completion
+	struct io_uring_cqe *cqe;
+	// the slot of the completed operation
+	struct prefetch_slot *slot;
+
+	while (head != __atomic_load_n(pf->cqtail,__ATOMIC_ACQUIRE)) {
+		cqe = &pf->cqes[head & *pf->cqmask];
+		slot = &pf->slots[cqe->user_data % PREFETCH_DEPTH];
+		pf->inflight--;
+		if (slot->state == PREFETCH_OPEN) {
+			slot->fd = (cqe->res < 0) ? -1 : cqe->res;
+			slot->err = (cqe->res < 0) ? -cqe->res : 0;
+			slot->state = PREFETCH_READY;
+			if (slot->fd != -1 && ! pf->quit &&
+				prefetch_opened(slot))
+			{
+				prefetch_ring_queue(pf,cqe->user_data);
+			}
+		}
+		else {
+			slot->len = (cqe->res < 0) ? -1 : cqe->res;
+			slot->state = PREFETCH_READY;
+		}
+		head++;
+	}
+	// the kernel may reuse the completions once the new head is seen
+	__atomic_store_n(pf->cqhead,head,__ATOMIC_RELEASE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// prefetch_ring_abandon function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pf is a read-ahead pipeline whose io_uring instance failed
+// stops using the instance - a file whose read is still in flight keeps its
+//  file descriptor and is searched from the start, and a file whose open is
+//  still in flight, or was never handed over, is left for grep_path
+// note: the kernel may still write into the buffer of a read in flight, which
+//        cannot be waited for any more, so the buffer is never freed or
+//        reused, and the descriptor of an open in flight is never closed
+void prefetch_ring_abandon(struct prefetch *pf) {
+	// index of the slot
+	int sidx;
+	// the slot
+	struct prefetch_slot *slot;
+
+	pf->broken = TRUE;
+	for (sidx=0; sidx<PREFETCH_DEPTH; sidx++) {
+		slot = &pf->slots[sidx];
+		if (slot->state == PREFETCH_READ) {
+			slot->buff = NULL;
+			slot->len = -1;
+			slot->state = PREFETCH_READY;
+		}
+		else if (slot->state == PREFETCH_OPEN) {
+			slot->state = PREFETCH_FREE;
+		}
+	}
+	pf->inflight = 0;
+	pf->tosubmit = 0;
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_parallel function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// filenames is the array of file paths to search
+// numfiles is the number of file paths
+// sc is this thread's scanner, with the compiled search strings
+// numjobs is the number of worker threads to start
+// foundmatch is incremented for each file where any lines matched
+// founderror is incremented for each error with a file
+// searches the files in a pool of worker threads while the calling thread
+//  prints each file's output in argument order as soon as it and every file
+//  before it are finished, returns 0 on success or -1 if the pool could not
+//  be started
+// note: errors are printed to stderr by the workers as they happen, so they
+//        are not held back in argument order like the selected lines
+int grep_parallel(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int numjobs, int *foundmatch, int *founderror)
+{
+	// the shared pool state
+	struct work_pool pool;
+
+	memset(&pool,0,sizeof(pool));
+	pool.filenames = filenames;
+	pool.numjobs = numfiles;
+	pool.pat = sc->pat;
+	return(pool_run(&pool,numjobs,foundmatch,founderror));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_chunked function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a memory mapped file
+// size is the size of the mapped file
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path that was mapped
+// numjobs is the number of worker threads to start
+// splits the mapping into chunks of about CHUNK_SIZE bytes that start on line
+//  boundaries, searches them in a pool of worker threads and prints each
+//  chunk's output in file order, returns the number of lines selected, or -1
+//  on error
+// note: each chunk is a run of whole lines searched by grep_region, so the
+//        invert option and the "\r\n" handling work exactly as for the whole
+//        file
+long grep_chunked(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname, int numjobs)
+{
+	// the shared pool state
+	struct work_pool pool;
+	// number of chunks that selected any lines
+	int foundmatch = 0;
+	// number of errors in the pool
+	int founderror = 0;
+
+	memset(&pool,0,sizeof(pool));
+	pool.data = data;
+	pool.size = size;
+	pool.file_pathname = file_pathname;
+	pool.numjobs = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	pool.pat = sc->pat;
+	if (pool_run(&pool,numjobs,&foundmatch,&founderror) != 0 ||
+		founderror > 0)
+	{
+		errno = EIO;
+		return(-1);
+	}
+	return(pool.matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool_run function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is a work pool with its jobs (files or chunks) filled in
+// numjobs is the number of worker threads to start
+// foundmatch is incremented by each job's match count
+// founderror is incremented by each job's error count
+// starts the worker threads and prints each job's output in order as soon as
+//  it and every job before it are finished, returns 0 on success or -1 if the
+//  pool could not be started
+int pool_run(struct work_pool *pool, int numjobs, int *foundmatch,
+	int *founderror)
+{
+	// worker thread handles
+	pthread_t threads[MAX_JOBS];
+	// number of workers started
+	int started;
+	// index of the job being printed
+	int jidx;
+	// return value of pthread functions
+	int ret;
+
+	// never start more workers than there are jobs
+	if (numjobs > pool->numjobs) { numjobs = pool->numjobs; }
+	pool->next = 0;
+	pool->printed = 0;
+	pool->matchcount = 0;
+	pool->window = numjobs * JOB_WINDOW;
+	pool->jobs = calloc(pool->numjobs,sizeof(struct pool_job));
+	if (pool->jobs == NULL) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		return(-1);
+	}
+	pthread_mutex_init(&pool->lock,NULL);
+	pthread_cond_init(&pool->cond,NULL);
+	// start the workers, carrying on with fewer if some fail to start
+	for (started=0; started<numjobs; started++) {
+		ret = pthread_create(&threads[started],NULL,grep_worker,pool);
+		if (ret != 0) {
+			fprintf(stderr,"%s: error starting thread: %s\n",
+				PROG_NAME,strerror(ret));
+			break;
+		}
+	}
+	// with no workers at all, nothing can be searched
+	if (started == 0) {
+		pthread_cond_destroy(&pool->cond);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->jobs);
+		return(-1);
+	}
+	// print each job's output in order, waiting for each job to be
+	//  finished
+	for (jidx=0; jidx<pool->numjobs; jidx++) {
+		// after a write error, or once the -q option has found a
+		//  selected line, the rest of the jobs are not printed
+		if (mg_out.err != 0 ||
+			(mg_mode == MODE_QUIET && *foundmatch > 0)) { break; }
+		pthread_mutex_lock(&pool->lock);
+		while (! pool->jobs[jidx].done) {
+			pthread_cond_wait(&pool->cond,&pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		// with context, each file's lines are separated from the
+		//  lines printed before them
+		if (mg_context && pool->jobs[jidx].groups) {
+			if (mg_ctx.any) { out_write(&mg_out,"--\n",3); }
+			mg_ctx.any = TRUE;
+		}
+		out_write(&mg_out,pool->jobs[jidx].out,
+			pool->jobs[jidx].outlen);
+		free(pool->jobs[jidx].out);
+		pool->jobs[jidx].out = NULL;
+		// combine the counters the same way as the single thread loop
+		*foundmatch += pool->jobs[jidx].foundmatch;
+		*founderror += pool->jobs[jidx].founderror;
+		pool->matchcount += pool->jobs[jidx].matchcount;
+		// let the workers move past this job, or if stdout can no
+		//  longer be written, stop handing out jobs
+		pthread_mutex_lock(&pool->lock);
+		pool->printed = jidx + 1;
+		if (mg_out.err != 0 ||
+			(mg_mode == MODE_QUIET && *foundmatch > 0))
+		{
+			pool->next = pool->numjobs;
+		}
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	// wait for every worker to finish
+	for (jidx=0; jidx<started; jidx++) {
+		pthread_join(threads[jidx],NULL);
+	}
+	// free the output of any jobs left unprinted after a write error
+	for (jidx=0; jidx<pool->numjobs; jidx++) { free(pool->jobs[jidx].out); }
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->jobs);
+	pool->jobs = NULL;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_worker function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// arg is the work pool shared with pool_run
+// worker thread started by pool_run - takes the next job in order, searches
+//  the file or chunk with its output going to a growing output buffer, and
+//  hands the output back to be printed, until every job has been taken
+// note: a worker never runs more than the pool window ahead of the job being
+//        printed
+void *grep_worker(void *arg) {
+	// the shared pool state
+	struct work_pool *pool = arg;
+	// index of the job being searched
+	int jidx;
+	// result for the job being searched
+	struct pool_job *job;
+	// bounds of the chunk being searched
+	size_t from, to;
+	// this thread's scanner, searching for the pool's search strings
+	struct mygrep_scanner scanner;
+
+	scanner_init(&scanner,pool->pat);
+	while (TRUE) {
+		// take the next job once it is inside the window
+		pthread_mutex_lock(&pool->lock);
+		while (pool->next < pool->numjobs &&
+			pool->next >= pool->printed + pool->window)
+		{
+			pthread_cond_wait(&pool->cond,&pool->lock);
+		}
+		if (pool->next >= pool->numjobs) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		jidx = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		job = &pool->jobs[jidx];
+		// selected lines for this job go to a growing output buffer
+		if (out_init(&mg_out,-1) != 0) {
+			fprintf(stderr,"%s: error allocating memory: %s\n",
+				PROG_NAME,strerror(errno));
+			job->founderror++;
+		}
+		else {
+			// search a whole file, whose output starts on its
+			//  own
+			mg_ctx.any = FALSE;
+			if (pool->data == NULL) {
+				grep_path(pool->filenames[jidx],&scanner,
+					&job->foundmatch,&job->founderror);
+			}
+			// search one chunk of the mapped file, catching
+			//  SIGBUS the same way as grep_file
+			else if (sigsetjmp(mg_sigbus_jmp,1) == 0) {
+				mg_in_mapping = 1;
+				mg_stop = FALSE;
+				from = chunk_start(pool->data,pool->size,jidx);
+				to = chunk_start(pool->data,pool->size,jidx+1);
+				chunk_lines(pool,jidx,from,to);
+				STATS_BEGIN(STAGE_MATCH);
+				job->matchcount = grep_region(pool->data+from,
+					to-from,&scanner,pool->file_pathname);
+				STATS_END(STAGE_MATCH);
+				STATS_LINES(pool->data+from,to-from);
+				if (job->matchcount > 0) { job->foundmatch = 1; }
+			}
+			else {
+				STATS_END(STAGE_MATCH);
+				fprintf(stderr,"%s: file '%s' was truncated "
+					"while being read\n",PROG_NAME,
+					pool->file_pathname);
+				job->founderror++;
+			}
+			mg_in_mapping = 0;
+			// the job takes over the output buffer
+			if (mg_out.err != 0) {
+				fprintf(stderr,"%s: error allocating memory: "
+					"%s\n",PROG_NAME,strerror(mg_out.err));
+				job->founderror++;
+			}
+			job->out = mg_out.buff;
+			job->outlen = mg_out.len;
+			job->groups = mg_ctx.any;
+			mg_out.buff = NULL;
+		}
+		// hand the result back to the printing thread - a chunk that
+		//  failed before its lines were counted does not keep the
+		//  chunks after it waiting
+		pthread_mutex_lock(&pool->lock);
+		job->done = TRUE;
+		if (job->firstline == 0) { job->firstline = 1; }
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	// add this thread's counters to the totals, and release its block
+	//  buffer and scanner
+	STATS_MERGE();
+	reader_free(&mg_reader);
+	scanner_clear(&scanner);
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// chunk_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the work pool searching chunks of a mapped file
+// jidx is the index of the chunk about to be searched
+// from and to are the offsets of the start and end of the chunk
+// sets the thread's byte offset to the start of the chunk, and with the -n
+//  option its line number too - the lines of the chunk are counted, then the
+//  number of its first line is taken from the chunk before it once that is
+//  known, and passed on to the chunk after it
+// note: each chunk only waits for the running sum of the line counts, which
+//        every worker counts at the same time, never for a chunk to be
+//        searched
+void chunk_lines(struct work_pool *pool, int jidx, size_t from, size_t to) {
+	// the chunk's result
+	struct pool_job *job = &pool->jobs[jidx];
+
+	lines_reset(pool->data+from);
+	mg_lines.offset = from;
+	if (! mg_lineno) { return; }
+	job->lines = count_lines(pool->data+from,to-from);
+	pthread_mutex_lock(&pool->lock);
+	while (jidx > 0 && pool->jobs[jidx-1].firstline == 0) {
+		pthread_cond_wait(&pool->cond,&pool->lock);
+	}
+	job->firstline = (jidx > 0) ? pool->jobs[jidx-1].firstline +
+		pool->jobs[jidx-1].lines : 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	mg_lines.lineno = job->firstline;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_recursive function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// filenames is the array of paths given in args, directories or files
+// numfiles is the number of paths, 0 searches the current directory
+// sc is this thread's scanner, with the compiled search strings
+// numjobs is the number of threads searching the files found, 1 searches them
+//  in the calling thread
+// foundmatch is incremented for each file where any lines matched
+// founderror is incremented for each error with a file or directory
+// walks the directory trees in WALK_THREADS threads, handing each regular file
+//  to the searching threads as soon as it is found instead of listing the
+//  whole tree first, returns 0 on success or -1 if the walk could not be
+//  started
+// note: the output of each file is kept together, but files are printed in
+//        the order they are finished, which depends on the threads
+int grep_recursive(char **filenames, int numfiles, struct mygrep_scanner *sc,
+	int numjobs, int *foundmatch, int *founderror)
+{
+	// the shared walk state
+	struct walk_pool pool;
+	// walking and searching thread handles
+	pthread_t walkers[WALK_THREADS];
+	pthread_t searchers[MAX_JOBS];
+	// number of walking and searching threads started
+	int numwalkers, numsearchers = 0;
+	// index of the thread
+	int idx;
+	// return value of pthread functions
+	int ret;
+	// path of the file being searched in this thread
+	char *path;
+	// counters for the file being searched in this thread
+	int filematch, fileerror;
+
+	memset(&pool,0,sizeof(pool));
+	pool.pat = sc->pat;
+	pool.out = &mg_out;
+	numwalkers = walk_start(&pool,filenames,numfiles,walkers);
+	// start the searching threads if more than one job was asked for
+	if (numwalkers > 0 && numjobs > 1) {
+		for (; numsearchers<numjobs; numsearchers++) {
+			ret = pthread_create(&searchers[numsearchers],NULL,
+				walk_searcher,&pool);
+			if (ret != 0) {
+				fprintf(stderr,"%s: error starting thread: "
+					"%s\n",PROG_NAME,strerror(ret));
+				break;
+			}
+		}
+	}
+	// otherwise search the files in this thread, writing straight to the
+	//  output buffer
+	if (numwalkers > 0 && numsearchers == 0) {
+		while ((path = walk_next_file(&pool)) != NULL) {
+			filematch = 0;
+			fileerror = 0;
+			grep_path(path,sc,&filematch,&fileerror);
+			free(path);
+			pthread_mutex_lock(&pool.lock);
+			pool.foundmatch += filematch;
+			pool.founderror += fileerror;
+			if (mg_out.err != 0 ||
+				(mg_mode == MODE_QUIET && pool.foundmatch > 0))
+			{
+				walk_stop(&pool);
+			}
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+	// wait for every thread to finish
+	for (idx=0; idx<numsearchers; idx++) {
+		pthread_join(searchers[idx],NULL);
+	}
+	walk_end(&pool,walkers,numwalkers);
+	*foundmatch += pool.foundmatch;
+	*founderror += pool.founderror;
+	if (numwalkers == 0) { return(-1); }
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_start function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool, zeroed by the caller
+// filenames is the array of paths to walk, directories or files
+// numfiles is the number of paths, 0 walks the current directory
+// walkers is set to the handles of the walking threads
+// sets up the locks of the pool, adds the paths to the directories waiting and
+//  starts WALK_THREADS walking threads, returns the number of threads started,
+//  0 if the walk could not be started
+// note: the files found are taken with walk_next_file, and walk_end is called
+//        once the walk is done or stopped
+int walk_start(struct walk_pool *pool, char **filenames, int numfiles,
+	pthread_t *walkers)
+{
+	// number of walking threads started
+	int numwalkers;
+	// number of walking threads to start, 0 if the paths could not be
+	//  added
+	int startwalkers;
+	// index of the path
+	int idx;
+	// return value of pthread functions
+	int ret;
+
+	pool->walkers = WALK_THREADS;
+	pthread_mutex_init(&pool->lock,NULL);
+	pthread_cond_init(&pool->dircond,NULL);
+	pthread_cond_init(&pool->filecond,NULL);
+	pthread_cond_init(&pool->spacecond,NULL);
+	pthread_mutex_init(&pool->outlock,NULL);
+	// the stack is popped from the end, so push the paths in reverse to
+	//  start with the first one
+	if (numfiles == 0 && walk_push_dir(pool,"",TRUE) != 0) {
+		numfiles = -1;
+	}
+	for (idx=numfiles-1; idx>=0; idx--) {
+		if (walk_push_dir(pool,filenames[idx],TRUE) != 0) { break; }
+	}
+	if (idx >= 0 || numfiles < 0) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		pool->walkers = 0;
+	}
+	// start the walking threads, carrying on with fewer if some fail to
+	//  start - the count is read before any thread can change it
+	startwalkers = pool->walkers;
+	for (numwalkers=0; numwalkers<startwalkers; numwalkers++) {
+		ret = pthread_create(&walkers[numwalkers],NULL,walk_worker,
+			pool);
+		if (ret != 0) {
+			fprintf(stderr,"%s: error starting thread: %s\n",
+				PROG_NAME,strerror(ret));
+			break;
+		}
+	}
+	// the threads that did start may already have exited, so only take
+	//  off the ones that did not
+	pthread_mutex_lock(&pool->lock);
+	if (pool->walkers > 0) { pool->walkers -= WALK_THREADS - numwalkers; }
+	pthread_cond_broadcast(&pool->filecond);
+	pthread_mutex_unlock(&pool->lock);
+	return(numwalkers);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_end function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool set up by walk_start
+// walkers is the array of walking thread handles
+// numwalkers is the number of walking threads started
+// waits for the walking threads to finish, frees the paths still waiting
+//  after the walk was stopped early and releases the locks of the pool
+void walk_end(struct walk_pool *pool, pthread_t *walkers, int numwalkers) {
+	// index of the thread, path or directory
+	int idx;
+
+	for (idx=0; idx<numwalkers; idx++) {
+		pthread_join(walkers[idx],NULL);
+	}
+	// free anything left after stopping early
+	for (idx=0; idx<pool->numfiles; idx++) {
+		free(pool->files[(pool->head+idx) % WALK_QUEUE]);
+	}
+	for (idx=0; idx<pool->numdirs; idx++) { free(pool->dirs[idx].path); }
+	free(pool->dirs);
+	pthread_mutex_destroy(&pool->outlock);
+	pthread_cond_destroy(&pool->spacecond);
+	pthread_cond_destroy(&pool->filecond);
+	pthread_cond_destroy(&pool->dircond);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_worker function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// arg is the walk pool shared with grep_recursive
+// walking thread started by grep_recursive - takes the next directory waiting
+//  and reads it, until no directories are waiting and no other walking thread
+//  is reading one
+void *walk_worker(void *arg) {
+	// the shared walk state
+	struct walk_pool *pool = arg;
+	// directory being read
+	struct walk_entry ent;
+	// buffer the directory entries are read into
+	char *buff;
+
+	buff = malloc(WALK_BUFF_SIZE);
+	if (buff == NULL) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+	}
+	while (buff != NULL) {
+		// wait for a directory while another thread may still find
+		//  one
+		pthread_mutex_lock(&pool->lock);
+		while (pool->numdirs == 0 && pool->busy > 0 && ! pool->quit) {
+			pthread_cond_wait(&pool->dircond,&pool->lock);
+		}
+		if (pool->quit || pool->numdirs == 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		ent = pool->dirs[--pool->numdirs];
+		pool->busy++;
+		pthread_mutex_unlock(&pool->lock);
+		walk_dir(pool,&ent,buff);
+		free(ent.path);
+		pthread_mutex_lock(&pool->lock);
+		// once the last busy thread finds nothing more, the walk
+		//  is finished and every waiting thread can exit
+		pool->busy--;
+		if (pool->busy == 0 && pool->numdirs == 0) {
+			pthread_cond_broadcast(&pool->dircond);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	// the searching threads stop once every walking thread has exited
+	//  and no files are waiting
+	pthread_mutex_lock(&pool->lock);
+	pool->walkers--;
+	if (pool->walkers == 0) { pthread_cond_broadcast(&pool->filecond); }
+	pthread_mutex_unlock(&pool->lock);
+	free(buff);
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_dir function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool
+// ent is the directory to read
+// buff is a buffer of WALK_BUFF_SIZE bytes for the directory entries
+// reads the directory with getdents64(), adding each subdirectory to the
+//  directories waiting and each regular file to the files waiting to be
+//  searched - a path given on the command line that is not a directory is
+//  added as a file
+// note: symbolic links and special files inside a directory are skipped, and
+//        the type of an entry is only looked up with fstatat() if the file
+//        system does not report it
+void walk_dir(struct walk_pool *pool, struct walk_entry *ent, char *buff) {
+	// directory file descriptor
+	int dirfd;
+	// number of bytes of entries read, and position of the entry
+	ssize_t nread, pos;
+	// the directory entry
+	struct dirent64 *dent;
+	// type of the entry
+	unsigned char type;
+	// status of an entry of unknown type
+	struct stat st;
+	// length of the directory path, and of the entry name
+	size_t dirlen, namelen;
+	// path of the entry
+	char *path;
+	// boolean flag for a directory path that already ends in '/'
+	int slash;
+	// errno to report after adding the last files
+	int saverr;
+	// files found but not yet added to the files waiting
+	char *batch[WALK_BATCH];
+	// number of files in the batch
+	int numbatch = 0;
+
+	// paths given on the command line are followed if they are symbolic
+	//  links, the ones found inside a directory are not
+	dirfd = open((ent->path[0] == '\0') ? "." : ent->path,
+		O_RDONLY|O_DIRECTORY|O_CLOEXEC|(ent->isroot ? 0 : O_NOFOLLOW));
+	if (dirfd == -1) {
+		// a path given on the command line that is not a directory, or
+		//  cannot be opened, is searched as a file, which reports
+		//  any error with the usual message
+		if (ent->isroot) {
+			path = strdup(ent->path);
+			if (path != NULL) {
+				walk_push_files(pool,&path,1);
+				return;
+			}
+		}
+		else if (errno == EACCES) {
+			fprintf(stderr,"%s: directory '%s' is not readable: "
+				"%s\n",PROG_NAME,ent->path,strerror(errno));
+		}
+		else {
+			fprintf(stderr,"%s: directory '%s' failed to open: "
+				"%s\n",PROG_NAME,ent->path,strerror(errno));
+		}
+		pthread_mutex_lock(&pool->lock);
+		pool->founderror++;
+		pthread_mutex_unlock(&pool->lock);
+		return;
+	}
+	dirlen = strlen(ent->path);
+	slash = (dirlen > 0 && ent->path[dirlen-1] == '/');
+	while ((nread = getdents64(dirfd,buff,WALK_BUFF_SIZE)) > 0) {
+		for (pos=0; pos<nread; pos+=dent->d_reclen) {
+			dent = (struct dirent64 *) (buff + pos);
+			if (strcmp(dent->d_name,".") == 0 ||
+				strcmp(dent->d_name,"..") == 0) { continue; }
+			type = dent->d_type;
+			if (type == DT_UNKNOWN) {
+				if (fstatat(dirfd,dent->d_name,&st,
+					AT_SYMLINK_NOFOLLOW) != 0) { continue; }
+				if (S_ISDIR(st.st_mode)) { type = DT_DIR; }
+				else if (S_ISREG(st.st_mode)) { type = DT_REG; }
+			}
+			if (type != DT_DIR && type != DT_REG) { continue; }
+			// the path of the entry is the directory path and the
+			//  name, or just the name in the current directory
+			namelen = strlen(dent->d_name);
+			path = malloc(dirlen + namelen + 2);
+			if (path == NULL) { break; }
+			if (dirlen == 0) { strcpy(path,dent->d_name); }
+			else if (slash) {
+				sprintf(path,"%s%s",ent->path,dent->d_name);
+			}
+			else {
+				sprintf(path,"%s/%s",ent->path,dent->d_name);
+			}
+			if (type == DT_DIR) {
+				if (walk_push_dir(pool,path,FALSE) != 0) {
+					free(path);
+					break;
+				}
+			}
+			else { batch[numbatch++] = path; }
+			// stop reading once the search is stopping early
+			if (numbatch == WALK_BATCH) {
+				numbatch = 0;
+				if (walk_push_files(pool,batch,WALK_BATCH) != 0) {
+					close(dirfd);
+					return;
+				}
+			}
+		}
+		if (pos < nread) {
+			nread = -1;
+			break;
+		}
+	}
+	// add the files left in the batch, even after an error
+	if (numbatch > 0) {
+		saverr = errno;
+		walk_push_files(pool,batch,numbatch);
+		errno = saverr;
+	}
+	if (nread == -1) {
+		fprintf(stderr,"%s: directory '%s' failed to read: %s\n",
+			PROG_NAME,ent->path,strerror(errno));
+		pthread_mutex_lock(&pool->lock);
+		pool->founderror++;
+		pthread_mutex_unlock(&pool->lock);
+	}
+	close(dirfd);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_push_dir function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool
+// path is the path of the directory, which the pool takes over for a
+//  directory found while walking, and copies for a path given on the command
+//  line
+// isroot is a boolean flag for a path given on the command line
+// adds the directory to the directories waiting to be read, doubling the stack
+//  as needed, returns 0 on success or -1 if memory could not be allocated
+int walk_push_dir(struct walk_pool *pool, char *path, int isroot) {
+	// the grown stack
+	struct walk_entry *temp;
+
+	if (isroot) {
+		path = strdup(path);
+		if (path == NULL) { return(-1); }
+	}
+	pthread_mutex_lock(&pool->lock);
+	if (pool->numdirs == pool->dirsize) {
+		temp = realloc(pool->dirs,(pool->dirsize > 0 ? pool->dirsize * 2 :
+			64) * sizeof(struct walk_entry));
+		if (temp == NULL) {
+			pthread_mutex_unlock(&pool->lock);
+			if (isroot) { free(path); }
+			return(-1);
+		}
+		pool->dirs = temp;
+		pool->dirsize = (pool->dirsize > 0) ? pool->dirsize * 2 : 64;
+	}
+	pool->dirs[pool->numdirs].path = path;
+	pool->dirs[pool->numdirs].isroot = isroot;
+	pool->numdirs++;
+	pthread_cond_signal(&pool->dircond);
+	pthread_mutex_unlock(&pool->lock);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_push_files function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool
+// paths is the array of paths of the files, which the pool takes over
+// count is the number of paths
+// adds the files to the files waiting to be searched, waiting whenever
+//  WALK_QUEUE files are already waiting, returns 0 on success or -1 if the
+//  search is stopping early, in which case the paths not added are freed
+int walk_push_files(struct walk_pool *pool, char **paths, int count) {
+	// index of the path being added
+	int idx = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (idx < count && ! pool->quit) {
+		while (pool->numfiles == WALK_QUEUE && ! pool->quit) {
+			pthread_cond_wait(&pool->spacecond,&pool->lock);
+		}
+		for (; idx < count && pool->numfiles < WALK_QUEUE; idx++) {
+			pool->files[(pool->head + pool->numfiles) % WALK_QUEUE] =
+				paths[idx];
+			pool->numfiles++;
+		}
+		pthread_cond_broadcast(&pool->filecond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (idx < count) {
+		for (; idx < count; idx++) { free(paths[idx]); }
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_next_file function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool
+// takes the oldest file waiting to be searched, waiting for one while any
+//  walking thread is still running, returns its path, which must be freed, or
+//  null once every file has been taken or the search is stopping early
+char *walk_next_file(struct walk_pool *pool) {
+	// path of the file taken
+	char *path;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->numfiles == 0 && pool->walkers > 0 && ! pool->quit) {
+		pthread_cond_wait(&pool->filecond,&pool->lock);
+	}
+	if (pool->quit || pool->numfiles == 0) {
+		pthread_mutex_unlock(&pool->lock);
+		return(NULL);
+	}
+	path = pool->files[pool->head];
+	pool->head = (pool->head + 1) % WALK_QUEUE;
+	pool->numfiles--;
+	// walking threads only wait when the ring is full, and are woken once
+	//  it is half empty, so they add files in large runs instead of
+	//  taking turns with the searching threads one file at a time
+	if (pool->numfiles == WALK_QUEUE / 2) {
+		pthread_cond_broadcast(&pool->spacecond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return(path);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_searcher function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// arg is the walk pool shared with grep_recursive
+// searching thread started by grep_recursive for the -j option - takes the
+//  files found by the walking threads one at a time, searches each one with
+//  its output going to a growing output buffer, and appends the whole output
+//  of the file to the main thread's output buffer
+void *walk_searcher(void *arg) {
+	// the shared walk state
+	struct walk_pool *pool = arg;
+	// path of the file being searched
+	char *path;
+	// counters for the file being searched
+	int filematch, fileerror;
+	// boolean flag for a write error on the main output buffer
+	int writeerr;
+	// this thread's scanner, searching for the pool's search strings
+	struct mygrep_scanner scanner;
+
+	// one growing output buffer is reused for every file
+	if (out_init(&mg_out,-1) != 0) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		pthread_mutex_lock(&pool->lock);
+		pool->founderror++;
+		pthread_mutex_unlock(&pool->lock);
+		return(NULL);
+	}
+	scanner_init(&scanner,pool->pat);
+	while ((path = walk_next_file(pool)) != NULL) {
+		filematch = 0;
+		fileerror = 0;
+		mg_out.len = 0;
+		mg_ctx.any = FALSE;
+		grep_path(path,&scanner,&filematch,&fileerror);
+		free(path);
+		if (mg_out.err != 0) {
+			fprintf(stderr,"%s: error allocating memory: %s\n",
+				PROG_NAME,strerror(mg_out.err));
+			mg_out.err = 0;
+			fileerror++;
+		}
+		pthread_mutex_lock(&pool->outlock);
+		// with context, each file's lines are separated from the
+		//  lines printed before them
+		if (mg_context && mg_ctx.any) {
+			if (pool->anyout) { out_write(pool->out,"--\n",3); }
+			pool->anyout = TRUE;
+		}
+		out_write(pool->out,mg_out.buff,mg_out.len);
+		writeerr = (pool->out->err != 0);
+		pthread_mutex_unlock(&pool->outlock);
+		pthread_mutex_lock(&pool->lock);
+		pool->foundmatch += filematch;
+		pool->founderror += fileerror;
+		if (writeerr || (mg_mode == MODE_QUIET && pool->foundmatch > 0)) {
+			walk_stop(pool);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	// add this thread's counters to the totals, and release its buffers
+	//  and scanner
+	STATS_MERGE();
+	free(mg_out.buff);
+	mg_out.buff = NULL;
+	reader_free(&mg_reader);
+	scanner_clear(&scanner);
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// walk_stop function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pool is the walk pool, whose lock must be held
+// stops the walk early, waking every thread waiting on the pool so that it
+//  sees the quit flag
+void walk_stop(struct walk_pool *pool) {
+	pool->quit = TRUE;
+	pthread_cond_broadcast(&pool->dircond);
+	pthread_cond_broadcast(&pool->filecond);
+	pthread_cond_broadcast(&pool->spacecond);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// is_binary function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fd is the file descriptor of an open file
+// checks the first BINARY_BLOCK bytes of the file for a null byte, as
+//  data_binary does, a piece at a time without moving the file position,
+//  returns TRUE if the file is binary, or FALSE if it is not or cannot be read
+//  this way
+// note: a compressed file that can be decompressed is not binary, it is
+//        searched once decompressed
+int is_binary(int fd) {
+	// piece of the start of the file
+	char buff[BINARY_PIECE];
+	// number of bytes read, and the offset of the piece
+	ssize_t nread;
+	off_t off;
+
+	if (compress_type(fd) != COMP_NONE) { return(FALSE); }
+	for (off=0; off<BINARY_BLOCK; off+=nread) {
+		nread = pread(fd,buff,BINARY_PIECE,off);
+		if (nread <= 0) { return(FALSE); }
+		if (data_binary(buff,nread)) { return(TRUE); }
+	}
+	return(FALSE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data_binary function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a file or stream
+// size is the number of bytes of it in memory
+// returns TRUE if the first BINARY_BLOCK bytes (or all of them if there are
+//  fewer) hold a null byte, which text files do not have, otherwise FALSE
+// note: every check for a binary file goes through here, so a file is decided
+//        the same way whether it is mapped, read ahead, read as a stream or
+//        walked with the -r option
+int data_binary(char *data, size_t size) {
+	return(memchr(data,'\0',(size < BINARY_BLOCK) ? size : BINARY_BLOCK)
+		!= NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// chunk_start function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a memory mapped file
+// size is the size of the mapped file
+// chunk is the index of the chunk
+// returns the offset of the first line start at or after chunk * CHUNK_SIZE,
+//  or the size of the file if there is none - a chunk runs from its own start
+//  to the start of the next chunk, which may be empty if a long line covers
+//  the whole chunk
+// note: a '\n' right after a '\r' belongs to the same line ending, so a chunk
+//        never starts between the two
+size_t chunk_start(char *data, size_t size, int chunk) {
+	return(line_start(data,size,(size_t) chunk * CHUNK_SIZE));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// line_start function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines
+// size is the size of the run
+// pos is an offset in the run
+// returns the offset of the first line start at or after pos, or the size of
+//  the run if there is none
+// note: a '\n' right after a '\r' belongs to the same line ending, so the
+//        offset returned is never between the two
+size_t line_start(char *data, size_t size, size_t pos) {
+	// the first line ending at or after the byte before pos
+	char *eol;
+
+	if (pos == 0) { return(0); }
+	if (pos >= size) { return(size); }
+	// start from the byte before pos, so pos itself is used if it is
+	//  already the start of a line
+	eol = find_eol(data+pos-1,size-pos+1);
+	if (eol == NULL) { return(size); }
+	pos = eol - data + 1;
+	if (*eol == '\r' && pos < size && data[pos] == '\n') { pos++; }
+	return(pos);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_region function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines, either a memory mapped file or a
+//  block from the line reader
+// size is the size of the run, including the last line ending if there is one
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path the run came from
+// searches the whole run with scan_region, the same search loop the library
+//  interface runs, and prints the selected lines it finds to stdout with
+//  region_select, returns the number of lines selected
+// note: with the invert option the lines between hits are all selected, so
+//        they are split and printed (or just counted) by print_lines
+// note: unless lines are being printed, the start of a hit line is never
+//        looked for, and with the -l or -q option the search stops at the
+//        first selected line
+// note: with the -A, -B or -C options the run is searched by grep_context
+//        instead
+// note: a DFA that could not be set up is recorded in the output buffer as
+//        for a failed write, which stops the search
+// note: runs of selected lines that print_lines left in the run, to be written
+//        straight from it, are written before returning, since a stream's
+//        buffer is refilled after each run
+// note: this function should always return, never calling exit()
+long grep_region(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname)
+{
+	// number of lines selected
+	long matchcount;
+
+	// lines around the selected lines are printed too
+	if (mg_context && ! mg_binary) {
+		matchcount = grep_context(data,size,sc,file_pathname);
+	}
+	// stop early if the output can no longer be written, or the -l or -q
+	//  option has found a selected line
+	else {
+		sc->stopped = (mg_out.err != 0 || mg_stop);
+		matchcount = scan_region(sc,data,size,mg_mode == MODE_PRINT,
+			region_select,file_pathname);
+	}
+	if (sc->err != 0 && mg_out.err == 0) { mg_out.err = sc->err; }
+	// the runs of the input listed to be written are written before the
+	//  input is changed
+	if (mg_out.iovcnt > 0) { out_flush(&mg_out); }
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// region_select function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is this thread's scanner
+// from is the start of a run of selected lines found by scan_region - the
+//  line holding a hit, or with the invert option the lines between two hits
+// to is the end of the run, just past the line ending of its last line
+// arg is the file path the run came from
+// prints the run, or just counts it, for grep_region, returns the number of
+//  lines selected
+// note: unless lines are being printed, a hit line starts wherever the search
+//        for its hit did, since its real start is never looked for
+long region_select(struct mygrep_scanner *sc, char *from, char *to,
+	void *arg)
+{
+	// file path the run came from
+	char *file_pathname = arg;
+	// output mode for this file - the lines of a binary file are not
+	//  printed, the first selected line is enough to report it
+	int mode = (mg_binary && mg_mode == MODE_PRINT) ? MODE_LIST : mg_mode;
+	// number of lines selected
+	long matchcount = 1;
+
+	// with the invert option every line of the run is selected
+	if (sc->pat->flags & MYGREP_INVERT) {
+		matchcount = print_lines(from,to-from,file_pathname);
+	}
+	// with the -o option only the matches are printed
+	else if (mode == MODE_PRINT && mg_only) {
+		print_matches(sc,from,line_end(from,to),file_pathname);
+	}
+	else if (mode == MODE_PRINT) {
+		print_line(from,line_end(from,to)-from,file_pathname,':');
+	}
+	else if (mode >= MODE_LIST) { mg_stop = TRUE; }
+	sc->stopped = (mg_out.err != 0 || mg_stop);
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// grep_context function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines, either a whole mapped file or a
+//  block from the line reader
+// size is the size of the run, including the last line ending if there is one
+// sc is this thread's scanner, with the compiled search strings
+// file_pathname is the file path the run came from
+// searches the run with scan_region the same way as grep_region, printing each
+//  run of selected lines with the lines of context around it, returns the
+//  number of lines selected
+// note: lines before the run, back to the floor of the context state, may be
+//        printed as context, and the lines after the last selected line are
+//        only printed as far as the end of the run - the rest are printed at
+//        the start of the next run
+// note: this function should always return, never calling exit()
+long grep_context(char *data, size_t size, struct mygrep_scanner *sc,
+	char *file_pathname)
+{
+	// number of lines selected
+	long matchcount;
+
+	sc->stopped = (mg_out.err != 0);
+	matchcount = scan_region(sc,data,size,TRUE,context_select,
+		file_pathname);
+	// the lines after the last selected line, up to the end of the run
+	if (mg_ctx.pending > 0 && mg_out.err == 0) {
+		mg_ctx.pending -= context_lines(mg_ctx.printed,data+size,
+			mg_ctx.pending,'-',sc,file_pathname);
+	}
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// context_select function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is this thread's scanner
+// from is the start of a run of selected lines found by scan_region
+// to is the end of the run, just past the line ending of its last line
+// arg is the file path the run came from
+// prints the run with the lines of context around it for grep_context,
+//  returns the number of lines selected
+long context_select(struct mygrep_scanner *sc, char *from, char *to,
+	void *arg)
+{
+	// number of lines selected
+	long matchcount = context_print(from,to,sc,arg);
+
+	sc->stopped = (mg_out.err != 0);
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// context_print function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// from is the start of a run of selected lines
+// to is the end of the run, just past the line ending of its last line
+// sc is this thread's scanner, for the -o option
+// file_pathname is the file path the lines came from
+// prints the lines still owed as context after the last selected line, then
+//  up to mg_before lines before the run, then the run itself, returns the
+//  number of lines selected
+// note: lines are never printed twice - the lines before the run are not
+//        looked for further back than the last line printed
+long context_print(char *from, char *to, struct mygrep_scanner *sc,
+	char *file_pathname)
+{
+	// earliest line that can be printed as context before the run
+	char *lower;
+	// start of the first line of context before the run
+	char *start = from;
+	// number of lines of context before the run
+	long count;
+
+	if (mg_ctx.pending > 0) {
+		mg_ctx.pending -= context_lines(mg_ctx.printed,from,
+			mg_ctx.pending,'-',sc,file_pathname);
+	}
+	lower = (mg_ctx.printed != NULL) ? mg_ctx.printed : mg_ctx.floor;
+	for (count=0; count<mg_before && start > lower; count++) {
+		start = line_back(lower,start);
+	}
+	context_lines(start,from,count,'-',sc,file_pathname);
+	count = context_lines(from,to,-1,':',sc,file_pathname);
+	mg_ctx.pending = mg_after;
+	return(count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// context_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// from is the start of the first line to print
+// to is the end of the lines that may be printed
+// max is the most lines to print, or -1 for every line up to to
+// sep is the char after the filename, ':' for selected lines and '-' for
+//  context lines
+// sc is this thread's scanner, for the -o option
+// file_pathname is the file path the lines came from
+// prints lines from from onwards, starting a new group with a "--" line if
+//  they do not follow the last line printed, returns the number of lines
+//  printed
+// note: with the -o option only the matches in the selected lines are printed,
+//        and context lines are passed over as if they were printed, so groups
+//        are still separated by "--" as in grep
+long context_lines(char *from, char *to, long max, char sep,
+	struct mygrep_scanner *sc, char *file_pathname)
+{
+	// number of lines printed
+	long count = 0;
+	// line ending of each line
+	char *eol;
+
+	if (from < to && max != 0 && from != mg_ctx.printed && mg_ctx.any) {
+		out_write(&mg_out,"--\n",3);
+	}
+	while (from < to && count != max) {
+		eol = find_eol(from,to-from);
+		// the last line of the file may have no line ending
+		if (eol == NULL) { eol = to; }
+		if (! mg_only) { print_line(from,eol-from,file_pathname,sep); }
+		else if (sep == ':') {
+			print_matches(sc,from,eol,file_pathname);
+		}
+		count++;
+		// skip the line ending, treating "\r\n" as one ending
+		from = eol;
+		if (from < to) {
+			from++;
+			if (*eol == '\r' && from < to && *from == '\n') {
+				from++;
+			}
+		}
+		mg_ctx.printed = from;
+		mg_ctx.any = TRUE;
+	}
+	return(count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// line_back function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// lower is the earliest byte that may be looked at, the start of a line
+// linestart is the start of a line after lower
+// returns the start of the line before the one at linestart, or lower if that
+//  line starts before it
+char *line_back(char *lower, char *linestart) {
+	// line ending of the line before, then the one before that
+	char *eol = linestart - 1;
+
+	// "\r\n" is one line ending
+	if (*eol == '\n' && eol > lower && eol[-1] == '\r') { eol--; }
+	eol = find_eol_back(lower,eol-lower);
+	return((eol != NULL) ? eol + 1 : lower);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// line_end function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// linestart is the start of a line
+// next is the start of the line after it, or the end of the text if the line
+//  has no line ending
+// returns the end of the line, not including its line ending, "\r\n" being one
+//  line ending
+char *line_end(char *linestart, char *next) {
+	if (next > linestart && next[-1] == '\n') {
+		next--;
+		if (next > linestart && next[-1] == '\r') { next--; }
+	}
+	else if (next > linestart && next[-1] == '\r') { next--; }
+	return(next);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// context_keep function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader of the stream being searched, just after a run was
+//  searched
+// block is the run just searched, which starts where the last run ended
+// sets how much of the run the reader keeps when its buffer is refilled - the
+//  last mg_before lines not yet printed, so they can be printed as context
+//  before the first selected line of the next run - and remembers where the
+//  last printed line ended relative to the end of the run
+// note: the lines kept are not limited in size, the reader grows its buffer
+//        to hold them, so a large -B prints as many lines from a pipe as
+//        from a mapped file
+// note: only the lines of the run are walked back over - the lines kept last
+//        time are counted in mg_ctx.kept, and dropped from their front, so a
+//        large -B does not walk all its lines again after each short read
+void context_keep(struct line_reader *rdr, char *block) {
+	// end of the run just searched
+	char *end = rdr->buff + rdr->start;
+	// earliest line that may be kept, and the first line kept
+	char *lower = rdr->buff, *from = end;
+	// the lines kept last time, just before the run
+	char *oldfrom = block - rdr->keep;
+	// line ending of a line dropped from the front of them
+	char *eol;
+	// number of lines kept, and of those kept last time, and of those to
+	//  drop
+	long count, old, drop;
+
+	if (mg_ctx.printed != NULL && mg_ctx.printed > lower) {
+		lower = mg_ctx.printed;
+	}
+	// walk back over the lines of the run first
+	for (count=0; count<mg_before && from > lower && from > block;
+		count++)
+	{
+		from = line_back((lower > block) ? lower : block,from);
+	}
+	// the lines kept last time are all still there, take as many of the
+	//  last of them as are needed
+	if (count < mg_before && from == block && lower <= oldfrom) {
+		old = (rdr->keep > 0) ? mg_ctx.kept : 0;
+		drop = old - (mg_before - count);
+		count = (drop > 0) ? mg_before : count + old;
+		for (from=oldfrom; drop>0; drop--) {
+			eol = find_eol(from,block-from);
+			from = eol + 1;
+			if (*eol == '\r' && from < block && *from == '\n') {
+				from++;
+			}
+		}
+	}
+	for (; count<mg_before && from > lower; count++) {
+		from = line_back(lower,from);
+	}
+	rdr->keep = end - from;
+	mg_ctx.kept = count;
+	mg_ctx.back = (mg_ctx.printed != NULL) ? end - mg_ctx.printed : -1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// context_restore function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader of the stream being searched
+// block is the run about to be searched, which starts where the last run ended
+// points the context state into the reader's buffer again after it may have
+//  been refilled - every byte in the buffer before the run is an earlier part
+//  of the stream, and the last printed line is only remembered if it is still
+//  in the buffer
+void context_restore(struct line_reader *rdr, char *block) {
+	mg_ctx.floor = rdr->buff;
+	if (mg_ctx.back >= 0 && mg_ctx.back <= block - rdr->buff) {
+		mg_ctx.printed = block - mg_ctx.back;
+	}
+	else { mg_ctx.printed = NULL; }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines
+// size is the size of the run, including the last line ending if there is one
+// file_pathname is the file path the lines came from
+// splits the run into lines and prints every one, returns the number of lines
+//  printed
+// note: with the -c or -o option the lines are only counted, and with the -l
+//        or -q option, or for a binary file, the first line is enough, so
+//        nothing is split at all
+long print_lines(char *data, size_t size, char *file_pathname) {
+	// number of lines printed
+	long count = 0;
+	// end of the run
+	char *end = data + size;
+	// line ending of each line
+	char *eol;
+
+	if (mg_mode >= MODE_LIST || (mg_binary && mg_mode == MODE_PRINT)) {
+		if (size == 0) { return(0); }
+		mg_stop = TRUE;
+		return(1);
+	}
+	// a line selected by the invert option holds no match to print for
+	//  the -o option
+	if (mg_mode == MODE_COUNT || mg_only) {
+		return(count_lines(data,size));
+	}
+	// with no prefix to add, the lines are printed as they are
+	if (! mg_printfname && ! mg_lineno && ! mg_byteoff) {
+		return(print_span(data,size));
+	}
+	while (data < end) {
+		eol = find_eol(data,end-data);
+		// the last line of the file may have no line ending
+		if (eol == NULL) { eol = end; }
+		print_line(data,eol-data,file_pathname,':');
+		count++;
+		// skip the line ending, treating "\r\n" as one ending
+		data = eol + 1;
+		if (eol < end && *eol == '\r' && data < end && *data == '\n') {
+			data++;
+		}
+		// print_line moved the line number on to this line, so the
+		//  next line is one more, with nothing to count
+		if (mg_lineno) {
+			mg_lines.offset += data - mg_lines.at;
+			mg_lines.at = data;
+			mg_lines.lineno++;
+		}
+	}
+	return(count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_span function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines
+// size is the size of the run, including the last line ending if there is one
+// prints every line of the run with no prefix, returns the number of lines
+//  printed
+// note: lines ending in '\n' are printed just as they are in the run, so each
+//        stretch of them is written as one span with out_span - only a line
+//        ending in '\r', which is printed ending in '\n', and a last line
+//        with no line ending are printed by themselves
+long print_span(char *data, size_t size) {
+	// number of lines printed
+	long count = 0;
+	// end of the run
+	char *end = data + size;
+	// next '\r' in the run
+	char *cr;
+	// end of the stretch of lines ending in '\n', and each '\n' in it
+	char *stop, *lf;
+
+	while (data < end) {
+		cr = memchr(data,'\r',end-data);
+		stop = end;
+		if (cr != NULL) {
+			lf = memrchr(data,'\n',cr-data);
+			stop = (lf != NULL) ? lf + 1 : data;
+		}
+		for (lf=data; (lf = memchr(lf,'\n',stop-lf)) != NULL; lf++) {
+			count++;
+		}
+		out_span(&mg_out,data,stop-data);
+		// the last line of the file may have no line ending
+		if (cr == NULL) {
+			if (end[-1] != '\n') {
+				out_write(&mg_out,"\n",1);
+				count++;
+			}
+			break;
+		}
+		print_line(stop,cr-stop,NULL,':');
+		count++;
+		// skip the line ending, treating "\r\n" as one ending
+		data = cr + 1;
+		if (data < end && *data == '\n') { data++; }
+	}
+	return(count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_result function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// file_pathname is the file path that was searched, null if stdin
+// matchcount is the number of lines selected in the file
+// prints the number of selected lines with the -c option (prefixed by the
+//  filename if more than one file was specified), or the filename if any
+//  lines were selected with the -l option, or "Binary file X matches" if any
+//  lines of a binary file were selected - nothing in the other modes
+void print_result(char *file_pathname, long matchcount) {
+	// the count as text
+	char countstr[32];
+	// name to print for the file
+	char *name = (file_pathname != NULL) ? file_pathname : STDIN_NAME;
+
+	if (mg_binary && mg_mode == MODE_PRINT && matchcount > 0) {
+		out_write(&mg_out,"Binary file ",12);
+		out_write(&mg_out,name,strlen(name));
+		out_write(&mg_out," matches\n",9);
+	}
+	else if (mg_mode == MODE_LIST && matchcount > 0) {
+		out_write(&mg_out,name,strlen(name));
+		out_write(&mg_out,"\n",1);
+	}
+	else if (mg_mode == MODE_COUNT) {
+		if (mg_printfname) {
+			out_write(&mg_out,name,strlen(name));
+			out_write(&mg_out,":",1);
+		}
+		snprintf(countstr,sizeof(countstr),"%ld\n",matchcount);
+		out_write(&mg_out,countstr,strlen(countstr));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// find_eol function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of the bytes to search
+// size is the number of bytes to search
+// returns a pointer to the first '\n' or '\r', or null if there is none
+// note: the search is done in windows of EOL_WINDOW bytes, so that looking for
+//        a '\n' in a file that only uses '\r' does not search to the end
+char *find_eol(char *data, size_t size) {
+	// number of bytes searched in each window
+	size_t n;
+	// line endings found in the window
+	char *lf, *cr;
+
+	while (size > 0) {
+		n = (size < EOL_WINDOW) ? size : EOL_WINDOW;
+		lf = memchr(data,'\n',n);
+		cr = memchr(data,'\r',(lf != NULL) ? (size_t)(lf-data) : n);
+		if (cr != NULL) { return(cr); }
+		if (lf != NULL) { return(lf); }
+		data += n;
+		size -= n;
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// find_eol_back function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of the bytes to search
+// size is the number of bytes to search
+// returns a pointer to the last '\n' or '\r', or null if there is none
+// note: the search is done backwards in windows of EOL_WINDOW bytes, as in
+//        find_eol
+char *find_eol_back(char *data, size_t size) {
+	// number of bytes searched in each window
+	size_t n;
+	// line endings found in the window
+	char *lf, *cr;
+	// start of the part of the window after the '\n'
+	char *from;
+
+	while (size > 0) {
+		n = (size < EOL_WINDOW) ? size : EOL_WINDOW;
+		from = data + size - n;
+		lf = memrchr(from,'\n',n);
+		if (lf != NULL) { from = lf + 1; }
+		cr = memrchr(from,'\r',data+size-from);
+		if (cr != NULL) { return(cr); }
+		if (lf != NULL) { return(lf); }
+		size -= n;
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_line function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// line is the line to print, which does not need to be null-terminated
+// linelen is the length of the line
+// file_pathname is the file path the line came from
+// sep is the char after the filename, ':' for a selected line and '-' for a
+//  context line
+// copies a line into the thread's output buffer (written to stdout unless in a
+//  worker thread), prefixed by the filename if more than one file was
+//  specified, and by its line number and byte offset with the -n and -b
+//  options
+void print_line(char *line, size_t linelen, char *file_pathname, char sep) {
+	// the thread's output buffer
+	struct out_buf *out = &mg_out;
+	// length of the filename prefix, not including the separator
+	size_t prefixlen = (mg_printfname) ? strlen(file_pathname) : 0;
+
+	// a line number or byte offset is added by print_part
+	if (mg_lineno || mg_byteoff) {
+		print_part(line,line,linelen,file_pathname,sep);
+		return;
+	}
+	// in the common case the whole line fits in the buffer and is copied
+	//  in with no other work
+	if (out->len + prefixlen + linelen + 2 <= out->size) {
+		if (mg_printfname) {
+			memcpy(out->buff+out->len,file_pathname,prefixlen);
+			out->buff[out->len+prefixlen] = sep;
+			out->len += prefixlen + 1;
+		}
+		memcpy(out->buff+out->len,line,linelen);
+		out->buff[out->len+linelen] = '\n';
+		out->len += linelen + 1;
+		return;
+	}
+	// otherwise write it in pieces, which flushes the buffer as needed
+	if (mg_printfname) {
+		out_write(out,file_pathname,prefixlen);
+		out_write(out,&sep,1);
+	}
+	out_write(out,line,linelen);
+	out_write(out,"\n",1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_part function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// linestart is the start of the line the part is in
+// part is the part of the line to print - the whole line, or one match in it
+//  for the -o option
+// partlen is the length of the part
+// file_pathname is the file path the line came from
+// sep is the char after each prefix, ':' for a selected line and '-' for a
+//  context line
+// copies the part into the thread's output buffer the same way as print_line,
+//  prefixed by the filename if more than one file was specified, the number
+//  of the line with the -n option and the byte offset of the part with the -b
+//  option
+void print_part(char *linestart, char *part, size_t partlen,
+	char *file_pathname, char sep)
+{
+	// the thread's output buffer
+	struct out_buf *out = &mg_out;
+	// the line number and byte offset, each followed by sep
+	char prefix[48];
+	// length of the line number and byte offset
+	size_t prefixlen = 0;
+	// length of the filename, not including the separator
+	size_t namelen = (mg_printfname) ? strlen(file_pathname) : 0;
+
+	if (mg_lineno) {
+		lines_seek(linestart);
+		prefixlen += format_number(prefix,mg_lines.lineno);
+		prefix[prefixlen++] = sep;
+	}
+	if (mg_byteoff) {
+		prefixlen += format_number(prefix+prefixlen,mg_lines.offset +
+			(part - mg_lines.at));
+		prefix[prefixlen++] = sep;
+	}
+	// as in print_line, the whole line is copied in at once if it fits
+	if (out->len + namelen + prefixlen + partlen + 2 <= out->size) {
+		if (mg_printfname) {
+			memcpy(out->buff+out->len,file_pathname,namelen);
+			out->buff[out->len+namelen] = sep;
+			out->len += namelen + 1;
+		}
+		memcpy(out->buff+out->len,prefix,prefixlen);
+		memcpy(out->buff+out->len+prefixlen,part,partlen);
+		out->buff[out->len+prefixlen+partlen] = '\n';
+		out->len += prefixlen + partlen + 1;
+		return;
+	}
+	if (mg_printfname) {
+		out_write(out,file_pathname,namelen);
+		out_write(out,&sep,1);
+	}
+	out_write(out,prefix,prefixlen);
+	out_write(out,part,partlen);
+	out_write(out,"\n",1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_matches function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is this thread's scanner, with the compiled search strings
+// linestart is the start of a selected line
+// eol is the end of the line, not including its line ending
+// file_pathname is the file path the line came from
+// prints every match in the line on a line of its own with print_part, for
+//  the -o option - the matches do not overlap, and each one is the longest
+//  starting where the earliest one does, as in grep
+// note: a match of no bytes is never printed, so a line matching only an empty
+//        search string, or an expression such as 'a*' with no 'a', prints
+//        nothing
+void print_matches(struct mygrep_scanner *sc, char *linestart, char *eol,
+	char *file_pathname)
+{
+	// search position, and the start and end of each match
+	char *from = linestart, *start, *end;
+
+	while (mg_out.err == 0 &&
+		(end = match_span(sc,linestart,eol,from,&start)) != NULL)
+	{
+		print_part(linestart,start,end-start,file_pathname,':');
+		from = end;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// match_span function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner, with the compiled search strings and the DFA
+// linestart is the start of the line
+// eol is the end of the line, not including its line ending
+// from is where in the line to start looking
+// start is set to the start of the match found
+// finds the first match in the line at or after from that is not empty - of
+//  all the matches starting there, the longest - returns a pointer to its end,
+//  or null if there is none
+// note: a single search string is found with the search function and is as
+//        long as the search string, except with the -i option outside ASCII,
+//        where utf8_match gives its length - the Aho-Corasick automaton and
+//        the DFA only find where the first match ends, so the longest match
+//        is worked out from there
+// note: if the DFA cannot be set up, its errno is kept in the scanner
+char *match_span(struct mygrep_scanner *sc, char *linestart, char *eol,
+	char *from, char **start)
+{
+	// state of the Aho-Corasick automaton
+	int state = 0;
+	// the compiled search strings
+	struct searcher *srch = &sc->pat->srch;
+	// position in the line, and the end of the match found
+	char *pos, *end = NULL;
+	// the scanner's DFA
+	struct dfa_cache *dfa = &sc->dfa;
+	// length of the match at each position, -1 if there is none
+	long len;
+
+	if (srch->nevermatch || srch->find == search_all) { return(NULL); }
+	// the earliest match ending gives the latest a match can start
+	if (srch->find == search_aho) {
+		for (pos=from; pos<eol; pos++) {
+			state = srch->trans[state*srch->nclasses+
+				srch->classes[(unsigned char) *pos]];
+			if (end != NULL && pos + 1 - *start > srch->maxlen) {
+				break;
+			}
+			// outlen is the longest search string ending here,
+			//  which starts earliest
+			if (srch->outlen[state] != 0 && (end == NULL ||
+				pos + 1 - srch->outlen[state] <= *start))
+			{
+				*start = pos + 1 - srch->outlen[state];
+				end = pos + 1;
+			}
+		}
+		return(end);
+	}
+	if (srch->find == NULL) {
+		if (dfa->re != srch->re && dfa_init(dfa,srch->re) != 0) {
+			sc->err = errno;
+			return(NULL);
+		}
+		while (from < eol) {
+			// the DFA takes the start of the text as the start of a
+			//  line, so it only says where a match can end when it
+			//  is, or when the expression has no '^'
+			end = eol - 1;
+			if (from == linestart || ! srch->re->bol) {
+				end = regex_scan(dfa,from,eol-from);
+				if (end == NULL) { return(NULL); }
+			}
+			for (; from <= end && from < eol; from++) {
+				len = regex_longest(dfa,linestart,eol,from);
+				if (len > 0) {
+					*start = from;
+					return(from + len);
+				}
+			}
+		}
+		return(NULL);
+	}
+	*start = srch->find(srch,from,eol-from);
+	if (*start == NULL) { return(NULL); }
+	if (srch->find == search_utf8_icase) {
+		return(*start + utf8_match(srch,*start,eol-*start));
+	}
+	return(*start + srch->len);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// lines_reset function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of the file being searched, or null for a stream whose
+//  first block is not read yet
+// sets the line number and byte offset of the thread to the start of a file
+void lines_reset(char *data) {
+	mg_lines.at = data;
+	mg_lines.lineno = 1;
+	mg_lines.offset = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// lines_seek function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// to is the start of a line in the same data as the thread's position, before
+//  or after it
+// moves the thread's line number and byte offset to the line at to, counting
+//  the lines in between with count_lines - only with the -n option, the byte
+//  offset alone needs no counting
+void lines_seek(char *to) {
+	if (mg_lineno) {
+		if (to >= mg_lines.at) {
+			mg_lines.lineno += count_lines(mg_lines.at,
+				to-mg_lines.at);
+		}
+		else { mg_lines.lineno -= count_lines(to,mg_lines.at-to); }
+	}
+	mg_lines.offset += to - mg_lines.at;
+	mg_lines.at = to;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// count_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of whole lines
+// size is the size of the run
+// returns the number of lines in the run - each '\n', each '\r' that is not
+//  part of a "\r\n", and a last line with no line ending
+// note: with SSE2 both line endings are counted in one pass over the run, 16
+//        bytes at a time - each block is compared again one byte further on
+//        to tell a lone '\r' from the start of a "\r\n" - without it with
+//        memchr, one pass for each line ending
+unsigned long long count_lines(char *data, size_t size) {
+	// number of lines
+	unsigned long long count = 0;
+	// end of the run, and each line ending found
+	char *end = data + size, *pos = data;
+#ifdef MG_X86
+	// each line ending copied to every lane
+	__m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	// block of the run, and the block one byte further on
+	__m128i blk, nextblk;
+	// line endings counted in each lane, and their sum
+	__m128i lanes = _mm_setzero_si128(), sum;
+	// number of blocks counted in the lanes, which hold at most 255
+	int blocks = 0;
+
+	for (; end - pos > 16; pos += 16) {
+		blk = _mm_loadu_si128((__m128i *) pos);
+		nextblk = _mm_loadu_si128((__m128i *) (pos+1));
+		// a lane that matches is -1, so subtracting it counts it
+		lanes = _mm_sub_epi8(lanes,_mm_cmpeq_epi8(blk,lf));
+		lanes = _mm_sub_epi8(lanes,_mm_andnot_si128(
+			_mm_cmpeq_epi8(nextblk,lf),_mm_cmpeq_epi8(blk,cr)));
+		// add up the lanes before they can overflow, and after the
+		//  last block
+		if (++blocks == 255 || end - pos <= 32) {
+			sum = _mm_sad_epu8(lanes,_mm_setzero_si128());
+			count += _mm_cvtsi128_si32(sum) +
+				_mm_extract_epi16(sum,4);
+			lanes = _mm_setzero_si128();
+			blocks = 0;
+		}
+	}
+	// the bytes left over at the end, which cannot be read one past
+	for (; pos < end; pos++) {
+		if (*pos == '\n' || (*pos == '\r' && (pos+1 == end ||
+			pos[1] != '\n')))
+		{
+			count++;
+		}
+	}
+#else
+	for (; (pos = memchr(pos,'\n',end-pos)) != NULL; pos++) {
+		count++;
+	}
+	for (pos=data; (pos = memchr(pos,'\r',end-pos)) != NULL; pos++) {
+		if (pos+1 == end || pos[1] != '\n') { count++; }
+	}
+#endif
+	if (size > 0 && end[-1] != '\n' && end[-1] != '\r') { count++; }
+	return(count);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// format_number function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// buff is filled with the number in decimal, not null-terminated, and must
+//  have room for 20 digits
+// num is the number
+// returns the number of digits
+size_t format_number(char *buff, unsigned long long num) {
+	// digits from the last one back
+	char digits[20];
+	// number of digits, and index of each digit
+	size_t len = 0, idx;
+
+	do {
+		digits[len++] = '0' + num % 10;
+		num /= 10;
+	} while (num > 0);
+	for (idx=0; idx<len; idx++) { buff[idx] = digits[len-1-idx]; }
+	return(len);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out is the output buffer to set up
+// fd is the file descriptor to write to, or -1 for a buffer that grows
+// allocates the buffer and resets its state, noting whether fd is a pipe,
+//  returns 0 on success or -1 if memory could not be allocated
+int out_init(struct out_buf *out, int fd) {
+	// file status from fstat()
+	struct stat st;
+
+	out->fd = fd;
+	out->len = 0;
+	out->err = 0;
+	out->iovcnt = 0;
+	out->mark = 0;
+	out->pipe = (fd >= 0 && fstat(fd,&st) == 0 && S_ISFIFO(st.st_mode));
+	out->mapbase = NULL;
+	out->mapfd = -1;
+	out->size = OUT_BUFF_SIZE;
+	out->buff = malloc(out->size * sizeof(char));
+	if (out->buff == NULL) {
+		out->size = 0;
+		out->err = errno;
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out_flush function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out is the output buffer to flush
+// writes the contents of the buffer, along with the runs of the input listed
+//  by out_span, to its file descriptor and empties it, returns 0 on success
+//  or -1 if the write failed, which also sets the buffer's error
+// note: a buffer that grows has nothing to flush to, so it is left as it is
+int out_flush(struct out_buf *out) {
+	// return value of the write
+	int ret;
+
+	if (out->err != 0) { return(-1); }
+	if (out->fd < 0) { return(0); }
+	if (out->iovcnt > 0) {
+		// the bytes buffered after the last run come last
+		if (out->len > out->mark) {
+			out->iov[out->iovcnt].iov_base = out->buff + out->mark;
+			out->iov[out->iovcnt].iov_len = out->len - out->mark;
+			out->iovcnt++;
+		}
+		ret = writev_all(out->fd,out->iov,out->iovcnt);
+		out->iovcnt = 0;
+		out->mark = 0;
+	}
+	else if (out->len > 0) { ret = write_all(out->fd,out->buff,out->len); }
+	else { return(0); }
+	if (ret != 0) {
+		out->err = errno;
+		return(-1);
+	}
+	out->len = 0;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out_write function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out is the output buffer to write to
+// data is the bytes to write
+// len is the number of bytes
+// copies the bytes into the buffer, flushing it first if they do not fit - a
+//  run of bytes too large for the buffer is written straight from the
+//  caller's memory instead of being copied, and a buffer without a file
+//  descriptor is doubled until they fit
+// note: errors are kept in the buffer's error, after which all output is
+//        dropped
+void out_write(struct out_buf *out, char *data, size_t len) {
+	// the grown buffer
+	char *temp;
+	// the size the buffer grows to
+	size_t newsize;
+
+	if (out->err != 0 || len == 0) { return; }
+	if (out->len + len > out->size) {
+		// a buffer that grows doubles until the bytes fit
+		if (out->fd < 0) {
+			newsize = (out->size > 0) ? out->size : OUT_BUFF_SIZE;
+			while (out->len + len > newsize) { newsize *= 2; }
+			temp = realloc(out->buff,newsize);
+			if (temp == NULL) {
+				out->err = errno;
+				return;
+			}
+			out->buff = temp;
+			out->size = newsize;
+			STATS_ADD(grows,1);
+		}
+		// otherwise make room by writing out what is buffered
+		else {
+			if (out_flush(out) != 0) { return; }
+			if (len > out->size) {
+				if (write_all(out->fd,data,len) != 0) {
+					out->err = errno;
+				}
+				return;
+			}
+		}
+	}
+	memcpy(out->buff+out->len,data,len);
+	out->len += len;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out_span function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// out is the output buffer to write to
+// data is a run of the input being searched, printed as it is
+// len is the length of the run
+// lists a run of at least OUT_SPAN_MIN bytes to be written straight from the
+//  input by out_flush, after what is buffered, instead of copying it - a run
+//  of at least OUT_SPLICE_MIN bytes of a mapped file is spliced from the page
+//  cache at once when the output is a pipe - and copies a shorter run into
+//  the buffer with out_write
+// note: the listed runs must be written with out_flush before the input is
+//        changed, see grep_region - vmsplice() is not used for the same
+//        reason, since a stream's buffer is refilled while the pipe may still
+//        hold its pages
+void out_span(struct out_buf *out, char *data, size_t len) {
+	// offset of the run in the mapped file
+	loff_t off;
+	// number of bytes spliced by each call
+	ssize_t nspliced;
+
+	if (out->err != 0 || len == 0) { return; }
+	if (out->fd < 0 || len < OUT_SPAN_MIN) {
+		out_write(out,data,len);
+		return;
+	}
+	if (out->pipe && out->mapfd != -1 && len >= OUT_SPLICE_MIN) {
+		if (out_flush(out) != 0) { return; }
+		off = data - out->mapbase;
+		STATS_BEGIN(STAGE_WRITE);
+		while (len > 0) {
+			nspliced = splice(out->mapfd,&off,out->fd,NULL,len,
+				SPLICE_F_MORE);
+			STATS_ADD(writes,1);
+			if (nspliced == -1 && errno == EINTR) { continue; }
+			// the rest is written from the mapping - the file
+			//  was truncated, or the pipe or file system cannot
+			//  splice, which is not tried again
+			if (nspliced <= 0) {
+				if (nspliced == -1 && errno != EAGAIN) {
+					out->pipe = FALSE;
+				}
+				break;
+			}
+			data += nspliced;
+			len -= nspliced;
+		}
+		STATS_END(STAGE_WRITE);
+		if (len == 0) { return; }
+	}
+	// the bytes buffered since the last run come before this one
+	if (out->len > out->mark) {
+		out->iov[out->iovcnt].iov_base = out->buff + out->mark;
+		out->iov[out->iovcnt].iov_len = out->len - out->mark;
+		out->iovcnt++;
+		out->mark = out->len;
+	}
+	out->iov[out->iovcnt].iov_base = data;
+	out->iov[out->iovcnt].iov_len = len;
+	out->iovcnt++;
+	// room is kept for the buffered bytes after the last run
+	if (out->iovcnt >= OUT_IOV - 2) { out_flush(out); }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// write_all function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fd is the file descriptor to write to
+// data is the bytes to write
+// len is the number of bytes
+// writes all the bytes, retrying after partial writes and interrupted calls,
+//  returns 0 on success or -1 if write() fails, with errno set
+int write_all(int fd, char *data, size_t len) {
+	// number of bytes written by each call
+	ssize_t nwritten;
+
+	STATS_BEGIN(STAGE_WRITE);
+	while (len > 0) {
+		nwritten = write(fd,data,len);
+		STATS_ADD(writes,1);
+		if (nwritten == -1) {
+			if (errno == EINTR) { continue; }
+			break;
+		}
+		data += nwritten;
+		len -= nwritten;
+	}
+	STATS_END(STAGE_WRITE);
+	return((len > 0) ? -1 : 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// writev_all function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fd is the file descriptor to write to
+// iov is the array of runs of bytes to write, which is changed
+// iovcnt is the number of runs
+// writes all the runs in order, retrying after partial writes and interrupted
+//  calls the same way as write_all, returns 0 on success or -1 if writev()
+//  fails, with errno set
+int writev_all(int fd, struct iovec *iov, int iovcnt) {
+	// number of bytes written by each call
+	ssize_t nwritten;
+
+	STATS_BEGIN(STAGE_WRITE);
+	while (iovcnt > 0) {
+		// empty runs are skipped, so a run is only left when it is done
+		if (iov->iov_len == 0) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+		nwritten = writev(fd,iov,iovcnt);
+		STATS_ADD(writes,1);
+		if (nwritten == -1) {
+			if (errno == EINTR) { continue; }
+			break;
+		}
+		while (iovcnt > 0 && (size_t) nwritten >= iov->iov_len) {
+			nwritten -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *) iov->iov_base + nwritten;
+			iov->iov_len -= nwritten;
+		}
+	}
+	STATS_END(STAGE_WRITE);
+	return((iovcnt > 0) ? -1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sigbus_handler function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// signum is the signal number
+// jumps back to grep_file when a mapped file is truncated while it is being
+//  searched, any other SIGBUS gets the default action
+// note: SIGBUS from a memory access is delivered to the thread that made it,
+//        so the thread's own jump buffer is used
+void sigbus_handler(int signum) {
+	if (mg_in_mapping) { siglongjmp(mg_sigbus_jmp,1); }
+	signal(signum,SIG_DFL);
+	raise(signum);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader to set up
+// fd is an open file descriptor to read from
+// resets the reader state for a new stream, allocating the block buffer only
+//  if the reader does not already own one, returns 0 on success or -1 if
+//  memory could not be allocated
+// note: the decompression thread the reader takes its data from is left as
+//        it is, grep_compressed sets it around the search of the stream
+int reader_init(struct line_reader *rdr, int fd) {
+	rdr->fd = fd;
+	// keep the buffer from the previous stream, including any growth
+	if (rdr->buff == NULL) {
+		rdr->buffsize = BUFF_SIZE;
+		rdr->buff = malloc(rdr->buffsize * sizeof(char));
+		if (rdr->buff == NULL) { return(-1); }
+	}
+	rdr->start = 0;
+	rdr->end = 0;
+	rdr->scanned = 0;
+	rdr->keep = 0;
+	rdr->eof = FALSE;
+	rdr->ended = FALSE;
+	rdr->checked = FALSE;
+	rdr->binary = FALSE;
+	rdr->partial = FALSE;
+	rdr->overlap = 0;
+	rdr->skipping = FALSE;
+	rdr->skipped = 0;
+	rdr->cutlines = 0;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader to release
+// frees the block buffer, the file descriptor is left open
+void reader_free(struct line_reader *rdr) {
+	free(rdr->buff);
+	rdr->buff = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_fill function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader to fill
+// moves any unconsumed data, and the bytes before it that are kept, to the
+//  front of the buffer, grows the buffer if it is still full, then reads the
+//  next block from the file descriptor, or from the decompression thread for a
+//  compressed file
+// returns 0 on success (including end of file, which sets the eof flag) or -1
+//  if an I/O error or memory error occurs
+int reader_fill(struct line_reader *rdr) {
+	// number of bytes returned by read()
+	ssize_t nread;
+	// start of the bytes kept in the buffer
+	size_t from = rdr->start - rdr->keep;
+	// unconsumed bytes left in the buffer, and the bytes kept before them
+	size_t remain = rdr->end - from;
+	// end of the data before this fill, where the binary check starts
+	size_t first;
+
+	// slide the partial line down to the front of the buffer so the free
+	//  space is all at the end
+	if (from > 0) {
+		memmove(rdr->buff,rdr->buff+from,remain);
+		rdr->scanned -= from;
+		rdr->start -= from;
+		rdr->end = remain;
+	}
+	// if a single line fills the whole buffer, or the lines kept for -B
+	//  fill more than half of it, double the buffer size, so each fill
+	//  still reads at least half a buffer (a binary stream prints no
+	//  lines, and its lines are cut rather than grow the buffer)
+	if (rdr->end == rdr->buffsize || (rdr->keep > 0 && ! rdr->binary &&
+		rdr->end > rdr->buffsize / 2))
+	{
+		// reallocate memory up to the new buffer size
+		char *temp = realloc(rdr->buff,rdr->buffsize*2);
+		// return error if realloc fails, the old buffer is still owned
+		//  by the reader and is freed by reader_free
+		if (temp == NULL) { return(-1); }
+		rdr->buff = temp;
+		rdr->buffsize *= 2;
+		STATS_ADD(grows,1);
+	}
+	first = rdr->end;
+	if (rdr->ended) {
+		rdr->ended = FALSE;
+		rdr->eof = TRUE;
+		return(0);
+	}
+	// read as much as will fit, retrying if interrupted by a signal - the
+	//  first block decides whether the stream is binary, so until then the
+	//  reads go on until BUFF_SIZE bytes are in or the file ends, since a
+	//  pipe returns only what has arrived so far and a stream must be
+	//  decided the same way as a file
+	do {
+		STATS_BEGIN(STAGE_READ);
+		if (rdr->pipe != NULL) {
+			nread = decomp_read(rdr->pipe,rdr->buff+rdr->end,
+				rdr->buffsize-rdr->end);
+		}
+		else {
+			do {
+				nread = read(rdr->fd,rdr->buff+rdr->end,
+					rdr->buffsize-rdr->end);
+				STATS_ADD(reads,1);
+			} while (nread == -1 && errno == EINTR);
+		}
+		STATS_END(STAGE_READ);
+		if (nread == -1) { return(-1); }
+		STATS_ADD(bytes,nread);
+		// a read of zero bytes means the end of the file was reached,
+		//  left for the next fill if this one read anything
+		if (nread == 0 && rdr->end > first) { rdr->ended = TRUE; }
+		else if (nread == 0) { rdr->eof = TRUE; }
+		rdr->end += nread;
+	} while (! rdr->checked && ! mg_text && nread > 0 &&
+		rdr->end - first < BUFF_SIZE && rdr->end < rdr->buffsize);
+	// the -a option searches every file as text
+	if (! rdr->checked && rdr->end > first) {
+		rdr->checked = TRUE;
+		rdr->binary = (! mg_text &&
+			data_binary(rdr->buff+first,rdr->end-first));
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// get_next_block function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is a reader set up on an open file descriptor
+// block is set to point at the next run of whole lines in the reader's buffer
+// blocklen is set to the length of the run, including the last line ending
+// hands out every whole line currently in the block buffer at once, reading
+//  more blocks as needed, returns 1 if a run was found, 2 if part of a line
+//  too long for the buffer was found, 0 if the end of the file is reached, or
+//  -1 if an I/O error occurs
+// note: the run ends just after the last line ending in the buffer - a '\r'
+//        as the very last byte read is not counted until the next block
+//        shows if it is followed by a '\n', so a "\r\n" pair is never split
+//        between two runs
+// note: at the end of the file the last line may have no line ending
+// note: with the --max-line-length option a line longer than the limit is
+//        handed out cut after the limit, with no line ending, as if it ended
+//        there, and the rest of it is skipped - so the buffer never has to
+//        hold more than the limit of any line
+// note: with the partial flag a line filling the whole buffer is handed out
+//        in parts instead of growing the buffer, each starting with the last
+//        overlap bytes of the part before - a part is never more than one
+//        line, and the caller sets the skipping flag once a part is selected
+// note: the run points into the reader's buffer and is only valid until the
+//        next call to this function
+// note: this function should not print any error messages or other output and
+//        it must always return
+int get_next_block(struct line_reader *rdr, char **block, size_t *blocklen) {
+	// last '\n' and last '\r' in the part of the buffer searched
+	char *lf, *cr;
+	// start of the part of the buffer not yet searched
+	char *from;
+	// end of the run handed out
+	char *cut;
+
+	// this function can handle three types of line ending: "\n", "\r", or
+	//  "\r\n"
+	while (TRUE) {
+		// the rest of a line that was cut short or already selected is
+		//  not handed out, more is read until its line ending is found
+		if (rdr->skipping && ! reader_skip(rdr) && ! rdr->eof) {
+			if (reader_fill(rdr) != 0) { return(-1); }
+			continue;
+		}
+		// at the end of the file the rest of the buffer is the last run
+		if (rdr->eof) {
+			if (rdr->start == rdr->end || rdr->follow) {
+				return(0);
+			}
+			*block = rdr->buff + rdr->start;
+			*blocklen = rdr->end - rdr->start;
+			rdr->start = rdr->end;
+			return(1);
+		}
+		// only search the bytes read since the last search, the bytes
+		//  before them hold no usable line ending
+		if (rdr->scanned < rdr->start) { rdr->scanned = rdr->start; }
+		from = rdr->buff + rdr->scanned;
+		// find the last line ending of each kind with memrchr, leaving
+		//  out a '\r' that is the last byte read
+		lf = memrchr(from,'\n',rdr->end-rdr->scanned);
+		cr = memrchr(from,'\r',rdr->end-rdr->scanned);
+		if (cr != NULL && cr == rdr->buff + rdr->end - 1) {
+			cr = memrchr(from,'\r',cr-from);
+		}
+		cut = (lf == NULL || (cr != NULL && cr > lf)) ? cr : lf;
+		if (cut != NULL) {
+			cut++;
+			*block = rdr->buff + rdr->start;
+			// the run stops at a line longer than the limit
+			if (mg_maxline > 0) {
+				cut = reader_limit(rdr,*block,cut);
+			}
+			*blocklen = cut - *block;
+			rdr->start = cut - rdr->buff;
+			return(1);
+		}
+		// an unfinished line is cut once it is longer than the limit,
+		//  it holds no line ending to look for
+		if (mg_maxline > 0 && rdr->end - rdr->start > mg_maxline) {
+			*block = rdr->buff + rdr->start;
+			*blocklen = mg_maxline;
+			rdr->start += mg_maxline;
+			rdr->skipping = TRUE;
+			rdr->cutlines++;
+			return(1);
+		}
+		// a line filling the whole buffer is handed out as it is, up to
+		//  a last '\r' that may end it, and only the last overlap bytes
+		//  of the part are kept for the next part
+		cut = rdr->buff + rdr->end;
+		if (rdr->end > rdr->start && cut[-1] == '\r') { cut--; }
+		if (rdr->partial && rdr->end - (rdr->start - rdr->keep) ==
+			rdr->buffsize && (size_t) (cut - (rdr->buff +
+			rdr->start)) > rdr->overlap)
+		{
+			*block = rdr->buff + rdr->start;
+			*blocklen = cut - *block;
+			rdr->start = cut - rdr->buff - rdr->overlap;
+			rdr->scanned = cut - rdr->buff;
+			return(2);
+		}
+		// the lines of a binary stream are never printed, so a line
+		//  that would grow the buffer is cut after its last null byte
+		//  instead, as if null bytes ended lines
+		if (rdr->binary && rdr->end - (rdr->start - rdr->keep) ==
+			rdr->buffsize)
+		{
+			cut = memrchr(rdr->buff+rdr->start,'\0',
+				rdr->end-rdr->start);
+			if (cut != NULL) {
+				cut++;
+				*block = rdr->buff + rdr->start;
+				*blocklen = cut - *block;
+				rdr->start = cut - rdr->buff;
+				return(1);
+			}
+		}
+		// no whole line yet, only a trailing '\r' has to be searched
+		//  again after the next block is read
+		rdr->scanned = rdr->end;
+		if (rdr->end > rdr->start && rdr->buff[rdr->end-1] == '\r') {
+			rdr->scanned--;
+		}
+		if (reader_fill(rdr) != 0) { return(-1); }
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_skip function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is a reader skipping the rest of a line
+// skips the bytes in the buffer up to and including the next line ending,
+//  counting them in skipped, returns TRUE once the line ending is passed or
+//  FALSE if every byte in the buffer was skipped and the line goes on
+// note: a '\r' as the last byte read is kept until the next block shows if a
+//        '\n' follows it, unless the end of the file was reached
+// note: nothing before the rest of the line is kept for the -B option, the
+//        lines before it are too far back once a long line is skipped
+int reader_skip(struct line_reader *rdr) {
+	// start and end of the bytes in the buffer
+	char *from = rdr->buff + rdr->start, *end = rdr->buff + rdr->end;
+	// line ending of the line, and the first byte not skipped
+	char *eol = find_eol(from,end-from), *next;
+
+	if (eol == NULL) { next = end; }
+	else if (*eol == '\r' && eol+1 == end && (! rdr->eof || rdr->follow)) {
+		next = eol;
+	}
+	else {
+		next = eol + 1;
+		if (*eol == '\r' && next < end && *next == '\n') { next++; }
+		rdr->skipping = FALSE;
+	}
+	rdr->skipped += next - from;
+	rdr->start = next - rdr->buff;
+	rdr->scanned = rdr->start;
+	rdr->keep = 0;
+	return(! rdr->skipping);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_limit function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader
+// from is the start of a run of whole lines in the reader's buffer
+// to is the end of the run, just after its last line ending
+// looks for a line longer than the --max-line-length limit in the run, only
+//  while the rest of the run is longer than the limit, returns the end of the
+//  run, or the point the first such line is cut at, setting the skipping flag
+//  for the rest of it
+char *reader_limit(struct line_reader *rdr, char *from, char *to) {
+	// line ending of each line
+	char *eol;
+
+	while ((size_t) (to - from) > mg_maxline) {
+		// a line no longer than the limit ends within one byte of it
+		eol = find_eol(from,mg_maxline+1);
+		if (eol == NULL) {
+			rdr->skipping = TRUE;
+			rdr->cutlines++;
+			return(from + mg_maxline);
+		}
+		from = eol + 1;
+		if (*eol == '\r' && from < to && *from == '\n') { from++; }
+	}
+	return(to);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// reader_report_cut function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// rdr is the reader of a stream
+// file_pathname is the file path the stream came from, null for stdin
+// prints to stderr how many lines of the stream the --max-line-length option
+//  cut since the last report, if any
+void reader_report_cut(struct line_reader *rdr, char *file_pathname) {
+	if (rdr->cutlines == 0) { return; }
+	fprintf(stderr,"%s: %lu line%s of '%s' longer than %lu bytes, only the "
+		"first %lu bytes searched\n",PROG_NAME,rdr->cutlines,
+		(rdr->cutlines == 1) ? "" : "s",
+		(file_pathname != NULL) ? file_pathname : STDIN_NAME,
+		(unsigned long) mg_maxline,(unsigned long) mg_maxline);
+	rdr->cutlines = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_open function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dp is the decompression pipe to set up
+// fd is the file descriptor of the compressed file, at its start
+// type is the compression format, COMP_GZIP or COMP_ZSTD
+// file_pathname is the path of the file, for error messages
+// allocates the buffers and decompression state and starts the thread that
+//  decompresses the file, returns 0 on success or -1 with errno set on error
+int decomp_open(struct decomp_pipe *dp, int fd, int type,
+	char *file_pathname)
+{
+	// index of the block
+	int idx;
+	// return value of pthread_create
+	int ret;
+
+	memset(dp,0,sizeof(*dp));
+	dp->fd = fd;
+	dp->type = type;
+	dp->file_pathname = file_pathname;
+	dp->instream = TRUE;
+	dp->inbuff = malloc(BUFF_SIZE);
+	if (dp->inbuff == NULL) { return(-1); }
+	for (idx=0; idx<DECOMP_QUEUE; idx++) {
+		dp->blocks[idx] = malloc(DECOMP_BLOCK);
+		if (dp->blocks[idx] == NULL) {
+			decomp_free(dp);
+			return(-1);
+		}
+	}
+#ifdef MG_ZLIB
+	// a window of 15 bits plus 16 only accepts the gzip format
+	if (type == COMP_GZIP && inflateInit2(&dp->zs,15+16) != Z_OK) {
+		decomp_free(dp);
+		errno = ENOMEM;
+		return(-1);
+	}
+#endif
+#ifdef MG_ZSTD
+	if (type == COMP_ZSTD) {
+		dp->zds = ZSTD_createDStream();
+		if (dp->zds == NULL ||
+			ZSTD_isError(ZSTD_initDStream(dp->zds)))
+		{
+			decomp_free(dp);
+			errno = ENOMEM;
+			return(-1);
+		}
+		dp->zin.src = dp->inbuff;
+	}
+#endif
+	pthread_mutex_init(&dp->lock,NULL);
+	pthread_cond_init(&dp->fullcond,NULL);
+	pthread_cond_init(&dp->spacecond,NULL);
+	ret = pthread_create(&dp->thread,NULL,decomp_worker,dp);
+	if (ret != 0) {
+		pthread_cond_destroy(&dp->spacecond);
+		pthread_cond_destroy(&dp->fullcond);
+		pthread_mutex_destroy(&dp->lock);
+		decomp_free(dp);
+		errno = ret;
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_close function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dp is a decompression pipe set up by decomp_open
+// stops the decompression thread if it is still running, waits for it to exit
+//  and frees the buffers and decompression state
+void decomp_close(struct decomp_pipe *dp) {
+	pthread_mutex_lock(&dp->lock);
+	dp->quit = TRUE;
+	pthread_cond_signal(&dp->spacecond);
+	pthread_mutex_unlock(&dp->lock);
+	pthread_join(dp->thread,NULL);
+	pthread_cond_destroy(&dp->spacecond);
+	pthread_cond_destroy(&dp->fullcond);
+	pthread_mutex_destroy(&dp->lock);
+	decomp_free(dp);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dp is a decompression pipe with no thread running
+// frees the buffers and decompression state, any of which may not have been
+//  set up yet
+void decomp_free(struct decomp_pipe *dp) {
+	// index of the block
+	int idx;
+
+#ifdef MG_ZLIB
+	// inflateEnd() does nothing for a stream that was never set up
+	if (dp->type == COMP_GZIP) { inflateEnd(&dp->zs); }
+#endif
+#ifdef MG_ZSTD
+	if (dp->type == COMP_ZSTD) { ZSTD_freeDStream(dp->zds); }
+#endif
+	for (idx=0; idx<DECOMP_QUEUE; idx++) { free(dp->blocks[idx]); }
+	free(dp->inbuff);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_read function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dp is a decompression pipe set up by decomp_open
+// buff is the buffer to copy decompressed data into
+// len is the size of the buffer
+// waits until a decompressed block is ready, then copies as much of the
+//  blocks waiting as fits, returns the number of bytes copied, 0 at the end of
+//  the decompressed data, or -1 with errno set if decompression failed
+// note: this takes the place of read() for the reader of a compressed file
+ssize_t decomp_read(struct decomp_pipe *dp, char *buff, size_t len) {
+	// number of bytes copied
+	size_t copied = 0;
+	// bytes copied from the oldest block
+	size_t take;
+	// number of blocks waiting
+	int count;
+
+	pthread_mutex_lock(&dp->lock);
+	while (dp->count == 0 && ! dp->done) {
+		pthread_cond_wait(&dp->fullcond,&dp->lock);
+	}
+	count = dp->count;
+	pthread_mutex_unlock(&dp->lock);
+	// the thread only stops with no blocks waiting at the end of the data
+	//  or after an error
+	if (count == 0) {
+		if (dp->err != 0) {
+			errno = dp->err;
+			return(-1);
+		}
+		return(0);
+	}
+	// the blocks counted were filled before they were added, so they can
+	//  be read without holding the lock
+	while (copied < len && count > 0) {
+		take = dp->lens[dp->head] - dp->pos;
+		if (take > len - copied) { take = len - copied; }
+		memcpy(buff+copied,dp->blocks[dp->head]+dp->pos,take);
+		copied += take;
+		dp->pos += take;
+		// hand a finished block back to the decompression thread
+		if (dp->pos == dp->lens[dp->head]) {
+			dp->pos = 0;
+			pthread_mutex_lock(&dp->lock);
+			dp->head = (dp->head + 1) % DECOMP_QUEUE;
+			dp->count--;
+			count = dp->count;
+			pthread_cond_signal(&dp->spacecond);
+			pthread_mutex_unlock(&dp->lock);
+		}
+	}
+	return(copied);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_worker function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// arg is the decompression pipe set up by decomp_open
+// decompression thread started by decomp_open - fills the free blocks of the
+//  ring with decompressed data and hands them to the searching thread, until
+//  the end of the file, an error, or the searching thread stops it
+void *decomp_worker(void *arg) {
+	// the shared pipe state
+	struct decomp_pipe *dp = arg;
+	// index of the block being filled
+	int slot;
+	// length of the data put in the block
+	size_t blocklen;
+	// return value of decomp_fill
+	int status;
+
+	do {
+		// wait for a free block
+		pthread_mutex_lock(&dp->lock);
+		while (dp->count == DECOMP_QUEUE && ! dp->quit) {
+			pthread_cond_wait(&dp->spacecond,&dp->lock);
+		}
+		if (dp->quit) {
+			pthread_mutex_unlock(&dp->lock);
+			break;
+		}
+		slot = (dp->head + dp->count) % DECOMP_QUEUE;
+		pthread_mutex_unlock(&dp->lock);
+		// the free block is not touched by the searching thread until
+		//  it is added to the count
+		STATS_BEGIN(STAGE_DECOMP);
+		status = decomp_fill(dp,dp->blocks[slot],&blocklen);
+		STATS_END(STAGE_DECOMP);
+		pthread_mutex_lock(&dp->lock);
+		if (blocklen > 0) {
+			dp->lens[slot] = blocklen;
+			dp->count++;
+		}
+		if (status != 1) { dp->done = TRUE; }
+		pthread_cond_signal(&dp->fullcond);
+		pthread_mutex_unlock(&dp->lock);
+	} while (status == 1);
+	STATS_MERGE();
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// decomp_fill function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dp is the decompression pipe
+// block is the block to fill, DECOMP_BLOCK bytes long
+// blocklen is set to the length of the data put in the block
+// reads compressed data from the file and decompresses it into the block
+//  until the block is full, returns 1 if the block is full, 0 at the end of
+//  the file, or -1 on error, setting the error in the pipe and printing it to
+//  stderr
+// note: a file of several gzip members or zstd frames one after another, as
+//        made by concatenating compressed files, is decompressed as a whole,
+//        as by zcat
+int decomp_fill(struct decomp_pipe *dp, char *block, size_t *blocklen) {
+	// number of bytes read
+	ssize_t nread;
+	// compressed data not yet used
+	size_t avail;
+	// boolean flag set once read() reports the end of the file
+	int eof = FALSE;
+	// length of the data in the block before decompressing more
+	size_t before;
+	// reason decompression failed, NULL if it did not
+	const char *errmsg = NULL;
+#ifdef MG_ZLIB
+	// return value of inflate()
+	int ret;
+#endif
+#ifdef MG_ZSTD
+	// block being filled, for ZSTD_decompressStream()
+	ZSTD_outBuffer zout = { block, DECOMP_BLOCK, 0 };
+	// return value of ZSTD_decompressStream()
+	size_t zret;
+#endif
+
+	*blocklen = 0;
+#ifdef MG_ZLIB
+	dp->zs.next_out = (unsigned char *)block;
+	dp->zs.avail_out = DECOMP_BLOCK;
+#endif
+	while (*blocklen < DECOMP_BLOCK) {
+		avail = 0;
+#ifdef MG_ZLIB
+		if (dp->type == COMP_GZIP) { avail = dp->zs.avail_in; }
+#endif
+#ifdef MG_ZSTD
+		if (dp->type == COMP_ZSTD) { avail = dp->zin.size-dp->zin.pos; }
+#endif
+		// read more compressed data once it is all used
+		if (avail == 0 && ! eof) {
+			STATS_BEGIN(STAGE_READ);
+			do {
+				nread = read(dp->fd,dp->inbuff,BUFF_SIZE);
+				STATS_ADD(reads,1);
+			} while (nread == -1 && errno == EINTR);
+			STATS_END(STAGE_READ);
+			if (nread == -1) {
+				dp->err = errno;
+				fprintf(stderr,"%s: error reading file '%s': "
+					"%s\n",PROG_NAME,dp->file_pathname,
+					strerror(errno));
+				return(-1);
+			}
+			if (nread == 0) { eof = TRUE; }
+			else { dp->instream = TRUE; }
+			STATS_ADD(compressed,nread);
+#ifdef MG_ZLIB
+			dp->zs.next_in = dp->inbuff;
+			dp->zs.avail_in = nread;
+#endif
+#ifdef MG_ZSTD
+			dp->zin.size = nread;
+			dp->zin.pos = 0;
+#endif
+		}
+		// the end of the file may only come between streams
+		if (eof && ! dp->instream) { return(0); }
+		// the decompressor may still hold data after the input is used
+		//  up, so it is only cut short if it makes no more progress
+		before = *blocklen;
+#ifdef MG_ZLIB
+		if (dp->type == COMP_GZIP) {
+			ret = inflate(&dp->zs,Z_NO_FLUSH);
+			*blocklen = DECOMP_BLOCK - dp->zs.avail_out;
+			// a gzip member ended, another may follow it
+			if (ret == Z_STREAM_END) {
+				dp->instream = (dp->zs.avail_in > 0);
+				ret = inflateReset(&dp->zs);
+			}
+			// Z_BUF_ERROR only means more input is needed
+			if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				errmsg = (dp->zs.msg != NULL) ? dp->zs.msg :
+					"invalid compressed data";
+				break;
+			}
+		}
+#endif
+#ifdef MG_ZSTD
+		if (dp->type == COMP_ZSTD) {
+			zret = ZSTD_decompressStream(dp->zds,&zout,&dp->zin);
+			*blocklen = zout.pos;
+			if (ZSTD_isError(zret)) {
+				errmsg = ZSTD_getErrorName(zret);
+				break;
+			}
+			// 0 is returned once a frame is complete and flushed
+			dp->instream = (zret != 0 || dp->zin.pos<dp->zin.size);
+		}
+#endif
+		if (eof && dp->instream && *blocklen == before) {
+			errmsg = "unexpected end of file";
+			break;
+		}
+	}
+	if (errmsg != NULL) {
+		dp->err = EIO;
+		fprintf(stderr,"%s: file '%s' has invalid compressed data: "
+			"%s\n",PROG_NAME,dp->file_pathname,errmsg);
+		return(-1);
+	}
+	return(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_compile function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the searcher to set up
+// plist is the list of search strings, a line matches if any of them does
+// flags is MYGREP_ICASE and MYGREP_EXTENDED for the -i and -E options, any
+//  other flag is left for the caller
+// errmsg is set to a message if an expression is invalid, or to null if
+//  memory could not be allocated
+// compiles the search strings once for every stream searched, by the program
+//  and by the library interface alike - regular expressions into one NFA, a
+//  single search string with search_init, and several into one Aho-Corasick
+//  automaton
+// returns 0 on success or -1 on error
+// note: the searcher points into the search strings, which must be kept until
+//        it is freed with search_free
+// note: with the -i option letters outside ASCII are only folded if the
+//        LC_CTYPE locale uses UTF-8, as in grep, and then the same way however
+//        many search strings there are and whether or not they are regular
+//        expressions
+int search_compile(struct searcher *srch, struct pattern_list *plist,
+	int flags, char **errmsg)
+{
+	// how the search strings are compared with the text
+	int fold = CASE_EXACT;
+	// index of the search string
+	int pidx;
+
+	*errmsg = NULL;
+	if (flags & MYGREP_ICASE) {
+		fold = (strcmp(nl_langinfo(CODESET),"UTF-8") == 0) ?
+			CASE_WIDE : CASE_ASCII;
+	}
+	if (flags & MYGREP_EXTENDED) {
+		return(search_init_regex(srch,plist,fold,FALSE,errmsg));
+	}
+	if (plist->num == 1) {
+		return(search_init(srch,plist->pats[0],plist->lens[0],fold));
+	}
+	// the Aho-Corasick automaton only folds ASCII, so several search
+	//  strings with a char outside ASCII to fold are compiled as plain
+	//  strings into a regular expression instead, which folds them the
+	//  same as a single search string
+	for (pidx=0; pidx<plist->num && fold == CASE_WIDE; pidx++) {
+		if (pattern_wide(plist->pats[pidx],plist->lens[pidx])) {
+			return(search_init_regex(srch,plist,fold,TRUE,errmsg));
+		}
+	}
+	return(search_init_multi(srch,plist,fold));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pattern_wide function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// str is a search string, which does not need to be null-terminated
+// len is the length of the search string
+// returns TRUE if the search string has a byte outside ASCII, which with the
+//  -i option in a UTF-8 locale makes every char of it fold by FOLD_WIDE,
+//  otherwise FALSE
+int pattern_wide(char *str, size_t len) {
+	// position in the search string
+	size_t pos;
+
+	for (pos=0; pos<len; pos++) {
+		if ((unsigned char) str[pos] >= 0x80) { return(TRUE); }
+	}
+	return(FALSE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the searcher to set up
+// needle is the search string, which does not need to be null-terminated
+// len is the length of the search string
+// fold is how the search string is compared with the text, from the CASE_
+//  directives
+// preprocesses the search string and picks the search function: memchr for a
+//  single char, the SIMD first and last byte filter for short search strings
+//  (AVX2 if the processor supports it, otherwise SSE2), and Boyer-Moore-
+//  Horspool for long search strings - an empty search string (only possible
+//  with the -e or -f options) matches every line, as in grep
+// with the -i option the search functions that fold case are picked instead,
+//  see search_init_icase
+// returns 0 on success or -1 if memory could not be allocated
+int search_init(struct searcher *srch, char *needle, size_t len, int fold) {
+	// index into the search string and skip table
+	size_t idx;
+
+	memset(srch,0,sizeof(*srch));
+	srch->needle = needle;
+	srch->len = len;
+	srch->fold = fold;
+	srch->nevermatch = (memchr(needle,'\r',len) != NULL ||
+		memchr(needle,'\n',len) != NULL);
+	if (srch->len == 0) { srch->find = search_all; }
+	else if (fold != CASE_EXACT) { return(search_init_icase(srch)); }
+	else if (srch->len == 1) { srch->find = search_memchr; }
+	else if (srch->len <= SIMD_MAX_NEEDLE) {
+#ifdef MG_X86
+		// the processor is checked at runtime, so the same binary
+		//  runs on processors with and without AVX2
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			srch->find = search_avx2;
+		}
+		else { srch->find = search_sse2; }
+#else
+		srch->find = search_memmem;
+#endif
+	}
+	else {
+		// a mismatch on a byte that is not in the search string skips
+		//  the whole search string length, otherwise the skip lines up
+		//  the last occurrence of that byte (not counting the last
+		//  byte of the search string)
+		for (idx=0; idx<256; idx++) { srch->skip[idx] = srch->len; }
+		for (idx=0; idx<srch->len-1; idx++) {
+			srch->skip[(unsigned char) needle[idx]] =
+				srch->len - 1 - idx;
+		}
+		srch->find = search_horspool;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_init_icase function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the searcher being set up by search_init, with a search string of
+//  at least one char
+// sets up the search for the -i option: the search string is folded to lower
+//  case once, and each position of the text is folded only while it is
+//  compared, so the text is never copied - the SIMD filter compares the text
+//  with both cases of the first and last byte, and Boyer-Moore-Horspool skips
+//  on both cases of each byte
+// a search string with bytes outside ASCII in a UTF-8 locale is decoded and
+//  searched one char at a time with towupper() and towlower() instead, which
+//  is slower but folds every letter the locale knows
+// returns 0 on success or -1 if memory could not be allocated
+int search_init_icase(struct searcher *srch) {
+	// index into the search string and skip table
+	size_t idx;
+	// boolean flag for a byte outside ASCII in the search string
+	int nonascii = FALSE;
+	// lower and upper case of a byte of the search string
+	unsigned char lower, upper;
+	// position in the search string while decoding it
+	size_t pos;
+
+	srch->folded = malloc(srch->len);
+	if (srch->folded == NULL) { return(-1); }
+	for (idx=0; idx<srch->len; idx++) {
+		srch->folded[idx] = FOLD_ASCII((unsigned char) srch->needle[idx]);
+		if ((unsigned char) srch->needle[idx] >= 0x80) { nonascii = TRUE; }
+	}
+	if (nonascii && srch->fold == CASE_WIDE) {
+		srch->wneedle = malloc(srch->len * sizeof(wint_t));
+		if (srch->wneedle == NULL) { return(-1); }
+		for (pos=0, srch->wlen=0; pos<srch->len; srch->wlen++) {
+			pos += utf8_decode((unsigned char *) srch->needle+pos,
+				srch->len-pos,&srch->wneedle[srch->wlen]);
+			srch->wneedle[srch->wlen] =
+				FOLD_WIDE(srch->wneedle[srch->wlen]);
+		}
+		srch->find = search_utf8_icase;
+		return(utf8_prefilter(srch));
+	}
+#ifdef MG_X86
+	if (srch->len <= SIMD_MAX_NEEDLE) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			srch->find = search_avx2_icase;
+		}
+		else { srch->find = search_sse2_icase; }
+		return(0);
+	}
+#endif
+	// the skip for each byte is set for both of its cases
+	for (idx=0; idx<256; idx++) { srch->skip[idx] = srch->len; }
+	for (idx=0; idx<srch->len-1; idx++) {
+		lower = srch->folded[idx];
+		upper = (lower >= 'a' && lower <= 'z') ? lower - 0x20 : lower;
+		srch->skip[lower] = srch->len - 1 - idx;
+		srch->skip[upper] = srch->len - 1 - idx;
+	}
+	srch->find = search_horspool_icase;
+	return(0);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_init_multi function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the searcher to set up
+// plist is the list of search strings, which must hold at least two
+// fold is how the search strings are compared with the text, from the CASE_
+//  directives
+// compiles all the search strings into one Aho-Corasick automaton, with the
+//  failure links folded into a complete transition table so that searching
+//  never follows a failure link, returns 0 on success or -1 if memory could
+//  not be allocated
+// note: search strings with a line ending can never match a line, so they are
+//        left out, and an empty search string matches every line
+// note: with the -i option only ASCII letters are folded, so search_compile
+//        only gives search strings outside ASCII to it in other locales
+int search_init_multi(struct searcher *srch, struct pattern_list *plist,
+	int fold)
+{
+	// index of the search string being added
+	int pidx;
+	// position in the search string being added
+	size_t idx;
+	// most states the automaton can need, one per byte of search string
+	//  plus the root
+	size_t maxstates = 1;
+	// number of states used
+	int numstates = 1;
+	// failure link of each state, only needed while building
+	int *fail;
+	// queue of states for the breadth-first pass
+	int *queue;
+	// head and tail of the queue
+	int qhead = 0, qtail = 0;
+	// state being built, its child, and the byte class of the edge
+	int state, child, cls;
+	// the search string being added
+	unsigned char *pat;
+	// byte of the search string, folded with the -i option
+	int byte;
+
+	memset(srch,0,sizeof(*srch));
+	srch->fold = fold;
+	srch->find = search_aho;
+	srch->nevermatch = TRUE;
+	// give every byte used by a search string its own class
+	srch->nclasses = 1;
+	for (pidx=0; pidx<plist->num; pidx++) {
+		pat = (unsigned char *) plist->pats[pidx];
+		// an empty search string matches every line
+		if (plist->lens[pidx] == 0) {
+			srch->find = search_all;
+			srch->nevermatch = FALSE;
+			return(0);
+		}
+		if (memchr(pat,'\r',plist->lens[pidx]) != NULL ||
+			memchr(pat,'\n',plist->lens[pidx]) != NULL) { continue; }
+		srch->nevermatch = FALSE;
+		maxstates += plist->lens[pidx];
+		for (idx=0; idx<plist->lens[pidx]; idx++) {
+			byte = (fold != CASE_EXACT) ? FOLD_ASCII(pat[idx]) :
+				pat[idx];
+			if (srch->classes[byte] == 0) {
+				srch->classes[byte] = srch->nclasses++;
+			}
+		}
+	}
+	if (srch->nevermatch) { return(0); }
+	// with the -i option an upper case letter shares the class of its
+	//  lower case letter, so the automaton folds ASCII case for free
+	if (fold != CASE_EXACT) {
+		for (byte='A'; byte<='Z'; byte++) {
+			srch->classes[byte] = srch->classes[byte | 0x20];
+		}
+	}
+	srch->trans = calloc(maxstates * srch->nclasses,sizeof(int));
+	srch->outlen = calloc(maxstates,sizeof(int));
+	fail = calloc(maxstates,sizeof(int));
+	queue = malloc(maxstates * sizeof(int));
+	if (srch->trans == NULL || srch->outlen == NULL || fail == NULL ||
+		queue == NULL)
+	{
+		free(srch->trans);
+		free(srch->outlen);
+		free(fail);
+		free(queue);
+		srch->trans = NULL;
+		srch->outlen = NULL;
+		return(-1);
+	}
+	// build the trie of the search strings - state 0 is the root, and
+	//  since no edge of the trie leads back to the root, 0 also marks a
+	//  missing edge until the breadth-first pass fills it in
+	for (pidx=0; pidx<plist->num; pidx++) {
+		pat = (unsigned char *) plist->pats[pidx];
+		if (memchr(pat,'\r',plist->lens[pidx]) != NULL ||
+			memchr(pat,'\n',plist->lens[pidx]) != NULL) { continue; }
+		state = 0;
+		for (idx=0; idx<plist->lens[pidx]; idx++) {
+			byte = (fold != CASE_EXACT) ? FOLD_ASCII(pat[idx]) :
+				pat[idx];
+			cls = srch->classes[byte];
+			if (srch->trans[state*srch->nclasses+cls] == 0) {
+				srch->trans[state*srch->nclasses+cls] =
+					numstates++;
+			}
+			state = srch->trans[state*srch->nclasses+cls];
+		}
+		srch->outlen[state] = plist->lens[pidx];
+		if (srch->maxlen < (int) plist->lens[pidx]) {
+			srch->maxlen = plist->lens[pidx];
+		}
+	}
+	// visit the states in breadth-first order, setting the failure link
+	//  of each child and filling each missing edge with the edge from the
+	//  failure state, which is always finished already
+	queue[qtail++] = 0;
+	while (qhead < qtail) {
+		state = queue[qhead++];
+		for (cls=0; cls<srch->nclasses; cls++) {
+			child = srch->trans[state*srch->nclasses+cls];
+			if (child != 0) {
+				fail[child] = (state == 0) ? 0 :
+					srch->trans[fail[state]*srch->nclasses+
+					cls];
+				// a state also ends every search string its
+				//  failure state ends
+				if (srch->outlen[child] == 0) {
+					srch->outlen[child] =
+						srch->outlen[fail[child]];
+				}
+				queue[qtail++] = child;
+			}
+			else if (state != 0) {
+				srch->trans[state*srch->nclasses+cls] =
+					srch->trans[fail[state]*srch->nclasses+
+					cls];
+			}
+		}
+	}
+	free(fail);
+	free(queue);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_aho function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with an Aho-Corasick automaton
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the start of the first occurrence of any of the search
+//  strings in the text, or null if none of them occur
+char *search_aho(struct searcher *srch, char *hay, size_t haylen) {
+	// current state of the automaton
+	int state = 0;
+	// position in the text
+	size_t pos;
+
+	for (pos=0; pos<haylen; pos++) {
+		state = srch->trans[state*srch->nclasses+
+			srch->classes[(unsigned char) hay[pos]]];
+		if (srch->outlen[state] != 0) {
+			return(hay + pos + 1 - srch->outlen[state]);
+		}
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_all function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with an empty search string
+// hay is the text to search
+// haylen is the length of the text
+// returns a pointer to the start of the text, since an empty search string
+//  occurs everywhere, or null if there is no text left
+char *search_all(struct searcher *srch, char *hay, size_t haylen) {
+	(void) srch;
+	if (haylen == 0) { return(NULL); }
+	return(hay);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher set up by search_init or search_init_multi
+// frees the memory allocated for the searcher
+void search_free(struct searcher *srch) {
+	free(srch->trans);
+	free(srch->outlen);
+	free(srch->folded);
+	free(srch->wneedle);
+	if (srch->prefilter != NULL) {
+		search_free(srch->prefilter);
+		free(srch->prefilter);
+	}
+	free(srch->run);
+	if (srch->re != NULL) {
+		regex_free(srch->re);
+		free(srch->re);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_init_regex function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the searcher to set up
+// plist is the list of regular expressions, a line matches if any of them do
+// fold is how the expressions are compared with the text, from the CASE_
+//  directives
+// fixed is a boolean flag for search strings that are plain strings rather
+//  than regular expressions, see search_compile
+// errmsg is set to a message if an expression is invalid, or to null if
+//  memory could not be allocated
+// parses the regular expressions (POSIX extended syntax, as grep -E) and
+//  compiles them into one NFA, from which search_regex builds a DFA lazily
+// with the -i option in a UTF-8 locale each char of a pattern with chars
+//  outside ASCII is spelled out as the bytes of every char that folds the
+//  same, see re_parse_char, so the literal strings below are searched for
+//  folding only ASCII
+// the literal strings every match must contain are worked out from the parsed
+//  expression - if the expression only matches one string it is searched for
+//  with search_init like any other search string, and otherwise the longest
+//  string every match contains is searched for first, so the DFA only runs on
+//  the lines holding it
+// returns 0 on success or -1 on error
+// note: back-references and word boundaries are not supported, since the DFA
+//        needs neither to look back at the text nor to backtrack, which keeps
+//        every search linear in the length of the text
+int search_init_regex(struct searcher *srch, struct pattern_list *plist,
+	int fold, int fixed, char **errmsg)
+{
+	// the regular expression being compiled
+	struct regex *re;
+	// index of the pattern being parsed
+	int pidx;
+	// root of the parsed expression, and the root of each pattern
+	int root = -1, node;
+	// strings every match must contain
+	struct re_must must;
+	// the state that ends every match
+	int match;
+	// DFA used to find the bytes a match can start with
+	struct dfa_cache dfa;
+
+	memset(srch,0,sizeof(*srch));
+	*errmsg = NULL;
+	re = calloc(1,sizeof(*re));
+	if (re == NULL) { return(-1); }
+	srch->re = re;
+	srch->fold = fold;
+	re->fold = fold;
+	re->fixed = fixed;
+	// with more than one pattern, each is one branch of an alternation
+	if (plist->num > 1 && ! fixed) {
+		root = re_new_node(re,RE_ALT);
+		if (root == -1) { return(-1); }
+	}
+	for (pidx=0; pidx<plist->num && ! fixed; pidx++) {
+		re->pat = (unsigned char *) plist->pats[pidx];
+		re->len = plist->lens[pidx];
+		re->pos = 0;
+		re->depth = 0;
+		re->foldall = (fold == CASE_WIDE &&
+			pattern_wide((char *) re->pat,re->len));
+		node = re_parse_alt(re);
+		if (node == -1) {
+			*errmsg = re->err;
+			return(-1);
+		}
+		if (root == -1) { root = node; }
+		else { re_add_child(re,root,node); }
+	}
+	if (fixed) {
+		root = re_parse_strings(re,plist);
+		if (root == -1) {
+			*errmsg = NULL;
+			if (re->err != NULL) {
+				*errmsg = "Too many search strings to fold "
+					"with -i";
+			}
+			return(-1);
+		}
+	}
+	free(re->wide);
+	re->wide = NULL;
+	// an empty pattern file gives no expressions, and plain strings that
+	//  all have line endings give an empty alternation, which match nothing
+	if (root == -1 || re->nodes[root].child == -1) {
+		srch->nevermatch = TRUE;
+		return(0);
+	}
+	if (fold == CASE_WIDE) { fold = CASE_ASCII; }
+	re_must(re,root,&must);
+	// an expression matching only one string is searched for as a string,
+	//  keeping the expression around only to hold the string
+	if (must.exactlen >= 0) {
+		re->literal = malloc(must.exactlen + 1);
+		if (re->literal == NULL) { return(-1); }
+		memcpy(re->literal,must.exact,must.exactlen);
+		free(re->nodes);
+		re->nodes = NULL;
+		if (search_init(srch,re->literal,must.exactlen,fold) != 0) {
+			srch->re = re;
+			return(-1);
+		}
+		srch->re = re;
+		return(0);
+	}
+	match = re_new_state(re,RE_MATCH,-1,-1,-1);
+	if (match != -1) { re->start = re_compile(re,root,match); }
+	if (match == -1 || re->start == -1) {
+		*errmsg = re->err;
+		// plain strings can only be too big
+		if (fixed && re->err != NULL) {
+			*errmsg = "Too many search strings to fold with -i";
+		}
+		return(-1);
+	}
+	free(re->nodes);
+	re->nodes = NULL;
+	re_classes(re);
+	// the prefilter searches for the longest string every match contains
+	if (must.inlen > 0) {
+		re->literal = malloc(must.inlen + 1);
+		srch->prefilter = calloc(1,sizeof(struct searcher));
+		if (re->literal == NULL || srch->prefilter == NULL) {
+			return(-1);
+		}
+		memcpy(re->literal,must.in,must.inlen);
+		if (search_init(srch->prefilter,re->literal,must.inlen,
+			fold) != 0)
+		{
+			return(-1);
+		}
+	}
+	// a DFA is only set up to find the first bytes, each scanner builds its
+	//  own as it searches
+	memset(&dfa,0,sizeof(dfa));
+	if (dfa_init(&dfa,re) != 0) { return(-1); }
+	re_first(re,&dfa);
+	dfa_free(&dfa);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_regex function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with a regular expression
+// dfa is the scanner's DFA, set up for the expression
+// hay is the text to search, a run of whole lines
+// haylen is the length of the text
+// returns a pointer into the first line the regular expression matches, or
+//  null if no line matches
+// with a prefilter the text is searched for the string every match contains,
+//  and the DFA only runs on each line holding it, otherwise the DFA runs over
+//  the whole text
+char *search_regex(struct searcher *srch, struct dfa_cache *dfa, char *hay,
+	size_t haylen)
+{
+	// end of the text
+	char *end = hay + haylen;
+	// each hit of the prefilter, and the match found in its line
+	char *cand, *hit;
+	// start and end of the line holding the hit
+	char *linestart, *eol;
+	// previous line endings found searching backwards from the hit
+	char *lf, *cr;
+
+	if (srch->prefilter == NULL) { return(regex_scan(dfa,hay,haylen)); }
+	while (hay < end) {
+		cand = srch->prefilter->find(srch->prefilter,hay,end-hay);
+		if (cand == NULL) { return(NULL); }
+		lf = memrchr(hay,'\n',cand-hay);
+		cr = memrchr(hay,'\r',cand-hay);
+		if (lf == NULL || (cr != NULL && cr > lf)) { lf = cr; }
+		linestart = (lf != NULL) ? lf + 1 : hay;
+		eol = find_eol(cand,end-cand);
+		if (eol == NULL) { eol = end; }
+		hit = regex_scan(dfa,linestart,eol-linestart);
+		if (hit != NULL) { return(hit); }
+		// go on after the line ending, treating "\r\n" as one ending
+		hay = eol;
+		if (hay < end) {
+			if (*hay == '\r' && hay+1 < end && hay[1] == '\n') {
+				hay += 2;
+			}
+			else { hay++; }
+		}
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// regex_scan function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is this thread's DFA
+// hay is the text to search, a run of whole lines
+// haylen is the length of the text
+// runs the DFA over the text, going back to the start state at each line
+//  ending, returns a pointer into the first line that matches, or null if no
+//  line matches
+// note: each byte is one load from the transition table unless its transition
+//        has not been built yet, completes a match, or is a line ending - all
+//        of those are handled off the main loop, which is what keeps the
+//        search linear however the expression is written
+// note: once no match is possible in the rest of a line, such as after the
+//        first char of a line that does not fit an expression starting with
+//        '^', the rest of the line is skipped with find_eol
+char *regex_scan(struct dfa_cache *dfa, char *hay, size_t haylen) {
+	// position in the text
+	unsigned char *pos = (unsigned char *) hay;
+	// end of the text
+	unsigned char *end = pos + haylen;
+	// transition table, byte classes and state flags
+	int *trans = dfa->trans;
+	unsigned char *classes = dfa->re->classes;
+	unsigned char *flags = dfa->flags;
+	// length of a row of the transition table
+	int nclasses = dfa->re->nclasses;
+	// offset of the row of the current state, and of the next state
+	int state, next;
+	// end of a line with no match left in it
+	char *eol;
+
+	while (pos < end) {
+		// start of a line
+		state = (dfa->startstate >= 0) ? dfa->startstate :
+			dfa_start(dfa);
+		if (flags[state / nclasses] & DFA_F_ACCEPT) {
+			return((char *) pos);
+		}
+		// only a few bytes lead out of the start state, and the state
+		//  at the start of every line is the same, so the search jumps
+		//  to the next of them, even if it is lines ahead
+		if (dfa->re->numfirst > 0) {
+			pos = (unsigned char *) regex_skip(dfa->re,(char *) pos,
+				end-pos);
+			if (pos == NULL) { return(NULL); }
+		}
+		for (;;) {
+			// four bytes at a time while every transition is on
+			//  the main path, so the checks of the loop are shared
+			while (end - pos >= 4) {
+				next = trans[state + classes[pos[0]]];
+				if (next < 0) { break; }
+				state = trans[next + classes[pos[1]]];
+				if (state < 0) {
+					state = next;
+					pos += 1;
+					break;
+				}
+				next = trans[state + classes[pos[2]]];
+				if (next < 0) {
+					pos += 2;
+					break;
+				}
+				state = trans[next + classes[pos[3]]];
+				if (state < 0) {
+					state = next;
+					pos += 3;
+					break;
+				}
+				pos += 4;
+			}
+			// the last line of the text may have no line ending
+			if (pos == end) {
+				if (flags[state / nclasses] & DFA_F_EOLACCEPT) {
+					return((char *) end - 1);
+				}
+				return(NULL);
+			}
+			next = trans[state + classes[*pos]];
+			if (next >= 0) {
+				state = next;
+				pos++;
+				continue;
+			}
+			// transitions on line endings are never built, the
+			//  line is checked for a match at its end and the next
+			//  line starts over
+			if (*pos == '\n' || *pos == '\r') {
+				if (flags[state / nclasses] & DFA_F_EOLACCEPT) {
+					return((char *) pos);
+				}
+				if (*pos == '\r' && pos+1 < end &&
+					pos[1] == '\n') { pos++; }
+				pos++;
+				break;
+			}
+			if (next == DFA_UNKNOWN) {
+				next = dfa_step(dfa,state,*pos);
+				if (flags[next / nclasses] & DFA_F_ACCEPT) {
+					next = DFA_ACCEPT;
+				}
+				else if (flags[next / nclasses] & DFA_F_DEAD) {
+					next = DFA_DEAD;
+				}
+			}
+			if (next == DFA_ACCEPT) { return((char *) pos); }
+			if (next == DFA_DEAD) {
+				eol = find_eol((char *) pos,end-pos);
+				if (eol == NULL) { return(NULL); }
+				pos = (unsigned char *) eol;
+				if (*pos == '\r' && pos+1 < end &&
+					pos[1] == '\n') { pos++; }
+				pos++;
+				break;
+			}
+			state = next;
+			pos++;
+		}
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// regex_longest function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is this thread's DFA, used for its stack, marks and sets of NFA states
+// linestart is the start of the line
+// eol is the end of the line, not including its line ending
+// from is where in the line the match must start
+// runs the anchored states of the DFA from from, remembering the last place a
+//  match ends, until no match can go on or the line ends, returns the length
+//  of the longest match starting there, or -1 if none does
+// note: this is only run on lines already selected, for the -o option - if
+//        the cache is full and thrown away on the way, the match is found
+//        again with the NFA, which needs no cache
+long regex_longest(struct dfa_cache *dfa, char *linestart, char *eol,
+	char *from)
+{
+	// transition table, byte classes and state flags
+	int *trans = dfa->trans;
+	unsigned char *classes = dfa->re->classes;
+	unsigned char *stateflags = dfa->flags;
+	// length of a row of the transition table
+	int nclasses = dfa->re->nclasses;
+	// number of times the cache was thrown away before the match
+	unsigned long flushes = dfa->flushes;
+	// position in the line, and the end of the line
+	unsigned char *pos = (unsigned char *) from;
+	unsigned char *end = (unsigned char *) eol;
+	// offset of the row of the current state, and of the next one
+	int state, next;
+	// flags of the current state
+	unsigned char flags;
+	// length of the longest match so far
+	long longest = -1;
+
+	state = dfa->anchored[from == linestart];
+	if (state < 0) { state = dfa_anchored(dfa,from == linestart); }
+	while (TRUE) {
+		flags = stateflags[state / nclasses];
+		if (pos == end) {
+			if (flags & DFA_F_EOLACCEPT) {
+				longest = (char *) pos - from;
+			}
+			break;
+		}
+		if (flags & DFA_F_DEAD) { break; }
+		if (flags & DFA_F_ACCEPT) { longest = (char *) pos - from; }
+		next = trans[state + classes[*pos]];
+		if (next == DFA_UNKNOWN) {
+			next = dfa_step(dfa,state,*pos);
+			if (dfa->flushes != flushes) {
+				return(regex_longest_nfa(dfa,linestart,eol,
+					from));
+			}
+		}
+		state = next;
+		pos++;
+	}
+	return(longest);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// regex_longest_nfa function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is this thread's DFA, used for its stack, marks and sets of NFA states
+// linestart is the start of the line
+// eol is the end of the line, not including its line ending
+// from is where in the line the match must start
+// runs the NFA from the start of the expression at from, following every path
+//  at once until none is left, returns the length of the longest match
+//  starting there, or -1 if none does
+// note: this is what regex_longest falls back on when the DFA cache is full
+long regex_longest_nfa(struct dfa_cache *dfa, char *linestart, char *eol,
+	char *from)
+{
+	// the NFA
+	struct re_state *states = dfa->re->states;
+	// NFA states reached at the current position, and at the next one
+	int *set = dfa->work, *next = dfa->work2, *temp;
+	// number of NFA states in the set
+	int len;
+	// index into the set, NFA state, and number of NFA states on the stack
+	int idx, nfa, depth;
+	// position in the line, and the end of the line
+	unsigned char *pos = (unsigned char *) from;
+	unsigned char *end = (unsigned char *) eol;
+	// length of the longest match so far
+	long longest = -1;
+
+	dfa_new_pass(dfa);
+	dfa->stack[0] = dfa->re->start;
+	len = dfa_closure(dfa,1,from == linestart,pos == end,set);
+	while (len > 0) {
+		depth = 0;
+		for (idx=0; idx<len; idx++) {
+			nfa = set[idx];
+			if (states[nfa].type == RE_MATCH) {
+				longest = (char *) pos - from;
+			}
+			else if (pos < end && states[nfa].type == RE_SET &&
+				(dfa->re->sets[states[nfa].set][*pos >> 3] &
+				(1 << (*pos & 7))))
+			{
+				dfa->stack[depth++] = states[nfa].out;
+			}
+		}
+		if (depth == 0) { break; }
+		pos++;
+		dfa_new_pass(dfa);
+		len = dfa_closure(dfa,depth,FALSE,pos == end,next);
+		temp = set;
+		set = next;
+		next = temp;
+	}
+	return(longest);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_alt function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// parses branches separated by '|', up to the end of the pattern or a ')'
+//  closing a group, returns the node of the alternation (or of the only
+//  branch), or -1 on error
+int re_parse_alt(struct regex *re) {
+	// the alternation, and the branch just parsed
+	int alt, branch;
+
+	branch = re_parse_branch(re);
+	if (branch == -1 || re->pos >= re->len || re->pat[re->pos] != '|') {
+		return(branch);
+	}
+	alt = re_new_node(re,RE_ALT);
+	if (alt == -1) { return(-1); }
+	re_add_child(re,alt,branch);
+	while (re->pos < re->len && re->pat[re->pos] == '|') {
+		re->pos++;
+		branch = re_parse_branch(re);
+		if (branch == -1) { return(-1); }
+		re_add_child(re,alt,branch);
+	}
+	return(alt);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_branch function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// parses a run of atoms, each followed by any number of '*', '+', '?' and
+//  {m,n} repeats, up to a '|', a ')' closing a group or the end of the pattern,
+//  returns the node of the concatenation, or -1 on error
+// note: as in grep, a repeat at the start of a branch has nothing to repeat
+//        and is ignored, and an empty branch matches the empty string, while
+//        a '*' right after a '^' that starts a branch is an ordinary char, as
+//        in a grep basic regular expression - grep -E takes it both ways,
+//        selecting a line on "^*a" as if the '^' could be left out but then
+//        finding no match in it with -o unless the line starts with 'a'
+int re_parse_branch(struct regex *re) {
+	// the concatenation, and the atom just parsed
+	int cat, atom;
+	// the repeat wrapped around the atom
+	int rep;
+	// fewest and most repeats
+	int min, max;
+	// result of parsing an interval
+	int interval;
+	// next char of the pattern
+	unsigned char chr;
+	// boolean flag for the atom being a '^' that starts the branch
+	int leading;
+
+	cat = re_new_node(re,RE_CAT);
+	if (cat == -1) { return(-1); }
+	while (re->pos < re->len) {
+		chr = re->pat[re->pos];
+		if (chr == '|' || (chr == ')' && re->depth > 0)) { break; }
+		// a repeat with nothing before it is skipped
+		if (re->nodes[cat].child == -1 && (chr == '*' || chr == '+' ||
+			chr == '?'))
+		{
+			re->pos++;
+			continue;
+		}
+		if (re->nodes[cat].child == -1 && chr == '{') {
+			interval = re_parse_interval(re,&min,&max);
+			if (interval == -1) { return(-1); }
+			if (interval == 1) { continue; }
+		}
+		leading = (re->nodes[cat].child == -1 && chr == '^');
+		atom = re_parse_atom(re);
+		if (atom == -1) { return(-1); }
+		// wrap the atom in each repeat after it
+		while (re->pos < re->len) {
+			chr = re->pat[re->pos];
+			if (leading && chr == '*') { break; }
+			if (chr == '*' || chr == '+' || chr == '?') {
+				min = (chr == '+');
+				max = (chr == '?') ? 1 : -1;
+				re->pos++;
+			}
+			else if (chr == '{') {
+				interval = re_parse_interval(re,&min,&max);
+				if (interval == -1) { return(-1); }
+				// a '{' that does not start an interval is
+				//  an ordinary char
+				if (interval == 0) { break; }
+			}
+			else { break; }
+			rep = re_new_node(re,RE_REPEAT);
+			if (rep == -1) { return(-1); }
+			re->nodes[rep].child = atom;
+			re->nodes[rep].min = min;
+			re->nodes[rep].max = max;
+			atom = rep;
+		}
+		re_add_child(re,cat,atom);
+	}
+	return(cat);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_interval function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed, at a '{'
+// min and max are set to the fewest and most repeats, max is -1 for no limit
+// parses an interval {m}, {m,}, {,n} or {m,n}, returns 1 and moves past it if
+//  there is one, 0 without moving if the '{' does not start an interval (grep
+//  takes it as an ordinary char then), or -1 if the interval is invalid
+int re_parse_interval(struct regex *re, int *min, int *max) {
+	// position in the pattern
+	size_t pos = re->pos + 1;
+	// boolean flags for a number before and after the comma
+	int hasmin = FALSE, hasmax = FALSE;
+
+	*min = 0;
+	*max = -1;
+	while (pos < re->len && re->pat[pos] >= '0' && re->pat[pos] <= '9') {
+		if (*min <= RE_MAX_REPEAT) {
+			*min = *min * 10 + re->pat[pos]-'0';
+		}
+		hasmin = TRUE;
+		pos++;
+	}
+	if (pos < re->len && re->pat[pos] == ',') {
+		pos++;
+		while (pos < re->len && re->pat[pos] >= '0' &&
+			re->pat[pos] <= '9')
+		{
+			if (! hasmax) { *max = 0; }
+			if (*max <= RE_MAX_REPEAT) {
+				*max = *max * 10 + re->pat[pos]-'0';
+			}
+			hasmax = TRUE;
+			pos++;
+		}
+	}
+	else if (hasmin) { *max = *min; }
+	if (pos >= re->len || re->pat[pos] != '}' || (! hasmin && ! hasmax)) {
+		return(0);
+	}
+	if (*min > RE_MAX_REPEAT || *max > RE_MAX_REPEAT) {
+		re->err = "Regular expression too big";
+		return(-1);
+	}
+	if (*max != -1 && *max < *min) {
+		re->err = "Invalid content of \\{\\}";
+		return(-1);
+	}
+	re->pos = pos + 1;
+	return(1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_atom function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// parses one char, '.', bracket expression, anchor, escape or group in
+//  parentheses, returns its node, or -1 on error
+// note: '\w', '\W', '\s' and '\S' are taken as in grep, any other escaped char
+//        is an ordinary char, and a ')' without a '(' is an ordinary char
+int re_parse_atom(struct regex *re) {
+	// the node parsed
+	int node;
+	// the set of bytes matched
+	int set;
+	// char of the pattern
+	unsigned char chr;
+	// byte added to a set
+	int byte;
+
+	chr = re->pat[re->pos++];
+	if (chr == '(') {
+		if (re->depth >= RE_MAX_DEPTH) {
+			re->err = "Regular expression too big";
+			return(-1);
+		}
+		re->depth++;
+		node = re_parse_alt(re);
+		if (node == -1) { return(-1); }
+		if (re->pos >= re->len || re->pat[re->pos] != ')') {
+			re->err = "Unmatched ( or \\(";
+			return(-1);
+		}
+		re->pos++;
+		re->depth--;
+		return(node);
+	}
+	if (chr == '^') { return(re_new_node(re,RE_BOL)); }
+	if (chr == '$') { return(re_new_node(re,RE_EOL)); }
+	if (chr == '[') { return(re_parse_bracket(re)); }
+	node = re_new_node(re,RE_SET);
+	set = re_new_set(re);
+	if (node == -1 || set == -1) { return(-1); }
+	re->nodes[node].set = set;
+	// any char but a line ending
+	if (chr == '.') {
+		for (byte=0; byte<256; byte++) {
+			if (byte != '\n' && byte != '\r') {
+				re_set_add(re,set,byte);
+			}
+		}
+		return(node);
+	}
+	if (chr == '\\') {
+		if (re->pos >= re->len) {
+			re->err = "Trailing backslash";
+			return(-1);
+		}
+		chr = re->pat[re->pos++];
+		if (chr >= '1' && chr <= '9') {
+			re->err = "Back-references are not supported";
+			return(-1);
+		}
+		if (strchr("bB<>`'",chr) != NULL) {
+			re->err = "Word boundaries are not supported";
+			return(-1);
+		}
+		if (chr == 'w' || chr == 'W' || chr == 's' || chr == 'S') {
+			for (byte=0; byte<256; byte++) {
+				if ((((chr == 'w' || chr == 'W') &&
+					(isalnum(byte) || byte == '_')) ||
+					((chr == 's' || chr == 'S') &&
+					isspace(byte))) == (chr == 'w' ||
+					chr == 's'))
+				{
+					re_set_add(re,set,byte);
+				}
+			}
+			return(node);
+		}
+	}
+	return(re_parse_char(re,node,set));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_bracket function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed, just past a '['
+// parses a bracket expression up to its ']' - chars, ranges such as a-z,
+//  classes such as [:digit:], and [.c.] and [=c=] for a single char c, all
+//  matched as bytes - and returns its node, or -1 on error
+// note: a ']' first in the list, or a '-' first or last, is an ordinary char,
+//        and a list starting with '^' matches every byte not in it except the
+//        line endings
+int re_parse_bracket(struct regex *re) {
+	// names of the classes, and the function testing each
+	static char *classnames[] = { "alpha", "digit", "alnum", "upper",
+		"lower", "space", "blank", "punct", "print", "graph", "cntrl",
+		"xdigit" };
+	static int (*classfns[])(int) = { isalpha, isdigit, isalnum, isupper,
+		islower, isspace, isblank, ispunct, isprint, isgraph, iscntrl,
+		isxdigit };
+	// the node parsed, and its set of bytes
+	int node, set;
+	// boolean flags for a list starting with '^', and for the first item
+	//  of the list
+	int negate = FALSE, first = TRUE;
+	// first and last byte of a range
+	int lo, hi;
+	// kind of a [: :], [. .] or [= =] item, and the position of its end
+	unsigned char kind;
+	unsigned char *close;
+	// length of the name of a class
+	size_t namelen;
+	// index into the class names, and byte tested
+	int idx, byte;
+	// set of the bytes in the list, before it is negated
+	unsigned char bits[32];
+
+	node = re_new_node(re,RE_SET);
+	set = re_new_set(re);
+	if (node == -1 || set == -1) { return(-1); }
+	re->nodes[node].set = set;
+	if (re->pos < re->len && re->pat[re->pos] == '^') {
+		negate = TRUE;
+		re->pos++;
+	}
+	for (;;) {
+		if (re->pos >= re->len) {
+			re->err = "Unmatched [, [^, [:, [., or [=";
+			return(-1);
+		}
+		if (re->pat[re->pos] == ']' && ! first) {
+			re->pos++;
+			break;
+		}
+		first = FALSE;
+		lo = re->pat[re->pos];
+		kind = (re->pos+1 < re->len) ? re->pat[re->pos+1] : 0;
+		if (lo == '[' && (kind == ':' || kind == '.' || kind == '=')) {
+			// find the closing ":]", ".]" or "=]"
+			for (close=re->pat+re->pos+2; close+1<re->pat+re->len;
+				close++)
+			{
+				if (close[0] == kind && close[1] == ']') {
+					break;
+				}
+			}
+			if (close+1 >= re->pat+re->len) {
+				re->err = "Unmatched [, [^, [:, [., or [=";
+				return(-1);
+			}
+			namelen = close - (re->pat+re->pos+2);
+			if (kind == ':') {
+				for (idx=0; idx<12; idx++) {
+					if (strlen(classnames[idx]) == namelen &&
+						memcmp(classnames[idx],
+						re->pat+re->pos+2,namelen) == 0)
+					{ break; }
+				}
+				if (idx == 12) {
+					re->err = "Invalid character class name";
+					return(-1);
+				}
+				for (byte=0; byte<256; byte++) {
+					if (classfns[idx](byte)) {
+						re_set_add(re,set,byte);
+					}
+				}
+				re->pos = close + 2 - re->pat;
+				continue;
+			}
+			if (namelen != 1) {
+				re->err = "Invalid collation character";
+				return(-1);
+			}
+			lo = re->pat[re->pos+2];
+			re->pos = close + 2 - re->pat;
+		}
+		else { re->pos++; }
+		// a range, unless the '-' is last in the list
+		if (re->pos+1 < re->len && re->pat[re->pos] == '-' &&
+			re->pat[re->pos+1] != ']')
+		{
+			hi = re->pat[re->pos+1];
+			re->pos += 2;
+			if (hi < lo) {
+				re->err = "Invalid range end";
+				return(-1);
+			}
+			for (byte=lo; byte<=hi; byte++) {
+				re_set_add(re,set,byte);
+			}
+		}
+		else { re_set_add(re,set,lo); }
+	}
+	if (negate) {
+		memcpy(bits,re->sets[set],sizeof(bits));
+		memset(re->sets[set],0,sizeof(bits));
+		for (byte=0; byte<256; byte++) {
+			if (! (bits[byte >> 3] & (1 << (byte & 7))) &&
+				byte != '\n' && byte != '\r')
+			{
+				re->sets[set][byte >> 3] |= 1 << (byte & 7);
+			}
+		}
+	}
+	return(node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_strings function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// plist is the list of search strings, which are not regular expressions
+// gathers the search strings into a trie of their chars, as they are
+//  compared, and parses it with re_trie_node, so search strings starting
+//  with the same chars share them and the NFA only branches where they
+//  differ - a flat alternation of thousands of strings would put all of
+//  their first states in every state of the DFA - returns the node of the
+//  trie's root, an alternation with no branches if every search string has a
+//  line ending, or -1 on error
+int re_parse_strings(struct regex *re, struct pattern_list *plist) {
+	// the trie, its number of nodes and the most it can need, one per byte
+	//  of search string plus the root
+	struct re_trie *trie;
+	int numtrie = 1;
+	size_t triesize = 1;
+	// index of the search string, and position in it
+	int pidx;
+	size_t pos;
+	// the search string being added, and the length of each of its chars
+	unsigned char *pat;
+	size_t chrlen;
+	// boolean flag for a search string folded by FOLD_WIDE
+	int foldall;
+	// each char of the search string, and the char as it is compared
+	wint_t chr, key;
+	// node of the trie reached, its child with the char, and the child
+	//  before that
+	int cur, child, prev;
+	// node of the root
+	int root;
+
+	for (pidx=0; pidx<plist->num; pidx++) {
+		triesize += plist->lens[pidx];
+	}
+	trie = malloc(triesize * sizeof(struct re_trie));
+	if (trie == NULL) { return(-1); }
+	trie[0].child = -1;
+	trie[0].next = -1;
+	trie[0].end = FALSE;
+	for (pidx=0; pidx<plist->num; pidx++) {
+		pat = (unsigned char *) plist->pats[pidx];
+		// a search string with a line ending can never match a line
+		if (memchr(pat,'\r',plist->lens[pidx]) != NULL ||
+			memchr(pat,'\n',plist->lens[pidx]) != NULL) { continue; }
+		foldall = (re->fold == CASE_WIDE &&
+			pattern_wide((char *) pat,plist->lens[pidx]));
+		cur = 0;
+		for (pos=0; pos<plist->lens[pidx]; pos+=chrlen) {
+			// chars folded by FOLD_WIDE and by FOLD_ASCII never
+			//  compare the same, so the second are put past the
+			//  chars and bytes utf8_decode gives
+			if (foldall) {
+				chrlen = utf8_decode(pat+pos,
+					plist->lens[pidx]-pos,&chr);
+				key = FOLD_WIDE(chr);
+			}
+			else {
+				chrlen = 1;
+				key = 0x110100 + ((re->fold != CASE_EXACT) ?
+					FOLD_ASCII(pat[pos]) : pat[pos]);
+			}
+			for (child=trie[cur].child, prev=-1; child!=-1 &&
+				trie[child].key!=key; child=trie[child].next)
+			{
+				prev = child;
+			}
+			if (child == -1) {
+				child = numtrie++;
+				trie[child].key = key;
+				trie[child].chr = pat + pos;
+				trie[child].left = plist->lens[pidx] - pos;
+				trie[child].foldall = foldall;
+				trie[child].child = -1;
+				trie[child].next = -1;
+				trie[child].end = FALSE;
+				if (prev == -1) { trie[cur].child = child; }
+				else { trie[prev].next = child; }
+			}
+			cur = child;
+		}
+		trie[cur].end = TRUE;
+	}
+	root = re_trie_node(re,trie,0,0);
+	free(trie);
+	return(root);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_trie_node function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// trie is the trie of the search strings
+// idx is the node of the trie whose children are parsed
+// depth is the number of branching nodes above the node
+// parses the search strings going on from a node of the trie into an
+//  alternation, with a branch for each child holding its chars up to the
+//  next node where search strings branch or end, followed by that node's
+//  alternation - and an empty branch if a search string ends at the node -
+//  returns the node of the alternation, or -1 on error
+// note: as with parentheses, at most RE_MAX_DEPTH alternations are nested,
+//        which bounds the recursion here and when the NFA is built
+int re_trie_node(struct regex *re, struct re_trie *trie, int idx, int depth) {
+	// the alternation, each branch, and the node and set of each char
+	int alt, cat, node, set;
+	// child of the node, and the node reached along it
+	int child, cur;
+
+	if (depth > RE_MAX_DEPTH) {
+		re->err = "Regular expression too big";
+		return(-1);
+	}
+	alt = re_new_node(re,RE_ALT);
+	if (alt == -1) { return(-1); }
+	// a match may end with a search string ending at the node
+	if (trie[idx].end) {
+		cat = re_new_node(re,RE_CAT);
+		if (cat == -1) { return(-1); }
+		re_add_child(re,alt,cat);
+	}
+	for (child=trie[idx].child; child!=-1; child=trie[child].next) {
+		cat = re_new_node(re,RE_CAT);
+		if (cat == -1) { return(-1); }
+		re_add_child(re,alt,cat);
+		for (cur=child; ; cur=trie[cur].child) {
+			node = re_new_node(re,RE_SET);
+			set = re_new_set(re);
+			if (node == -1 || set == -1) { return(-1); }
+			re->nodes[node].set = set;
+			// the char is parsed from the first search string
+			//  holding it
+			re->pat = trie[cur].chr;
+			re->len = trie[cur].left;
+			re->pos = 1;
+			re->foldall = trie[cur].foldall;
+			node = re_parse_char(re,node,set);
+			if (node == -1) { return(-1); }
+			re_add_child(re,cat,node);
+			if (trie[cur].end || trie[cur].child == -1 ||
+				trie[trie[cur].child].next != -1) { break; }
+		}
+		if (trie[cur].child != -1) {
+			node = re_trie_node(re,trie,cur,depth+1);
+			if (node == -1) { return(-1); }
+			re_add_child(re,cat,node);
+		}
+	}
+	return(alt);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_parse_char function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed, just past the first byte of an
+//  ordinary char
+// node is a new RE_SET node for the char
+// set is the empty set of the node
+// adds the byte to the set, or with the -i option in a UTF-8 locale, for a
+//  char of a pattern with chars outside ASCII, matches every char that folds
+//  the same - the chars of one byte are added to the set, and if there are
+//  longer ones the node becomes an alternation of the set and their UTF-8
+//  bytes - and moves past the rest of the char, returns the node, or -1 if
+//  memory could not be allocated
+// note: chars whose bytes only differ in the last byte, as the two cases of
+//        most letters do, share one branch ending with a set of both bytes,
+//        which keeps the NFA of a long list of words small
+// note: a byte that does not start a valid UTF-8 char only matches itself
+int re_parse_char(struct regex *re, int node, int set) {
+	// the char decoded, and the chars that fold the same
+	wint_t chr, variants[FOLD_MAX_VARIANTS];
+	// number of chars that fold the same, and index of the one added
+	int numvariants, vidx;
+	// bytes of each char added, and the length of each
+	unsigned char bytes[FOLD_MAX_VARIANTS][4];
+	size_t lens[FOLD_MAX_VARIANTS];
+	// set of the last byte of the branch each char was added to
+	int lastsets[FOLD_MAX_VARIANTS];
+	// index of the byte, and of an earlier char
+	size_t bidx;
+	int prev;
+	// node of the set, branch of the alternation, and the node and set of
+	//  each of its bytes
+	int setnode, cat, bytenode, byteset = -1;
+	// boolean flag for a char of one byte among the chars folding the same
+	int onebyte = FALSE;
+	// length of the char decoded
+	size_t len;
+
+	if (! re->foldall) {
+		re_set_add(re,set,re->pat[re->pos-1]);
+		return(node);
+	}
+	len = utf8_decode(re->pat+re->pos-1,re->len-re->pos+1,&chr);
+	if (chr > 0x10FFFF) {
+		re_set_add(re,set,re->pat[re->pos-1]);
+		return(node);
+	}
+	re->pos += len - 1;
+	if (re->wide == NULL && fold_table(re) != 0) { return(-1); }
+	numvariants = fold_variants(re,chr,variants);
+	for (vidx=0; vidx<numvariants; vidx++) {
+		if (variants[vidx] < 0x80) {
+			re_set_add(re,set,variants[vidx]);
+			onebyte = TRUE;
+		}
+	}
+	if (onebyte && numvariants == 1) { return(node); }
+	// the set becomes one branch of the alternation, if it is not empty
+	setnode = node;
+	node = re_new_node(re,RE_ALT);
+	if (node == -1) { return(-1); }
+	if (onebyte) { re_add_child(re,node,setnode); }
+	for (vidx=0; vidx<numvariants; vidx++) {
+		lens[vidx] = 0;
+		if (variants[vidx] < 0x80) { continue; }
+		lens[vidx] = utf8_encode(variants[vidx],bytes[vidx]);
+		for (prev=0; prev<vidx; prev++) {
+			if (lens[prev] == lens[vidx] && memcmp(bytes[prev],
+				bytes[vidx],lens[vidx]-1) == 0) { break; }
+		}
+		if (prev < vidx) {
+			lastsets[vidx] = lastsets[prev];
+			re_set_add(re,lastsets[vidx],bytes[vidx][lens[vidx]-1]);
+			continue;
+		}
+		cat = re_new_node(re,RE_CAT);
+		if (cat == -1) { return(-1); }
+		re_add_child(re,node,cat);
+		for (bidx=0; bidx<lens[vidx]; bidx++) {
+			bytenode = re_new_node(re,RE_SET);
+			byteset = re_new_set(re);
+			if (bytenode == -1 || byteset == -1) { return(-1); }
+			re->nodes[bytenode].set = byteset;
+			re_set_add(re,byteset,bytes[vidx][bidx]);
+			re_add_child(re,cat,bytenode);
+		}
+		lastsets[vidx] = byteset;
+	}
+	return(node);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fold_table function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// lists every char up to FOLD_WIDE_LAST that FOLD_WIDE changes, sorted by the
+//  char it folds to, so the chars folding the same as a char of the
+//  expression can be looked up, returns 0 on success or -1 if memory could
+//  not be allocated
+// note: towupper() and towlower() only map one char to one, so the table is
+//        the only way back from a folded char to all the chars folding to it,
+//        such as from sigma to final sigma
+int fold_table(struct regex *re) {
+	// char looked at, and the char it folds to
+	wint_t chr, folded;
+	// number of chars there is room for
+	size_t size = 1024;
+	// the grown table
+	struct wide_fold *temp;
+
+	re->wide = malloc(size * sizeof(struct wide_fold));
+	if (re->wide == NULL) { return(-1); }
+	re->numwide = 0;
+	for (chr=0; chr<=FOLD_WIDE_LAST; chr++) {
+		folded = FOLD_WIDE(chr);
+		if (folded == chr) { continue; }
+		if ((size_t) re->numwide == size) {
+			size *= 2;
+			temp = realloc(re->wide,
+				size * sizeof(struct wide_fold));
+			if (temp == NULL) { return(-1); }
+			re->wide = temp;
+		}
+		re->wide[re->numwide].chr = chr;
+		re->wide[re->numwide].folded = folded;
+		re->numwide++;
+	}
+	qsort(re->wide,re->numwide,sizeof(struct wide_fold),fold_cmp);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fold_cmp function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b are entries of the table of chars FOLD_WIDE changes
+// comparison function for qsort, ordering the entries by the char they fold
+//  to and then by the char
+int fold_cmp(const void *a, const void *b) {
+	// the entries compared
+	const struct wide_fold *left = a, *right = b;
+
+	if (left->folded != right->folded) {
+		return((left->folded < right->folded) ? -1 : 1);
+	}
+	if (left->chr != right->chr) {
+		return((left->chr < right->chr) ? -1 : 1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// fold_variants function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed, with its table of chars
+//  FOLD_WIDE changes
+// chr is a char of the expression
+// variants is set to the chars that fold the same as chr, at most
+//  FOLD_MAX_VARIANTS
+// returns the number of chars found, chr itself among them
+int fold_variants(struct regex *re, wint_t chr, wint_t *variants) {
+	// the char every variant folds to
+	wint_t folded = FOLD_WIDE(chr);
+	// number of variants found
+	int num = 0;
+	// bounds of the binary search of the table
+	int low = 0, high = re->numwide, mid;
+
+	if (FOLD_WIDE(folded) == folded) { variants[num++] = folded; }
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (re->wide[mid].folded < folded) { low = mid + 1; }
+		else { high = mid; }
+	}
+	for (; low<re->numwide && re->wide[low].folded == folded &&
+		num<FOLD_MAX_VARIANTS; low++)
+	{
+		variants[num++] = re->wide[low].chr;
+	}
+	if (num == 0) { variants[num++] = chr; }
+	return(num);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_new_node function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// type is the kind of node, one of the RE_ directives
+// adds a node with no children to the parsed expression, doubling the array of
+//  nodes as needed, returns the index of the node or -1 if memory could not be
+//  allocated
+int re_new_node(struct regex *re, int type) {
+	// the grown array
+	struct re_node *tempnodes;
+
+	if (re->numnodes == re->nodesize) {
+		re->nodesize = (re->nodesize > 0) ? re->nodesize * 2 : 64;
+		tempnodes = realloc(re->nodes,
+			re->nodesize * sizeof(struct re_node));
+		if (tempnodes == NULL) { return(-1); }
+		re->nodes = tempnodes;
+	}
+	re->nodes[re->numnodes].type = type;
+	re->nodes[re->numnodes].child = -1;
+	re->nodes[re->numnodes].last = -1;
+	re->nodes[re->numnodes].next = -1;
+	re->nodes[re->numnodes].prev = -1;
+	re->nodes[re->numnodes].min = 0;
+	re->nodes[re->numnodes].max = 0;
+	re->nodes[re->numnodes].set = -1;
+	return(re->numnodes++);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_add_child function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// parent is a concatenation or alternation node
+// child is the node to add as its last child
+void re_add_child(struct regex *re, int parent, int child) {
+	re->nodes[child].prev = re->nodes[parent].last;
+	if (re->nodes[parent].last == -1) { re->nodes[parent].child = child; }
+	else { re->nodes[re->nodes[parent].last].next = child; }
+	re->nodes[parent].last = child;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_new_set function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// adds an empty set of bytes, doubling the array of sets as needed, returns
+//  the index of the set or -1 if memory could not be allocated
+int re_new_set(struct regex *re) {
+	// the grown array
+	unsigned char (*tempsets)[32];
+
+	if (re->numsets == re->setsize) {
+		re->setsize = (re->setsize > 0) ? re->setsize * 2 : 16;
+		tempsets = realloc(re->sets,re->setsize * sizeof(*re->sets));
+		if (tempsets == NULL) { return(-1); }
+		re->sets = tempsets;
+	}
+	memset(re->sets[re->numsets],0,sizeof(*re->sets));
+	return(re->numsets++);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_set_add function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being parsed
+// set is the index of the set
+// byte is the byte to add
+// adds a byte to a set, along with the other case of an ASCII letter with the
+//  -i option
+void re_set_add(struct regex *re, int set, int byte) {
+	re->sets[set][byte >> 3] |= 1 << (byte & 7);
+	if (re->fold != CASE_EXACT && ((byte >= 'a' && byte <= 'z') ||
+		(byte >= 'A' && byte <= 'Z')))
+	{
+		byte ^= 0x20;
+		re->sets[set][byte >> 3] |= 1 << (byte & 7);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_set_char function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression
+// set is the index of the set
+// returns the byte if the set only holds one byte (or, with the -i option,
+//  both cases of one ASCII letter, returning the lower case), otherwise -1
+int re_set_char(struct regex *re, int set) {
+	// number of bytes in the set, and the first two found
+	int count = 0, first = -1, second = -1;
+	// byte tested
+	int byte;
+
+	for (byte=0; byte<256 && count<3; byte++) {
+		if (re->sets[set][byte >> 3] & (1 << (byte & 7))) {
+			if (count == 0) { first = byte; }
+			else { second = byte; }
+			count++;
+		}
+	}
+	if (count == 1) { return(first); }
+	if (count == 2 && re->fold != CASE_EXACT && first >= 'A' &&
+		first <= 'Z' && second == (first | 0x20)) { return(second); }
+	return(-1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_must function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the parsed regular expression
+// node is the node to work out the strings for
+// must is set to the strings every match of the node starts with, ends with
+//  and contains, and to the only string it matches if there is one
+// note: the strings are only the ones that are simple to prove, e.g. for an
+//        alternation only what its branches share, so a match may contain a
+//        longer string than the one found, but never a shorter one
+void re_must(struct regex *re, int node, struct re_must *must) {
+	// strings for each child
+	struct re_must part;
+	// a child of the node, and the repeat count
+	int child, count;
+	// the byte a set matches
+	int chr;
+	// the byte as a string
+	char chrstr;
+
+	switch (re->nodes[node].type) {
+	case RE_SET:
+		chr = re_set_char(re,re->nodes[node].set);
+		if (chr >= 0) {
+			chrstr = chr;
+			must_exact(must,&chrstr,1);
+		}
+		else {
+			must_exact(must,"",0);
+			must->exactlen = -1;
+		}
+		break;
+	case RE_CAT:
+		must_exact(must,"",0);
+		for (child=re->nodes[node].child; child!=-1;
+			child=re->nodes[child].next)
+		{
+			re_must(re,child,&part);
+			must_cat(must,&part);
+		}
+		break;
+	case RE_ALT:
+		child = re->nodes[node].child;
+		re_must(re,child,must);
+		for (child=re->nodes[child].next; child!=-1;
+			child=re->nodes[child].next)
+		{
+			re_must(re,child,&part);
+			must_alt(must,&part);
+		}
+		break;
+	case RE_REPEAT:
+		if (re->nodes[node].max == 0) {
+			must_exact(must,"",0);
+			break;
+		}
+		re_must(re,re->nodes[node].child,&part);
+		if (re->nodes[node].min == 0) {
+			must_exact(must,"",0);
+			must->exactlen = -1;
+			break;
+		}
+		// a match starts with the first copy and ends with the last,
+		//  and holds at least min copies in a row
+		*must = part;
+		for (count=1; count<re->nodes[node].min; count++) {
+			must_cat(must,&part);
+		}
+		if (re->nodes[node].max != re->nodes[node].min) {
+			must->exactlen = -1;
+		}
+		break;
+	default:
+		// an anchor matches no chars but is not the empty string
+		must_exact(must,"",0);
+		must->exactlen = -1;
+		break;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must_exact function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must is set to the strings of a node matching only one string
+// str is the string, at most RE_MUST_MAX bytes
+// len is the length of the string
+void must_exact(struct re_must *must, char *str, int len) {
+	memcpy(must->exact,str,len);
+	memcpy(must->left,str,len);
+	memcpy(must->right,str,len);
+	memcpy(must->in,str,len);
+	must->exactlen = len;
+	must->leftlen = len;
+	must->rightlen = len;
+	must->inlen = len;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must_cat function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// acc is the strings of the nodes concatenated so far, and is updated
+// part is the strings of the node concatenated after them
+// note: a string that would grow past RE_MUST_MAX is cut short, keeping the
+//        end of a string a match ends with and the start of the others
+void must_cat(struct re_must *acc, struct re_must *part) {
+	// the end of one node joined to the start of the next
+	char joined[2*RE_MUST_MAX];
+	// length of the joined string
+	int len;
+
+	// a match holds the end of acc followed by the start of part
+	memcpy(joined,acc->right,acc->rightlen);
+	memcpy(joined+acc->rightlen,part->left,part->leftlen);
+	len = acc->rightlen + part->leftlen;
+	must_longest(acc,joined,(len < RE_MUST_MAX) ? len : RE_MUST_MAX);
+	must_longest(acc,part->in,part->inlen);
+	// the end grows only if part matches one string
+	if (part->exactlen >= 0) {
+		memcpy(joined,acc->right,acc->rightlen);
+		memcpy(joined+acc->rightlen,part->exact,part->exactlen);
+		len = acc->rightlen + part->exactlen;
+		acc->rightlen = (len < RE_MUST_MAX) ? len : RE_MUST_MAX;
+		memcpy(acc->right,joined+len-acc->rightlen,acc->rightlen);
+	}
+	else {
+		memcpy(acc->right,part->right,part->rightlen);
+		acc->rightlen = part->rightlen;
+	}
+	// the start grows only if acc matches one string
+	if (acc->exactlen >= 0) {
+		len = acc->exactlen + part->leftlen;
+		if (len > RE_MUST_MAX) { len = RE_MUST_MAX; }
+		memcpy(acc->left+acc->exactlen,part->left,len-acc->exactlen);
+		acc->leftlen = len;
+	}
+	if (acc->exactlen >= 0 && part->exactlen >= 0 &&
+		acc->exactlen + part->exactlen <= RE_MUST_MAX)
+	{
+		memcpy(acc->exact+acc->exactlen,part->exact,part->exactlen);
+		acc->exactlen += part->exactlen;
+	}
+	else { acc->exactlen = -1; }
+	must_longest(acc,acc->left,acc->leftlen);
+	must_longest(acc,acc->right,acc->rightlen);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must_alt function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// acc is the strings of the branches of an alternation so far, and is updated
+// part is the strings of the next branch
+// keeps only what both sides share - the common start and end, and a string
+//  contained in both when one side's string holds the other's
+void must_alt(struct re_must *acc, struct re_must *part) {
+	// length of the common start and end
+	int len;
+
+	if (acc->exactlen != part->exactlen || (acc->exactlen >= 0 &&
+		memcmp(acc->exact,part->exact,acc->exactlen) != 0))
+	{
+		acc->exactlen = -1;
+	}
+	for (len=0; len<acc->leftlen && len<part->leftlen &&
+		acc->left[len] == part->left[len]; len++) { }
+	acc->leftlen = len;
+	for (len=0; len<acc->rightlen && len<part->rightlen &&
+		acc->right[acc->rightlen-1-len] ==
+		part->right[part->rightlen-1-len]; len++) { }
+	memmove(acc->right,acc->right+acc->rightlen-len,len);
+	acc->rightlen = len;
+	if (part->inlen <= acc->inlen &&
+		memmem(acc->in,acc->inlen,part->in,part->inlen) != NULL)
+	{
+		memcpy(acc->in,part->in,part->inlen);
+		acc->inlen = part->inlen;
+	}
+	else if (memmem(part->in,part->inlen,acc->in,acc->inlen) == NULL) {
+		acc->inlen = 0;
+	}
+	must_longest(acc,acc->left,acc->leftlen);
+	must_longest(acc,acc->right,acc->rightlen);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must_longest function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// must is the strings of a node
+// str is a string every match of the node contains
+// len is its length, at most RE_MUST_MAX
+// keeps str as the string every match contains if it is longer than the one
+//  found so far
+void must_longest(struct re_must *must, char *str, int len) {
+	if (len > must->inlen) {
+		memmove(must->in,str,len);
+		must->inlen = len;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_compile function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the parsed regular expression
+// node is the node to compile
+// next is the NFA state that follows a match of the node
+// compiles the node into NFA states leading to next (Thompson's construction,
+//  built from the end backwards so that no list of dangling exits is needed),
+//  returns the state a match of the node starts from, or -1 if memory could
+//  not be allocated or the NFA would be too big
+// note: an interval is compiled as copies of its node, a{2,4} as aa(a(a)?)?
+int re_compile(struct regex *re, int node, int next) {
+	// a child of the node
+	int child;
+	// the state built, and a split before it
+	int state, split;
+	// number of copies of a repeated node
+	int count;
+
+	switch (re->nodes[node].type) {
+	case RE_SET:
+	case RE_BOL:
+	case RE_EOL:
+		return(re_new_state(re,re->nodes[node].type,next,-1,
+			re->nodes[node].set));
+	case RE_CAT:
+		// the children are compiled from the last, each leading to
+		//  the one after it
+		state = next;
+		for (child=re->nodes[node].last; child!=-1 && state!=-1;
+			child=re->nodes[child].prev)
+		{
+			state = re_compile(re,child,state);
+		}
+		return(state);
+	case RE_ALT:
+		// a split between each branch and the rest of the branches
+		child = re->nodes[node].last;
+		state = re_compile(re,child,next);
+		for (child=re->nodes[child].prev; child!=-1 && state!=-1;
+			child=re->nodes[child].prev)
+		{
+			split = re_compile(re,child,next);
+			if (split == -1) { return(-1); }
+			state = re_new_state(re,RE_SPLIT,split,state,-1);
+		}
+		return(state);
+	case RE_REPEAT:
+		child = re->nodes[node].child;
+		if (re->nodes[node].max == -1) {
+			// a loop through the node, or on to next
+			state = re_new_state(re,RE_SPLIT,-1,next,-1);
+			if (state == -1) { return(-1); }
+			split = re_compile(re,child,state);
+			if (split == -1) { return(-1); }
+			re->states[state].out = split;
+		}
+		else {
+			// the optional copies, each may skip to next
+			state = next;
+			for (count=re->nodes[node].min;
+				count<re->nodes[node].max && state!=-1; count++)
+			{
+				split = re_compile(re,child,state);
+				if (split == -1) { return(-1); }
+				state = re_new_state(re,RE_SPLIT,split,next,-1);
+			}
+		}
+		// the copies every match has
+		for (count=0; count<re->nodes[node].min && state!=-1; count++) {
+			state = re_compile(re,child,state);
+		}
+		return(state);
+	default:
+		return(next);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_new_state function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the regular expression being compiled
+// type, out, out1 and set are the fields of the new state
+// adds a state to the NFA, doubling the array of states as needed, returns the
+//  index of the state or -1 if memory could not be allocated or there would be
+//  more than RE_MAX_STATES states (RE_MAX_FIXED_STATES for search strings
+//  that are not regular expressions)
+int re_new_state(struct regex *re, int type, int out, int out1, int set) {
+	// the grown array
+	struct re_state *tempstates;
+	// most states the NFA may have
+	int maxstates = re->fixed ? RE_MAX_FIXED_STATES : RE_MAX_STATES;
+
+	if (re->numstates == maxstates) {
+		re->err = "Regular expression too big";
+		return(-1);
+	}
+	if (re->numstates == re->statesize) {
+		re->statesize = (re->statesize > 0) ? re->statesize * 2 : 64;
+		tempstates = realloc(re->states,
+			re->statesize * sizeof(struct re_state));
+		if (tempstates == NULL) { return(-1); }
+		re->states = tempstates;
+	}
+	re->states[re->numstates].type = type;
+	re->states[re->numstates].out = out;
+	re->states[re->numstates].out1 = out1;
+	re->states[re->numstates].set = set;
+	if (type == RE_BOL) { re->bol = TRUE; }
+	return(re->numstates++);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_classes function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the compiled regular expression
+// splits the bytes into the fewest classes such that every set of the
+//  expression holds either all or none of each class, with the line endings
+//  in a class of their own - the DFA then has one column per class instead of
+//  one per byte
+void re_classes(struct regex *re) {
+	// new class of the bytes of each old class in and not in the set
+	int inclass[256], outclass[256];
+	// new number of classes
+	int numclasses;
+	// index of the set, and byte tested
+	int set, byte;
+	// boolean flag for the byte being in the set
+	int inset;
+	// class the byte moves to
+	int *newclass;
+
+	memset(re->classes,0,sizeof(re->classes));
+	re->nclasses = 1;
+	// set -1 stands for the line endings
+	for (set=-1; set<re->numsets; set++) {
+		for (byte=0; byte<re->nclasses; byte++) {
+			inclass[byte] = -1;
+			outclass[byte] = -1;
+		}
+		numclasses = 0;
+		for (byte=0; byte<256; byte++) {
+			inset = (set == -1) ? (byte == '\n' || byte == '\r') :
+				((re->sets[set][byte >> 3] >> (byte & 7)) & 1);
+			newclass = inset ? &inclass[re->classes[byte]] :
+				&outclass[re->classes[byte]];
+			if (*newclass == -1) { *newclass = numclasses++; }
+			re->classes[byte] = *newclass;
+		}
+		re->nclasses = numclasses;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re_first function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is the compiled regular expression
+// dfa is a DFA set up for the expression, used for its stack and marks
+// finds the bytes a match can start with, and keeps them in re->first if
+//  there are at most three - any other byte leaves the DFA in its start state
+// note: the search only skips if the expression has no '^', so the state at
+//        the start of a line is the same as the state the search falls back
+//        to in the middle of one, and if no match can end at a line ending
+//        without reading a byte, such as for 'a*' or '$'
+void re_first(struct regex *re, struct dfa_cache *dfa) {
+	// bytes a match can start with
+	unsigned char bits[32];
+	// NFA states reached from the start without reading a byte
+	int len;
+	// index into the NFA states and the set, and byte tested
+	int idx, byte;
+	// NFA state in the set
+	struct re_state *state;
+
+	re->numfirst = 0;
+	for (idx=0; idx<re->numstates; idx++) {
+		if (re->states[idx].type == RE_BOL) { return; }
+	}
+	dfa_new_pass(dfa);
+	dfa->stack[0] = re->start;
+	len = dfa_closure(dfa,1,TRUE,FALSE,dfa->work);
+	memset(bits,0,sizeof(bits));
+	for (idx=0; idx<len; idx++) {
+		state = &re->states[dfa->work[idx]];
+		if (state->type != RE_SET) { return; }
+		for (byte=0; byte<32; byte++) {
+			bits[byte] |= re->sets[state->set][byte];
+		}
+	}
+	// a line ending in a set can never be matched, the search resets at it
+	for (byte=0; byte<256; byte++) {
+		if ((bits[byte >> 3] & (1 << (byte & 7))) && byte != '\n' &&
+			byte != '\r')
+		{
+			if (re->numfirst == 3) {
+				re->numfirst = 0;
+				return;
+			}
+			re->first[re->numfirst++] = byte;
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// regex_skip function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is a regular expression with bytes a match can start with
+// hay is the text to search
+// haylen is the length of the text
+// returns a pointer to the first byte of the text a match can start with, or
+//  null if there is none - memchr for one byte, otherwise SSE2 compares each
+//  block with every byte at once
+char *regex_skip(struct regex *re, char *hay, size_t haylen) {
+	// position in the text
+	size_t pos = 0;
+#ifdef MG_X86
+	// each byte copied to every lane, the last one repeated for a set of
+	//  two bytes
+	__m128i first0 = _mm_set1_epi8(re->first[0]);
+	__m128i first1 = _mm_set1_epi8(re->first[1]);
+	__m128i first2 = _mm_set1_epi8(re->first[re->numfirst-1]);
+	// block of text
+	__m128i blk;
+	// bit mask of the bytes found in the block
+	unsigned int mask;
+#endif
+
+	if (re->numfirst == 1) { return(memchr(hay,re->first[0],haylen)); }
+#ifdef MG_X86
+	for (; pos + 16 <= haylen; pos += 16) {
+		blk = _mm_loadu_si128((__m128i *) (hay+pos));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(blk,first0),_mm_cmpeq_epi8(blk,first1)),
+			_mm_cmpeq_epi8(blk,first2)));
+		if (mask != 0) { return(hay + pos + __builtin_ctz(mask)); }
+	}
+#endif
+	// the bytes left over at the end, or all of them without SSE2
+	for (; pos < haylen; pos++) {
+		if ((unsigned char) hay[pos] == re->first[0] ||
+			(unsigned char) hay[pos] == re->first[1] ||
+			(unsigned char) hay[pos] == re->first[re->numfirst-1])
+		{
+			return(hay + pos);
+		}
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// regex_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// re is a regular expression set up by search_init_regex
+// frees the memory allocated for the regular expression
+void regex_free(struct regex *re) {
+	free(re->nodes);
+	free(re->sets);
+	free(re->states);
+	free(re->literal);
+	free(re->wide);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA to set up, which may hold the states of another expression
+// re is the compiled regular expression
+// allocates the DFA's arrays, sized so that the states (their rows of the
+//  transition table and their entries in the hash table) and the sets of NFA
+//  states each take about half of DFA_CACHE_SIZE, returns 0 on success or -1
+//  if memory could not be allocated
+// note: the arrays are not filled in, only the rows of the states built are
+//        ever written, so the pages of a cache that is never filled are never
+//        touched
+int dfa_init(struct dfa_cache *dfa, struct regex *re) {
+	// size of a row of the transition table
+	size_t rowsize = re->nclasses * sizeof(int);
+
+	dfa_free(dfa);
+	// each state also takes about 32 bytes of flags, set positions and
+	//  hash table entries
+	dfa->maxstates = DFA_CACHE_SIZE / 2 / (rowsize + 32);
+	if (dfa->maxstates < DFA_MIN_STATES) {
+		dfa->maxstates = DFA_MIN_STATES;
+	}
+	// the sets must at least fit two states of every NFA state, so that
+	//  the cache never has to be thrown away twice for one step
+	dfa->setscap = DFA_CACHE_SIZE / 2 / sizeof(int);
+	if (dfa->setscap < 2 * re->numstates) {
+		dfa->setscap = 2 * re->numstates;
+	}
+	for (dfa->numbuckets=1; dfa->numbuckets<2*dfa->maxstates;
+		dfa->numbuckets*=2) { }
+	dfa->trans = malloc(dfa->maxstates * rowsize);
+	dfa->flags = malloc(dfa->maxstates);
+	dfa->bols = malloc(dfa->maxstates);
+	dfa->setstart = malloc(dfa->maxstates * sizeof(int));
+	dfa->setlen = malloc(dfa->maxstates * sizeof(int));
+	dfa->chain = malloc(dfa->maxstates * sizeof(int));
+	dfa->sets = malloc(dfa->setscap * sizeof(int));
+	dfa->buckets = malloc(dfa->numbuckets * sizeof(int));
+	dfa->stack = malloc((3 * re->numstates + 2) * sizeof(int));
+	dfa->mark = calloc(re->numstates,sizeof(unsigned int));
+	dfa->work = malloc(re->numstates * sizeof(int));
+	dfa->work2 = malloc(re->numstates * sizeof(int));
+	if (dfa->trans == NULL || dfa->flags == NULL || dfa->bols == NULL ||
+		dfa->setstart == NULL || dfa->setlen == NULL ||
+		dfa->chain == NULL || dfa->sets == NULL ||
+		dfa->buckets == NULL || dfa->stack == NULL ||
+		dfa->mark == NULL || dfa->work == NULL || dfa->work2 == NULL)
+	{
+		dfa_free(dfa);
+		return(-1);
+	}
+	dfa->gen = 0;
+	dfa->flushes = 0;
+	dfa->re = re;
+	dfa_flush(dfa);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_flush function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA to empty
+// throws away every state, so the cache can be filled again from the start
+void dfa_flush(struct dfa_cache *dfa) {
+	memset(dfa->buckets,0xff,dfa->numbuckets * sizeof(int));
+	dfa->numstates = 0;
+	dfa->setsused = 0;
+	dfa->startstate = -1;
+	dfa->anchored[0] = -1;
+	dfa->anchored[1] = -1;
+	dfa->flushes++;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_start function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA
+// builds the state at the start of a line, where '^' matches, returns the
+//  offset of its row
+int dfa_start(struct dfa_cache *dfa) {
+	// number of NFA states in the set
+	int len;
+	// offset of the row of the state
+	int state;
+
+	dfa_new_pass(dfa);
+	dfa->stack[0] = dfa->re->start;
+	len = dfa_closure(dfa,1,TRUE,FALSE,dfa->work);
+	state = dfa_add(dfa,dfa->work,len,TRUE);
+	dfa->startstate = state;
+	return(state);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_anchored function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA
+// bol is a boolean flag for a match at the start of a line, where '^' matches
+// builds the anchored state for a match starting at one byte, returns the
+//  offset of its row
+int dfa_anchored(struct dfa_cache *dfa, int bol) {
+	// number of NFA states in the set
+	int len;
+	// offset of the row of the state
+	int state;
+
+	dfa_new_pass(dfa);
+	dfa->stack[0] = dfa->re->start;
+	len = dfa_closure(dfa,1,bol,FALSE,dfa->work);
+	state = dfa_add(dfa,dfa->work,len,bol | DFA_ANCHORED);
+	dfa->anchored[bol] = state;
+	return(state);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_new_pass function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA
+// moves on the pass number, so every NFA state counts as not visited without
+//  clearing the marks - they are only cleared when the number wraps around
+void dfa_new_pass(struct dfa_cache *dfa) {
+	if (++dfa->gen == 0) {
+		memset(dfa->mark,0,dfa->re->numstates * sizeof(unsigned int));
+		dfa->gen = 1;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_step function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA
+// state is the offset of the row of the current state
+// byte is the next byte of the text, which is not a line ending
+// builds the state reached from the current state on the byte - every NFA
+//  state of the current state that matches the byte moves on, and the start of
+//  the expression is added again, since a match may start at any byte - and
+//  stores it in the transition table, returns the offset of its row
+// a transition to a state that has found a match, or after which the line
+//  cannot match, is stored as DFA_ACCEPT or DFA_DEAD, so the search loop only
+//  has to check the flags of a state when it leaves its main path
+// from an anchored state the start is not added again, and the transition is
+//  always stored as the next state, since the longest match goes on past the
+//  states that have found one
+// note: if the cache is full and has to be thrown away, the transition is not
+//        stored, since the row of the current state is gone
+int dfa_step(struct dfa_cache *dfa, int state, unsigned char byte) {
+	// the NFA
+	struct re_state *states = dfa->re->states;
+	// the current state's set of NFA states
+	int *set = dfa->sets + dfa->setstart[state / dfa->re->nclasses];
+	// number of NFA states in the current set, and in the new set
+	int len = dfa->setlen[state / dfa->re->nclasses], newlen;
+	// index into the set, and NFA state
+	int idx, nfa;
+	// number of NFA states on the stack
+	int depth = 0;
+	// number of times the cache was thrown away before the new state
+	unsigned long flushes = dfa->flushes;
+	// offset of the row of the new state, and its flags
+	int next;
+	unsigned char flags;
+	// DFA_ANCHORED for an anchored current state, or 0
+	int anchored = dfa->bols[state / dfa->re->nclasses] & DFA_ANCHORED;
+
+	dfa_new_pass(dfa);
+	for (idx=0; idx<len; idx++) {
+		nfa = set[idx];
+		if (states[nfa].type == RE_SET &&
+			(dfa->re->sets[states[nfa].set][byte >> 3] &
+			(1 << (byte & 7))))
+		{
+			dfa->stack[depth++] = states[nfa].out;
+		}
+	}
+	if (! anchored) { dfa->stack[depth++] = dfa->re->start; }
+	newlen = dfa_closure(dfa,depth,FALSE,FALSE,dfa->work);
+	next = dfa_add(dfa,dfa->work,newlen,anchored);
+	if (flushes == dfa->flushes && anchored) {
+		dfa->trans[state + dfa->re->classes[byte]] = next;
+	}
+	else if (flushes == dfa->flushes) {
+		flags = dfa->flags[next / dfa->re->nclasses];
+		dfa->trans[state + dfa->re->classes[byte]] =
+			(flags & DFA_F_ACCEPT) ? DFA_ACCEPT :
+			(flags & DFA_F_DEAD) ? DFA_DEAD : next;
+	}
+	return(next);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_add function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA
+// set is a set of NFA states, which is sorted in place
+// len is the number of NFA states in the set
+// bol is a boolean flag for the state at the start of a line, with
+//  DFA_ANCHORED added for an anchored state
+// finds the state with this set of NFA states, or adds it - throwing away the
+//  whole cache first if it is full - returns the offset of its row
+int dfa_add(struct dfa_cache *dfa, int *set, int len, int bol) {
+	// the NFA
+	struct re_state *states = dfa->re->states;
+	// hash of the set
+	unsigned int hash = 2166136261u;
+	// index of the state found or added
+	int idx;
+	// index into the set, and number of NFA states on the stack
+	int pos, depth;
+	// number of NFA states reached at the end of a line
+	int eollen;
+	// flags of the new state
+	unsigned char flags = 0;
+	// boolean flag for an NFA state that still needs a byte
+	int needbyte = FALSE;
+
+	qsort(set,len,sizeof(int),dfa_cmp_state);
+	for (pos=0; pos<len; pos++) { hash = (hash ^ set[pos]) * 16777619u; }
+	hash = (hash ^ bol) * 16777619u;
+	for (idx=dfa->buckets[hash & (dfa->numbuckets-1)]; idx!=-1;
+		idx=dfa->chain[idx])
+	{
+		if (dfa->setlen[idx] == len && dfa->bols[idx] == bol &&
+			memcmp(dfa->sets+dfa->setstart[idx],set,
+			len * sizeof(int)) == 0)
+		{
+			return(idx * dfa->re->nclasses);
+		}
+	}
+	if (dfa->numstates == dfa->maxstates ||
+		dfa->setsused + len > dfa->setscap)
+	{
+		dfa_flush(dfa);
+		STATS_ADD(flushes,1);
+	}
+	idx = dfa->numstates++;
+	for (pos=0; pos<dfa->re->nclasses; pos++) {
+		dfa->trans[idx * dfa->re->nclasses + pos] = DFA_UNKNOWN;
+	}
+	dfa->setstart[idx] = dfa->setsused;
+	dfa->setlen[idx] = len;
+	memcpy(dfa->sets+dfa->setsused,set,len * sizeof(int));
+	dfa->setsused += len;
+	dfa->bols[idx] = bol;
+	dfa->chain[idx] = dfa->buckets[hash & (dfa->numbuckets-1)];
+	dfa->buckets[hash & (dfa->numbuckets-1)] = idx;
+	// a match is found if the set holds the final state, and also at the
+	//  end of a line if the final state is reached through the '$' anchors
+	//  of the set
+	dfa_new_pass(dfa);
+	depth = 0;
+	for (pos=0; pos<len; pos++) {
+		if (states[set[pos]].type == RE_MATCH) {
+			flags |= DFA_F_ACCEPT | DFA_F_EOLACCEPT;
+		}
+		else if (states[set[pos]].type == RE_SET) { needbyte = TRUE; }
+		else if (states[set[pos]].type == RE_EOL) {
+			dfa->stack[depth++] = states[set[pos]].out;
+		}
+	}
+	eollen = dfa_closure(dfa,depth,bol & ~DFA_ANCHORED,TRUE,dfa->work2);
+	for (pos=0; pos<eollen; pos++) {
+		if (states[dfa->work2[pos]].type == RE_MATCH) {
+			flags |= DFA_F_EOLACCEPT;
+		}
+	}
+	// with no NFA state left that needs a byte and no match at the end of
+	//  the line, nothing in the rest of the line can change the outcome
+	if (! needbyte && ! (flags & DFA_F_EOLACCEPT)) { flags |= DFA_F_DEAD; }
+	dfa->flags[idx] = flags;
+	return(idx * dfa->re->nclasses);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_closure function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA, whose stack holds the NFA states to start from and whose
+//  current pass number has been moved on
+// depth is the number of NFA states on the stack
+// bol and eol are boolean flags for the start and end of a line, where the
+//  '^' and '$' anchors match
+// set is filled with the NFA states reached without reading a byte that match
+//  a byte, '$' anchors that do not match here, and the final state
+// returns the number of NFA states in set
+int dfa_closure(struct dfa_cache *dfa, int depth, int bol, int eol, int *set) {
+	// the NFA
+	struct re_state *states = dfa->re->states;
+	// number of NFA states in the set
+	int len = 0;
+	// NFA state visited
+	int nfa;
+
+	while (depth > 0) {
+		nfa = dfa->stack[--depth];
+		if (dfa->mark[nfa] == dfa->gen) { continue; }
+		dfa->mark[nfa] = dfa->gen;
+		switch (states[nfa].type) {
+		case RE_SPLIT:
+			dfa->stack[depth++] = states[nfa].out1;
+			dfa->stack[depth++] = states[nfa].out;
+			break;
+		case RE_BOL:
+			if (bol) { dfa->stack[depth++] = states[nfa].out; }
+			break;
+		case RE_EOL:
+			if (eol) { dfa->stack[depth++] = states[nfa].out; }
+			else { set[len++] = nfa; }
+			break;
+		default:
+			set[len++] = nfa;
+			break;
+		}
+	}
+	return(len);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_cmp_state function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b point to NFA state numbers
+// compares two NFA state numbers for qsort()
+int dfa_cmp_state(const void *a, const void *b) {
+	return((*(const int *) a > *(const int *) b) -
+		(*(const int *) a < *(const int *) b));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// dfa is the DFA to free, which may never have been set up
+// frees the memory allocated for the DFA
+void dfa_free(struct dfa_cache *dfa) {
+	free(dfa->trans);
+	free(dfa->flags);
+	free(dfa->bols);
+	free(dfa->setstart);
+	free(dfa->setlen);
+	free(dfa->chain);
+	free(dfa->sets);
+	free(dfa->buckets);
+	free(dfa->stack);
+	free(dfa->mark);
+	free(dfa->work);
+	free(dfa->work2);
+	memset(dfa,0,sizeof(*dfa));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// add_pattern function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// plist is the list of search strings
+// pat is the search string to add, which does not need to be null-terminated
+// len is the length of the search string
+// adds a search string to the end of the list, doubling the list as needed,
+//  returns 0 on success or -1 if memory could not be allocated
+int add_pattern(struct pattern_list *plist, char *pat, size_t len) {
+	// the grown arrays
+	char **temppats;
+	size_t *templens;
+
+	if (plist->num == plist->size) {
+		plist->size = (plist->size > 0) ? plist->size * 2 : 16;
+		temppats = realloc(plist->pats,plist->size * sizeof(char *));
+		if (temppats == NULL) { return(-1); }
+		plist->pats = temppats;
+		templens = realloc(plist->lens,plist->size * sizeof(size_t));
+		if (templens == NULL) { return(-1); }
+		plist->lens = templens;
+	}
+	plist->pats[plist->num] = pat;
+	plist->lens[plist->num] = len;
+	plist->num++;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// read_patterns function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// plist is the list of search strings
+// pathname is the path of the pattern file
+// reads the whole pattern file and adds each of its lines to the list as a
+//  search string, returns 0 on success or -1 if the file could not be read or
+//  memory could not be allocated
+// the file contents are kept in the list, since the search strings point
+//  into them
+// note: the same three line endings are handled as in the searched files
+int read_patterns(struct pattern_list *plist, char *pathname) {
+	// file handle for the pattern file
+	FILE *fileh;
+	// buffer holding the whole file
+	char *buff;
+	// the grown buffer and list of file contents
+	char *temp;
+	char **tempbuffs;
+	// size of the buffer and number of bytes in it
+	size_t buffsize = BUFF_SIZE, len = 0;
+	// number of bytes returned by read()
+	ssize_t nread;
+	// start of each line and its line ending
+	char *line, *eol;
+	// end of the file contents
+	char *end;
+	// errno to report after cleaning up
+	int saverr;
+
+	tempbuffs = realloc(plist->buffs,(plist->numbuffs+1) * sizeof(char *));
+	if (tempbuffs == NULL) { return(-1); }
+	plist->buffs = tempbuffs;
+	fileh = fopen(pathname,"r");
+	if (fileh == NULL) { return(-1); }
+	buff = malloc(buffsize);
+	if (buff == NULL) {
+		fclose(fileh);
+		return(-1);
+	}
+	// read the whole file, doubling the buffer as needed
+	while (TRUE) {
+		if (len == buffsize) {
+			temp = realloc(buff,buffsize*2);
+			if (temp == NULL) { break; }
+			buff = temp;
+			buffsize *= 2;
+		}
+		nread = read(fileno(fileh),buff+len,buffsize-len);
+		if (nread == -1 && errno == EINTR) { continue; }
+		if (nread <= 0) { break; }
+		len += nread;
+	}
+	if (nread != 0) {
+		saverr = errno;
+		free(buff);
+		fclose(fileh);
+		errno = saverr;
+		return(-1);
+	}
+	fclose(fileh);
+	plist->buffs[plist->numbuffs++] = buff;
+	// add each line, skipping "\r\n" as one line ending
+	line = buff;
+	end = buff + len;
+	while (line < end) {
+		eol = find_eol(line,end-line);
+		if (eol == NULL) { eol = end; }
+		if (add_pattern(plist,line,eol-line) != 0) { return(-1); }
+		line = eol + 1;
+		if (eol < end && *eol == '\r' && line < end && *line == '\n') {
+			line++;
+		}
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_memchr function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with a single char search string
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  or null if it does not occur
+char *search_memchr(struct searcher *srch, char *hay, size_t haylen) {
+	return(memchr(hay,srch->needle[0],haylen));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_memmem function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a compiled searcher
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  or null if it does not occur
+// note: only used for short search strings on processors without SIMD search
+//        functions
+char *search_memmem(struct searcher *srch, char *hay, size_t haylen) {
+	return(memmem(hay,haylen,srch->needle,srch->len));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_horspool function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with its skip table filled in
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  or null if it does not occur
+// note: the last byte of each window is compared first and the window is then
+//        moved by the skip for that byte, so long search strings skip most
+//        of the text without looking at it
+char *search_horspool(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// last byte of the search string
+	char last = srch->needle[len-1];
+	// position of the current window in the text
+	size_t pos = 0;
+	// last byte of the current window
+	char c;
+
+	if (haylen < len) { return(NULL); }
+	while (pos <= haylen - len) {
+		c = hay[pos+len-1];
+		if (c == last && memcmp(hay+pos,srch->needle,len-1) == 0) {
+			return(hay+pos);
+		}
+		pos += srch->skip[(unsigned char) c];
+	}
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_horspool_icase function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with its skip table filled in
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  ignoring the case of ASCII letters, or null if it does not occur
+char *search_horspool_icase(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// last byte of the folded search string
+	unsigned char last = srch->folded[len-1];
+	// position of the current window in the text
+	size_t pos = 0;
+	// last byte of the current window
+	unsigned char c;
+
+	if (haylen < len) { return(NULL); }
+	while (pos <= haylen - len) {
+		c = hay[pos+len-1];
+		if (FOLD_ASCII(c) == last &&
+			casecmp_ascii(hay+pos,srch->folded,len-1) == 0)
+		{
+			return(hay+pos);
+		}
+		pos += srch->skip[c];
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_utf8_icase function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with its search string decoded
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to an occurrence of the search string in the text,
+//  comparing one UTF-8 char at a time after folding each with FOLD_WIDE, or
+//  null if it does not occur - the occurrence returned is in the first line
+//  that has one, which is all grep_region needs
+// note: with a prefilter only the positions where its run of ASCII chars
+//        occurs are compared, after stepping back over the chars before the
+//        run, otherwise the text is stepped through one char at a time - a
+//        match never starts in the middle of a char
+char *search_utf8_icase(struct searcher *srch, char *hay, size_t haylen) {
+	// position of the current char in the text
+	size_t pos = 0;
+	// number of bytes in the current char
+	size_t step;
+	// candidate found by the prefilter
+	char *cand;
+	// position where the candidate match starts
+	size_t start;
+	// number of chars stepped back over
+	size_t back;
+	// char decoded from the text
+	wint_t chr;
+
+	if (srch->prefilter == NULL) {
+		for (; pos<haylen; pos+=step) {
+			step = utf8_decode((unsigned char *) hay+pos,haylen-pos,
+				&chr);
+			if (FOLD_WIDE(chr) == srch->wneedle[0] &&
+				utf8_match(srch,hay+pos,haylen-pos)) {
+				return(hay+pos);
+			}
+		}
+		return(NULL);
+	}
+	while (pos < haylen) {
+		cand = srch->prefilter->find(srch->prefilter,hay+pos,
+			haylen-pos);
+		if (cand == NULL) { return(NULL); }
+		// step back one char for each char before the run, a char
+		//  being a lead byte and at most three continuation bytes
+		start = cand - hay;
+		for (back=0; back<srch->runidx && start>0; back++) {
+			start--;
+			for (step=0; step<3 && start>0 &&
+				((unsigned char) hay[start] & 0xC0) == 0x80;
+				step++) { start--; }
+		}
+		if (back == srch->runidx &&
+			utf8_match(srch,hay+start,haylen-start)) {
+			return(hay+start);
+		}
+		pos = cand - hay + 1;
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// utf8_match function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with its search string decoded
+// text is the text to compare, which does not need to be null-terminated
+// len is the length of the text
+// returns the number of bytes of the text that match if it starts with the
+//  search string once both are folded with FOLD_WIDE, or 0 if it does not
+// note: a folded char may take a different number of bytes than the char of
+//        the search string, so the length of a match is not always len
+size_t utf8_match(struct searcher *srch, char *text, size_t len) {
+	// position of the char being compared
+	size_t pos = 0;
+	// index of the char of the search string being compared
+	size_t widx;
+	// char decoded from the text
+	wint_t chr;
+
+	for (widx=0; widx<srch->wlen; widx++) {
+		if (pos >= len) { return(0); }
+		pos += utf8_decode((unsigned char *) text+pos,len-pos,&chr);
+		if (FOLD_WIDE(chr) != srch->wneedle[widx]) { return(0); }
+	}
+	return(pos);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// utf8_prefilter function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with its search string decoded
+// sets up a prefilter for the longest run of ASCII chars in the search string
+//  whose case can be folded with FOLD_ASCII - a letter that some char outside
+//  ASCII also folds to (such as 'k' for the Kelvin sign) cannot be part of the
+//  run, since the ASCII search would miss that char, returns 0 on success or
+//  -1 if memory could not be allocated
+// note: a search string without such a run gets no prefilter
+int utf8_prefilter(struct searcher *srch) {
+	// boolean flag for each ASCII char that cannot be part of the run
+	char unsafe[128];
+	// char being checked, and its folded form
+	wint_t chr, folded;
+	// index into the decoded search string, and start and length of the
+	//  run being measured
+	size_t widx, start = 0, len = 0;
+
+	// every char outside ASCII that folds into ASCII is found once, cases
+	//  only exist below 0x20000
+	memset(unsafe,0,sizeof(unsafe));
+	for (chr=0; chr<0x20000; chr++) {
+		folded = FOLD_WIDE(chr);
+		if (chr < 128 && folded != (wint_t) FOLD_ASCII(chr)) {
+			unsafe[chr] = TRUE;
+		}
+		else if (chr >= 128 && folded < 128) { unsafe[folded] = TRUE; }
+	}
+	for (widx=0; widx<=srch->wlen; widx++) {
+		if (widx < srch->wlen && srch->wneedle[widx] < 128 &&
+			! unsafe[srch->wneedle[widx]])
+		{
+			len++;
+			continue;
+		}
+		if (len > 0 && (srch->run == NULL || len > strlen(srch->run))) {
+			free(srch->run);
+			srch->run = malloc(len + 1);
+			if (srch->run == NULL) { return(-1); }
+			for (start=0; start<len; start++) {
+				srch->run[start] = srch->wneedle[widx-len+start];
+			}
+			srch->run[len] = '\0';
+			srch->runidx = widx - len;
+		}
+		len = 0;
+	}
+	if (srch->run == NULL) { return(0); }
+	srch->prefilter = malloc(sizeof(struct searcher));
+	if (srch->prefilter == NULL) { return(-1); }
+	return(search_init(srch->prefilter,srch->run,strlen(srch->run),
+		CASE_ASCII));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// casecmp_ascii function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// text is the text to compare, which does not need to be null-terminated
+// folded is the folded search string to compare it with
+// len is the number of bytes to compare
+// returns 0 if the text equals the folded search string once its ASCII letters
+//  are folded to lower case, or 1 if it does not
+int casecmp_ascii(char *text, char *folded, size_t len) {
+	// index of the byte being compared
+	size_t idx;
+
+	for (idx=0; idx<len; idx++) {
+		if (FOLD_ASCII((unsigned char) text[idx]) !=
+			(unsigned char) folded[idx]) { return(1); }
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// utf8_decode function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// str is the text to decode, which does not need to be null-terminated
+// len is the number of bytes left in the text, at least 1
+// chr is set to the char decoded
+// decodes one UTF-8 char, returns the number of bytes it takes up - a byte
+//  that does not start a valid char takes up 1 byte and is given a value past
+//  the end of Unicode, so it never equals a real char
+size_t utf8_decode(unsigned char *str, size_t len, wint_t *chr) {
+	// number of continuation bytes, and index of the one being read
+	size_t more, idx;
+	// smallest value that needs this many bytes, to reject overlong forms
+	wint_t least;
+
+	if (str[0] < 0x80) {
+		*chr = str[0];
+		return(1);
+	}
+	else if (str[0] >= 0xC2 && str[0] <= 0xDF) {
+		more = 1;
+		least = 0x80;
+		*chr = str[0] & 0x1F;
+	}
+	else if (str[0] >= 0xE0 && str[0] <= 0xEF) {
+		more = 2;
+		least = 0x800;
+		*chr = str[0] & 0x0F;
+	}
+	else if (str[0] >= 0xF0 && str[0] <= 0xF4) {
+		more = 3;
+		least = 0x10000;
+		*chr = str[0] & 0x07;
+	}
+	else { more = len; least = 0; }
+	if (more < len) {
+		for (idx=1; idx<=more && (str[idx] & 0xC0) == 0x80; idx++) {
+			*chr = (*chr << 6) | (str[idx] & 0x3F);
+		}
+		if (idx > more && *chr >= least && *chr <= 0x10FFFF &&
+			(*chr < 0xD800 || *chr > 0xDFFF)) { return(more + 1); }
+	}
+	*chr = 0x110000 + str[0];
+	return(1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// utf8_encode function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// chr is a Unicode char
+// str is set to the UTF-8 bytes of the char, with room for 4
+// returns the number of bytes the char takes up
+size_t utf8_encode(wint_t chr, unsigned char *str) {
+	if (chr < 0x80) {
+		str[0] = chr;
+		return(1);
+	}
+	if (chr < 0x800) {
+		str[0] = 0xC0 | (chr >> 6);
+		str[1] = 0x80 | (chr & 0x3F);
+		return(2);
+	}
+	if (chr < 0x10000) {
+		str[0] = 0xE0 | (chr >> 12);
+		str[1] = 0x80 | ((chr >> 6) & 0x3F);
+		str[2] = 0x80 | (chr & 0x3F);
+		return(3);
+	}
+	str[0] = 0xF0 | (chr >> 18);
+	str[1] = 0x80 | ((chr >> 12) & 0x3F);
+	str[2] = 0x80 | ((chr >> 6) & 0x3F);
+	str[3] = 0x80 | (chr & 0x3F);
+	return(4);
+}
+
+
+
+#ifdef MG_X86
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_sse2 function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with a search string of at least two chars
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  or null if it does not occur
+// note: 16 positions are tested at once by comparing the first byte of the
+//        search string with 16 bytes of text, and the last byte of the search
+//        string with the 16 bytes that many positions later - only positions
+//        where both match are compared in full
+char *search_sse2(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// first and last byte of the search string copied to every lane
+	__m128i first = _mm_set1_epi8(srch->needle[0]);
+	__m128i last = _mm_set1_epi8(srch->needle[len-1]);
+	// blocks of text lined up with the first and last byte
+	__m128i blkfirst, blklast;
+	// bit mask of candidate positions in the block
+	unsigned int mask;
+	// position of the current block in the text
+	size_t pos = 0;
+	// offset of a candidate inside the block
+	size_t bit;
+	// candidate position found in the leftover text
+	char *cand;
+
+	if (haylen < len) { return(NULL); }
+	for (; pos + 16 + len - 1 <= haylen; pos += 16) {
+		blkfirst = _mm_loadu_si128((__m128i *) (hay+pos));
+		blklast = _mm_loadu_si128((__m128i *) (hay+pos+len-1));
+		mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(blkfirst,first),
+			_mm_cmpeq_epi8(blklast,last)));
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			if (memcmp(hay+pos+bit+1,srch->needle+1,len-2) == 0) {
+				return(hay+pos+bit);
+			}
+			mask &= mask - 1;
+		}
+	}
+	// the positions left over at the end (all of them for text shorter
+	//  than a block, such as most lines) are found with memchr
+	for (; pos + len <= haylen; pos++) {
+		cand = memchr(hay+pos,srch->needle[0],haylen-len+1-pos);
+		if (cand == NULL) { return(NULL); }
+		if (memcmp(cand+1,srch->needle+1,len-1) == 0) {
+			return(cand);
+		}
+		pos = cand - hay;
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_avx2 function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher with a search string of at least two chars
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  or null if it does not occur
+// note: the same filter as search_sse2, testing 32 positions at once - it is
+//        compiled for AVX2 on its own and only called when search_init finds
+//        that the processor supports AVX2
+__attribute__((target("avx2")))
+char *search_avx2(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// first and last byte of the search string copied to every lane
+	__m256i first = _mm256_set1_epi8(srch->needle[0]);
+	__m256i last = _mm256_set1_epi8(srch->needle[len-1]);
+	// blocks of text lined up with the first and last byte
+	__m256i blkfirst, blklast;
+	// bit mask of candidate positions in the block
+	unsigned int mask;
+	// position of the current block in the text
+	size_t pos = 0;
+	// offset of a candidate inside the block
+	size_t bit;
+
+	if (haylen < len) { return(NULL); }
+	for (; pos + 32 + len - 1 <= haylen; pos += 32) {
+		blkfirst = _mm256_loadu_si256((__m256i *) (hay+pos));
+		blklast = _mm256_loadu_si256((__m256i *) (hay+pos+len-1));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(blkfirst,first),
+			_mm256_cmpeq_epi8(blklast,last)));
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			if (memcmp(hay+pos+bit+1,srch->needle+1,len-2) == 0) {
+				return(hay+pos+bit);
+			}
+			mask &= mask - 1;
+		}
+	}
+	// the rest of the text is shorter than one block, so the SSE2 filter
+	//  and its one at a time loop finish it
+	return(search_sse2(srch,hay+pos,haylen-pos));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_sse2_icase function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with a search string of at most
+//  SIMD_MAX_NEEDLE chars
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  ignoring the case of ASCII letters, or null if it does not occur
+// note: the same filter as search_sse2, except that each block is compared
+//        with both cases of the first and last byte, so the text is folded
+//        only at the candidate positions
+char *search_sse2_icase(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// lower and upper case of the first and last byte
+	unsigned char flower = srch->folded[0], llower = srch->folded[len-1];
+	unsigned char fupper = (flower >= 'a' && flower <= 'z') ?
+		flower - 0x20 : flower;
+	unsigned char lupper = (llower >= 'a' && llower <= 'z') ?
+		llower - 0x20 : llower;
+	// both cases of the first and last byte copied to every lane
+	__m128i firstlo = _mm_set1_epi8(flower), firstup = _mm_set1_epi8(fupper);
+	__m128i lastlo = _mm_set1_epi8(llower), lastup = _mm_set1_epi8(lupper);
+	// blocks of text lined up with the first and last byte
+	__m128i blkfirst, blklast;
+	// bit mask of candidate positions in the block
+	unsigned int mask;
+	// position of the current block in the text
+	size_t pos = 0;
+	// offset of a candidate inside the block
+	size_t bit;
+	// number of bytes between the first and last byte
+	size_t mid = (len > 2) ? len - 2 : 0;
+
+	if (haylen < len) { return(NULL); }
+	for (; pos + 16 + len - 1 <= haylen; pos += 16) {
+		blkfirst = _mm_loadu_si128((__m128i *) (hay+pos));
+		blklast = _mm_loadu_si128((__m128i *) (hay+pos+len-1));
+		mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(blkfirst,firstlo),
+				_mm_cmpeq_epi8(blkfirst,firstup)),
+			_mm_or_si128(_mm_cmpeq_epi8(blklast,lastlo),
+				_mm_cmpeq_epi8(blklast,lastup))));
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			if (casecmp_ascii(hay+pos+bit+1,srch->folded+1,mid) == 0) {
+				return(hay+pos+bit);
+			}
+			mask &= mask - 1;
+		}
+	}
+	// the positions left over at the end are tested one at a time
+	for (; pos + len <= haylen; pos++) {
+		if (FOLD_ASCII((unsigned char) hay[pos]) == flower &&
+			casecmp_ascii(hay+pos+1,srch->folded+1,len-1) == 0)
+		{
+			return(hay+pos);
+		}
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// search_avx2_icase function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is a searcher for the -i option with a search string of at most
+//  SIMD_MAX_NEEDLE chars
+// hay is the text to search, which does not need to be null-terminated
+// haylen is the length of the text
+// returns a pointer to the first occurrence of the search string in the text,
+//  ignoring the case of ASCII letters, or null if it does not occur
+// note: the same filter as search_sse2_icase with 32 positions at once
+__attribute__((target("avx2")))
+char *search_avx2_icase(struct searcher *srch, char *hay, size_t haylen) {
+	// length of the search string
+	size_t len = srch->len;
+	// lower and upper case of the first and last byte
+	unsigned char flower = srch->folded[0], llower = srch->folded[len-1];
+	unsigned char fupper = (flower >= 'a' && flower <= 'z') ?
+		flower - 0x20 : flower;
+	unsigned char lupper = (llower >= 'a' && llower <= 'z') ?
+		llower - 0x20 : llower;
+	// both cases of the first and last byte copied to every lane
+	__m256i firstlo = _mm256_set1_epi8(flower);
+	__m256i firstup = _mm256_set1_epi8(fupper);
+	__m256i lastlo = _mm256_set1_epi8(llower);
+	__m256i lastup = _mm256_set1_epi8(lupper);
+	// blocks of text lined up with the first and last byte
+	__m256i blkfirst, blklast;
+	// bit mask of candidate positions in the block
+	unsigned int mask;
+	// position of the current block in the text
+	size_t pos = 0;
+	// offset of a candidate inside the block
+	size_t bit;
+	// number of bytes between the first and last byte
+	size_t mid = (len > 2) ? len - 2 : 0;
+
+	if (haylen < len) { return(NULL); }
+	for (; pos + 32 + len - 1 <= haylen; pos += 32) {
+		blkfirst = _mm256_loadu_si256((__m256i *) (hay+pos));
+		blklast = _mm256_loadu_si256((__m256i *) (hay+pos+len-1));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(blkfirst,firstlo),
+				_mm256_cmpeq_epi8(blkfirst,firstup)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(blklast,lastlo),
+				_mm256_cmpeq_epi8(blklast,lastup))));
+		while (mask != 0) {
+			bit = __builtin_ctz(mask);
+			if (casecmp_ascii(hay+pos+bit+1,srch->folded+1,mid) == 0) {
+				return(hay+pos+bit);
+			}
+			mask &= mask - 1;
+		}
+	}
+	// the rest of the text is shorter than one block, so the SSE2 filter
+	//  finishes it
+	return(search_sse2_icase(srch,hay+pos,haylen-pos));
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_main function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// argc is the number of args after the program name
+// argv is the args after the program name, starting with "index"
+// runs the index subcommand - "index [-o INDEX] [PATH]..." reads every file
+//  under the paths, or under the current directory if none are given, and
+//  writes a trigram index of them to INDEX, INDEX_NAME by default, for the
+//  --index option
+// returns the exit status, 0 if every file was indexed or R_ERROR otherwise
+int index_main(int argc, char *argv[]) {
+	// path of the index written
+	char *indexpath = INDEX_NAME;
+	// index of current position in argv, the subcommand is at index 0
+	int argidx = 1;
+
+	for (; argidx < argc && argv[argidx][0] == '-' &&
+		argv[argidx][1] != '\0'; argidx++)
+	{
+		// the output option names the index file
+		if (strcmp(argv[argidx],"-o") == 0) {
+			if (argidx+1 >= argc) {
+				print_usage(PROG_NAME);
+				return(R_ERROR);
+			}
+			argidx++;
+			indexpath = argv[argidx];
+		}
+		// '--' ends the options, even if the next path starts with '-'
+		else if (strcmp(argv[argidx],"--") == 0) {
+			argidx++;
+			break;
+		}
+		else {
+			fprintf(stderr,"%s: unknown option '%s'\n",PROG_NAME,
+				argv[argidx]);
+			print_usage(PROG_NAME);
+			return(R_ERROR);
+		}
+	}
+	if (index_build(indexpath,argv+argidx,argc-argidx) != 0) {
+		return(R_ERROR);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_build function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// indexpath is the path of the index to write
+// paths is the array of paths to index, directories or files
+// numpaths is the number of paths, 0 indexes the current directory
+// walks the paths the same way as the -r option, reads each file found with
+//  index_add_file, and writes the index to a temporary file that is renamed
+//  over indexpath once it is complete, so a search never maps a partly
+//  written index
+// returns 0 on success, or -1 if any file could not be read or the index
+//  could not be written - a file that could not be read is left out of the
+//  index, and a search finds it there is none for it and searches it in full
+int index_build(char *indexpath, char **paths, int numpaths) {
+	// state while the files are read
+	struct index_builder bld;
+	// the walk finding the files
+	struct walk_pool pool;
+	// walking thread handles, and the number of them started
+	pthread_t walkers[WALK_THREADS];
+	int numwalkers;
+	// path of the file being read
+	char *path;
+	// path the index is written to before it is renamed
+	char *tmppath;
+	// file descriptor of the index being written
+	int fd;
+	// status of the index being written and of the one it replaces
+	struct stat st;
+	// number of files that could not be read
+	int founderror = 0;
+	// return value of index_add_file, and -1 once the index cannot be
+	//  written
+	int ret;
+
+	memset(&bld,0,sizeof(bld));
+	bld.listsize = INDEX_HASH_MIN;
+	bld.lists = calloc(bld.listsize,sizeof(struct index_list));
+	bld.seen = calloc(INDEX_TRIGRAMS / 8,1);
+	tmppath = malloc(strlen(indexpath) + 5);
+	if (bld.lists == NULL || bld.seen == NULL || tmppath == NULL) {
+		fprintf(stderr,"%s: error allocating memory: %s\n",PROG_NAME,
+			strerror(errno));
+		free(tmppath);
+		index_free_builder(&bld);
+		return(-1);
+	}
+	sprintf(tmppath,"%s.tmp",indexpath);
+	fd = open(tmppath,O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+	if (fd == -1 || fstat(fd,&st) != 0) {
+		fprintf(stderr,"%s: index '%s' could not be created: %s\n",
+			PROG_NAME,tmppath,strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			unlink(tmppath);
+		}
+		free(tmppath);
+		index_free_builder(&bld);
+		return(-1);
+	}
+	// the index may be written inside a directory it indexes
+	bld.dev[0] = st.st_dev;
+	bld.ino[0] = st.st_ino;
+	if (stat(indexpath,&st) == 0) {
+		bld.dev[1] = st.st_dev;
+		bld.ino[1] = st.st_ino;
+	}
+	// the walking threads find the files, which are read in this thread
+	//  as they are found
+	memset(&pool,0,sizeof(pool));
+	numwalkers = walk_start(&pool,paths,numpaths,walkers);
+	ret = (numwalkers > 0) ? 0 : -1;
+	while ((path = walk_next_file(&pool)) != NULL) {
+		ret = index_add_file(&bld,path);
+		if (ret == 1) {
+			founderror++;
+			ret = 0;
+		}
+		// an index missing part of a file would hide its matches, so
+		//  running out of memory stops the whole index
+		else if (ret == -1) {
+			fprintf(stderr,"%s: error allocating memory: %s\n",
+				PROG_NAME,strerror(errno));
+			pthread_mutex_lock(&pool.lock);
+			walk_stop(&pool);
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+	walk_end(&pool,walkers,numwalkers);
+	founderror += pool.founderror;
+	if (ret == 0 && (index_write(&bld,fd,paths,numpaths) != 0 ||
+		fsync(fd) != 0))
+	{
+		fprintf(stderr,"%s: index '%s' could not be written: %s\n",
+			PROG_NAME,tmppath,strerror(errno));
+		ret = -1;
+	}
+	if (close(fd) != 0 && ret == 0) {
+		fprintf(stderr,"%s: index '%s' failed to close: %s\n",
+			PROG_NAME,tmppath,strerror(errno));
+		ret = -1;
+	}
+	if (ret == 0 && rename(tmppath,indexpath) != 0) {
+		fprintf(stderr,"%s: index '%s' could not be written: %s\n",
+			PROG_NAME,indexpath,strerror(errno));
+		ret = -1;
+	}
+	if (ret != 0) { unlink(tmppath); }
+	free(tmppath);
+	index_free_builder(&bld);
+	if (ret != 0 || founderror > 0) { return(-1); }
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_add_file function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// path is the path of the file, which the builder takes over
+// reads the file through the line reader, decompressing it first if it is a
+//  gzip or zstd file, and adds the trigrams of each of its blocks to the index
+// returns 0 on success or if the file is not indexed because it is not a
+//  regular file or is the index itself, 1 if the file could not be read, which
+//  is printed to stderr, or -1 if memory could not be allocated
+// note: the size and modification time are taken before the file is read, so
+//        a file that changes while it is read is found to be stale and is
+//        searched in full
+int index_add_file(struct index_builder *bld, char *path) {
+	// file descriptor of the file
+	int fd;
+	// status of the file
+	struct stat st;
+	// the entry of the file, and the grown list of entries
+	struct index_entry *entry, *temp;
+	// the decompression thread for a compressed file
+	struct decomp_pipe dp;
+	// compression format found at the start of the file
+	int type;
+	// each run of whole lines read, and its length
+	char *run;
+	size_t runlen;
+	// offset of the run in the file, or in the decompressed data
+	uint64_t offset = 0;
+	// return value of get_next_block, and -1 once memory runs out
+	int status = 0, ret = 0;
+	// index of the index file being written and replaced
+	int idx;
+	// errno from reading the file, kept while it is closed
+	int saved;
+
+	fd = open(path,O_RDONLY|O_CLOEXEC);
+	if (fd == -1 || fstat(fd,&st) != 0) {
+		if (errno == ENOENT) {
+			fprintf(stderr,"%s: file '%s' does not exist: %s\n",
+				PROG_NAME,path,strerror(errno));
+		}
+		else if (errno == EACCES) {
+			fprintf(stderr,"%s: file '%s' is not readable: %s\n",
+				PROG_NAME,path,strerror(errno));
+		}
+		else {
+			fprintf(stderr,"%s: file '%s' failed to open: %s\n",
+				PROG_NAME,path,strerror(errno));
+		}
+		if (fd != -1) { close(fd); }
+		free(path);
+		return(1);
+	}
+	for (idx=0; idx<2; idx++) {
+		if (st.st_dev == bld->dev[idx] && st.st_ino == bld->ino[idx]) {
+			break;
+		}
+	}
+	if (idx < 2 || ! S_ISREG(st.st_mode)) {
+		close(fd);
+		free(path);
+		return(0);
+	}
+	if (bld->numfiles == bld->filesize) {
+		temp = realloc(bld->files,(bld->filesize*2 + 64) *
+			sizeof(struct index_entry));
+		if (temp == NULL) {
+			close(fd);
+			free(path);
+			return(-1);
+		}
+		bld->files = temp;
+		bld->filesize = bld->filesize*2 + 64;
+	}
+	entry = &bld->files[bld->numfiles];
+	memset(entry,0,sizeof(*entry));
+	entry->file.size = st.st_size;
+	entry->file.mtime = st.st_mtim.tv_sec;
+	entry->file.mtimens = st.st_mtim.tv_nsec;
+	entry->file.firstblock = bld->numblocks;
+	if (is_binary(fd)) {
+		entry->file.flags |= INDEX_F_BINARY;
+		close(fd);
+		entry->path = path;
+		bld->numfiles++;
+		return(0);
+	}
+	bld->fileblocks = 0;
+	bld->blockfill = 0;
+	// a compressed file is read from its decompression thread, as it is
+	//  when searched
+	type = compress_type(fd);
+	if (type != COMP_NONE) {
+		entry->file.flags |= INDEX_F_WHOLE;
+		if (decomp_open(&dp,fd,type,path) != 0) {
+			fprintf(stderr,"%s: file '%s' could not be "
+				"decompressed: %s\n",PROG_NAME,path,
+				strerror(errno));
+			close(fd);
+			free(path);
+			return(1);
+		}
+		mg_reader.pipe = &dp;
+	}
+	if (reader_init(&mg_reader,fd) != 0) { ret = -1; }
+	// blocks of the index start at line starts, so null bytes are never
+	//  taken as line endings here, as they may be in a binary stream
+	mg_reader.checked = TRUE;
+	while (ret == 0 &&
+		(status = get_next_block(&mg_reader,&run,&runlen)) == 1)
+	{
+		if (index_add_run(bld,run,runlen,offset,
+			type != COMP_NONE) != 0)
+		{
+			ret = -1;
+		}
+		offset += runlen;
+	}
+	saved = errno;
+	if (type != COMP_NONE) {
+		mg_reader.pipe = NULL;
+		decomp_close(&dp);
+	}
+	close(fd);
+	errno = saved;
+	if (ret == -1) {
+		free(path);
+		return(-1);
+	}
+	if (status == -1) {
+		fprintf(stderr,"%s: error reading line from file '%s': %s\n",
+			PROG_NAME,path,strerror(errno));
+		free(path);
+		return(1);
+	}
+	// a file that grew or shrank while it was read gets the size read, so
+	//  its blocks stay inside it and it is found to be stale
+	if (type == COMP_NONE && offset != entry->file.size) {
+		entry->file.size = offset;
+	}
+	entry->file.numblocks = bld->fileblocks;
+	entry->path = path;
+	bld->numfiles++;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_add_run function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// run is a run of whole lines from the line reader
+// len is the length of the run
+// offset is the offset of the run in the file
+// whole is a boolean flag for a file indexed as a single block
+// adds the run to the current block of the file, starting a new block at the
+//  first line start once the current one holds INDEX_BLOCK bytes, returns 0 on
+//  success or -1 if memory could not be allocated
+int index_add_run(struct index_builder *bld, char *run, size_t len,
+	uint64_t offset, int whole)
+{
+	// position in the run, and the end of the part added to the block
+	size_t pos = 0, cut;
+	// index of the trigram cleared
+	size_t idx;
+	// the grown array of block starts
+	uint64_t *temp;
+	// trigram cleared
+	uint32_t trigram;
+
+	while (pos < len) {
+		if (bld->fileblocks == 0 ||
+			(! whole && bld->blockfill >= INDEX_BLOCK))
+		{
+			if (bld->numblocks == bld->blocksize) {
+				temp = realloc(bld->blocks,(bld->blocksize*2 +
+					1024) * sizeof(uint64_t));
+				if (temp == NULL) { return(-1); }
+				bld->blocks = temp;
+				bld->blocksize = bld->blocksize*2 + 1024;
+			}
+			bld->blocks[bld->numblocks++] = offset + pos;
+			bld->fileblocks++;
+			bld->blockfill = 0;
+			for (idx=0; idx<bld->numtouched; idx++) {
+				trigram = bld->touched[idx];
+				bld->seen[trigram >> 3] &=
+					~(1 << (trigram & 7));
+			}
+			bld->numtouched = 0;
+		}
+		cut = len;
+		if (! whole && len - pos > INDEX_BLOCK - bld->blockfill) {
+			cut = line_start(run,len,pos + INDEX_BLOCK -
+				bld->blockfill);
+		}
+		if (index_add_bytes(bld,run+pos,cut-pos) != 0) { return(-1); }
+		bld->blockfill += cut - pos;
+		pos = cut;
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_add_bytes function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// data is the start of whole lines in the current block
+// len is the length of the lines
+// adds every trigram of the lines to the current block, with letters folded
+//  by FOLD_ASCII, returns 0 on success or -1 if memory could not be allocated
+// note: a trigram is only looked up in the hash table the first time it is
+//        found in a block, later ones are caught by its bit in seen
+int index_add_bytes(struct index_builder *bld, char *data, size_t len) {
+	// the last three bytes, folded
+	uint32_t trigram = 0;
+	// number of bytes before the current one in the same line, up to 2
+	int have = 0;
+	// position in the lines
+	size_t pos;
+	// byte at the position
+	unsigned char byte;
+	// the grown array of trigrams set in seen
+	uint32_t *temp;
+
+	for (pos=0; pos<len; pos++) {
+		byte = data[pos];
+		// trigrams never span a line ending, since no match does
+		if (byte == '\n' || byte == '\r') {
+			have = 0;
+			continue;
+		}
+		trigram = ((trigram << 8) | FOLD_ASCII(byte)) &
+			(INDEX_TRIGRAMS - 1);
+		if (have < 2) {
+			have++;
+			continue;
+		}
+		if (bld->seen[trigram >> 3] & (1 << (trigram & 7))) {
+			continue;
+		}
+		bld->seen[trigram >> 3] |= 1 << (trigram & 7);
+		if (bld->numtouched == bld->touchedsize) {
+			temp = realloc(bld->touched,
+				(bld->touchedsize*2 + 4096) * sizeof(uint32_t));
+			if (temp == NULL) { return(-1); }
+			bld->touched = temp;
+			bld->touchedsize = bld->touchedsize*2 + 4096;
+		}
+		bld->touched[bld->numtouched++] = trigram;
+		if (index_add_trigram(bld,trigram) != 0) { return(-1); }
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_add_trigram function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// trigram is a trigram found in the current block
+// adds the current block to the posting list of the trigram, finding or adding
+//  the list in the hash table, returns 0 on success or -1 if memory could not
+//  be allocated
+int index_add_trigram(struct index_builder *bld, uint32_t trigram) {
+	// slot of the trigram in the hash table
+	size_t slot;
+	// the posting list of the trigram
+	struct index_list *list;
+	// difference from the last block in the list
+	uint32_t delta;
+	// the grown list
+	unsigned char *temp;
+
+	// the table is kept at most half full
+	if (bld->numlists*2 >= bld->listsize && index_grow(bld) != 0) {
+		return(-1);
+	}
+	slot = INDEX_HASH(trigram) & (bld->listsize - 1);
+	while (bld->lists[slot].key != 0 && bld->lists[slot].key != trigram+1) {
+		slot = (slot + 1) & (bld->listsize - 1);
+	}
+	list = &bld->lists[slot];
+	if (list->key == 0) {
+		list->key = trigram + 1;
+		bld->numlists++;
+	}
+	// the number of the current block plus one is the number of blocks
+	if (list->last == bld->numblocks) { return(0); }
+	// room for the longest difference, 5 groups of 7 bits
+	if (list->len + 5 > list->size) {
+		temp = realloc(list->data,list->size*2 + 8);
+		if (temp == NULL) { return(-1); }
+		list->data = temp;
+		list->size = list->size*2 + 8;
+	}
+	delta = bld->numblocks - list->last;
+	while (delta >= 0x80) {
+		list->data[list->len++] = (delta & 0x7f) | 0x80;
+		delta >>= 7;
+	}
+	list->data[list->len++] = delta;
+	list->last = bld->numblocks;
+	list->count++;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_grow function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// doubles the hash table of posting lists, moving every list to its slot in
+//  the new table, returns 0 on success or -1 if memory could not be allocated
+int index_grow(struct index_builder *bld) {
+	// the new table and its size
+	struct index_list *lists;
+	size_t size = bld->listsize * 2;
+	// index of the slot in the old table, and slot in the new one
+	size_t idx, slot;
+
+	lists = calloc(size,sizeof(struct index_list));
+	if (lists == NULL) { return(-1); }
+	for (idx=0; idx<bld->listsize; idx++) {
+		if (bld->lists[idx].key == 0) { continue; }
+		slot = INDEX_HASH(bld->lists[idx].key - 1) & (size - 1);
+		while (lists[slot].key != 0) { slot = (slot + 1) & (size - 1); }
+		lists[slot] = bld->lists[idx];
+	}
+	free(bld->lists);
+	bld->lists = lists;
+	bld->listsize = size;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_write function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index that was built
+// fd is the file descriptor to write the index to
+// roots is the array of paths the index was built from
+// numroots is the number of paths, 0 for the current directory
+// sorts the files by path and the posting lists by trigram and writes the
+//  index, laid out as described at index_header, through an output buffer,
+//  returns 0 on success or -1 with errno set on error
+// note: the posting lists are packed to the front of the hash table to be
+//        sorted, so no more trigrams can be added afterwards
+int index_write(struct index_builder *bld, int fd, char **roots,
+	int numroots)
+{
+	// the header, each file and each trigram as written
+	struct index_header hdr;
+	struct index_file file;
+	struct index_trigram tri;
+	// buffer the index is written through
+	struct out_buf out;
+	// offset in the strings section and in the postings section
+	uint64_t stroff = 0, postoff = 0;
+	// index of the file or list, and the number of lists
+	size_t idx, numlists = 0;
+	// index of the path
+	int ridx;
+	// the current directory, for an index built with no paths
+	char *cwdroot = "";
+	// the index as written, read back for its checksum
+	char *map;
+
+	if (numroots == 0) {
+		roots = &cwdroot;
+		numroots = 1;
+	}
+	qsort(bld->files,bld->numfiles,sizeof(struct index_entry),
+		index_cmp_entry);
+	for (idx=0; idx<bld->listsize; idx++) {
+		if (bld->lists[idx].key != 0) {
+			bld->lists[numlists++] = bld->lists[idx];
+		}
+	}
+	// the slots after the packed lists may hold copies of them, which
+	//  index_free_builder must not free again
+	bld->listsize = numlists;
+	qsort(bld->lists,numlists,sizeof(struct index_list),index_cmp_list);
+	memset(&hdr,0,sizeof(hdr));
+	memcpy(hdr.magic,INDEX_MAGIC,sizeof(hdr.magic));
+	hdr.endian = INDEX_ENDIAN;
+	hdr.blocksize = INDEX_BLOCK;
+	hdr.numfiles = bld->numfiles;
+	hdr.numblocks = bld->numblocks;
+	hdr.numtrigrams = numlists;
+	hdr.numroots = numroots;
+	hdr.filesoff = sizeof(hdr);
+	hdr.blocksoff = hdr.filesoff + hdr.numfiles*sizeof(struct index_file);
+	hdr.trigramsoff = hdr.blocksoff + hdr.numblocks*sizeof(uint64_t);
+	hdr.rootsoff = hdr.trigramsoff +
+		hdr.numtrigrams*sizeof(struct index_trigram);
+	hdr.postingsoff = hdr.rootsoff + hdr.numroots*sizeof(uint64_t);
+	for (idx=0; idx<numlists; idx++) {
+		hdr.postingslen += bld->lists[idx].len;
+	}
+	hdr.stringsoff = hdr.postingsoff + hdr.postingslen;
+	for (idx=0; idx<bld->numfiles; idx++) {
+		hdr.stringslen += strlen(bld->files[idx].path) + 1;
+	}
+	for (ridx=0; ridx<numroots; ridx++) {
+		hdr.stringslen += strlen(roots[ridx]) + 1;
+	}
+	hdr.length = hdr.stringsoff + hdr.stringslen;
+	if (out_init(&out,fd) != 0) { return(-1); }
+	out_write(&out,(char *) &hdr,sizeof(hdr));
+	for (idx=0; idx<bld->numfiles; idx++) {
+		file = bld->files[idx].file;
+		file.path = stroff;
+		stroff += strlen(bld->files[idx].path) + 1;
+		out_write(&out,(char *) &file,sizeof(file));
+	}
+	out_write(&out,(char *) bld->blocks,bld->numblocks*sizeof(uint64_t));
+	for (idx=0; idx<numlists; idx++) {
+		tri.trigram = bld->lists[idx].key - 1;
+		tri.count = bld->lists[idx].count;
+		tri.off = postoff;
+		postoff += bld->lists[idx].len;
+		out_write(&out,(char *) &tri,sizeof(tri));
+	}
+	for (ridx=0; ridx<numroots; ridx++) {
+		out_write(&out,(char *) &stroff,sizeof(stroff));
+		stroff += strlen(roots[ridx]) + 1;
+	}
+	for (idx=0; idx<numlists; idx++) {
+		out_write(&out,(char *) bld->lists[idx].data,
+			bld->lists[idx].len);
+	}
+	for (idx=0; idx<bld->numfiles; idx++) {
+		out_write(&out,bld->files[idx].path,
+			strlen(bld->files[idx].path) + 1);
+	}
+	for (ridx=0; ridx<numroots; ridx++) {
+		out_write(&out,roots[ridx],strlen(roots[ridx]) + 1);
+	}
+	out_flush(&out);
+	free(out.buff);
+	if (out.err != 0) {
+		errno = out.err;
+		return(-1);
+	}
+	// the checksum is of the bytes as they reached the file, so the header
+	//  is written again once they are read back
+	map = mmap(NULL,hdr.length,PROT_READ,MAP_SHARED,fd,0);
+	if (map == MAP_FAILED) { return(-1); }
+	hdr.checksum = index_checksum(map,hdr.length);
+	munmap(map,hdr.length);
+	errno = EIO;
+	if (pwrite(fd,&hdr,sizeof(hdr),0) != (ssize_t) sizeof(hdr)) {
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_cmp_entry function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b are files read by the index subcommand
+// compares two files by path for qsort, in the order index_find_file expects
+int index_cmp_entry(const void *a, const void *b) {
+	return(strcmp(((struct index_entry *) a)->path,
+		((struct index_entry *) b)->path));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_cmp_list function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b are posting lists of the index being built
+// compares two posting lists by trigram for qsort
+int index_cmp_list(const void *a, const void *b) {
+	// the trigrams plus one
+	uint32_t ka = ((struct index_list *) a)->key;
+	uint32_t kb = ((struct index_list *) b)->key;
+
+	return((ka > kb) - (ka < kb));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_free_builder function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// bld is the index being built
+// frees the posting lists, the files and every other array of the builder
+void index_free_builder(struct index_builder *bld) {
+	// index of the list or file
+	size_t idx;
+
+	for (idx=0; idx<bld->listsize && bld->lists != NULL; idx++) {
+		free(bld->lists[idx].data);
+	}
+	for (idx=0; idx<bld->numfiles; idx++) { free(bld->files[idx].path); }
+	free(bld->lists);
+	free(bld->seen);
+	free(bld->touched);
+	free(bld->files);
+	free(bld->blocks);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_open function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index to set up
+// indexpath is the path of an index written by the index subcommand
+// maps the index read only, compares its length and checksum with the ones in
+//  its header and checks it with index_check, returns 0 on success, 1 if it
+//  was damaged since it was written but can still be read, which sets the all
+//  flag so it only gives the paths it was built from, or -1 with errno set on
+//  error - EINVAL for a file that is not an index of this version, EBADMSG for
+//  a damaged index that cannot be read
+// note: a damaged posting list would leave out blocks holding a match, and
+//        nothing else shows it, so the whole index is summed before each
+//        search that uses it - about as long as reading it once
+int index_open(struct trigram_index *idx, char *indexpath) {
+	// file descriptor of the index
+	int fd;
+	// status of the index
+	struct stat st;
+	// errno kept while the file is closed
+	int saved;
+	// the header
+	struct index_header *hdr;
+	// boolean flag set if the index does not have the length or checksum
+	//  it was written with
+	int damaged;
+
+	memset(idx,0,sizeof(*idx));
+	fd = open(indexpath,O_RDONLY|O_CLOEXEC);
+	if (fd == -1) { return(-1); }
+	if (fstat(fd,&st) != 0) {
+		saved = errno;
+		close(fd);
+		errno = saved;
+		return(-1);
+	}
+	if (! S_ISREG(st.st_mode) ||
+		(size_t) st.st_size < sizeof(struct index_header))
+	{
+		close(fd);
+		errno = EINVAL;
+		return(-1);
+	}
+	idx->map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	saved = errno;
+	close(fd);
+	if (idx->map == MAP_FAILED) {
+		idx->map = NULL;
+		errno = saved;
+		return(-1);
+	}
+	idx->size = st.st_size;
+	hdr = (struct index_header *) idx->map;
+	if (memcmp(hdr->magic,INDEX_MAGIC,sizeof(hdr->magic)) != 0 ||
+		hdr->endian != INDEX_ENDIAN)
+	{
+		munmap(idx->map,idx->size);
+		idx->map = NULL;
+		errno = EINVAL;
+		return(-1);
+	}
+	damaged = (hdr->length != idx->size ||
+		hdr->checksum != index_checksum(idx->map,idx->size));
+	if (index_check(idx) != 0) {
+		munmap(idx->map,idx->size);
+		idx->map = NULL;
+		errno = damaged ? EBADMSG : EINVAL;
+		return(-1);
+	}
+	if (damaged) {
+		idx->all = TRUE;
+		return(1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_check function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is an index that was just mapped, whose magic bytes were checked
+// checks the counts in the header, that every section lies inside the
+//  mapping, and that every path, block and posting list the sections point to
+//  lies inside its section, then sets the pointers to the sections, returns 0
+//  for a valid index or -1 otherwise
+// note: the posting lists themselves are checked as they are decoded by
+//        index_postings
+int index_check(struct trigram_index *idx) {
+	// the header
+	struct index_header *hdr = (struct index_header *) idx->map;
+	// size of the mapping
+	uint64_t size = idx->size;
+	// the file being checked
+	struct index_file *file;
+	// index of the file, block, trigram or path
+	uint64_t num, blk;
+
+	if (hdr->numblocks > UINT32_MAX || hdr->numroots == 0) { return(-1); }
+	if (! index_fits(hdr->filesoff,hdr->numfiles,
+		sizeof(struct index_file),size) ||
+		! index_fits(hdr->blocksoff,hdr->numblocks,sizeof(uint64_t),
+		size) ||
+		! index_fits(hdr->trigramsoff,hdr->numtrigrams,
+		sizeof(struct index_trigram),size) ||
+		! index_fits(hdr->rootsoff,hdr->numroots,sizeof(uint64_t),
+		size) ||
+		! index_fits(hdr->postingsoff,hdr->postingslen,1,size) ||
+		! index_fits(hdr->stringsoff,hdr->stringslen,1,size))
+	{
+		return(-1);
+	}
+	idx->hdr = hdr;
+	idx->files = (struct index_file *) (idx->map + hdr->filesoff);
+	idx->blocks = (uint64_t *) (idx->map + hdr->blocksoff);
+	idx->trigrams = (struct index_trigram *) (idx->map + hdr->trigramsoff);
+	idx->roots = (uint64_t *) (idx->map + hdr->rootsoff);
+	idx->postings = (unsigned char *) (idx->map + hdr->postingsoff);
+	idx->strings = idx->map + hdr->stringsoff;
+	// the strings end in a null byte, so no path runs past the section
+	if (hdr->stringslen == 0 || idx->strings[hdr->stringslen-1] != '\0') {
+		return(-1);
+	}
+	for (num=0; num<hdr->numfiles; num++) {
+		file = &idx->files[num];
+		if (file->path >= hdr->stringslen ||
+			file->firstblock > hdr->numblocks ||
+			file->numblocks > hdr->numblocks - file->firstblock)
+		{
+			return(-1);
+		}
+		// the blocks of a file are searched in place, so they must
+		//  start at the start of the file, be in order and lie
+		//  inside it
+		if (file->flags & INDEX_F_WHOLE) { continue; }
+		for (blk=0; blk<file->numblocks; blk++) {
+			if (idx->blocks[file->firstblock+blk] > file->size ||
+				(blk == 0 &&
+				idx->blocks[file->firstblock] != 0) ||
+				(blk > 0 && idx->blocks[file->firstblock+blk] <
+				idx->blocks[file->firstblock+blk-1]))
+			{
+				return(-1);
+			}
+		}
+	}
+	// each posting list runs to the start of the next one
+	for (num=0; num<hdr->numtrigrams; num++) {
+		if (idx->trigrams[num].off > hdr->postingslen ||
+			(num > 0 && idx->trigrams[num].off <
+			idx->trigrams[num-1].off))
+		{
+			return(-1);
+		}
+	}
+	for (num=0; num<hdr->numroots; num++) {
+		if (idx->roots[num] >= hdr->stringslen) { return(-1); }
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_checksum function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// map is a whole index, of at least a header
+// size is its length
+// returns the checksum of the index, with the checksum in its header taken
+//  as 0, so the same one is found before and after it is stored there
+uint64_t index_checksum(char *map, size_t size) {
+	// copy of the header, with the checksum cleared
+	struct index_header hdr;
+
+	memcpy(&hdr,map,sizeof(hdr));
+	hdr.checksum = 0;
+	return(index_sum(index_sum(0,(unsigned char *) &hdr,sizeof(hdr)),
+		(unsigned char *) map + sizeof(hdr),size - sizeof(hdr)));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_sum function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sum is the checksum of the bytes before data, 0 if there are none
+// data is the bytes to add to it
+// len is the number of bytes
+// returns the checksum of the bytes before data followed by data - each word
+//  of 8 bytes is mixed into one of INDEX_SUM_LANES sums in turn, which are
+//  mixed together with the length at the end
+// note: index_mix is one to one in the sum and in the word, so a change to a
+//        single word always changes the checksum
+uint64_t index_sum(uint64_t sum, unsigned char *data, size_t len) {
+	// the sums, each started apart from the others
+	uint64_t lanes[INDEX_SUM_LANES];
+	// the word being added, padded with zeros at the end of data
+	uint64_t word;
+	// position in data, and the sum the word is added to
+	size_t pos = 0, lane;
+
+	for (lane=0; lane<INDEX_SUM_LANES; lane++) {
+		lanes[lane] = index_mix(sum,lane + 1);
+	}
+	for (; len - pos >= INDEX_SUM_LANES * 8; pos+=INDEX_SUM_LANES*8) {
+		for (lane=0; lane<INDEX_SUM_LANES; lane++) {
+			memcpy(&word,data+pos+lane*8,8);
+			lanes[lane] = index_mix(lanes[lane],word);
+		}
+	}
+	for (lane=0; pos<len; pos+=8, lane++) {
+		word = 0;
+		memcpy(&word,data+pos,(len - pos < 8) ? len - pos : 8);
+		lanes[lane] = index_mix(lanes[lane],word);
+	}
+	sum = len;
+	for (lane=0; lane<INDEX_SUM_LANES; lane++) {
+		sum = index_mix(sum,lanes[lane]);
+	}
+	return(sum);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_mix function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sum is a checksum
+// word is the 8 bytes to mix into it
+// returns the new checksum - the word is added with an xor, then multiplied by
+//  the odd constant of INDEX_HASH and its high bits folded down, each of which
+//  can be undone
+uint64_t index_mix(uint64_t sum, uint64_t word) {
+	sum = (sum ^ word) * 0x9E3779B97F4A7C15ULL;
+	return(sum ^ (sum >> 32));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_fits function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// off is the offset of a section of an index
+// count is the number of items in the section
+// itemsize is the size of each item, 1 for a section of bytes
+// size is the size of the index
+// returns TRUE if the section lies inside the index, and starts on a multiple
+//  of 8 bytes unless it is a section of bytes, or FALSE otherwise
+int index_fits(uint64_t off, uint64_t count, uint64_t itemsize,
+	uint64_t size)
+{
+	if (itemsize > 1 && off % 8 != 0) { return(FALSE); }
+	if (count > size / itemsize || off > size - count*itemsize) {
+		return(FALSE);
+	}
+	return(TRUE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_query function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// pat is the compiled search strings
+// searchstr is the search string from args, or null
+// plist is the list of search strings from the -e and -f options
+// works out the blocks of the index that may hold a match - for each search
+//  string, the blocks holding every one of its trigrams, and for a regular
+//  expression, the blocks holding every trigram of the string every match
+//  contains - or sets the all flag if the search cannot be narrowed
+// returns 0 on success or -1 with errno set on error
+// note: with the -v option and the -A, -B and -C options lines outside the
+//        blocks holding a match are printed too, and the -n option counts
+//        every line before a match, so they are never narrowed
+int index_query(struct trigram_index *idx, struct mygrep_pattern *pat,
+	char *searchstr, struct pattern_list *plist)
+{
+	// the compiled search strings
+	struct searcher *srch = &pat->srch;
+	// room for the blocks found
+	size_t candsize = 0;
+	// index of the search string, and of the block kept
+	size_t pidx, kept;
+	// return value of index_pattern, 1 once a search string cannot be
+	//  narrowed
+	int ret = 0;
+
+	idx->cand = NULL;
+	idx->numcand = 0;
+	if (idx->all || (pat->flags & MYGREP_INVERT) || mg_context ||
+		mg_lineno)
+	{
+		idx->all = TRUE;
+		return(0);
+	}
+	// plain strings compiled into a regular expression are narrowed by
+	//  each of them, as without it
+	if (srch->re != NULL && ! srch->re->fixed) {
+		if (srch->prefilter != NULL) {
+			ret = index_pattern(idx,srch->prefilter->needle,
+				srch->prefilter->len,srch->prefilter->fold,
+				&idx->cand,&idx->numcand,&candsize);
+		}
+		else if (srch->re->literal != NULL) {
+			ret = index_pattern(idx,srch->needle,srch->len,
+				srch->fold,&idx->cand,&idx->numcand,&candsize);
+		}
+		else { ret = 1; }
+	}
+	else if (searchstr != NULL) {
+		ret = index_pattern(idx,searchstr,strlen(searchstr),
+			srch->fold,&idx->cand,&idx->numcand,&candsize);
+	}
+	else {
+		for (pidx=0; pidx<(size_t) plist->num && ret == 0; pidx++) {
+			ret = index_pattern(idx,plist->pats[pidx],
+				plist->lens[pidx],srch->fold,&idx->cand,
+				&idx->numcand,&candsize);
+		}
+	}
+	if (ret == -1) { return(-1); }
+	if (ret == 1) {
+		free(idx->cand);
+		idx->cand = NULL;
+		idx->numcand = 0;
+		idx->all = TRUE;
+		return(0);
+	}
+	// a block may hold more than one of the search strings
+	qsort(idx->cand,idx->numcand,sizeof(uint32_t),index_cmp_block);
+	for (pidx=0, kept=0; pidx<idx->numcand; pidx++) {
+		if (kept == 0 || idx->cand[pidx] != idx->cand[kept-1]) {
+			idx->cand[kept++] = idx->cand[pidx];
+		}
+	}
+	idx->numcand = kept;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_pattern function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// pat is a string every match of a search string contains
+// len is the length of the string
+// fold is how the search strings are compared with the text, from the CASE_
+//  directives
+// cand is the array the blocks holding every trigram of the string are added
+//  to, grown as needed
+// numcand is the number of blocks in the array
+// candsize is the number of blocks there is room for
+// decodes the posting list of each trigram of the string, shortest first, and
+//  keeps the blocks found in all of them
+// returns 0 on success, 1 if the string has no trigram the index can narrow
+//  the search by, or -1 with errno set on error
+// note: with the -i option in a UTF-8 locale a search string with chars
+//        outside ASCII is folded by FOLD_WIDE, under which a few of them
+//        match 'i', 'k' or 's' (such as the Kelvin sign), so trigrams with
+//        those letters, or with bytes outside ASCII, are not used then
+int index_pattern(struct trigram_index *idx, char *pat, size_t len, int fold,
+	uint32_t **cand, size_t *numcand, size_t *candsize)
+{
+	// trigrams of the string, and their entries in the index
+	uint32_t *trigrams;
+	struct index_trigram **found;
+	// number of trigrams, and of different ones
+	size_t num = 0, numfound = 0;
+	// position in the string, and in the trigram
+	size_t pos, byteidx;
+	// byte of the string, folded
+	unsigned char byte;
+	// boolean flag for a trigram the search can be narrowed by
+	int usable;
+	// boolean flag for a string folded by FOLD_WIDE
+	int wide = FALSE;
+	// the blocks holding every trigram so far, and the list of the next
+	//  trigram
+	uint32_t *list, *other;
+	// number of blocks kept, and position in each list
+	size_t count, kept, apos, bpos;
+	// index of the trigram
+	size_t tidx;
+	// the grown array of blocks
+	uint32_t *temp;
+
+	if (len < 3) { return(1); }
+	trigrams = malloc((len - 2) * sizeof(uint32_t));
+	found = malloc((len - 2) * sizeof(struct index_trigram *));
+	if (trigrams == NULL || found == NULL) {
+		free(trigrams);
+		free(found);
+		return(-1);
+	}
+	for (pos=0; pos<len && fold == CASE_WIDE; pos++) {
+		if ((unsigned char) pat[pos] >= 0x80) { wide = TRUE; }
+	}
+	for (pos=0; pos+3<=len; pos++) {
+		usable = TRUE;
+		trigrams[num] = 0;
+		for (byteidx=0; byteidx<3; byteidx++) {
+			byte = FOLD_ASCII((unsigned char) pat[pos+byteidx]);
+			if (byte == '\n' || byte == '\r' || (wide &&
+				(byte >= 0x80 || byte == 'i' || byte == 'k' ||
+				byte == 's')))
+			{
+				usable = FALSE;
+			}
+			trigrams[num] = (trigrams[num] << 8) | byte;
+		}
+		if (usable) { num++; }
+	}
+	qsort(trigrams,num,sizeof(uint32_t),index_cmp_block);
+	for (tidx=0; tidx<num; tidx++) {
+		if (tidx > 0 && trigrams[tidx] == trigrams[tidx-1]) {
+			continue;
+		}
+		found[numfound] = index_find_trigram(idx,trigrams[tidx]);
+		// a trigram no block holds means no block can match
+		if (found[numfound] == NULL) {
+			free(trigrams);
+			free(found);
+			return(0);
+		}
+		numfound++;
+	}
+	free(trigrams);
+	if (numfound == 0) {
+		free(found);
+		return(1);
+	}
+	qsort(found,numfound,sizeof(struct index_trigram *),index_cmp_count);
+	list = index_postings(idx,found[0]);
+	count = found[0]->count;
+	for (tidx=1; tidx<numfound && list != NULL && count > 0; tidx++) {
+		other = index_postings(idx,found[tidx]);
+		if (other == NULL) {
+			free(list);
+			list = NULL;
+			break;
+		}
+		kept = 0;
+		bpos = 0;
+		for (apos=0; apos<count; apos++) {
+			while (bpos < found[tidx]->count &&
+				other[bpos] < list[apos]) { bpos++; }
+			if (bpos == found[tidx]->count) { break; }
+			if (other[bpos] == list[apos]) {
+				list[kept++] = list[apos];
+			}
+		}
+		count = kept;
+		free(other);
+	}
+	free(found);
+	if (list == NULL) { return(-1); }
+	if (*numcand + count > *candsize) {
+		temp = realloc(*cand,(*numcand + count + *candsize) *
+			sizeof(uint32_t));
+		if (temp == NULL) {
+			free(list);
+			return(-1);
+		}
+		*cand = temp;
+		*candsize = *numcand + count + *candsize;
+	}
+	memcpy(*cand + *numcand,list,count * sizeof(uint32_t));
+	*numcand += count;
+	free(list);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_postings function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// tri is a trigram of the index
+// decodes the posting list of the trigram, returns an allocated array of its
+//  count block numbers in order, or null with errno set on error, EINVAL for a
+//  list that runs past its end or names a block the index does not have
+uint32_t *index_postings(struct trigram_index *idx,
+	struct index_trigram *tri)
+{
+	// position in the list, and its end - the start of the next list, or
+	//  the end of the section for the last one
+	unsigned char *pos = idx->postings + tri->off;
+	unsigned char *end = idx->postings +
+		((tri + 1 < idx->trigrams + idx->hdr->numtrigrams) ?
+		(tri + 1)->off : idx->hdr->postingslen);
+	// the decoded list, and the number of blocks decoded
+	uint32_t *list;
+	uint32_t num = 0;
+	// number of the block plus one, and the difference from the last one
+	uint64_t block = 0, delta;
+	// position of the group of 7 bits in the difference
+	int shift;
+
+	list = malloc(((size_t) tri->count + 1) * sizeof(uint32_t));
+	if (list == NULL) { return(NULL); }
+	while (num < tri->count) {
+		delta = 0;
+		shift = 0;
+		do {
+			if (pos == end || shift > 28) {
+				free(list);
+				errno = EINVAL;
+				return(NULL);
+			}
+			delta |= (uint64_t) (*pos & 0x7f) << shift;
+			shift += 7;
+		} while (*pos++ & 0x80);
+		block += delta;
+		if (delta == 0 || block > idx->hdr->numblocks) {
+			free(list);
+			errno = EINVAL;
+			return(NULL);
+		}
+		list[num++] = block - 1;
+	}
+	return(list);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_find_trigram function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// trigram is the trigram to look for, with letters folded by FOLD_ASCII
+// returns the entry of the trigram, or null if no block holds it
+struct index_trigram *index_find_trigram(struct trigram_index *idx,
+	uint32_t trigram)
+{
+	return(bsearch(&trigram,idx->trigrams,idx->hdr->numtrigrams,
+		sizeof(struct index_trigram),index_cmp_trigram));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_find_file function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// path is the path of a file being searched
+// returns the entry of the file, or null if the index has no file with that
+//  path
+// note: paths are compared as strings, so a file is only found if it is named
+//        the way the walk of the index subcommand named it - searching with no
+//        files given walks the same paths the index was built from
+struct index_file *index_find_file(struct trigram_index *idx, char *path) {
+	// range of entries left to search
+	uint64_t lo = 0, hi = idx->hdr->numfiles, mid;
+	// result of comparing the paths
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(path,idx->strings + idx->files[mid].path);
+		if (cmp == 0) { return(&idx->files[mid]); }
+		if (cmp < 0) { hi = mid; }
+		else { lo = mid + 1; }
+	}
+	return(NULL);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_file_hits function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option
+// path is the path of the file being searched
+// fd is the file descriptor of the open file
+// looks the file up in the index and, if it has the same size and modification
+//  time as when it was indexed, sets mg_hits to the blocks of the file that
+//  may hold a match, returns 0 if it did, or -1 if the file is to be searched
+//  in full - it is not in the index, is binary, has changed since, or is a
+//  compressed file with a block that may hold a match
+int index_file_hits(struct trigram_index *idx, char *path, int fd) {
+	// entry of the file
+	struct index_file *file;
+	// status of the file
+	struct stat st;
+	// candidates of the file, from lo up to but not including hi
+	size_t lo, hi;
+
+	file = index_find_file(idx,path);
+	if (file == NULL || (file->flags & INDEX_F_BINARY) ||
+		fstat(fd,&st) != 0 ||
+		(uint64_t) st.st_size != file->size ||
+		st.st_mtim.tv_sec != file->mtime ||
+		st.st_mtim.tv_nsec != file->mtimens)
+	{
+		return(-1);
+	}
+	lo = index_lower(idx->cand,idx->numcand,file->firstblock);
+	hi = index_lower(idx->cand,idx->numcand,
+		(uint64_t) file->firstblock + file->numblocks);
+	if ((file->flags & INDEX_F_WHOLE) && hi > lo) { return(-1); }
+	mg_hits.first = file->firstblock;
+	mg_hits.blocks = idx->blocks + file->firstblock;
+	mg_hits.numblocks = file->numblocks;
+	mg_hits.size = file->size;
+	mg_hits.cand = idx->cand + lo;
+	mg_hits.numcand = hi - lo;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_lower function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// cand is an array of block numbers in order
+// num is the number of blocks in the array
+// block is the block number to look for
+// returns the index of the first block in the array that is not below block,
+//  or num if there is none
+size_t index_lower(uint32_t *cand, size_t num, uint64_t block) {
+	// range of the array left to search
+	size_t lo = 0, hi = num, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cand[mid] < block) { lo = mid + 1; }
+		else { hi = mid; }
+	}
+	return(lo);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_close function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// idx is the index mapped by the --index option, or one never opened
+// frees the blocks found for the search and unmaps the index
+void index_close(struct trigram_index *idx) {
+	free(idx->cand);
+	idx->cand = NULL;
+	if (idx->map != NULL) { munmap(idx->map,idx->size); }
+	idx->map = NULL;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_cmp_trigram function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a is the trigram looked for
+// b is a trigram of the index
+// compares a trigram to an entry of the index for bsearch
+int index_cmp_trigram(const void *a, const void *b) {
+	// the trigrams
+	uint32_t ta = *(uint32_t *) a;
+	uint32_t tb = ((struct index_trigram *) b)->trigram;
+
+	return((ta > tb) - (ta < tb));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_cmp_count function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b are pointers to trigrams of the index
+// compares two trigrams by the length of their posting lists for qsort, so
+//  the rarest trigram is decoded first
+int index_cmp_count(const void *a, const void *b) {
+	// the lengths of the lists
+	uint32_t ca = (*(struct index_trigram **) a)->count;
+	uint32_t cb = (*(struct index_trigram **) b)->count;
+
+	return((ca > cb) - (ca < cb));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// index_cmp_block function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// a and b are block numbers, or trigrams
+// compares two numbers for qsort
+int index_cmp_block(const void *a, const void *b) {
+	// the numbers
+	uint32_t na = *(uint32_t *) a;
+	uint32_t nb = *(uint32_t *) b;
+
+	return((na > nb) - (na < nb));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_compile function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pats is the array of search strings, which are not null-terminated
+// lens is the length of each search string
+// numpats is the number of search strings
+// flags is any of the MYGREP_ directives ORed together
+// errmsg, if not null, is set to a message if a regular expression is invalid,
+//  or to null if memory could not be allocated
+// copies the search strings and compiles them with search_compile, as main()
+//  compiles the program's own, returns the pattern or null on error
+MG_API struct mygrep_pattern *mygrep_compile(const char *const *pats,
+	const size_t *lens, int numpats, int flags, const char **errmsg)
+{
+	// the pattern compiled
+	struct mygrep_pattern *pat;
+	// the copied search strings, as the -e option lists them
+	struct pattern_list plist = { NULL, NULL, 0, 0, NULL, 0 };
+	// total length of the search strings, and each copy's place in the text
+	size_t total = 0, at = 0;
+	// index of the search string
+	int pidx;
+	// message for an invalid regular expression
+	char *msg = NULL;
+	// return value of search_compile
+	int ret = -1;
+
+	if (errmsg != NULL) { *errmsg = NULL; }
+	pat = calloc(1,sizeof(struct mygrep_pattern));
+	if (pat == NULL) { return(NULL); }
+	pat->flags = flags;
+	for (pidx=0; pidx<numpats; pidx++) { total += lens[pidx]; }
+	// one byte more, so no search strings, or only empty ones, still get
+	//  a buffer
+	pat->text = malloc(total + 1);
+	if (pat->text == NULL) {
+		free(pat);
+		return(NULL);
+	}
+	for (pidx=0; pidx<numpats; pidx++) {
+		memcpy(pat->text+at,pats[pidx],lens[pidx]);
+		if (add_pattern(&plist,pat->text+at,lens[pidx]) != 0) { break; }
+		at += lens[pidx];
+	}
+	if (pidx == numpats) {
+		ret = search_compile(&pat->srch,&plist,flags,&msg);
+	}
+	free(plist.pats);
+	free(plist.lens);
+	if (ret != 0) {
+		if (errmsg != NULL) { *errmsg = msg; }
+		mygrep_pattern_free(pat);
+		return(NULL);
+	}
+	return(pat);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_pattern_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pat is a pattern from mygrep_compile, or null
+// frees the pattern, once no scanner uses it
+MG_API void mygrep_pattern_free(struct mygrep_pattern *pat) {
+	if (pat == NULL) { return; }
+	search_free(&pat->srch);
+	free(pat->text);
+	free(pat);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_scanner_new function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pat is the pattern to search for
+// returns a scanner at the start of a stream, or null if memory could not be
+//  allocated
+// note: nothing else is allocated until the scanner needs it - the DFA at the
+//        first search, the buffer of the unfinished last line at the first
+//        line split between two calls, and the reader's buffer at the first
+//        call to mygrep_scan_fd
+MG_API struct mygrep_scanner *mygrep_scanner_new(struct mygrep_pattern *pat) {
+	// the scanner
+	struct mygrep_scanner *sc = malloc(sizeof(struct mygrep_scanner));
+
+	if (sc == NULL) { return(NULL); }
+	scanner_init(sc,pat);
+	return(sc);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_scanner_free function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is a scanner from mygrep_scanner_new, or null
+// frees the scanner and everything it allocated, the pattern is left as it is
+MG_API void mygrep_scanner_free(struct mygrep_scanner *sc) {
+	if (sc == NULL) { return; }
+	scanner_clear(sc);
+	free(sc);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_scan function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// data is the next bytes of the stream
+// len is the number of bytes
+// cb is the callback given each match, and arg its argument
+// finishes the unfinished line kept from the last call with the bytes up to the
+//  first line ending, and searches it from the scanner's buffer, then searches
+//  the whole lines after it in place with scanner_search, and keeps the
+//  unfinished last line, returns the number of lines selected, or -1 with
+//  errno set if memory could not be allocated
+// note: a '\r' as the last byte is kept with its line until the next call
+//        shows if it is followed by a '\n', as in get_next_block, so a "\r\n"
+//        split between two calls is one line ending
+MG_API long mygrep_scan(struct mygrep_scanner *sc, const char *data,
+	size_t len, mygrep_callback cb, void *arg)
+{
+	// position in the data, and its end
+	char *pos = (char *) data, *end = (char *) data + len;
+	// first line ending in the data, and the end of its whole lines
+	char *eol, *cut;
+	// bytes of the data that finish the unfinished line
+	size_t take;
+	// number of lines selected, and by each run
+	long matchcount = 0, ret;
+
+	if (sc->stopped || len == 0) { return(0); }
+	sc->cb = cb;
+	sc->cbarg = arg;
+	if (sc->taillen > 0) {
+		// a line kept for its last '\r' is finished either way, with
+		//  the '\n' after it if there is one
+		if (sc->tail[sc->taillen-1] == '\r') {
+			take = (*pos == '\n') ? 1 : 0;
+		}
+		else {
+			eol = find_eol(pos,len);
+			if (eol == NULL || (*eol == '\r' && eol+1 == end)) {
+				return(scanner_keep(sc,pos,len));
+			}
+			take = eol + 1 - pos;
+			if (*eol == '\r' && eol[1] == '\n') { take++; }
+		}
+		if (scanner_keep(sc,pos,take) != 0) { return(-1); }
+		matchcount = scanner_search(sc,sc->tail,sc->taillen);
+		sc->taillen = 0;
+		if (matchcount == -1) { return(-1); }
+		pos += take;
+	}
+	cut = find_eol_back(pos,end-pos);
+	if (cut != NULL && *cut == '\r' && cut+1 == end) {
+		cut = find_eol_back(pos,cut-pos);
+	}
+	cut = (cut != NULL) ? cut + 1 : pos;
+	ret = scanner_search(sc,pos,cut-pos);
+	if (ret == -1) { return(-1); }
+	if (! sc->stopped && scanner_keep(sc,cut,end-cut) != 0) { return(-1); }
+	return(matchcount + ret);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_finish function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// cb is the callback given each match, and arg its argument
+// searches the unfinished last line kept by mygrep_scan, which the end of the
+//  stream finishes, then resets the scanner for a new stream, returns the
+//  number of lines selected, or -1 with errno set on error
+MG_API long mygrep_finish(struct mygrep_scanner *sc, mygrep_callback cb,
+	void *arg)
+{
+	// number of lines selected
+	long matchcount = 0;
+
+	sc->cb = cb;
+	sc->cbarg = arg;
+	if (sc->taillen > 0 && ! sc->stopped) {
+		matchcount = scanner_search(sc,sc->tail,sc->taillen);
+	}
+	scanner_reset(sc);
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// mygrep_scan_fd function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// fd is an open file descriptor
+// cb is the callback given each match, and arg its argument
+// searches everything read from the file descriptor as a new stream, one run
+//  of whole lines from the scanner's reader at a time, the same way as
+//  grep_stream, returns the number of lines selected, or -1 with errno set if
+//  a read fails or memory could not be allocated
+// note: every stream is searched as text, a null byte does not end lines
+MG_API long mygrep_scan_fd(struct mygrep_scanner *sc, int fd,
+	mygrep_callback cb, void *arg)
+{
+	// number of lines selected, and by each run
+	long matchcount = 0, ret;
+	// pointer to each run of whole lines inside the reader's block buffer
+	char *block;
+	// length of each run of lines, including the last line ending
+	size_t blocklen;
+	// return value of get_next_block
+	int status = 0;
+
+	scanner_reset(sc);
+	if (reader_init(&sc->rdr,fd) != 0) { return(-1); }
+	sc->rdr.checked = TRUE;
+	sc->cb = cb;
+	sc->cbarg = arg;
+	while (! sc->stopped &&
+		(status = get_next_block(&sc->rdr,&block,&blocklen)) == 1)
+	{
+		ret = scanner_search(sc,block,blocklen);
+		if (ret == -1) {
+			status = -1;
+			break;
+		}
+		matchcount += ret;
+	}
+	scanner_reset(sc);
+	return((status == -1) ? -1 : matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_init function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner to set up
+// pat is the pattern to search for
+// sets up a scanner at the start of a stream, allocating nothing - a thread of
+//  the program keeps one for every file it searches, and the library one per
+//  stream
+void scanner_init(struct mygrep_scanner *sc, struct mygrep_pattern *pat) {
+	memset(sc,0,sizeof(struct mygrep_scanner));
+	sc->pat = pat;
+	scanner_reset(sc);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_clear function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is a scanner set up by scanner_init
+// frees everything the scanner allocated, the scanner itself is left as it is
+void scanner_clear(struct mygrep_scanner *sc) {
+	dfa_free(&sc->dfa);
+	reader_free(&sc->rdr);
+	free(sc->tail);
+	sc->tail = NULL;
+	sc->tailsize = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_find function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// hay is the text to search, a run of whole lines
+// haylen is the length of the text
+// returns a pointer to the first hit of the pattern in the text, with the
+//  search function picked by search_compile, or with the scanner's DFA for a
+//  regular expression - built the first time the scanner searches - or null
+//  if there is none
+// note: if the DFA cannot be set up, its errno is kept in the scanner and
+//        null is returned
+char *scanner_find(struct mygrep_scanner *sc, char *hay, size_t haylen) {
+	// the compiled search strings
+	struct searcher *srch = &sc->pat->srch;
+
+	if (srch->find != NULL) { return(srch->find(srch,hay,haylen)); }
+	if (sc->dfa.re != srch->re && dfa_init(&sc->dfa,srch->re) != 0) {
+		sc->err = errno;
+		return(NULL);
+	}
+	return(search_regex(srch,&sc->dfa,hay,haylen));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scan_region function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// data is the start of a run of whole lines
+// size is the size of the run, including the last line ending if there is one
+// linestarts is a boolean flag for a handler that needs the start of each line
+//  holding a hit
+// handler is given each run of selected lines, and arg
+// searches the whole run for the pattern at once, only finding the line
+//  boundaries around each hit, and hands the handler each line holding a hit,
+//  or with MYGREP_INVERT each run of lines between two hits, from its start to
+//  just past its last line ending - the search loop of the program and of the
+//  library interface alike - returns the number of lines the handler selected
+// note: the search stops once the handler sets the scanner's stopped flag, or
+//        the DFA cannot be set up
+// note: without linestarts or MYGREP_INVERT a line holding a hit is given
+//        from wherever its search started, its real start is never looked for
+// note: a search string with a line ending never matches, as in a search line
+//        by line, because no line contains a line ending
+long scan_region(struct mygrep_scanner *sc, char *data, size_t size,
+	int linestarts, long (*handler)(struct mygrep_scanner *sc, char *from,
+	char *to, void *arg), void *arg)
+{
+	// the compiled search strings
+	struct searcher *srch = &sc->pat->srch;
+	// boolean flag for MYGREP_INVERT
+	int invert = ((sc->pat->flags & MYGREP_INVERT) != 0);
+	// number of lines selected
+	long matchcount = 0;
+	// start of the part of the run not yet searched, always the start of
+	//  a line, and the end of the run
+	char *pos = data, *end = data + size;
+	// each hit, the start of its line, and the start of the line after
+	char *hit, *linestart, *next;
+
+	sc->err = 0;
+	while (pos < end && ! sc->stopped) {
+		hit = srch->nevermatch ? NULL : scanner_find(sc,pos,end-pos);
+		if (sc->err != 0) { break; }
+		// no more hits, with MYGREP_INVERT all the remaining lines are
+		//  selected
+		if (hit == NULL) { linestart = next = end; }
+		else {
+			linestart = pos;
+			if (invert || linestarts) {
+				linestart = find_eol_back(pos,hit-pos);
+				linestart = (linestart != NULL) ?
+					linestart + 1 : pos;
+			}
+			// the next line starts after the line ending, treating
+			//  "\r\n" as one ending
+			next = find_eol(hit,end-hit);
+			if (next == NULL) { next = end; }
+			else if (*next == '\r' && next+1 < end &&
+				next[1] == '\n')
+			{
+				next += 2;
+			}
+			else { next++; }
+		}
+		// with MYGREP_INVERT the lines before the hit line are
+		//  selected and the hit line is not
+		if (invert && linestart > pos) {
+			matchcount += handler(sc,pos,linestart,arg);
+		}
+		else if (! invert && hit != NULL) {
+			matchcount += handler(sc,linestart,next,arg);
+		}
+		pos = next;
+	}
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_search function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner, with the callback of the library call being run
+// data is the start of a run of whole lines of the stream, just after the
+//  last run searched
+// size is the size of the run, including the last line ending if there is one
+// searches the whole run with scan_region, handing each selected line to
+//  scan_line, and moves the scanner's line number and byte offset past it,
+//  returns the number of lines selected, or -1 with errno set if the DFA could
+//  not be set up
+long scanner_search(struct mygrep_scanner *sc, char *data, size_t size) {
+	// number of lines selected
+	long matchcount;
+
+	sc->lines.at = data;
+	matchcount = scan_region(sc,data,size,TRUE,scan_lines,NULL);
+	// the lines after the last one selected are counted, the run is not
+	//  kept
+	sc->lines.lineno += count_lines(sc->lines.at,data+size-sc->lines.at);
+	sc->lines.offset += data + size - sc->lines.at;
+	sc->lines.at = NULL;
+	if (sc->err != 0) {
+		errno = sc->err;
+		return(-1);
+	}
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scan_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// from is the start of a run of selected lines found by scan_region
+// to is the end of the run, just past the line ending of its last line
+// arg is not used
+// splits the run into lines and hands each one to scan_line, until the
+//  callback stops the scan, returns the number of lines selected
+long scan_lines(struct mygrep_scanner *sc, char *from, char *to, void *arg) {
+	// number of lines selected
+	long matchcount = 0;
+	// end of each line
+	char *eol;
+
+	while (from < to && ! sc->stopped) {
+		eol = find_eol(from,to-from);
+		if (eol == NULL) { eol = to; }
+		scan_line(sc,from,eol);
+		matchcount++;
+		from = eol;
+		if (from < to) {
+			from += (*from == '\r' && from+1 < to &&
+				from[1] == '\n') ? 2 : 1;
+		}
+	}
+	if (sc->err != 0) { sc->stopped = TRUE; }
+	return(matchcount);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scan_line function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner, with the callback of the library call being run
+// linestart is the start of a selected line, at or after the scanner's
+//  position
+// eol is the end of the line, not including its line ending
+// moves the scanner's line number and byte offset to the line, counting the
+//  lines in between with count_lines, then gives the callback each match in
+//  the line found by match_span, as print_matches does for the -o option, or
+//  the whole line with MYGREP_INVERT - a line with only a match of no bytes
+//  is given once, with the match at its start
+// note: the scanner stops once the callback returns anything other than 0
+void scan_line(struct mygrep_scanner *sc, char *linestart, char *eol) {
+	// the match given to the callback
+	struct mygrep_match match;
+	// search position, and the start and end of each match
+	char *from = linestart, *start, *end;
+
+	sc->lines.lineno += count_lines(sc->lines.at,linestart-sc->lines.at);
+	sc->lines.offset += linestart - sc->lines.at;
+	sc->lines.at = linestart;
+	match.line = linestart;
+	match.linelen = eol - linestart;
+	match.lineno = sc->lines.lineno;
+	match.offset = sc->lines.offset;
+	match.start = linestart;
+	match.len = 0;
+	if (sc->pat->flags & MYGREP_INVERT) {
+		match.len = eol - linestart;
+		sc->stopped = (sc->cb(&match,sc->cbarg) != 0);
+		return;
+	}
+	while (! sc->stopped && sc->err == 0 &&
+		(end = match_span(sc,linestart,eol,from,&start)) != NULL)
+	{
+		match.start = start;
+		match.len = end - start;
+		sc->stopped = (sc->cb(&match,sc->cbarg) != 0);
+		from = end;
+	}
+	if (from == linestart && sc->err == 0) {
+		sc->stopped = (sc->cb(&match,sc->cbarg) != 0);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_keep function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// data is the bytes to keep
+// len is the number of bytes
+// adds the bytes to the unfinished last line kept by the scanner, doubling its
+//  buffer as needed, returns 0 on success or -1 if memory could not be
+//  allocated
+int scanner_keep(struct mygrep_scanner *sc, char *data, size_t len) {
+	// the grown buffer, and its size
+	char *temp;
+	size_t size = (sc->tailsize > 0) ? sc->tailsize : BUFF_SIZE;
+
+	while (size - sc->taillen < len) { size *= 2; }
+	if (size != sc->tailsize) {
+		temp = realloc(sc->tail,size);
+		if (temp == NULL) { return(-1); }
+		sc->tail = temp;
+		sc->tailsize = size;
+	}
+	memcpy(sc->tail+sc->taillen,data,len);
+	sc->taillen += len;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// scanner_reset function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// sc is the scanner
+// drops the unfinished last line and sets the scanner to the start of a new
+//  stream, keeping its buffers and DFA for it
+void scanner_reset(struct mygrep_scanner *sc) {
+	sc->taillen = 0;
+	sc->stopped = FALSE;
+	sc->lines.at = NULL;
+	sc->lines.lineno = 1;
+	sc->lines.offset = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// free_str_arr function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// size is number of elements in string array
+// arr is the string array
+// frees allocated memory for a string array
+void free_str_arr(int size, char **arr) {
+	int idx;
+	for (idx=0; idx < size; idx++) {
+		free(arr[idx]);
+	}
+	free(arr);
+}
+
+
+#ifdef MG_STATS
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_now function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// returns the time from the monotonic clock in nanoseconds, for the --stats
+//  option
+unsigned long long stats_now(void) {
+	// the time read
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_begin function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stage is the stage starting, one of the STAGE_ directives
+// starts timing a stage of the search in this thread, nested in the stage
+//  being timed already if there is one
+void stats_begin(int stage) {
+	mg_stats.start[stage] = stats_now();
+	mg_stats.outer[stage] = mg_stats.current;
+	mg_stats.current = stage;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_end function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stage is the stage ending, the one started last
+// adds the time since the stage started to it, and takes it off the stage it
+//  is nested in, so that every nanosecond is only counted in one stage
+// note: a stage that is not being timed is ignored, so a stage cut short by
+//        the SIGBUS handler can be ended without knowing if it started
+void stats_end(int stage) {
+	// time spent in the stage
+	unsigned long long elapsed;
+
+	if (mg_stats.current != stage) { return; }
+	elapsed = stats_now() - mg_stats.start[stage];
+	mg_stats.ns[stage] += elapsed;
+	mg_stats.current = mg_stats.outer[stage];
+	// the outer stage may dip below zero until it ends, which unsigned
+	//  arithmetic makes up for
+	if (mg_stats.current != STAGE_NONE) {
+		mg_stats.ns[mg_stats.current] -= elapsed;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_lines function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the start of a run of lines about to be searched
+// size is the length of the run
+// counts the lines of the run for the --stats option, timed as a stage of its
+//  own - the search skips from match to match without looking at the lines in
+//  between, so they take a pass of their own to count
+void stats_lines(char *data, size_t size) {
+	stats_begin(STAGE_COUNT);
+	mg_stats.lines += count_lines(data,size);
+	stats_end(STAGE_COUNT);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_file_begin function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// notes the time and the bytes searched so far in this thread, when a file is
+//  opened
+void stats_file_begin(void) {
+	mg_stats.filestart = stats_now();
+	mg_stats.filebytes = mg_stats.bytes;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_file_end function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// file_pathname is the path of the file, or null for stdin
+// matchcount is the number of lines selected in the file, or -1 on error
+// counts the file and adds it to the files searched, with the bytes searched
+//  and the time taken since stats_file_begin
+// note: if memory runs out the file is counted but left out of the list
+void stats_file_end(char *file_pathname, long matchcount) {
+	// the grown list of files
+	struct stats_file *temp;
+	// the file added
+	struct stats_file *file;
+
+	mg_stats.files++;
+	if (matchcount > 0) { mg_stats.matches += matchcount; }
+	pthread_mutex_lock(&mg_statslock);
+	if (mg_numstatfiles == mg_statfilessize) {
+		temp = realloc(mg_statfiles,(mg_statfilessize*2 + 16) *
+			sizeof(struct stats_file));
+		if (temp == NULL) {
+			pthread_mutex_unlock(&mg_statslock);
+			return;
+		}
+		mg_statfiles = temp;
+		mg_statfilessize = mg_statfilessize*2 + 16;
+	}
+	file = &mg_statfiles[mg_numstatfiles];
+	file->name = NULL;
+	if (file_pathname == NULL ||
+		(file->name = strdup(file_pathname)) != NULL)
+	{
+		file->bytes = mg_stats.bytes - mg_stats.filebytes;
+		file->ns = stats_now() - mg_stats.filestart;
+		file->matches = matchcount;
+		mg_numstatfiles++;
+	}
+	pthread_mutex_unlock(&mg_statslock);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_merge function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// adds this thread's counters and stage times to the totals and clears them,
+//  called by each thread when it is done
+void stats_merge(void) {
+	// index of the stage
+	int stage;
+
+	pthread_mutex_lock(&mg_statslock);
+	mg_totals.bytes += mg_stats.bytes;
+	mg_totals.compressed += mg_stats.compressed;
+	mg_totals.lines += mg_stats.lines;
+	mg_totals.matches += mg_stats.matches;
+	mg_totals.files += mg_stats.files;
+	mg_totals.reads += mg_stats.reads;
+	mg_totals.writes += mg_stats.writes;
+	mg_totals.grows += mg_stats.grows;
+	mg_totals.flushes += mg_stats.flushes;
+	for (stage=0; stage<NUM_STAGES; stage++) {
+		mg_totals.ns[stage] += mg_stats.ns[stage];
+	}
+	pthread_mutex_unlock(&mg_statslock);
+	memset(&mg_stats,0,sizeof(mg_stats));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_report function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// wallns is the time the whole run took, in nanoseconds
+// prints the totals, the time spent in each stage and the throughput of each
+//  file to stderr, as text or as a JSON object for the --stats option, and
+//  frees the list of files
+// note: stage times are added up over every thread, so with the -j option
+//        they can add up to more than the wall time
+void stats_report(unsigned long long wallns) {
+	// names of the stages
+	static char *stagenames[NUM_STAGES] = { "", "read", "split", "match",
+		"write", "decompress", "count" };
+	// index of the stage and the file
+	int stage;
+	size_t idx;
+	// the file being printed
+	struct stats_file *file;
+	// throughput in MB/s
+	double rate;
+
+	rate = (wallns > 0) ? mg_totals.bytes * 1000.0 / wallns : 0;
+	if (mg_statson == STATS_JSON) {
+		fprintf(stderr,"{\"files\": %llu, \"bytes\": %llu, "
+			"\"compressed_bytes\": %llu, \"lines\": %llu, "
+			"\"selected\": %llu, \"reads\": %llu, "
+			"\"writes\": %llu, "
+			"\"buffer_growths\": %llu, \"dfa_flushes\": %llu, "
+			"\"seconds\": {",mg_totals.files,mg_totals.bytes,
+			mg_totals.compressed,mg_totals.lines,mg_totals.matches,
+			mg_totals.reads,mg_totals.writes,mg_totals.grows,
+			mg_totals.flushes);
+		for (stage=1; stage<NUM_STAGES; stage++) {
+			fprintf(stderr,"\"%s\": %.6f, ",stagenames[stage],
+				mg_totals.ns[stage] / 1e9);
+		}
+		fprintf(stderr,"\"wall\": %.6f}, \"mb_per_s\": %.1f, "
+			"\"per_file\": [",wallns / 1e9,rate);
+		for (idx=0; idx<mg_numstatfiles; idx++) {
+			file = &mg_statfiles[idx];
+			fprintf(stderr,"%s{\"name\": ",(idx > 0) ? ", " : "");
+			stats_json_str(file->name);
+			fprintf(stderr,", \"bytes\": %llu, \"seconds\": %.6f, "
+				"\"mb_per_s\": %.1f, \"selected\": %ld}",
+				file->bytes,file->ns / 1e9,(file->ns > 0) ?
+				file->bytes * 1000.0 / file->ns : 0,
+				file->matches);
+		}
+		fprintf(stderr,"]}\n");
+	}
+	else {
+		fprintf(stderr,"%s: stats\n",PROG_NAME);
+		fprintf(stderr,"  files searched      %llu\n",mg_totals.files);
+		fprintf(stderr,"  bytes searched      %llu\n",mg_totals.bytes);
+		fprintf(stderr,"  compressed bytes    %llu\n",
+			mg_totals.compressed);
+		fprintf(stderr,"  lines searched      %llu\n",mg_totals.lines);
+		fprintf(stderr,"  lines selected      %llu\n",
+			mg_totals.matches);
+		fprintf(stderr,"  read() calls        %llu\n",mg_totals.reads);
+		fprintf(stderr,"  write() calls       %llu\n",mg_totals.writes);
+		fprintf(stderr,"  buffer growths      %llu\n",mg_totals.grows);
+		fprintf(stderr,"  DFA cache flushes   %llu\n",
+			mg_totals.flushes);
+		for (stage=1; stage<NUM_STAGES; stage++) {
+			fprintf(stderr,"  %-11s seconds %.6f\n",
+				stagenames[stage],mg_totals.ns[stage] / 1e9);
+		}
+		fprintf(stderr,"  wall seconds        %.6f\n",wallns / 1e9);
+		fprintf(stderr,"  throughput          %.1f MB/s\n",rate);
+		for (idx=0; idx<mg_numstatfiles; idx++) {
+			file = &mg_statfiles[idx];
+			fprintf(stderr,"  %9.1f MB/s %12llu bytes %10.6f s "
+				"%8ld selected  %s\n",(file->ns > 0) ?
+				file->bytes * 1000.0 / file->ns : 0,file->bytes,
+				file->ns / 1e9,file->matches,
+				(file->name != NULL) ? file->name : STDIN_NAME);
+		}
+	}
+	for (idx=0; idx<mg_numstatfiles; idx++) {
+		free(mg_statfiles[idx].name);
+	}
+	free(mg_statfiles);
+	mg_statfiles = NULL;
+	mg_numstatfiles = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// stats_json_str function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// str is the string to print, or null
+// prints the string to stderr as a JSON string, escaping quotes, backslashes
+//  and control chars, or null if there is no string
+void stats_json_str(char *str) {
+	// char of the string
+	unsigned char chr;
+
+	if (str == NULL) {
+		fprintf(stderr,"null");
+		return;
+	}
+	fprintf(stderr,"\"");
+	for (; *str != '\0'; str++) {
+		chr = *str;
+		if (chr == '"' || chr == '\\') { fprintf(stderr,"\\%c",chr); }
+		else if (chr < 0x20) { fprintf(stderr,"\\u%04x",chr); }
+		else { fputc(chr,stderr); }
+	}
+	fprintf(stderr,"\"");
 }
+#endif
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -540,8 +12259,15 @@ void free_str_arr(int size, char **arr) {
 // progname is the designated name of this program
 // prints usage message
 void print_usage(char *progname) {
-	fprintf(stderr,"Usage: %s [-v|--invert-match] STRING [FILE]...\n",
-		progname);
+	fprintf(stderr,"Usage: %s [-v|--invert-match] [-i] [-E] [-c|-l|-q] "
+		"[-n] [-b] [-o] "
+		"[-A NUM] [-B NUM] [-C NUM] [-a] [-r] [-j JOBS] "
+		"[--stats[=json]] "
+		"[--index INDEX] [--follow] [--max-line-length NUM] "
+		"STRING [FILE]...\n",progname);
+	fprintf(stderr,"  or:  %s [OPTION]... -e STRING [-e STRING]... "
+		"[-f FILE]... [FILE]...\n",progname);
+	fprintf(stderr,"  or:  %s index [-o INDEX] [PATH]...\n",progname);
 }
 
 
@@ -0,0 +1,1482 @@
+// mgbench - benchmark harness for mygrep
+//
+// generates repeatable corpora with set line lengths, match densities, line
+//  ending mixes and very long lines, runs the search paths of mygrep against
+//  them and reports MB/s, lines/s, allocations and peak RSS
+//
+// the results are written to a CSV file, one row per corpus and search, so
+//  that the results of two builds can be compared with the -b option
+//
+// lab1.c is compiled into this program with its main() renamed, and every
+//  run of it is done in a child process, so each run starts from fresh
+//  globals and its peak RSS can be read with wait4()
+//
+// compile with
+//  gcc -O2 -Wall -pthread -o mgbench mgbench.c
+// or, for the gzip and zstd rows, with
+//  gcc -O2 -Wall -pthread -DMG_ZLIB -DMG_ZSTD -o mgbench mgbench.c -lz -lzstd
+// run with
+//  ./mgbench [-s MB] [-r REPS] [-S SEED] [-d DIR] [-o FILE] [-b BASELINE]
+//   [-m MYGREP] [-n BATCHES] [-a SCALE]
+//
+// with -m the first corpus is also cut into batches of whole lines, which are
+//  searched once in this process through the library interface in mygrep.h,
+//  and once by starting the mygrep program named by -m for every batch, fed
+//  the batch on stdin, to show what a program searching many small inputs
+//  saves by linking the library
+//
+// the first corpus is also searched in this process for search strings of 1
+//  to 256 bytes, once with strstr() and once with the search function that
+//  search_init() picks, over the whole corpus at once - the search strings
+//  are made of the corpus words but end in a byte the corpus never has, so
+//  both scan the whole corpus and the rows compare the search functions alone
+//
+// built with -DMG_ZLIB or -DMG_ZSTD, each corpus is also written compressed
+//  and searched by the gzip or zstd rows - their MB/s is of the text once
+//  decompressed, so it can be read against the plain row
+//
+// with -a, nothing is benchmarked - every search is run once on each corpus
+//  and once on a corpus SCALE times larger, and mgbench fails if the larger
+//  one allocated more than the line count allows, which shows that the
+//  search loop does not allocate for each line it reads
+
+// _GNU_SOURCE is defined here as well, since the system headers are included
+//  before lab1.c
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<time.h>
+#include<sys/stat.h>
+#include<sys/types.h>
+#include<sys/time.h>
+#include<sys/resource.h>
+#include<sys/wait.h>
+
+// ALLOCATION COUNTING
+// the allocation functions used by lab1.c are replaced by these counting
+//  versions, the counters are updated atomically since the -j option
+//  allocates from several threads
+long mb_allocs = 0;
+long mb_allocbytes = 0;
+
+void *mb_malloc(size_t size) {
+	__atomic_add_fetch(&mb_allocs,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&mb_allocbytes,(long) size,__ATOMIC_RELAXED);
+	return(malloc(size));
+}
+
+void *mb_calloc(size_t num, size_t size) {
+	__atomic_add_fetch(&mb_allocs,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&mb_allocbytes,(long) (num*size),__ATOMIC_RELAXED);
+	return(calloc(num,size));
+}
+
+void *mb_realloc(void *ptr, size_t size) {
+	__atomic_add_fetch(&mb_allocs,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&mb_allocbytes,(long) size,__ATOMIC_RELAXED);
+	return(realloc(ptr,size));
+}
+
+#define malloc(size) mb_malloc(size)
+#define calloc(num,size) mb_calloc(num,size)
+#define realloc(ptr,size) mb_realloc(ptr,size)
+#define main mygrep_main
+#include "lab1.c"
+#undef main
+#undef malloc
+#undef calloc
+#undef realloc
+
+// PREPROCESSOR DIRECTIVES
+// preprocessor directive for benchmark program name
+#define BENCH_NAME "mgbench"
+// preprocessor directives of defaults for the options
+#define DEF_SIZE_MB 32
+#define DEF_REPS 3
+#define DEF_SEED 1
+#define DEF_DIR "mgbench-data"
+#define DEF_OUT "mgbench.csv"
+#define DEF_BATCHES 256
+// preprocessor directive of size of the buffer corpora are written through
+#define GEN_BUFF_SIZE (1024*1024)
+// preprocessor directive of the search string planted in matching lines -
+//  none of the words the corpora are made of contain it
+#define NEEDLE "mgneedle"
+// preprocessor directive of most arguments a search passes to mygrep
+#define MAX_ARGS 24
+// preprocessor directives of the longest search string of the needle rows,
+//  and of the byte each of them ends in, which is in none of the words
+#define NEEDLE_MAX_LEN 256
+#define NEEDLE_MISS '~'
+// preprocessor directive of lines the larger corpus of -a must have for each
+//  allocation it makes beyond those of the smaller one - a few allocations
+//  may grow with the size, such as one for every CHUNK_SIZE bytes with -j,
+//  but far fewer than one for each line
+#define ALLOC_CHECK_LINES 10000
+
+// STRUCTURES
+// description of a corpus to generate
+struct corpus {
+	// name of the corpus, also its file name
+	char *name;
+	// shortest and longest line, line lengths are uniform between them
+	size_t minlen;
+	size_t maxlen;
+	// a very long line is written every longevery lines, 0 for none
+	long longevery;
+	// length of the very long lines
+	size_t longlen;
+	// number of lines in every 1000 that contain the search string
+	int density;
+	// percent of lines ending in "\r\n" and in '\r', the rest end in '\n'
+	int crlfpct;
+	int crpct;
+};
+
+// description of a search to run against each corpus
+struct search {
+	// name of the search
+	char *name;
+	// boolean flag for feeding the corpus on stdin instead of naming it
+	int usestdin;
+	// arguments before the file name, null-terminated
+	char *args[MAX_ARGS];
+	// LC_ALL the search runs with, or null to keep this program's
+	//  environment
+	char *locale;
+	// suffix added to the corpus file name, for a compressed copy of it,
+	//  or null to search the corpus itself
+	char *suffix;
+};
+
+// corpus generator state
+struct gen {
+	// file descriptor being written
+	int fd;
+	// buffer of bytes not yet written
+	char buff[GEN_BUFF_SIZE];
+	// number of bytes in the buffer
+	size_t len;
+	// state of the xorshift random number generator
+	unsigned long long rng;
+};
+
+// measurements of one corpus and search
+struct result {
+	// fastest wall time of the runs, in seconds
+	double seconds;
+	// number of allocations and bytes allocated by the last run
+	long allocs;
+	long allocbytes;
+	// largest peak RSS of the runs, in KB
+	long maxrss;
+	// exit status of the last run
+	int status;
+};
+
+// GLOBALS
+// corpora generated for every run, all of them are the same size
+struct corpus corpora[] = {
+	// short lines with '\n' line endings, 1% matching
+	{ "short-lf", 10, 60, 0, 0, 10, 0, 0 },
+	// every line ending mixed evenly
+	{ "mixed-eol", 0, 120, 0, 0, 10, 33, 33 },
+	// "\r\n" line endings only
+	{ "crlf", 40, 80, 0, 0, 10, 100, 0 },
+	// half of the lines matching
+	{ "dense", 10, 60, 0, 0, 500, 0, 0 },
+	// a 256 KiB line every 5000 lines
+	{ "long-lines", 20, 200, 5000, 256*1024, 10, 0, 0 },
+};
+
+// searches run against every corpus
+struct search searches[] = {
+	{ "plain", 0, { NEEDLE, NULL } },
+	{ "invert", 0, { "-v", NEEDLE, NULL } },
+	{ "count", 0, { "-c", NEEDLE, NULL } },
+	{ "multi10", 0, { "-e", NEEDLE, "-e", "qqxa", "-e", "qqxb", "-e",
+		"qqxc", "-e", "qqxd", "-e", "qqxe", "-e", "qqxf", "-e", "qqxg",
+		"-e", "qqxh", "-e", "qqxi", NULL } },
+	{ "jobs4", 0, { "-j", "4", NEEDLE, NULL } },
+	// a log pattern, prefiltered on its longest literal, and an IP address
+	//  pattern with only '.' to prefilter on
+	{ "regex", 0, { "-E", "error.*timeout", NULL } },
+	{ "regex-ip", 0, { "-E",
+		"[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+", NULL } },
+	{ "stdin", 1, { NEEDLE, NULL } },
+	// -i against the plain and multi10 rows, and a search string outside
+	//  ASCII, which is folded one char at a time behind a prefilter on its
+	//  longest ASCII run and matches no line
+	{ "icase", 0, { "-i", NEEDLE, NULL } },
+	{ "icase10", 0, { "-i", "-e", NEEDLE, "-e", "qqxa", "-e", "qqxb", "-e",
+		"qqxc", "-e", "qqxd", "-e", "qqxe", "-e", "qqxf", "-e", "qqxg",
+		"-e", "qqxh", "-e", "qqxi", NULL } },
+	{ "icase-u8", 0, { "-i", NEEDLE "\xc3\xa9", NULL }, "C.UTF-8" },
+	// two lines of context around every match, against plain
+	{ "context", 0, { "-C", "2", NEEDLE, NULL } },
+	// the corpus compressed, decompressed on its own thread while it is
+	//  searched, against plain
+#ifdef MG_ZLIB
+	{ "gzip", 0, { NEEDLE, NULL }, NULL, ".gz" },
+#endif
+#ifdef MG_ZSTD
+	{ "zstd", 0, { NEEDLE, NULL }, NULL, ".zst" },
+#endif
+};
+
+// lengths of the search strings of the needle rows - 32 and 33 are either
+//  side of SIMD_MAX_NEEDLE, where search_init() moves to Boyer-Moore-Horspool
+size_t needlelens[] = { 1, 2, 4, 8, 16, 32, 33, 64, 128, 256 };
+
+// words the corpora are made of
+char *words[] = { "alpha", "beta", "gamma", "delta", "error", "timeout",
+	"INFO", "request", "id=1234", "user", "session", "cache", "GET",
+	"/index.html", "200", "latency_ms=17" };
+
+// PROTOTYPES
+int gen_corpus(struct corpus *corp, char *pathname, size_t size,
+	unsigned long long seed, long *numlines);
+unsigned long long gen_rand(struct gen *gen);
+int gen_put(struct gen *gen, char *str, size_t len);
+int gen_line(struct gen *gen, size_t len, int match);
+int gen_flush(struct gen *gen);
+int gen_compressed(char *pathname);
+int run_search(struct search *srch, char *pathname, int reps,
+	struct result *res);
+int run_once(struct search *srch, char *pathname, struct result *res,
+	double *seconds);
+int run_batches(char *pathname, char *mygrep, int numbatches, int reps,
+	struct result *lib, struct result *spawn, long *numlines);
+int batch_library(char *data, size_t *cuts, int numbatches,
+	struct result *res, double *seconds, long *selected);
+int batch_spawn(char *data, size_t *cuts, int numbatches, char *mygrep,
+	struct result *res, double *seconds, long *selected);
+int count_match(const struct mygrep_match *match, void *arg);
+int run_needle(char *data, size_t len, size_t needlelen, int reps,
+	struct result *res);
+int compare_results(char *basepath, char *newpath);
+int check_allocs(char *datadir, size_t size, int scale,
+	unsigned long long seed);
+char *load_file(char *pathname, size_t *len);
+void print_bench_usage(char *progname);
+
+// main function
+int main(int argc, char *argv[]) {
+	// size of each corpus in bytes
+	size_t size = (size_t) DEF_SIZE_MB * 1024 * 1024;
+	// number of runs of each search, the fastest is reported
+	int reps = DEF_REPS;
+	// seed for the corpus generator
+	unsigned long long seed = DEF_SEED;
+	// directory the corpora are written to
+	char *datadir = DEF_DIR;
+	// results file
+	char *outpath = DEF_OUT;
+	// results file of an earlier build to compare against, if any
+	char *basepath = NULL;
+	// mygrep program started for each batch, null to skip the batches
+	char *mygrep = NULL;
+	// number of batches the first corpus is cut into
+	int numbatches = DEF_BATCHES;
+	// how many times larger the second corpus of the allocation check is,
+	//  0 to benchmark instead
+	int scale = 0;
+	// measurements of the batches searched by the library and by starting
+	//  mygrep, and the names of the two
+	struct result batchres[2];
+	char *batchnames[2] = { "library", "spawn" };
+	// measurements of the needle rows with strstr() and with the search
+	//  function of search_init(), and the names of the two
+	struct result needleres[2];
+	char *needlenames[2] = { "strstr", "find" };
+	// the first corpus and its length, for the needle rows
+	char *data;
+	size_t datalen;
+	// index of the needle length, and the name of its row
+	int nidx;
+	char needlename[32];
+	// index of current position in argv
+	int argidx;
+	// index of the corpus and search being run
+	int cidx, sidx;
+	// path of the corpus being searched
+	char pathname[4096];
+	// number of lines in the corpus
+	long numlines;
+	// measurements of the search
+	struct result res;
+	// results file handle
+	FILE *outh;
+	// throughput of the search
+	double mbps, lps;
+	// keep track of number of errors
+	int founderror = 0;
+
+	// read the options, each of which takes a value
+	for (argidx=1; argidx<argc; argidx++) {
+		if (argv[argidx][0] != '-' || argv[argidx][1] == '\0' ||
+			argv[argidx][2] != '\0' || argidx+1 >= argc)
+		{
+			print_bench_usage(BENCH_NAME);
+			return(R_ERROR);
+		}
+		switch (argv[argidx][1]) {
+			case 's': size = strtoul(argv[++argidx],NULL,10) *
+				1024 * 1024; break;
+			case 'r': reps = atoi(argv[++argidx]); break;
+			case 'S': seed = strtoull(argv[++argidx],NULL,10); break;
+			case 'd': datadir = argv[++argidx]; break;
+			case 'o': outpath = argv[++argidx]; break;
+			case 'b': basepath = argv[++argidx]; break;
+			case 'm': mygrep = argv[++argidx]; break;
+			case 'n': numbatches = atoi(argv[++argidx]); break;
+			case 'a': scale = atoi(argv[++argidx]); break;
+			default:
+				print_bench_usage(BENCH_NAME);
+				return(R_ERROR);
+		}
+	}
+	if (size == 0 || reps < 1 || numbatches < 1 || scale == 1 ||
+		scale < 0)
+	{
+		print_bench_usage(BENCH_NAME);
+		return(R_ERROR);
+	}
+	if (mkdir(datadir,0755) != 0 && errno != EEXIST) {
+		fprintf(stderr,"%s: cannot create directory '%s': %s\n",
+			BENCH_NAME,datadir,strerror(errno));
+		return(R_ERROR);
+	}
+	if (scale > 0) {
+		if (check_allocs(datadir,size,scale,seed) != 0) {
+			return(R_ERROR);
+		}
+		return(0);
+	}
+	outh = fopen(outpath,"w");
+	if (outh == NULL) {
+		fprintf(stderr,"%s: cannot open '%s': %s\n",BENCH_NAME,
+			outpath,strerror(errno));
+		return(R_ERROR);
+	}
+	fprintf(outh,"corpus,search,bytes,lines,seconds,mb_per_s,lines_per_s,"
+		"allocs,alloc_bytes,peak_rss_kb,status\n");
+	printf("%-12s %-8s %10s %12s %8s %12s %8s\n","corpus","search",
+		"MB/s","lines/s","allocs","alloc bytes","RSS KB");
+	for (cidx=0; cidx<(int) (sizeof(corpora)/sizeof(corpora[0])); cidx++) {
+		snprintf(pathname,sizeof(pathname),"%s/%s.txt",datadir,
+			corpora[cidx].name);
+		if (gen_corpus(&corpora[cidx],pathname,size,seed+cidx,
+			&numlines) != 0)
+		{
+			fprintf(stderr,"%s: cannot write corpus '%s': %s\n",
+				BENCH_NAME,pathname,strerror(errno));
+			founderror++;
+			continue;
+		}
+		if (gen_compressed(pathname) != 0) {
+			fprintf(stderr,"%s: cannot compress corpus '%s': %s\n",
+				BENCH_NAME,pathname,strerror(errno));
+			founderror++;
+			continue;
+		}
+		for (sidx=0; sidx<(int) (sizeof(searches)/sizeof(searches[0]));
+			sidx++)
+		{
+			if (run_search(&searches[sidx],pathname,reps,&res)
+				!= 0)
+			{
+				fprintf(stderr,"%s: cannot run search '%s': "
+					"%s\n",BENCH_NAME,searches[sidx].name,
+					strerror(errno));
+				founderror++;
+				continue;
+			}
+			if (res.status == R_ERROR) { founderror++; }
+			mbps = size / (1024.0*1024.0) / res.seconds;
+			lps = numlines / res.seconds;
+			fprintf(outh,"%s,%s,%lu,%ld,%.6f,%.1f,%.0f,%ld,%ld,%ld,"
+				"%d\n",corpora[cidx].name,searches[sidx].name,
+				(unsigned long) size,numlines,res.seconds,mbps,
+				lps,res.allocs,res.allocbytes,res.maxrss,
+				res.status);
+			printf("%-12s %-8s %10.1f %12.0f %8ld %12ld %8ld\n",
+				corpora[cidx].name,searches[sidx].name,mbps,lps,
+				res.allocs,res.allocbytes,res.maxrss);
+		}
+	}
+	// the needle rows and the batches come from the first corpus, written
+	//  above
+	snprintf(pathname,sizeof(pathname),"%s/%s.txt",datadir,
+		corpora[0].name);
+	data = load_file(pathname,&datalen);
+	if (data == NULL) {
+		fprintf(stderr,"%s: cannot read '%s': %s\n",BENCH_NAME,
+			pathname,strerror(errno));
+		founderror++;
+	}
+	else {
+		numlines = count_lines(data,datalen);
+		printf("\n%-12s %-8s %10s\n","needle","search","MB/s");
+	}
+	for (nidx=0; data != NULL &&
+		nidx<(int) (sizeof(needlelens)/sizeof(needlelens[0])); nidx++)
+	{
+		if (run_needle(data,datalen,needlelens[nidx],reps,needleres)
+			!= 0)
+		{
+			fprintf(stderr,"%s: cannot run needle of %lu bytes: "
+				"%s\n",BENCH_NAME,
+				(unsigned long) needlelens[nidx],
+				strerror(errno));
+			founderror++;
+			continue;
+		}
+		snprintf(needlename,sizeof(needlename),"needle-%lu",
+			(unsigned long) needlelens[nidx]);
+		for (sidx=0; sidx<2; sidx++) {
+			res = needleres[sidx];
+			if (res.status == R_ERROR) { founderror++; }
+			mbps = datalen / (1024.0*1024.0) / res.seconds;
+			lps = numlines / res.seconds;
+			fprintf(outh,"%s,%s,%lu,%ld,%.6f,%.1f,%.0f,%ld,%ld,"
+				"%ld,%d\n",needlename,needlenames[sidx],
+				(unsigned long) datalen,numlines,res.seconds,
+				mbps,lps,res.allocs,res.allocbytes,res.maxrss,
+				res.status);
+			printf("%-12s %-8s %10.1f\n",needlename,
+				needlenames[sidx],mbps);
+		}
+	}
+	free(data);
+	if (mygrep != NULL && run_batches(pathname,mygrep,numbatches,reps,
+		&batchres[0],&batchres[1],&numlines) != 0)
+	{
+		fprintf(stderr,"%s: cannot run batches: %s\n",BENCH_NAME,
+			strerror(errno));
+		founderror++;
+	}
+	else if (mygrep != NULL) {
+		printf("\n%-12s %-8s %10s %12s %10s %8s\n","batches","search",
+			"MB/s","lines/s","us/batch","allocs");
+		for (sidx=0; sidx<2; sidx++) {
+			res = batchres[sidx];
+			if (res.status == R_ERROR) { founderror++; }
+			mbps = size / (1024.0*1024.0) / res.seconds;
+			lps = numlines / res.seconds;
+			fprintf(outh,"batches,%s,%lu,%ld,%.6f,%.1f,%.0f,%ld,"
+				"%ld,%ld,%d\n",batchnames[sidx],
+				(unsigned long) size,numlines,res.seconds,mbps,
+				lps,res.allocs,res.allocbytes,res.maxrss,
+				res.status);
+			printf("%-12d %-8s %10.1f %12.0f %10.1f %8ld\n",
+				numbatches,batchnames[sidx],mbps,lps,
+				res.seconds * 1e6 / numbatches,res.allocs);
+		}
+	}
+	if (fclose(outh) != 0) {
+		fprintf(stderr,"%s: cannot write '%s': %s\n",BENCH_NAME,
+			outpath,strerror(errno));
+		founderror++;
+	}
+	if (basepath != NULL && compare_results(basepath,outpath) != 0) {
+		founderror++;
+	}
+	if (founderror > 0) { return(R_ERROR); }
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_corpus function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// corp is the description of the corpus
+// pathname is the file to write
+// size is the size of the corpus in bytes, the last line is cut short to fit
+// seed is the seed for the random number generator, the same seed always
+//  gives the same corpus
+// numlines is set to the number of lines written
+// writes the corpus, returns 0 on success or -1 on error
+int gen_corpus(struct corpus *corp, char *pathname, size_t size,
+	unsigned long long seed, long *numlines)
+{
+	// generator state, too large for the stack
+	struct gen *gen;
+	// bytes written so far
+	size_t written = 0;
+	// length of the next line, not counting the line ending
+	size_t len;
+	// random number picking the line ending and match
+	int pick;
+	// line ending of the next line
+	char *eol;
+	// errno to report after cleaning up
+	int saverr;
+
+	gen = malloc(sizeof(*gen));
+	if (gen == NULL) { return(-1); }
+	gen->fd = open(pathname,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if (gen->fd == -1) {
+		free(gen);
+		return(-1);
+	}
+	gen->len = 0;
+	// xorshift must not start from 0
+	gen->rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+	*numlines = 0;
+	while (written < size) {
+		if (corp->longevery > 0 && *numlines % corp->longevery ==
+			corp->longevery - 1)
+		{
+			len = corp->longlen;
+		}
+		else {
+			len = corp->minlen + gen_rand(gen) %
+				(corp->maxlen - corp->minlen + 1);
+		}
+		pick = gen_rand(gen) % 100;
+		if (pick < corp->crlfpct) { eol = "\r\n"; }
+		else if (pick < corp->crlfpct + corp->crpct) { eol = "\r"; }
+		else { eol = "\n"; }
+		// the line and its line ending are cut short at the end
+		if (len + strlen(eol) > size - written) {
+			len = size - written;
+			eol = "";
+		}
+		if (gen_line(gen,len,(int) (gen_rand(gen) % 1000) <
+			corp->density) != 0 || gen_put(gen,eol,strlen(eol)) != 0)
+		{
+			break;
+		}
+		written += len + strlen(eol);
+		(*numlines)++;
+	}
+	if (written < size || gen_flush(gen) != 0) {
+		saverr = errno;
+		close(gen->fd);
+		free(gen);
+		errno = saverr;
+		return(-1);
+	}
+	saverr = close(gen->fd);
+	free(gen);
+	if (saverr != 0) { return(-1); }
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_rand function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen is the generator state
+// returns the next number from the xorshift64* generator, only the high bits
+//  are returned since the low bits of xorshift are weak
+unsigned long long gen_rand(struct gen *gen) {
+	gen->rng ^= gen->rng >> 12;
+	gen->rng ^= gen->rng << 25;
+	gen->rng ^= gen->rng >> 27;
+	return((gen->rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_line function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen is the generator state
+// len is the length of the line, not counting the line ending
+// match is a boolean flag for planting the search string in the line
+// writes a line of random words, returns 0 on success or -1 on error
+// note: a matching line shorter than the search string is cut short by the
+//        line length, and so does not match
+int gen_line(struct gen *gen, size_t len, int match) {
+	// where the search string goes in the line, past the end if nowhere
+	size_t at = len;
+	// bytes of the line written so far
+	size_t done = 0;
+	// word being written and the bytes of it that fit
+	char *word;
+	size_t wlen;
+	// boolean flag for the last thing written being a space
+	int space = TRUE;
+
+	if (match && len >= strlen(NEEDLE)) {
+		at = gen_rand(gen) % (len - strlen(NEEDLE) + 1);
+	}
+	while (done < len) {
+		// words are separated by single spaces
+		if (done == at) { word = NEEDLE; }
+		else if (done > 0 && ! space) { word = " "; }
+		else { word = words[gen_rand(gen) %
+			(sizeof(words)/sizeof(words[0]))]; }
+		space = (word[0] == ' ');
+		wlen = strlen(word);
+		// a word never runs over the search string or the line end
+		if (done < at && done + wlen > at) { wlen = at - done; }
+		if (done + wlen > len) { wlen = len - done; }
+		if (gen_put(gen,word,wlen) != 0) { return(-1); }
+		done += wlen;
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_put function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen is the generator state
+// str is the bytes to write
+// len is the number of bytes
+// adds the bytes to the buffer, writing it out when full, returns 0 on
+//  success or -1 on error
+int gen_put(struct gen *gen, char *str, size_t len) {
+	if (gen->len + len > GEN_BUFF_SIZE && gen_flush(gen) != 0) {
+		return(-1);
+	}
+	memcpy(gen->buff+gen->len,str,len);
+	gen->len += len;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_flush function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen is the generator state
+// writes out the buffer, returns 0 on success or -1 on error
+int gen_flush(struct gen *gen) {
+	if (write_all(gen->fd,gen->buff,gen->len) != 0) { return(-1); }
+	gen->len = 0;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// gen_compressed function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pathname is the corpus just written
+// writes the corpus compressed with gzip to pathname with ".gz" added, and
+//  with zstd to pathname with ".zst" added, for each of them this program was
+//  built with, returns 0 on success or -1 on error
+// note: each is compressed at the default level of the gzip and zstd programs
+int gen_compressed(char *pathname) {
+#if defined(MG_ZLIB) || defined(MG_ZSTD)
+	// the corpus and its length
+	char *data;
+	size_t len;
+	// path of the compressed copy
+	char comppath[4096];
+	// boolean flag for a failed write
+	int failed = FALSE;
+#ifdef MG_ZLIB
+	// the gzip file being written
+	gzFile gz;
+#endif
+#ifdef MG_ZSTD
+	// the compressed corpus, its size and length
+	char *comp;
+	size_t compsize, complen;
+	// file descriptor of the zstd file
+	int fd;
+#endif
+
+	data = load_file(pathname,&len);
+	if (data == NULL) { return(-1); }
+#ifdef MG_ZLIB
+	snprintf(comppath,sizeof(comppath),"%s.gz",pathname);
+	gz = gzopen(comppath,"wb6");
+	if (gz == NULL || (len > 0 && gzwrite(gz,data,len) != (int) len)) {
+		failed = TRUE;
+	}
+	if (gz != NULL && gzclose(gz) != Z_OK) { failed = TRUE; }
+#endif
+#ifdef MG_ZSTD
+	snprintf(comppath,sizeof(comppath),"%s.zst",pathname);
+	compsize = ZSTD_compressBound(len);
+	comp = malloc(compsize);
+	if (comp == NULL) { failed = TRUE; }
+	else {
+		complen = ZSTD_compress(comp,compsize,data,len,3);
+		fd = open(comppath,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if (ZSTD_isError(complen) || fd == -1 ||
+			write_all(fd,comp,complen) != 0)
+		{
+			failed = TRUE;
+		}
+		if (fd != -1 && close(fd) != 0) { failed = TRUE; }
+		free(comp);
+	}
+#endif
+	free(data);
+	if (failed) {
+		if (errno == 0) { errno = EIO; }
+		return(-1);
+	}
+#endif
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// run_search function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the search to run
+// pathname is the corpus to search
+// reps is the number of runs
+// res is set to the measurements
+// runs the search reps times, keeping the fastest time and the largest peak
+//  RSS, returns 0 on success or -1 on error
+// note: the first run also brings the corpus into the page cache
+int run_search(struct search *srch, char *pathname, int reps,
+	struct result *res)
+{
+	// index of the run
+	int ridx;
+	// wall time of the run
+	double seconds;
+
+	res->seconds = 0;
+	res->maxrss = 0;
+	for (ridx=0; ridx<reps; ridx++) {
+		if (run_once(srch,pathname,res,&seconds) != 0) { return(-1); }
+		if (ridx == 0 || seconds < res->seconds) {
+			res->seconds = seconds;
+		}
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// run_once function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// srch is the search to run
+// pathname is the corpus to search
+// res is updated with the allocations, peak RSS and exit status
+// seconds is set to the wall time
+// runs mygrep once in a child process with stdout going to /dev/null, the
+//  child sends its allocation counters back over a pipe, returns 0 on
+//  success or -1 on error
+int run_once(struct search *srch, char *pathname, struct result *res,
+	double *seconds)
+{
+	// arguments for mygrep
+	char *args[MAX_ARGS+2];
+	// number of arguments
+	int nargs;
+	// pipe the counters come back over
+	int fds[2];
+	// counters sent by the child
+	long counts[2];
+	// child process id and status
+	pid_t pid;
+	int status;
+	// resource usage of the child, for the peak RSS
+	struct rusage usage;
+	// start and end time
+	struct timespec start, end;
+	// file descriptors the child redirects
+	int nullfd, infd;
+	// the corpus, or its compressed copy
+	char corppath[4096];
+
+	args[0] = PROG_NAME;
+	for (nargs=1; srch->args[nargs-1] != NULL; nargs++) {
+		args[nargs] = srch->args[nargs-1];
+	}
+	snprintf(corppath,sizeof(corppath),"%s%s",pathname,
+		(srch->suffix != NULL) ? srch->suffix : "");
+	if (! srch->usestdin) { args[nargs++] = corppath; }
+	args[nargs] = NULL;
+	if (pipe(fds) != 0) { return(-1); }
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	pid = fork();
+	if (pid == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		return(-1);
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		nullfd = open("/dev/null",O_WRONLY);
+		if (nullfd == -1 || dup2(nullfd,STDOUT_FILENO) == -1) {
+			_exit(127);
+		}
+		if (srch->usestdin) {
+			infd = open(corppath,O_RDONLY);
+			if (infd == -1 || dup2(infd,STDIN_FILENO) == -1) {
+				_exit(127);
+			}
+		}
+		if (srch->locale != NULL &&
+			setenv("LC_ALL",srch->locale,1) != 0)
+		{
+			_exit(127);
+		}
+		status = mygrep_main(nargs,args);
+		counts[0] = mb_allocs;
+		counts[1] = mb_allocbytes;
+		if (write_all(fds[1],(char *) counts,sizeof(counts)) != 0) {
+			_exit(127);
+		}
+		_exit(status);
+	}
+	close(fds[1]);
+	if (wait4(pid,&status,0,&usage) == -1) {
+		close(fds[0]);
+		return(-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	*seconds = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	if (read(fds[0],counts,sizeof(counts)) != sizeof(counts) ||
+		! WIFEXITED(status) || WEXITSTATUS(status) == 127)
+	{
+		close(fds[0]);
+		errno = ECHILD;
+		return(-1);
+	}
+	close(fds[0]);
+	res->allocs = counts[0];
+	res->allocbytes = counts[1];
+	res->status = WEXITSTATUS(status);
+	if (usage.ru_maxrss > res->maxrss) { res->maxrss = usage.ru_maxrss; }
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// run_batches function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pathname is the corpus to cut into batches
+// mygrep is the mygrep program to start for each batch
+// numbatches is the number of batches
+// reps is the number of runs each way
+// lib and spawn are set to the measurements of the library and of starting
+//  mygrep
+// numlines is set to the number of lines in the corpus
+// loads the corpus and cuts it into batches of whole lines of about the same
+//  size, then searches every batch reps times each way, keeping the fastest
+//  time, returns 0 on success or -1 on error
+// note: both ways must select the same number of lines, otherwise the status
+//        of the spawn row is R_ERROR
+int run_batches(char *pathname, char *mygrep, int numbatches, int reps,
+	struct result *lib, struct result *spawn, long *numlines)
+{
+	// the corpus and its length
+	char *data;
+	size_t len;
+	// offset of the start of each batch, and of the end of the last
+	size_t *cuts;
+	// share of the corpus each batch starts at, and the line ending there
+	size_t pos;
+	char *eol;
+	// index of the batch and of the run
+	int bidx, ridx;
+	// wall time of the run
+	double seconds;
+	// lines selected by the library and by mygrep
+	long libcount = 0, spawncount = 0;
+	// errno to report after cleaning up
+	int saverr;
+
+	data = load_file(pathname,&len);
+	if (data == NULL) { return(-1); }
+	cuts = malloc((numbatches + 1) * sizeof(size_t));
+	if (cuts == NULL) {
+		free(data);
+		return(-1);
+	}
+	// each batch ends after the first line ending at or after its share
+	cuts[0] = 0;
+	for (bidx=1; bidx<numbatches; bidx++) {
+		pos = len / numbatches * bidx;
+		if (pos < cuts[bidx-1]) { pos = cuts[bidx-1]; }
+		eol = find_eol(data+pos,len-pos);
+		cuts[bidx] = (eol != NULL) ? (size_t) (eol + 1 - data) : len;
+		if (eol != NULL && *eol == '\r' && cuts[bidx] < len &&
+			data[cuts[bidx]] == '\n')
+		{
+			cuts[bidx]++;
+		}
+	}
+	cuts[numbatches] = len;
+	*numlines = count_lines(data,len);
+	lib->maxrss = 0;
+	spawn->maxrss = 0;
+	for (ridx=0; ridx<reps; ridx++) {
+		if (batch_library(data,cuts,numbatches,lib,&seconds,
+			&libcount) != 0)
+		{
+			break;
+		}
+		if (ridx == 0 || seconds < lib->seconds) {
+			lib->seconds = seconds;
+		}
+		if (batch_spawn(data,cuts,numbatches,mygrep,spawn,&seconds,
+			&spawncount) != 0)
+		{
+			break;
+		}
+		if (ridx == 0 || seconds < spawn->seconds) {
+			spawn->seconds = seconds;
+		}
+	}
+	saverr = errno;
+	free(cuts);
+	free(data);
+	if (ridx < reps) {
+		errno = saverr;
+		return(-1);
+	}
+	if (libcount != spawncount) {
+		fprintf(stderr,"%s: the library selected %ld lines of the "
+			"batches, mygrep %ld\n",BENCH_NAME,libcount,spawncount);
+		spawn->status = R_ERROR;
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// batch_library function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the corpus
+// cuts is the offset of the start of each batch, and of the end of the last
+// numbatches is the number of batches
+// res is updated with the allocations, peak RSS and status
+// seconds is set to the wall time
+// selected is set to the number of lines selected
+// compiles the search string once and searches every batch as a stream of its
+//  own with one scanner, returns 0 on success or -1 on error
+// note: the peak RSS is that of this whole process, corpus included
+int batch_library(char *data, size_t *cuts, int numbatches,
+	struct result *res, double *seconds, long *selected)
+{
+	// the search string and its length
+	const char *pats[1] = { NEEDLE };
+	size_t lens[1] = { strlen(NEEDLE) };
+	// the compiled search string and the scanner
+	struct mygrep_pattern *pat;
+	struct mygrep_scanner *sc = NULL;
+	// number of matches given to the callback
+	long matches = 0;
+	// lines selected in each call
+	long ret = 0;
+	// index of the batch
+	int bidx;
+	// allocation counters before the run
+	long allocs = mb_allocs, allocbytes = mb_allocbytes;
+	// resource usage of this process, for the peak RSS
+	struct rusage usage;
+	// start and end time
+	struct timespec start, end;
+
+	*selected = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	pat = mygrep_compile(pats,lens,1,0,NULL);
+	if (pat != NULL) { sc = mygrep_scanner_new(pat); }
+	for (bidx=0; sc != NULL && bidx<numbatches && ret != -1; bidx++) {
+		ret = mygrep_scan(sc,data+cuts[bidx],cuts[bidx+1]-cuts[bidx],
+			count_match,&matches);
+		if (ret != -1) {
+			*selected += ret;
+			ret = mygrep_finish(sc,count_match,&matches);
+		}
+		if (ret != -1) { *selected += ret; }
+	}
+	mygrep_scanner_free(sc);
+	mygrep_pattern_free(pat);
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	if (sc == NULL || ret == -1) { return(-1); }
+	*seconds = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	res->allocs = mb_allocs - allocs;
+	res->allocbytes = mb_allocbytes - allocbytes;
+	res->status = (*selected > 0) ? R_MATCH : R_NOMATCH;
+	if (getrusage(RUSAGE_SELF,&usage) == 0 &&
+		usage.ru_maxrss > res->maxrss)
+	{
+		res->maxrss = usage.ru_maxrss;
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// batch_spawn function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the corpus
+// cuts is the offset of the start of each batch, and of the end of the last
+// numbatches is the number of batches
+// mygrep is the mygrep program to start
+// res is updated with the peak RSS and status
+// seconds is set to the wall time
+// selected is set to the number of lines selected
+// starts mygrep with the -c option for every batch, writes the batch to its
+//  stdin through a pipe and reads back the count, returns 0 on success or -1
+//  on error
+// note: the allocations of a program that was started are not counted, they
+//        are reported as 0
+int batch_spawn(char *data, size_t *cuts, int numbatches, char *mygrep,
+	struct result *res, double *seconds, long *selected)
+{
+	// arguments for mygrep
+	char *args[] = { PROG_NAME, "-c", NEEDLE, NULL };
+	// pipes to the child's stdin and from its stdout
+	int infds[2], outfds[2];
+	// count read back from the child, and the bytes of it read
+	char countstr[32];
+	size_t countlen;
+	ssize_t nread;
+	// child process id and status
+	pid_t pid;
+	int status;
+	// resource usage of the child, for the peak RSS
+	struct rusage usage;
+	// start and end time
+	struct timespec start, end;
+	// index of the batch
+	int bidx;
+
+	// a child that fails to start closes its stdin early, which must not
+	//  kill the benchmark
+	signal(SIGPIPE,SIG_IGN);
+	*selected = 0;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	for (bidx=0; bidx<numbatches; bidx++) {
+		if (pipe(infds) != 0) { return(-1); }
+		if (pipe(outfds) != 0) {
+			close(infds[0]);
+			close(infds[1]);
+			return(-1);
+		}
+		pid = fork();
+		if (pid == 0) {
+			if (dup2(infds[0],STDIN_FILENO) == -1 ||
+				dup2(outfds[1],STDOUT_FILENO) == -1)
+			{
+				_exit(127);
+			}
+			close(infds[0]);
+			close(infds[1]);
+			close(outfds[0]);
+			close(outfds[1]);
+			execv(mygrep,args);
+			_exit(127);
+		}
+		close(infds[0]);
+		close(outfds[1]);
+		// the count is only written once the whole batch is read, so
+		//  the batch is written first
+		if (pid != -1) {
+			write_all(infds[1],data+cuts[bidx],
+				cuts[bidx+1]-cuts[bidx]);
+		}
+		close(infds[1]);
+		countlen = 0;
+		while (pid != -1 && countlen < sizeof(countstr) - 1 &&
+			(nread = read(outfds[0],countstr+countlen,
+			sizeof(countstr)-1-countlen)) > 0)
+		{
+			countlen += nread;
+		}
+		countstr[countlen] = '\0';
+		close(outfds[0]);
+		if (pid == -1 || wait4(pid,&status,0,&usage) == -1) {
+			return(-1);
+		}
+		if (! WIFEXITED(status) || WEXITSTATUS(status) == 127 ||
+			WEXITSTATUS(status) == R_ERROR)
+		{
+			errno = ECHILD;
+			return(-1);
+		}
+		*selected += strtol(countstr,NULL,10);
+		if (usage.ru_maxrss > res->maxrss) {
+			res->maxrss = usage.ru_maxrss;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	*seconds = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	res->allocs = 0;
+	res->allocbytes = 0;
+	res->status = (*selected > 0) ? R_MATCH : R_NOMATCH;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// count_match function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// match is a match found by the library
+// arg is the number of matches, which is incremented
+// the callback of batch_library, returns 0 so the scan goes on
+int count_match(const struct mygrep_match *match, void *arg) {
+	(*(long *) arg)++;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// run_needle function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// data is the corpus, null-terminated for strstr()
+// len is the length of the corpus
+// needlelen is the length of the search string, at most NEEDLE_MAX_LEN
+// reps is the number of runs each way
+// res is set to the measurements of strstr() and of the search function picked
+//  by search_init(), in that order
+// makes a search string of the corpus words ending in NEEDLE_MISS and
+//  searches the whole corpus for it reps times each way, keeping the fastest
+//  time, returns 0 on success or -1 on error
+// note: both ways must find the search string at the same place, otherwise
+//        the status of the find row is R_ERROR
+int run_needle(char *data, size_t len, size_t needlelen, int reps,
+	struct result *res)
+{
+	// the search string
+	char needle[NEEDLE_MAX_LEN+1];
+	// bytes of the search string made so far
+	size_t done;
+	// index of the word being added, the word and the bytes of it that fit
+	int widx;
+	char *word;
+	size_t wlen;
+	// the compiled search string
+	struct searcher srch;
+	// where strstr() and the search function found the search string
+	char *strhit = NULL, *findhit = NULL;
+	// index of the run
+	int ridx;
+	// wall time of the run
+	double seconds;
+	// allocation counters before compiling the search string
+	long allocs = mb_allocs, allocbytes = mb_allocbytes;
+	// resource usage of this process, for the peak RSS
+	struct rusage usage;
+	// start and end time
+	struct timespec start, end;
+
+	// the words are separated by single spaces, as in the corpus, and the
+	//  last one is cut short to fit
+	for (done=0, widx=0; done < needlelen - 1; widx++) {
+		word = words[widx % (sizeof(words)/sizeof(words[0]))];
+		wlen = strlen(word);
+		if (done + wlen > needlelen - 1) {
+			wlen = needlelen - 1 - done;
+		}
+		memcpy(needle+done,word,wlen);
+		done += wlen;
+		if (done < needlelen - 1) { needle[done++] = ' '; }
+	}
+	needle[needlelen-1] = NEEDLE_MISS;
+	needle[needlelen] = '\0';
+	if (search_init(&srch,needle,needlelen,CASE_EXACT) != 0) {
+		return(-1);
+	}
+	res[0].allocs = 0;
+	res[0].allocbytes = 0;
+	res[1].allocs = mb_allocs - allocs;
+	res[1].allocbytes = mb_allocbytes - allocbytes;
+	for (ridx=0; ridx<reps; ridx++) {
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		strhit = strstr(data,needle);
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		seconds = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		if (ridx == 0 || seconds < res[0].seconds) {
+			res[0].seconds = seconds;
+		}
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		findhit = srch.find(&srch,data,len);
+		clock_gettime(CLOCK_MONOTONIC,&end);
+		seconds = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+		if (ridx == 0 || seconds < res[1].seconds) {
+			res[1].seconds = seconds;
+		}
+	}
+	search_free(&srch);
+	res[0].status = (strhit != NULL) ? R_MATCH : R_NOMATCH;
+	res[1].status = (findhit != strhit) ? R_ERROR : res[0].status;
+	res[0].maxrss = 0;
+	if (getrusage(RUSAGE_SELF,&usage) == 0) {
+		res[0].maxrss = usage.ru_maxrss;
+	}
+	res[1].maxrss = res[0].maxrss;
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// check_allocs function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// datadir is the directory the corpora are written to
+// size is the size of the smaller corpus in bytes
+// scale is how many times larger the larger corpus is
+// seed is the seed for the corpus generator, both sizes of a corpus use the
+//  same one
+// runs every search once on each corpus at both sizes and prints the
+//  allocations of each, returns 0 if none of them allocated more on the
+//  larger corpus than ALLOC_CHECK_LINES allows, or -1 if one did or a search
+//  could not be run
+int check_allocs(char *datadir, size_t size, int scale,
+	unsigned long long seed)
+{
+	// paths of the smaller and larger corpus
+	char smallpath[4096], largepath[4096];
+	// number of lines in the smaller and larger corpus
+	long smalllines, largelines;
+	// measurements of the search on the smaller and larger corpus
+	struct result smallres, largeres;
+	// index of the corpus and search being run
+	int cidx, sidx;
+	// boolean flag for allocations growing with the lines
+	int grows;
+	// keep track of number of errors
+	int founderror = 0;
+
+	printf("%-12s %-8s %10s %8s %10s %8s\n","corpus","search","lines",
+		"allocs","lines","allocs");
+	for (cidx=0; cidx<(int) (sizeof(corpora)/sizeof(corpora[0])); cidx++) {
+		snprintf(smallpath,sizeof(smallpath),"%s/%s.txt",datadir,
+			corpora[cidx].name);
+		snprintf(largepath,sizeof(largepath),"%s/%s-x%d.txt",datadir,
+			corpora[cidx].name,scale);
+		if (gen_corpus(&corpora[cidx],smallpath,size,seed+cidx,
+			&smalllines) != 0 || gen_compressed(smallpath) != 0 ||
+			gen_corpus(&corpora[cidx],largepath,size * scale,
+			seed+cidx,&largelines) != 0 ||
+			gen_compressed(largepath) != 0)
+		{
+			fprintf(stderr,"%s: cannot write corpus '%s': %s\n",
+				BENCH_NAME,corpora[cidx].name,strerror(errno));
+			founderror++;
+			continue;
+		}
+		for (sidx=0; sidx<(int) (sizeof(searches)/sizeof(searches[0]));
+			sidx++)
+		{
+			if (run_search(&searches[sidx],smallpath,1,&smallres)
+				!= 0 || run_search(&searches[sidx],largepath,1,
+				&largeres) != 0)
+			{
+				fprintf(stderr,"%s: cannot run search '%s': "
+					"%s\n",BENCH_NAME,searches[sidx].name,
+					strerror(errno));
+				founderror++;
+				continue;
+			}
+			grows = (largeres.allocs - smallres.allocs) *
+				ALLOC_CHECK_LINES >= largelines - smalllines &&
+				largeres.allocs > smallres.allocs;
+			if (grows || smallres.status == R_ERROR ||
+				largeres.status == R_ERROR)
+			{
+				founderror++;
+			}
+			printf("%-12s %-8s %10ld %8ld %10ld %8ld%s\n",
+				corpora[cidx].name,searches[sidx].name,
+				smalllines,smallres.allocs,largelines,
+				largeres.allocs,grows ? "  grows" : "");
+		}
+	}
+	if (founderror > 0) {
+		fprintf(stderr,"%s: %d searches allocated more on the larger "
+			"corpora or failed\n",BENCH_NAME,founderror);
+		return(-1);
+	}
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// compare_results function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// basepath is the results file of an earlier build
+// newpath is the results file just written
+// prints the change in MB/s of every corpus and search found in both files,
+//  returns 0 on success or -1 if either file could not be read
+int compare_results(char *basepath, char *newpath) {
+	// contents of both files
+	char *base, *cur;
+	size_t baselen, curlen;
+	// current line of the new results, and the row found in the old ones
+	char *line, *eol, *found;
+	// commas after the corpus and search names, which make up the key
+	char *comma1, *comma2;
+	// length of the "corpus,search," key at the start of the line
+	size_t keylen;
+	// MB/s of the old and new build
+	double oldmbps, newmbps;
+	// field being skipped to
+	int field;
+	char *pos;
+
+	base = load_file(basepath,&baselen);
+	if (base == NULL) {
+		fprintf(stderr,"%s: cannot read '%s': %s\n",BENCH_NAME,
+			basepath,strerror(errno));
+		return(-1);
+	}
+	cur = load_file(newpath,&curlen);
+	if (cur == NULL) {
+		fprintf(stderr,"%s: cannot read '%s': %s\n",BENCH_NAME,
+			newpath,strerror(errno));
+		free(base);
+		return(-1);
+	}
+	printf("\n%-12s %-8s %10s %10s %8s\n","corpus","search","old MB/s",
+		"new MB/s","change");
+	// skip the header line of the new results
+	line = memchr(cur,'\n',curlen);
+	line = (line == NULL) ? cur + curlen : line + 1;
+	for (; line < cur + curlen; line = eol + 1) {
+		eol = memchr(line,'\n',cur + curlen - line);
+		if (eol == NULL) { break; }
+		*eol = '\0';
+		// the key is the first two fields, including the comma after
+		comma1 = strchr(line,',');
+		if (comma1 == NULL || (comma2 = strchr(comma1+1,',')) == NULL) {
+			continue;
+		}
+		keylen = comma2 + 1 - line;
+		// find the same key at the start of a line of the old results
+		found = base;
+		while (found != NULL && strncmp(found,line,keylen) != 0) {
+			found = memchr(found,'\n',base + baselen - found);
+			if (found != NULL) { found++; }
+			if (found >= base + baselen) { found = NULL; }
+		}
+		if (found == NULL) { continue; }
+		// MB/s is the sixth field
+		for (field=0, pos=found; field<5 && pos != NULL; field++) {
+			pos = memchr(pos,',',base + baselen - pos);
+			if (pos != NULL) { pos++; }
+		}
+		if (pos == NULL) { continue; }
+		oldmbps = strtod(pos,NULL);
+		for (field=0, pos=line; field<5 && pos != NULL; field++) {
+			pos = strchr(pos,',');
+			if (pos != NULL) { pos++; }
+		}
+		if (pos == NULL) { continue; }
+		newmbps = strtod(pos,NULL);
+		printf("%-12.*s %-8.*s %10.1f %10.1f %+7.1f%%\n",
+			(int) (comma1 - line),line,(int) (comma2 - comma1 - 1),
+			comma1 + 1,oldmbps,newmbps,
+			(oldmbps > 0) ? (newmbps - oldmbps) * 100 / oldmbps : 0);
+	}
+	free(base);
+	free(cur);
+	return(0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// load_file function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// pathname is the file to read
+// len is set to the length of the file
+// reads the whole file into a buffer with a null added at the end, returns
+//  the buffer, which must be freed, or null on error
+char *load_file(char *pathname, size_t *len) {
+	// file descriptor and size of the file
+	int fd;
+	struct stat st;
+	// buffer holding the file
+	char *buff;
+	// errno to report after cleaning up
+	int saverr;
+
+	fd = open(pathname,O_RDONLY);
+	if (fd == -1) { return(NULL); }
+	if (fstat(fd,&st) != 0 || (buff = malloc(st.st_size + 1)) == NULL) {
+		saverr = errno;
+		close(fd);
+		errno = saverr;
+		return(NULL);
+	}
+	*len = 0;
+	while (*len < (size_t) st.st_size) {
+		ssize_t nread = read(fd,buff + *len,st.st_size - *len);
+		if (nread == -1 && errno == EINTR) { continue; }
+		if (nread <= 0) { break; }
+		*len += nread;
+	}
+	saverr = errno;
+	close(fd);
+	if (*len < (size_t) st.st_size) {
+		free(buff);
+		errno = saverr;
+		return(NULL);
+	}
+	buff[*len] = '\0';
+	return(buff);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// print_bench_usage function
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// progname is the name of the program
+// prints the usage message to stderr
+void print_bench_usage(char *progname) {
+	fprintf(stderr,"Usage: %s [-s MB] [-r REPS] [-S SEED] [-d DIR] "
+		"[-o FILE] [-b BASELINE] [-m MYGREP] [-n BATCHES] "
+		"[-a SCALE]\n",progname);
+	fprintf(stderr,"  -s  size of each corpus in MB (default %d)\n",
+		DEF_SIZE_MB);
+	fprintf(stderr,"  -r  runs of each search, the fastest is kept "
+		"(default %d)\n",DEF_REPS);
+	fprintf(stderr,"  -S  seed for the corpora (default %d)\n",DEF_SEED);
+	fprintf(stderr,"  -d  directory for the corpora (default %s)\n",
+		DEF_DIR);
+	fprintf(stderr,"  -o  results file (default %s)\n",DEF_OUT);
+	fprintf(stderr,"  -b  results file of another build to compare with\n");
+	fprintf(stderr,"  -m  mygrep program to compare the library with, "
+		"started for each batch\n");
+	fprintf(stderr,"  -n  batches the first corpus is cut into for -m "
+		"(default %d)\n",DEF_BATCHES);
+	fprintf(stderr,"  -a  only check that no search allocates more on "
+		"corpora SCALE times larger\n");
+}
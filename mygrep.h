@@ -0,0 +1,109 @@
+// mygrep.h - the search of mygrep as a library
+//
+// a program that searches many buffers or streams links the library instead
+//  of starting mygrep for each one - search strings are compiled once into a
+//  pattern, which any number of scanners share read only, and each scanner
+//  keeps everything about the stream it is searching, so nothing is global
+//  and scanners on different threads never wait for each other
+//
+// build the library from the same source as the program:
+//  gcc -O2 -Wall -pthread -DMG_LIBRARY -fvisibility=hidden -c -o libmygrep.o lab1.c
+//  objcopy --localize-hidden libmygrep.o
+//  ar rcs libmygrep.a libmygrep.o
+// and link with -L. -lmygrep -pthread - only the mygrep_ functions below are
+//  left visible, so the rest of lab1.c cannot clash with the program's names
+//
+// a scanner is fed a stream in pieces of any size with mygrep_scan, and
+//  mygrep_finish searches the last line, which need not end with a line
+//  ending - lines end with "\n", "\r" or "\r\n" as in the program, and a line
+//  split between two pieces is found just the same
+// for every line selected the callback is given the line, its number and byte
+//  offset in the stream, and where the search strings match in it, once for
+//  each match - the matches do not overlap, and each one is the longest
+//  starting where the earliest one does, as with the -o option
+// note: a line that only matches an empty search string, or an expression such
+//        as 'a*' with no 'a', is given to the callback once, with a match of
+//        no bytes at the start of the line
+// note: with MYGREP_INVERT the lines that do not match are selected, and each
+//        is given to the callback once, with the whole line as the match
+// note: a pattern, a scanner and the data given to the callback must not be
+//        used after they are freed, or after the callback returns - the line
+//        is only valid during the call
+// note: mygrep_compile reads the LC_CTYPE locale of the program for
+//        MYGREP_ICASE, folding letters outside ASCII if it uses UTF-8, but
+//        never sets it - call setlocale(LC_CTYPE,"") first to use the locale
+//        of the environment, as the program does
+#ifndef MYGREP_H
+#define MYGREP_H
+
+// stddef.h is included for size_t
+#include<stddef.h>
+
+// flags for mygrep_compile - the -i, -E and -v options of the program
+#define MYGREP_ICASE 1
+#define MYGREP_EXTENDED 2
+#define MYGREP_INVERT 4
+
+// compiled search strings, shared read only by every scanner using them
+struct mygrep_pattern;
+
+// state of the stream searched by one thread - the unfinished last line, the
+//  line number and byte offset, and the DFA built for a regular expression
+struct mygrep_scanner;
+
+// a match in a selected line, given to the callback
+struct mygrep_match {
+	// the selected line, not including its line ending, and its length
+	const char *line;
+	size_t linelen;
+	// number of the line in the stream, from 1, and the byte offset of its
+	//  start
+	unsigned long long lineno;
+	unsigned long long offset;
+	// the match inside the line, and its length
+	const char *start;
+	size_t len;
+};
+
+// callback given each match found by a scanner, with the argument given to
+//  the scan - returning anything other than 0 stops the scan
+typedef int (*mygrep_callback)(const struct mygrep_match *match, void *arg);
+
+// compiles numpats search strings of lens bytes each (not null-terminated)
+//  into a pattern that matches a line if any of them does, returns the pattern
+//  or null on error - errmsg, if not null, is set to a message for an invalid
+//  regular expression, or to null if memory could not be allocated
+// note: the search strings are copied, they may be freed once this returns
+struct mygrep_pattern *mygrep_compile(const char *const *pats,
+	const size_t *lens, int numpats, int flags, const char **errmsg);
+// frees a pattern once every scanner using it is freed
+void mygrep_pattern_free(struct mygrep_pattern *pat);
+
+// creates a scanner searching streams for pat, returns it or null if memory
+//  could not be allocated
+struct mygrep_scanner *mygrep_scanner_new(struct mygrep_pattern *pat);
+// frees a scanner, the pattern is left as it is
+void mygrep_scanner_free(struct mygrep_scanner *sc);
+
+// searches the next len bytes of the stream, calling cb with arg for each
+//  match in the whole lines they finish, and keeps an unfinished last line for
+//  the next call, returns the number of lines selected, or -1 with errno set if
+//  memory could not be allocated
+// note: once the callback stops the scan, the rest of the stream is ignored
+//        until mygrep_finish is called
+long mygrep_scan(struct mygrep_scanner *sc, const char *data, size_t len,
+	mygrep_callback cb, void *arg);
+// searches the unfinished last line kept by mygrep_scan, if any, and resets
+//  the scanner to start a new stream from line 1, returns the number of lines
+//  selected, or -1 with errno set if memory could not be allocated
+long mygrep_finish(struct mygrep_scanner *sc, mygrep_callback cb, void *arg);
+// searches the whole stream read from the file descriptor fd as a new stream
+//  from line 1, reading it in large blocks, returns the number of lines
+//  selected, or -1 with errno set if a read fails or memory could not be
+//  allocated
+// note: the file descriptor is read to its end, or until the callback stops
+//        the scan, and is left open
+long mygrep_scan_fd(struct mygrep_scanner *sc, int fd, mygrep_callback cb,
+	void *arg);
+
+#endif
@@ -0,0 +1,234 @@
+// lib_test.c - checks the contract of the library in mygrep.h
+//
+// build against the library, built as mygrep.h says:
+//  gcc -g -Wall -I.. -o lib_test lib_test.c -L. -lmygrep -pthread
+// and run with no arguments - each check that fails is printed, and the exit
+//  status is 1 if any did
+#define _GNU_SOURCE
+// stdio.h is included for printf and snprintf
+#include<stdio.h>
+// string.h is included for strlen, strcmp and memcpy
+#include<string.h>
+// unistd.h is included for pipe, write and close
+#include<unistd.h>
+// mygrep.h is the library being checked
+#include "mygrep.h"
+
+// stream searched by most checks - every line ending, two matches in one line,
+//  and a last line without a line ending
+static const char stream[] =
+	"foo one\nbar\r\nfoo two\rxfoox foo\nlast foo";
+// what the callback records for the stream searched for "foo", and for it
+//  searched with MYGREP_INVERT
+static const char wantfoo[] = "1:0:0:foo|3:13:0:foo|4:21:1:foo|4:21:6:foo|"
+	"5:31:5:foo|";
+static const char wantinvert[] = "2:8:0:bar|";
+
+// number of checks that failed
+static int fails = 0;
+
+// matches recorded by the callback, and the number of bytes of it used
+struct record {
+	char text[4096];
+	size_t len;
+	// matches to record before the callback stops the scan, -1 for all
+	int stopafter;
+};
+
+// callback adding "line number:line offset:match offset:match|" to the
+//  record given as arg, returns non-zero to stop the scan once stopafter
+//  matches are recorded
+static int record_match(const struct mygrep_match *match, void *arg) {
+	// the record being added to
+	struct record *rec = arg;
+
+	rec->len += snprintf(rec->text+rec->len,sizeof(rec->text)-rec->len,
+		"%llu:%llu:%d:%.*s|",match->lineno,match->offset,
+		(int) (match->start - match->line),(int) match->len,
+		match->start);
+	if (rec->len >= sizeof(rec->text)) { rec->len = sizeof(rec->text)-1; }
+	if (rec->stopafter > 0 && --rec->stopafter == 0) { return(1); }
+	return(0);
+}
+
+// reports a failed check if got differs from want or selected from
+//  wantselected
+static void check(const char *name, struct record *rec, const char *want,
+	long selected, long wantselected)
+{
+	if (strcmp(rec->text,want) != 0 || selected != wantselected) {
+		printf("FAIL: %s: got %ld lines \"%s\", want %ld \"%s\"\n",name,
+			selected,rec->text,wantselected,want);
+		fails++;
+	}
+}
+
+// searches data for pat in pieces of at most piece bytes with mygrep_scan and
+//  ends the stream with mygrep_finish, returns the number of lines selected,
+//  or -1 on error
+static long scan_pieces(struct mygrep_scanner *sc, const char *data,
+	size_t len, size_t piece, struct record *rec)
+{
+	// lines selected by each call, and in all
+	long ret, selected = 0;
+	// bytes of data searched so far, and in this piece
+	size_t done, size;
+
+	memset(rec,0,sizeof(*rec));
+	rec->stopafter = -1;
+	for (done=0; done<len; done+=size) {
+		size = (len - done < piece) ? len - done : piece;
+		ret = mygrep_scan(sc,data+done,size,record_match,rec);
+		if (ret == -1) { return(-1); }
+		selected += ret;
+	}
+	ret = mygrep_finish(sc,record_match,rec);
+	if (ret == -1) { return(-1); }
+	return(selected + ret);
+}
+
+// compiles the single search string str with flags, reporting a failed check
+//  named name if it cannot be, returns the pattern or null
+static struct mygrep_pattern *compile_one(const char *name, const char *str,
+	int flags)
+{
+	// the search string and its length
+	const char *pats[1] = { str };
+	size_t lens[1] = { strlen(str) };
+	// the pattern
+	struct mygrep_pattern *pat;
+	// message for an invalid expression
+	const char *msg = NULL;
+
+	pat = mygrep_compile(pats,lens,1,flags,&msg);
+	if (pat == NULL) {
+		printf("FAIL: %s: cannot compile \"%s\": %s\n",name,str,
+			(msg != NULL) ? msg : "out of memory");
+		fails++;
+	}
+	return(pat);
+}
+
+// searches the stream for str with flags in one piece, then split at every
+//  byte, then a byte at a time, each of which must give want and wantselected
+static void check_splits(const char *name, const char *str, int flags,
+	const char *want, long wantselected)
+{
+	// the pattern and the scanner, which is reused for every stream
+	struct mygrep_pattern *pat;
+	struct mygrep_scanner *sc;
+	// matches recorded and lines selected
+	struct record rec;
+	long selected;
+	// length of the stream, and where it is split
+	size_t len = strlen(stream), cut;
+	// the stream split in two pieces
+	char first[sizeof(stream)], second[sizeof(stream)];
+	// name of the check being run
+	char desc[128];
+
+	pat = compile_one(name,str,flags);
+	if (pat == NULL) { return; }
+	sc = mygrep_scanner_new(pat);
+	if (sc == NULL) {
+		printf("FAIL: %s: cannot create a scanner\n",name);
+		fails++;
+		mygrep_pattern_free(pat);
+		return;
+	}
+	selected = scan_pieces(sc,stream,len,len,&rec);
+	snprintf(desc,sizeof(desc),"%s in one piece",name);
+	check(desc,&rec,want,selected,wantselected);
+	selected = scan_pieces(sc,stream,len,1,&rec);
+	snprintf(desc,sizeof(desc),"%s a byte at a time",name);
+	check(desc,&rec,want,selected,wantselected);
+	// the pieces are copied out, so nothing past a piece can be read
+	for (cut=1; cut<len; cut++) {
+		memcpy(first,stream,cut);
+		memcpy(second,stream+cut,len-cut);
+		memset(&rec,0,sizeof(rec));
+		rec.stopafter = -1;
+		selected = mygrep_scan(sc,first,cut,record_match,&rec);
+		if (selected != -1) {
+			selected += mygrep_scan(sc,second,len-cut,record_match,
+				&rec);
+			selected += mygrep_finish(sc,record_match,&rec);
+		}
+		snprintf(desc,sizeof(desc),"%s split at byte %zu",name,cut);
+		check(desc,&rec,want,selected,wantselected);
+	}
+	mygrep_scanner_free(sc);
+	mygrep_pattern_free(pat);
+}
+
+// the library must keep its own names hidden, so a program may define any of
+//  the names in lab1.c - this is one of its functions, which fails the link
+//  if the library left it visible
+int search_init(void) {
+	return(0);
+}
+
+// main function
+int main(void) {
+	// the pattern and the scanner
+	struct mygrep_pattern *pat;
+	struct mygrep_scanner *sc;
+	// matches recorded and lines selected
+	struct record rec;
+	long selected;
+	// message for an invalid expression
+	const char *msg = NULL;
+	// pipe the stream is written to for mygrep_scan_fd
+	int fds[2];
+	// the invalid expression
+	const char *bad[1] = { "(foo" };
+	size_t badlen[1] = { 4 };
+
+	check_splits("plain","foo",0,wantfoo,4);
+	check_splits("invert","foo",MYGREP_INVERT,wantinvert,1);
+	check_splits("extended","fo+( |x|$)",MYGREP_EXTENDED,
+		"1:0:0:foo |3:13:0:foo |4:21:1:foox|4:21:6:foo|5:31:5:foo|",4);
+	check_splits("icase","FOO",MYGREP_ICASE,wantfoo,4);
+
+	// a file descriptor is read to its end as a stream of its own
+	pat = compile_one("scan_fd","foo",0);
+	sc = (pat != NULL) ? mygrep_scanner_new(pat) : NULL;
+	if (sc != NULL && pipe(fds) == 0) {
+		if (write(fds[1],stream,strlen(stream)) !=
+			(ssize_t) strlen(stream))
+		{
+			printf("FAIL: scan_fd: cannot write the pipe\n");
+			fails++;
+		}
+		close(fds[1]);
+		memset(&rec,0,sizeof(rec));
+		rec.stopafter = -1;
+		selected = mygrep_scan_fd(sc,fds[0],record_match,&rec);
+		close(fds[0]);
+		check("scan_fd",&rec,wantfoo,selected,4);
+
+		// a callback returning non-zero stops the scan, and the
+		//  scanner starts a new stream after mygrep_finish
+		memset(&rec,0,sizeof(rec));
+		rec.stopafter = 2;
+		selected = mygrep_scan(sc,stream,strlen(stream),record_match,
+			&rec);
+		selected += mygrep_finish(sc,record_match,&rec);
+		check("stopped by the callback",&rec,"1:0:0:foo|3:13:0:foo|",
+			selected,2);
+		selected = scan_pieces(sc,stream,strlen(stream),7,&rec);
+		check("after a stopped scan",&rec,wantfoo,selected,4);
+	}
+	mygrep_scanner_free(sc);
+	mygrep_pattern_free(pat);
+
+	// an invalid expression is not compiled, and says why
+	if (mygrep_compile(bad,badlen,1,MYGREP_EXTENDED,&msg) != NULL ||
+		msg == NULL)
+	{
+		printf("FAIL: \"%s\" compiled with MYGREP_EXTENDED\n",bad[0]);
+		fails++;
+	}
+	if (fails > 0) { return(1); }
+	return(0);
+}
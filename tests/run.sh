@@ -0,0 +1,378 @@
+#!/bin/sh
+# run.sh - checks of mygrep that need more than one command to set up
+#
+# run from the top of the repository with
+#  sh tests/run.sh
+# it builds mygrep, the library and the helpers into a temporary directory,
+#  prints each check that fails, and exits with status 1 if any did
+set -u
+top=$(cd "$(dirname "$0")/.." && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+fails=0
+
+# fail NAME - reports a failed check
+fail() {
+	echo "FAIL: $1"
+	fails=$((fails + 1))
+}
+
+# expect NAME WANT ARG... - runs mygrep with the ARGs and fails the check NAME
+#  unless it prints WANT, in which printf's '%b' escapes such as \n are
+#  expanded
+expect() {
+	name=$1
+	printf '%b' "$2" > "$tmp/want"
+	shift 2
+	"$mg" "$@" > "$tmp/got" 2> /dev/null
+	if ! cmp -s "$tmp/want" "$tmp/got"; then
+		fail "$name"
+	fi
+}
+
+gcc -g -Wall -pthread -o "$tmp/mygrep" "$top/lab1.c" || exit 1
+gcc -shared -fPIC -o "$tmp/uring_fail.so" "$top/tests/uring_fail.c" -ldl ||
+	exit 1
+mg="$tmp/mygrep"
+# the library is built the way mygrep.h says, and lib_test.c linked with it
+gcc -O2 -Wall -pthread -DMG_LIBRARY -fvisibility=hidden -c \
+	-o "$tmp/libmygrep.o" "$top/lab1.c" || exit 1
+objcopy --localize-hidden "$tmp/libmygrep.o" || exit 1
+ar rcs "$tmp/libmygrep.a" "$tmp/libmygrep.o" || exit 1
+gcc -g -Wall -I"$top" -o "$tmp/lib_test" "$top/tests/lib_test.c" -L"$tmp" \
+	-lmygrep -pthread || exit 1
+gcc -O2 -Wall -pthread -o "$tmp/mgbench" "$top/mgbench.c" || exit 1
+
+# library: lines split across pieces at every byte, MYGREP_INVERT,
+#  MYGREP_EXTENDED, MYGREP_ICASE, mygrep_scan_fd and a callback that stops the
+#  scan, each against the matches they must give
+if ! "$tmp/lib_test"; then
+	fail "library contract (lib_test)"
+fi
+
+# allocations: no search allocates more on a corpus 4 times larger, which
+#  mgbench -a checks with a counting malloc
+if ! "$tmp/mgbench" -s 1 -a 4 -d "$tmp/mbdata" > "$tmp/allocs"; then
+	cat "$tmp/allocs"
+	fail "allocations grow with the input (mgbench -a)"
+fi
+
+# read-ahead fallback: io_uring_enter failing at any point leaves the files
+#  to be opened one at a time, with the same output and exit status
+mkdir "$tmp/many"
+i=1
+while [ $i -le 80 ]; do
+	printf 'line foo %d\nbar\n' $i > "$tmp/many/f$i.txt"
+	i=$((i + 1))
+done
+head -c 300000 /dev/zero | tr '\0' 'x' > "$tmp/many/f40.txt"
+echo foo >> "$tmp/many/f40.txt"
+(cd "$tmp/many" && "$mg" -c foo f*.txt > "$tmp/want" 2>&1)
+for calls in 0 1 2 3 5 8; do
+	(cd "$tmp/many" && MG_URING_CALLS=$calls \
+		LD_PRELOAD="$tmp/uring_fail.so" "$mg" -c foo f*.txt \
+		> "$tmp/got" 2> "$tmp/err")
+	status=$?
+	if [ $status -ne 0 ] || ! cmp -s "$tmp/want" "$tmp/got"; then
+		fail "read-ahead fallback after $calls io_uring calls"
+	fi
+done
+
+# context with -j: a "--" line only comes between groups of lines, never
+#  before a "Binary file X matches" line, the same as without -j
+mkdir "$tmp/ctx"
+printf 'a\nfoo\nb\n' > "$tmp/ctx/c.txt"
+printf 'x\nfoo' > "$tmp/ctx/nonl.txt"
+printf 'foo\0bin\n' > "$tmp/ctx/bin.bin"
+printf 'q\nfoo\nr\nfoo\n' > "$tmp/ctx/b.txt"
+for opt in -C1 -A1 -B2; do
+	(cd "$tmp/ctx" && "$mg" $opt foo c.txt nonl.txt bin.bin bin.bin b.txt \
+		> "$tmp/want")
+	for jobs in -j2 -j4; do
+		(cd "$tmp/ctx" && "$mg" $opt $jobs foo c.txt nonl.txt bin.bin \
+			bin.bin b.txt > "$tmp/got")
+		if ! cmp -s "$tmp/want" "$tmp/got"; then
+			fail "context with $opt $jobs and a binary file"
+		fi
+	done
+done
+
+# -i outside ASCII: a search string folds the same alone, with other -e
+#  strings and with -E, where the locale has UTF-8
+if locale -a 2>/dev/null | grep -qi '^c\.utf-\?8$'; then
+	printf 'CAFE\nCAFÉ au lait\nΣΟΦΙΑ\nσοφια\nnothing\n' > "$tmp/fold.txt"
+	for word in café:1 σοφια:2; do
+		lines=${word#*:}
+		word=${word%:*}
+		LC_ALL=C.UTF-8 "$mg" -i "$word" "$tmp/fold.txt" > "$tmp/want"
+		if [ $(wc -l < "$tmp/want") -ne $lines ]; then
+			fail "-i $word alone"
+		fi
+		for opts in "-e $word -e zzz" "-e zzz -e $word" "-E $word" \
+			"-E ($word|zzz)"
+		do
+			LC_ALL=C.UTF-8 "$mg" -i $opts "$tmp/fold.txt" \
+				> "$tmp/got"
+			if ! cmp -s "$tmp/want" "$tmp/got"; then
+				fail "-i $opts"
+			fi
+		done
+	done
+fi
+
+# expect_sorted NAME WANT ARG... - the same as expect, for output whose order
+#  is not fixed, such as that of -r, which is sorted before it is compared
+expect_sorted() {
+	name=$1
+	printf '%b' "$2" > "$tmp/want"
+	shift 2
+	"$mg" "$@" 2> /dev/null | sort > "$tmp/got"
+	if ! cmp -s "$tmp/want" "$tmp/got"; then
+		fail "$name"
+	fi
+}
+
+# -r: every file under the tree, hidden ones too, without following symbolic
+#  links and skipping binary files, with or without -j, and a file named
+#  alone printed without its name
+mkdir -p "$tmp/tree/a/b" "$tmp/tree/c" "$tmp/tree/.hidden"
+printf 'foo 1\nbar\n' > "$tmp/tree/top.txt"
+printf 'x\nfoo 2\n' > "$tmp/tree/a/one.txt"
+printf 'foo 3\nfoo 4\n' > "$tmp/tree/a/b/deep.txt"
+printf 'nothing\n' > "$tmp/tree/c/none.txt"
+printf 'foo\0bin\n' > "$tmp/tree/c/bin.dat"
+printf 'foo hidden\n' > "$tmp/tree/.hidden/h.txt"
+ln -s ../top.txt "$tmp/tree/c/link.txt"
+want='.hidden/h.txt:foo hidden\na/b/deep.txt:foo 3\na/b/deep.txt:foo 4\n'
+want="${want}a/one.txt:foo 2\ntop.txt:foo 1\n"
+cd "$tmp/tree"
+expect_sorted "-r" "$want" -r foo
+expect_sorted "-r -j4" "$want" -r -j 4 foo
+want='./.hidden/h.txt:1\n./a/b/deep.txt:2\n./a/one.txt:1\n./c/none.txt:0\n'
+expect_sorted "-r -c" "${want}./top.txt:1\n" -r -c foo .
+expect "-r on a file" 'foo 2\n' -r foo a/one.txt
+cd "$top"
+
+# compressed files: a gzip and a zstd copy, of more than one decompressed
+#  block, give the same lines as the plain file, and a truncated one is an
+#  error reported once - only where zlib and libzstd can be linked, with
+#  CFLAGS and LDFLAGS for where they are installed
+awk 'BEGIN { for (i = 1; i <= 60000; i++)
+	print "line " i (i % 7 ? "" : " foo") }' > "$tmp/comp.txt"
+mgz=""
+for libs in "-DMG_ZLIB -DMG_ZSTD -lz -lzstd" "-DMG_ZLIB -lz"; do
+	if gcc -g -Wall -pthread ${CFLAGS-} -o "$tmp/mygrep_z" "$top/lab1.c" \
+		${LDFLAGS-} $libs 2> /dev/null
+	then
+		mgz="$tmp/mygrep_z"
+		break
+	fi
+done
+if [ -n "$mgz" ]; then
+	gzip -c "$tmp/comp.txt" > "$tmp/comp.gz"
+	comps=gz
+	case $libs in
+	*zstd*)
+		if zstd -q -c "$tmp/comp.txt" > "$tmp/comp.zst" 2> /dev/null
+		then
+			comps="gz zst"
+		fi
+	esac
+	head -c 20000 "$tmp/comp.gz" > "$tmp/trunc.gz"
+	for opts in -c "-v -c" -n "-n -b -o"; do
+		"$mg" $opts foo "$tmp/comp.txt" > "$tmp/want"
+		for ext in $comps; do
+			"$mgz" $opts foo "$tmp/comp.$ext" > "$tmp/got"
+			if ! cmp -s "$tmp/want" "$tmp/got"; then
+				fail "$opts on a .$ext file"
+			fi
+		done
+	done
+	if [ "$("$mg" -c foo "$tmp/comp.txt")" != 8571 ]; then
+		fail "-c on the plain copy of the compressed files"
+	fi
+	"$mgz" -c foo "$tmp/trunc.gz" > /dev/null 2> "$tmp/err"
+	if [ $? -ne 2 ] || [ $(wc -l < "$tmp/err") -ne 1 ]; then
+		fail "a truncated .gz file is one error"
+	fi
+fi
+
+# --index: the index narrows the search to some blocks, but finds what a full
+#  search of the same tree finds, and a file changed since the index was built
+#  is searched in full
+mkdir -p "$tmp/it/d/sub"
+cd "$tmp/it"
+awk 'BEGIN { for (i = 1; i <= 30000; i++)
+	print "row " i (i % 5000 ? "" : " needle") }' > d/big.txt
+printf 'needle here\nand hay\n' > d/sub/small.txt
+printf 'no match\n' > d/none.txt
+if ! "$mg" index -o idx d > /dev/null 2>&1; then
+	fail "index built"
+fi
+expect_sorted "--index -c" 'd/big.txt:6\nd/none.txt:0\nd/sub/small.txt:1\n' \
+	--index idx -c needle
+for opts in "needle" "-c needle" "-i NEEDLE" "-E ne+dle.h" "row.1" "ne" \
+	"-l hay" "zzzz"
+do
+	"$mg" -r $opts d | sort > "$tmp/want"
+	"$mg" --index idx $opts | sort > "$tmp/got"
+	if ! cmp -s "$tmp/want" "$tmp/got"; then
+		fail "--index $opts against a full search"
+	fi
+done
+echo 'row 1 needle' >> d/none.txt
+expect_sorted "--index with a changed file" 'd/none.txt\n' --index idx -l \
+	'row 1 needle'
+# a damaged index does not match its checksum, and is only used for the paths
+#  it was built from: one byte of the posting lists is changed, whose offset
+#  and length are the 11th and 12th numbers of 8 bytes in the header
+off=$(od -An -t u8 -j 80 -N 8 idx | tr -d ' ')
+len=$(od -An -t u8 -j 88 -N 8 idx | tr -d ' ')
+pos=$((off + len / 2))
+cp idx bad.idx
+if [ "$(od -An -t u1 -j $pos -N 1 idx | tr -d ' ')" = 0 ]; then
+	printf '\001' | dd of=bad.idx bs=1 seek=$pos conv=notrunc 2> /dev/null
+else
+	printf '\000' | dd of=bad.idx bs=1 seek=$pos conv=notrunc 2> /dev/null
+fi
+"$mg" -r -c needle d | sort > "$tmp/want"
+"$mg" --index bad.idx -c needle 2> "$tmp/err" | sort > "$tmp/got"
+if ! cmp -s "$tmp/want" "$tmp/got" || ! grep -q damaged "$tmp/err"; then
+	fail "--index with a damaged index"
+fi
+# a truncated one is searched without when files are named, and is an error
+#  when it has to give the paths
+head -c $(($(wc -c < idx) - 8)) idx > short.idx
+expect "--index with a truncated index" '6\n' --index short.idx -c needle \
+	d/big.txt
+"$mg" --index short.idx -c needle > /dev/null 2>&1
+if [ $? -ne 2 ]; then
+	fail "--index with a truncated index and no files"
+fi
+cd "$top"
+
+# wait_lines FILE N - waits up to 5 seconds for FILE to have N lines
+wait_lines() {
+	i=0
+	while [ $i -lt 50 ] && [ $(wc -l < "$1") -lt $2 ]; do
+		sleep 0.1
+		i=$((i + 1))
+	done
+}
+
+# --follow: the lines already there, then each line once its line ending is
+#  written, on through a rotation to the new file and a truncation, each step
+#  waiting for the output of the one before
+cd "$tmp"
+printf 'foo 1\nbar\n' > log
+"$mg" --follow foo log > follow.out 2> follow.err &
+pid=$!
+wait_lines follow.out 1
+printf 'foo 2\npart' >> log
+wait_lines follow.out 2
+printf 'ial foo\n' >> log
+wait_lines follow.out 3
+mv log log.1
+printf 'foo 3\n' > log
+wait_lines follow.out 4
+: > log
+wait_lines follow.err 2
+printf 'foo 4\n' >> log
+wait_lines follow.out 5
+kill $pid
+wait $pid 2> /dev/null
+printf 'foo 1\nfoo 2\npartial foo\nfoo 3\nfoo 4\n' > want
+if ! cmp -s want follow.out || [ $(wc -l < follow.err) -ne 2 ]; then
+	fail "--follow through appends, a rotation and a truncation"
+fi
+# -q exits at the first line selected, written after it started
+printf 'bar\n' > quiet
+timeout 5 "$mg" -q --follow foo quiet &
+pid=$!
+sleep 0.3
+printf 'foo\n' >> quiet
+wait $pid
+if [ $? -ne 0 ]; then
+	fail "--follow -q exits once a line is selected"
+fi
+cd "$top"
+
+# -v output written straight from the input: runs of over 64 KiB between the
+#  lines left out, some ending in "\r\n" or a lone '\r' and the last without
+#  a line ending, to a file, to a pipe, from stdin and with -j, each the same
+#  as the lines awk writes with '\n' endings
+awk 'BEGIN { pad = sprintf("%100s", "")
+	for (i = 1; i <= 40000; i++) {
+		line = "line " i pad (i % 1000 ? "" : " skip")
+		end = (i % 3333 ? (i % 4999 ? "\n" : "\r") : "\r\n")
+		if (i == 40000) { end = "" }
+		printf "%s%s", line, end > "'"$tmp/span.txt"'"
+		if (i % 1000) { print line > "'"$tmp/span.want"'" }
+	} }'
+"$mg" -v skip "$tmp/span.txt" > "$tmp/got"
+cmp -s "$tmp/span.want" "$tmp/got" || fail "-v to a file"
+"$mg" -v skip "$tmp/span.txt" | cat > "$tmp/got"
+cmp -s "$tmp/span.want" "$tmp/got" || fail "-v to a pipe"
+"$mg" -v skip < "$tmp/span.txt" | cat > "$tmp/got"
+cmp -s "$tmp/span.want" "$tmp/got" || fail "-v from stdin to a pipe"
+"$mg" -j 4 -v skip "$tmp/span.txt" | cat > "$tmp/got"
+cmp -s "$tmp/span.want" "$tmp/got" || fail "-v with -j to a pipe"
+
+# a large -B on a pipe: the lines kept in front of the buffer grow it, and
+#  all of them are printed, as from a file
+seq 1 300000 | sed 's/^300000$/MARK/' > "$tmp/seq.txt"
+tail -n 250001 "$tmp/seq.txt" > "$tmp/want"
+cat "$tmp/seq.txt" | "$mg" -B 250000 MARK > "$tmp/got"
+cmp -s "$tmp/want" "$tmp/got" || fail "-B 250000 on a pipe"
+
+# -n, -b and -o: line numbers and byte offsets of lines and of each match,
+#  with a "\r\n" line ending, an empty line and a last line without a line
+#  ending, and across the chunks -j splits a file of over 16 MB into
+printf 'a foo foo\r\nbar\nxfoo\n\nfoofoo' > "$tmp/nb.txt"
+expect "-n -b -o" "1:2:foo\n1:6:foo\n3:16:foo\n5:21:foo\n5:24:foo\n" \
+	-n -b -o foo "$tmp/nb.txt"
+expect "-n -b" "1:0:a foo foo\n3:15:xfoo\n5:21:foofoo\n" \
+	-n -b foo "$tmp/nb.txt"
+expect "-n -v" "2:bar\n4:\n" -n -v foo "$tmp/nb.txt"
+expect "-n -A" "1:a foo foo\n2-bar\n3:xfoo\n4-\n5:foofoo\n" \
+	-n -A 1 foo "$tmp/nb.txt"
+expect "-b -o -i" "2:foo\n6:foo\n16:foo\n21:foo\n24:foo\n" \
+	-b -o -i FOO "$tmp/nb.txt"
+awk 'BEGIN { for (i = 1; i <= 1500000; i++) printf "row %07d\n", i }' \
+	> "$tmp/rows.txt"
+expect "-n -b -o with -j" "1:0:row 0000001\n1400000:16799988:row 1400000\n" \
+	-j 4 -n -b -o -E 'row (0000001|1400000)' "$tmp/rows.txt"
+
+# -E: alternation, intervals, anchors, classes, -i and the literal prefilter,
+#  with the output grep -E gives for each - except a '*' right after a leading
+#  '^', which is an ordinary char as in grep without -E
+re="$tmp/re.txt"
+printf 'error: timeout after 30s\nok 200\n*star line\nGET /index.html 404\n' \
+	> "$re"
+printf 'abcabc\nuser=bob id=1234\nERROR Timeout\nx.y.z 10.0.0.1 end\n' >> "$re"
+expect "-E alternation" 'abc\nabc\n' -E -o 'abc|ab' "$re"
+expect "-E repeated group" '5:abc\n5:abc\n' -E -n -o '(a|b)+c' "$re"
+expect "-E interval" '2:200\n4:404\n6:123\n' -E -n -o '[0-9]{3}' "$re"
+expect "-E anchored group" '2\n' -E -c '^(ok|GET) ' "$re"
+expect "-E end anchor" '8:x.y.z 10.0.0.1 end\n' -E -n 'e?nd$' "$re"
+expect "-E prefiltered" '1:error: timeout after 30s\n' -E -n 'error.*timeout' \
+	"$re"
+expect "-E -i prefiltered" '1:error: timeout after 30s\n7:ERROR Timeout\n' \
+	-E -i -n 'error.*timeout' "$re"
+expect "-E address" '10.0.0.1\n' -E -o '[0-9]+\.[0-9]+\.[0-9]+\.[0-9]+' "$re"
+expect "-E negated class" 'timeout\n' -E -o 't[^ ]*t' "$re"
+expect "-E \\w" 'id=1234\n' -E -o 'id=\w+' "$re"
+expect "-E -v" '3\n' -E -v -c '[0-9]' "$re"
+expect "-E empty match" '8\n' -E -c 'x*' "$re"
+expect "-E -b -o" '21:30s\n' -E -b -o '[0-9]+s' "$re"
+expect "-E '*' after '^'" '3:*s\n' -E -n -o '^*s' "$re"
+"$mg" -E '(' "$re" > /dev/null 2>&1
+if [ $? -ne 2 ]; then
+	fail "-E unmatched ( exits with 2"
+fi
+
+if [ $fails -gt 0 ]; then
+	echo "$fails checks failed"
+	exit 1
+fi
+echo "all checks passed"
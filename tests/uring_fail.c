@@ -0,0 +1,47 @@
+// uring_fail.c - makes io_uring_enter fail, to test the read-ahead fallback
+//
+// build as a preloaded library:
+//  gcc -shared -fPIC -o uring_fail.so uring_fail.c -ldl
+// and run mygrep with LD_PRELOAD=./uring_fail.so - the first MG_URING_CALLS
+//  calls of io_uring_enter (0 if it is not set) go through, every later one
+//  fails with EIO, while operations handed over earlier may still be in flight
+#define _GNU_SOURCE
+// dlfcn.h is included for dlsym
+#include<dlfcn.h>
+// errno.h is included for errno and EIO
+#include<errno.h>
+// stdarg.h is included for the arguments of syscall
+#include<stdarg.h>
+// stdlib.h is included for getenv and atol
+#include<stdlib.h>
+// sys/syscall.h is included for SYS_io_uring_enter
+#include<sys/syscall.h>
+
+// number of calls of io_uring_enter so far
+static long calls = 0;
+
+// syscall from the C library, called for everything but io_uring_enter
+long syscall(long number, ...) {
+	// the C library's syscall
+	static long (*real)(long, ...) = NULL;
+	// the arguments, at most six
+	long arg[6];
+	// index of the argument
+	int aidx;
+	// calls let through, from MG_URING_CALLS
+	char *env;
+	va_list ap;
+
+	va_start(ap,number);
+	for (aidx=0; aidx<6; aidx++) { arg[aidx] = va_arg(ap,long); }
+	va_end(ap);
+	if (number == SYS_io_uring_enter) {
+		env = getenv("MG_URING_CALLS");
+		if (calls++ >= ((env != NULL) ? atol(env) : 0)) {
+			errno = EIO;
+			return(-1);
+		}
+	}
+	if (real == NULL) { real = dlsym(RTLD_NEXT,"syscall"); }
+	return(real(number,arg[0],arg[1],arg[2],arg[3],arg[4],arg[5]));
+}